@@ -0,0 +1,70 @@
+#include "abr_controller.h"
+
+#include <algorithm>
+
+#include "log.h"
+
+AbrController::AbrController(const AbrControllerConfig& config, const std::vector<int>& ladderBps,
+                             int initialBitrateBps)
+    : config_(config),
+      ladder_bps_(ladderBps),
+      up_pending_(false),
+      up_floor_bps_(0),
+      budget_bps_(0),
+      level_(0) {
+  setBudget(initialBitrateBps);
+}
+
+int AbrController::levelFor(int bitrateBps) const {
+  int level = 0;
+  for (size_t i = 1; i < ladder_bps_.size(); ++i) {
+    if (ladder_bps_[i] <= bitrateBps) {
+      level = static_cast<int>(i);
+    }
+  }
+  return level;
+}
+
+void AbrController::setBudget(int bitrateBps) {
+  bitrateBps = std::max(bitrateBps, config_.minBitrateBps);
+  if (config_.maxBitrateBps > 0) {
+    bitrateBps = std::min(bitrateBps, config_.maxBitrateBps);
+  }
+  budget_bps_ = bitrateBps;
+  int level = levelFor(bitrateBps);
+  if (level != level_) {
+    AG_LOG(INFO, "ABR budget %d bps, rendition %d -> %d", bitrateBps, level_.load(), level);
+    level_ = level;
+  }
+}
+
+void AbrController::onUplinkEstimate(int targetBitrateBps) {
+  onUplinkEstimate(targetBitrateBps, std::chrono::steady_clock::now());
+}
+
+void AbrController::onUplinkEstimate(int targetBitrateBps,
+                                     std::chrono::steady_clock::time_point now) {
+  if (targetBitrateBps <= 0) {
+    return;
+  }
+  int usable = static_cast<int>(targetBitrateBps * config_.headroom);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (usable <= budget_bps_) {
+    up_pending_ = false;
+    if (usable < budget_bps_) {
+      setBudget(usable);
+    }
+    return;
+  }
+  if (!up_pending_) {
+    up_pending_ = true;
+    up_since_ = now;
+    up_floor_bps_ = usable;
+    return;
+  }
+  up_floor_bps_ = std::min(up_floor_bps_, usable);
+  if (now - up_since_ >= std::chrono::milliseconds(config_.upSwitchHoldMs)) {
+    up_pending_ = false;
+    setBudget(up_floor_bps_);
+  }
+}
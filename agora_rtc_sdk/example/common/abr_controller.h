@@ -0,0 +1,66 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Adaptive bitrate from the uplink bandwidth estimate.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+struct AbrControllerConfig {
+  // Share of the estimate the video may use, the rest covers audio, FEC and
+  // retransmissions. Use 1.0 for an estimate that is already the video
+  // encoder's target, applying it again would only shrink the budget.
+  double headroom = 0.85;
+  // The estimate must stay high this long before the budget goes up. Going
+  // down is immediate.
+  int upSwitchHoldMs = 5000;
+  // The budget never goes below this
+  int minBitrateBps = 0;
+  // nor above this, 0 for no limit
+  int maxBitrateBps = 0;
+};
+
+/**
+ Turns INetworkObserver::onUplinkNetworkInfoUpdated estimates into a send
+ budget, and the budget into a rung of a bitrate ladder.
+
+ The budget drops on the first estimate that is too low, so the sender stops
+ overrunning the uplink at once, but only rises to the lowest estimate seen
+ during a whole hold period, so a single optimistic estimate does not make
+ the sender oscillate. Readers on the send thread never lock.
+ */
+class AbrController {
+ public:
+  // ladderBps holds the bitrates of the renditions in ascending order and may
+  // be empty when only the budget is used. The budget starts at
+  // initialBitrateBps.
+  AbrController(const AbrControllerConfig& config, const std::vector<int>& ladderBps,
+                int initialBitrateBps);
+
+  // From the network observer thread
+  void onUplinkEstimate(int targetBitrateBps);
+  void onUplinkEstimate(int targetBitrateBps, std::chrono::steady_clock::time_point now);
+
+  int budgetBps() const { return budget_bps_; }
+  // Highest rung that fits the budget, the lowest one if none does
+  int level() const { return level_; }
+
+ private:
+  int levelFor(int bitrateBps) const;
+  void setBudget(int bitrateBps);
+
+  AbrControllerConfig config_;
+  std::vector<int> ladder_bps_;
+
+  std::mutex mutex_;
+  bool up_pending_;
+  std::chrono::steady_clock::time_point up_since_;
+  int up_floor_bps_;
+
+  std::atomic<int> budget_bps_;
+  std::atomic<int> level_;
+};
@@ -0,0 +1,476 @@
+#include "opus_decode_service.h"
+
+#include <opus/opus.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "common/log.h"
+
+#define ARENA_ALIGNMENT (64)
+#define OPUS_MAX_PACKET_SIZE (1276)
+#define OPUS_MAX_FRAME_MS (120)
+#define LATENCY_BUCKET_US (10)
+// 10 us buckets up to 100 ms, the last one collects everything slower
+#define LATENCY_BUCKETS (10000)
+
+struct OpusDecodeService::PacketSlot {
+  int64_t timestampMs;
+  int64_t enqueueNs;
+  uint32_t length;
+  uint8_t data[OPUS_MAX_PACKET_SIZE];
+};
+
+struct OpusDecodeService::StreamState {
+  // Guards the ring indexes and the flags below
+  std::mutex mutex;
+  uint32_t head = 0;  // next packet to decode
+  uint32_t tail = 0;  // next free ring entry
+  bool active = false;
+  // In the run queue or owned by a worker
+  bool scheduled = false;
+  // Removed while scheduled, the owning worker releases the slot
+  bool removing = false;
+
+  // Only touched by the worker owning the stream
+  int64_t lastTimestampMs = 0;
+  int lastFrameSamples = 0;
+};
+
+struct OpusDecodeService::Worker {
+  int index = 0;
+  std::unique_ptr<int16_t[]> pcm;
+  std::unique_ptr<std::atomic<uint32_t>[]> latencyHistogram;
+  std::atomic<uint64_t> maxLatencyNs{0};
+  std::atomic<uint64_t> decodedFrames{0};
+  std::atomic<uint64_t> concealedFrames{0};
+  std::atomic<uint64_t> latePackets{0};
+  std::atomic<uint64_t> decodeErrors{0};
+  std::atomic<uint64_t> decoderResets{0};
+  std::atomic<uint64_t> decodedSamples{0};
+  std::atomic<uint64_t> cpuNs{0};
+};
+
+static size_t alignUp(size_t size) {
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static int64_t monotonicNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static int64_t threadCpuNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void counterAdd(std::atomic<uint64_t>& counter, uint64_t value) {
+  counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+OpusDecodeService::OpusDecodeService(const OpusDecodeServiceConfig& config) : config_(config) {
+  if (config_.workerCount <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    config_.workerCount = cpus > 0 ? (int)cpus : 1;
+  }
+  config_.maxStreams = std::max(config_.maxStreams, 1);
+  config_.batchSize = std::max(config_.batchSize, 1);
+  config_.queueDepth = std::max(config_.queueDepth, 2);
+
+  int decoderSize = opus_decoder_get_size(config_.numberOfChannels);
+  if (decoderSize <= 0) {
+    AG_LOG(ERROR, "Unsupported number of channels %d", config_.numberOfChannels);
+    return;
+  }
+  // [ OpusDecoder | packet ring ] per stream, every part cache line aligned
+  decoderSize_ = alignUp(decoderSize);
+  slotSize_ = decoderSize_ + alignUp(sizeof(PacketSlot)) * config_.queueDepth;
+
+  void* arena = nullptr;
+  if (posix_memalign(&arena, ARENA_ALIGNMENT, slotSize_ * config_.maxStreams) != 0) {
+    AG_LOG(ERROR, "Failed to allocate decoder arena for %d streams", config_.maxStreams);
+    return;
+  }
+  // commit the pages now rather than on the first packet of each stream
+  memset(arena, 0, slotSize_ * config_.maxStreams);
+  arena_ = static_cast<uint8_t*>(arena);
+
+  streams_.reset(new StreamState[config_.maxStreams]);
+  // hand out low ids first so that active streams stay packed in the arena
+  for (int i = config_.maxStreams - 1; i >= 0; --i) {
+    freeSlots_.push_back(i);
+  }
+}
+
+OpusDecodeService::~OpusDecodeService() {
+  stop();
+  free(arena_);
+  arena_ = nullptr;
+}
+
+uint8_t* OpusDecodeService::slotBase(int streamId) const {
+  return arena_ + slotSize_ * streamId;
+}
+
+OpusDecoder* OpusDecodeService::decoder(int streamId) const {
+  return reinterpret_cast<OpusDecoder*>(slotBase(streamId));
+}
+
+OpusDecodeService::PacketSlot* OpusDecodeService::packetSlot(int streamId, uint32_t index) const {
+  return reinterpret_cast<PacketSlot*>(slotBase(streamId) + decoderSize_ +
+                                       alignUp(sizeof(PacketSlot)) * (index % config_.queueDepth));
+}
+
+bool OpusDecodeService::start(PcmCallback callback) {
+  if (!arena_ || !threads_.empty()) {
+    return false;
+  }
+  callback_ = std::move(callback);
+  stopping_ = false;
+
+  workers_.clear();
+  for (int i = 0; i < config_.workerCount; ++i) {
+    std::unique_ptr<Worker> worker(new Worker);
+    worker->index = i;
+    worker->pcm.reset(
+        new int16_t[config_.sampleRateHz * OPUS_MAX_FRAME_MS / 1000 * config_.numberOfChannels]);
+    worker->latencyHistogram.reset(new std::atomic<uint32_t>[LATENCY_BUCKETS]);
+    for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+      worker->latencyHistogram[b].store(0, std::memory_order_relaxed);
+    }
+    workers_.push_back(std::move(worker));
+  }
+  for (auto& worker : workers_) {
+    threads_.emplace_back(&OpusDecodeService::workerLoop, this, worker.get());
+  }
+  AG_LOG(INFO, "Opus decode service started: %d workers, %d streams max, %zu bytes per stream",
+         config_.workerCount, config_.maxStreams, slotSize_ + sizeof(StreamState));
+  return true;
+}
+
+void OpusDecodeService::stop() {
+  {
+    std::lock_guard<std::mutex> lock(readyMutex_);
+    stopping_ = true;
+  }
+  readyCond_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  // streams still waiting in the run queue are rescheduled by their next packet
+  std::deque<int> pending;
+  {
+    std::lock_guard<std::mutex> lock(readyMutex_);
+    pending.swap(readyStreams_);
+  }
+  for (int streamId : pending) {
+    bool release;
+    {
+      std::lock_guard<std::mutex> lock(streams_[streamId].mutex);
+      streams_[streamId].scheduled = false;
+      release = streams_[streamId].removing;
+    }
+    if (release) {
+      releaseSlot(streamId);
+    }
+  }
+  // the workers are kept so that getStats() still works after stop()
+  threads_.clear();
+}
+
+int OpusDecodeService::addStream() {
+  int streamId;
+  {
+    std::lock_guard<std::mutex> lock(slotMutex_);
+    if (!arena_ || freeSlots_.empty()) {
+      return -1;
+    }
+    streamId = freeSlots_.back();
+    freeSlots_.pop_back();
+  }
+
+  int ret = opus_decoder_init(decoder(streamId), config_.sampleRateHz, config_.numberOfChannels);
+  if (ret != OPUS_OK) {
+    AG_LOG(ERROR, "opus_decoder_init failed: %s", opus_strerror(ret));
+    releaseSlot(streamId);
+    return -1;
+  }
+
+  StreamState& stream = streams_[streamId];
+  std::lock_guard<std::mutex> lock(stream.mutex);
+  stream.head = stream.tail = 0;
+  stream.active = true;
+  stream.scheduled = false;
+  stream.removing = false;
+  stream.lastTimestampMs = 0;
+  stream.lastFrameSamples = 0;
+  return streamId;
+}
+
+void OpusDecodeService::removeStream(int streamId) {
+  if (!streams_ || streamId < 0 || streamId >= config_.maxStreams) {
+    return;
+  }
+  StreamState& stream = streams_[streamId];
+  bool release = false;
+  {
+    std::lock_guard<std::mutex> lock(stream.mutex);
+    if (!stream.active) {
+      return;
+    }
+    stream.active = false;
+    if (stream.scheduled) {
+      stream.removing = true;
+    } else {
+      release = true;
+    }
+  }
+  if (release) {
+    releaseSlot(streamId);
+  }
+}
+
+void OpusDecodeService::releaseSlot(int streamId) {
+  {
+    StreamState& stream = streams_[streamId];
+    std::lock_guard<std::mutex> lock(stream.mutex);
+    stream.removing = false;
+    stream.head = stream.tail = 0;
+  }
+  std::lock_guard<std::mutex> lock(slotMutex_);
+  freeSlots_.push_back(streamId);
+}
+
+bool OpusDecodeService::pushPacket(int streamId, const uint8_t* packet, size_t length,
+                                   int64_t timestampMs) {
+  if (!streams_ || streamId < 0 || streamId >= config_.maxStreams || !packet || length == 0 ||
+      length > OPUS_MAX_PACKET_SIZE) {
+    return false;
+  }
+  StreamState& stream = streams_[streamId];
+  bool schedule = false;
+  {
+    std::lock_guard<std::mutex> lock(stream.mutex);
+    if (!stream.active) {
+      return false;
+    }
+    if (stream.tail - stream.head >= (uint32_t)config_.queueDepth) {
+      counterAdd(droppedPackets_, 1);
+      return false;
+    }
+    // the entry at tail is never the one a worker is decoding, the ring is not full
+    PacketSlot* slot = packetSlot(streamId, stream.tail);
+    slot->timestampMs = timestampMs;
+    slot->enqueueNs = monotonicNs();
+    slot->length = (uint32_t)length;
+    memcpy(slot->data, packet, length);
+    ++stream.tail;
+
+    schedule = !stream.scheduled;
+    stream.scheduled = true;
+  }
+  if (schedule) {
+    {
+      std::lock_guard<std::mutex> lock(readyMutex_);
+      readyStreams_.push_back(streamId);
+    }
+    readyCond_.notify_one();
+  }
+  return true;
+}
+
+void OpusDecodeService::workerLoop(Worker* worker) {
+  if (config_.pinWorkers) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(worker->index % CPU_SETSIZE, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0) {
+      AG_LOG(WARNING, "Failed to pin opus decode worker %d", worker->index);
+    }
+  }
+
+  std::vector<int> batch;
+  batch.reserve(config_.batchSize);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(readyMutex_);
+      readyCond_.wait(lock, [this] { return stopping_ || !readyStreams_.empty(); });
+      if (stopping_) {
+        break;
+      }
+      // share the queue with the other workers instead of taking a full batch
+      size_t count = readyStreams_.size() / config_.workerCount;
+      count = std::min(std::max(count, (size_t)1), (size_t)config_.batchSize);
+      batch.assign(readyStreams_.begin(), readyStreams_.begin() + count);
+      readyStreams_.erase(readyStreams_.begin(), readyStreams_.begin() + count);
+    }
+
+    int64_t cpuStart = threadCpuNs();
+    for (int streamId : batch) {
+      processStream(streamId, worker);
+    }
+    counterAdd(worker->cpuNs, threadCpuNs() - cpuStart);
+  }
+}
+
+void OpusDecodeService::processStream(int streamId, Worker* worker) {
+  StreamState& stream = streams_[streamId];
+  while (true) {
+    PacketSlot* slot = nullptr;
+    bool release = false;
+    {
+      std::lock_guard<std::mutex> lock(stream.mutex);
+      if (stream.removing) {
+        stream.scheduled = false;
+        release = true;
+      } else if (stream.head == stream.tail) {
+        stream.scheduled = false;
+        return;
+      } else {
+        // the entry stays reserved until head moves past it
+        slot = packetSlot(streamId, stream.head);
+      }
+    }
+    if (release) {
+      releaseSlot(streamId);
+      return;
+    }
+
+    decodePacket(streamId, *slot, worker);
+
+    std::lock_guard<std::mutex> lock(stream.mutex);
+    ++stream.head;
+  }
+}
+
+void OpusDecodeService::decodePacket(int streamId, const PacketSlot& packet, Worker* worker) {
+  StreamState& stream = streams_[streamId];
+  OpusDecoder* dec = decoder(streamId);
+
+  int samples = opus_packet_get_nb_samples(packet.data, packet.length, config_.sampleRateHz);
+  if (samples <= 0) {
+    counterAdd(worker->decodeErrors, 1);
+    return;
+  }
+
+  if (stream.lastFrameSamples > 0) {
+    if (packet.timestampMs <= stream.lastTimestampMs) {
+      // duplicate or arrived after it was concealed
+      counterAdd(worker->latePackets, 1);
+      return;
+    }
+    int64_t frameMs =
+        std::max<int64_t>(stream.lastFrameSamples * 1000LL / config_.sampleRateHz, 1);
+    int64_t expectedMs = stream.lastTimestampMs + frameMs;
+    // round to whole frames, timestamps jitter by a millisecond or so
+    int64_t missing = (packet.timestampMs - expectedMs + frameMs / 2) / frameMs;
+    if (missing > config_.maxConcealedFrames) {
+      // a new talk spurt or a stalled publisher, concealing would only add noise
+      opus_decoder_ctl(dec, OPUS_RESET_STATE);
+      counterAdd(worker->decoderResets, 1);
+    } else {
+      for (int64_t i = 0; i < missing; ++i) {
+        // the last missing frame may be recovered from the FEC data of this packet
+        bool fec = (i == missing - 1);
+        int ret = opus_decode(dec, fec ? packet.data : nullptr, fec ? packet.length : 0,
+                              worker->pcm.get(), stream.lastFrameSamples, fec ? 1 : 0);
+        if (ret < 0) {
+          counterAdd(worker->decodeErrors, 1);
+          break;
+        }
+        emit(streamId, worker, ret, expectedMs + i * frameMs, true);
+        counterAdd(worker->concealedFrames, 1);
+      }
+    }
+  }
+
+  int ret = opus_decode(dec, packet.data, packet.length, worker->pcm.get(),
+                        config_.sampleRateHz * OPUS_MAX_FRAME_MS / 1000, 0);
+  if (ret < 0) {
+    counterAdd(worker->decodeErrors, 1);
+    return;
+  }
+  emit(streamId, worker, ret, packet.timestampMs, false);
+  counterAdd(worker->decodedFrames, 1);
+  stream.lastTimestampMs = packet.timestampMs;
+  stream.lastFrameSamples = ret;
+
+  uint64_t latencyNs = monotonicNs() - packet.enqueueNs;
+  int bucket = std::min<uint64_t>(latencyNs / (LATENCY_BUCKET_US * 1000), LATENCY_BUCKETS - 1);
+  worker->latencyHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+  if (latencyNs > worker->maxLatencyNs.load(std::memory_order_relaxed)) {
+    worker->maxLatencyNs.store(latencyNs, std::memory_order_relaxed);
+  }
+}
+
+void OpusDecodeService::emit(int streamId, Worker* worker, int samples, int64_t timestampMs,
+                             bool concealed) {
+  counterAdd(worker->decodedSamples, samples);
+  if (callback_) {
+    callback_(streamId, worker->pcm.get(), samples, config_.numberOfChannels, timestampMs,
+              concealed);
+  }
+}
+
+OpusDecodeServiceStats OpusDecodeService::getStats() {
+  OpusDecodeServiceStats stats;
+  {
+    std::lock_guard<std::mutex> lock(slotMutex_);
+    stats.activeStreams = config_.maxStreams - (int)freeSlots_.size();
+  }
+  stats.workerCount = config_.workerCount;
+  stats.droppedPackets = droppedPackets_.load(std::memory_order_relaxed);
+  stats.bytesPerStream = slotSize_ + sizeof(StreamState);
+
+  std::vector<uint64_t> histogram(LATENCY_BUCKETS, 0);
+  uint64_t samples = 0;
+  uint64_t cpuNs = 0;
+  uint64_t maxLatencyNs = 0;
+  for (auto& worker : workers_) {
+    stats.decodedFrames += worker->decodedFrames.load(std::memory_order_relaxed);
+    stats.concealedFrames += worker->concealedFrames.load(std::memory_order_relaxed);
+    stats.latePackets += worker->latePackets.load(std::memory_order_relaxed);
+    stats.decodeErrors += worker->decodeErrors.load(std::memory_order_relaxed);
+    stats.decoderResets += worker->decoderResets.load(std::memory_order_relaxed);
+    samples += worker->decodedSamples.load(std::memory_order_relaxed);
+    cpuNs += worker->cpuNs.load(std::memory_order_relaxed);
+    maxLatencyNs = std::max<uint64_t>(maxLatencyNs, worker->maxLatencyNs.load());
+    for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+      histogram[b] += worker->latencyHistogram[b].load(std::memory_order_relaxed);
+    }
+  }
+
+  stats.audioSeconds = (double)samples / config_.sampleRateHz;
+  stats.cpuSeconds = cpuNs / 1e9;
+  if (cpuNs > 0) {
+    stats.streamsPerCore = stats.audioSeconds / stats.cpuSeconds;
+  }
+  stats.maxLatencyUs = maxLatencyNs / 1e3;
+
+  uint64_t total = 0;
+  for (uint64_t count : histogram) {
+    total += count;
+  }
+  uint64_t seen = 0;
+  for (int b = 0; b < LATENCY_BUCKETS && total > 0; ++b) {
+    seen += histogram[b];
+    // report the upper edge of the bucket
+    if (stats.p50LatencyUs == 0 && seen * 100 >= total * 50) {
+      stats.p50LatencyUs = (b + 1) * LATENCY_BUCKET_US;
+    }
+    if (seen * 100 >= total * 99) {
+      stats.p99LatencyUs = (b + 1) * LATENCY_BUCKET_US;
+      break;
+    }
+  }
+  return stats;
+}
@@ -0,0 +1,130 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Decode many received Opus streams on a fixed pool of worker threads.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct OpusDecoder;
+
+struct OpusDecodeServiceConfig {
+  int sampleRateHz = 48000;
+  int numberOfChannels = 1;
+  // Upper bound of concurrent streams, all decoder state is allocated up front
+  int maxStreams = 256;
+  // 0 means one worker per online CPU
+  int workerCount = 0;
+  // Number of ready streams a worker takes from the run queue at once
+  int batchSize = 16;
+  // Packets buffered per stream before pushPacket() starts dropping
+  int queueDepth = 8;
+  // Gaps of up to this many frames are concealed, longer ones reset the decoder
+  int maxConcealedFrames = 10;
+  // Pin worker i to CPU i
+  bool pinWorkers = false;
+};
+
+struct OpusDecodeServiceStats {
+  int activeStreams = 0;
+  int workerCount = 0;
+  uint64_t decodedFrames = 0;
+  uint64_t concealedFrames = 0;
+  uint64_t droppedPackets = 0;
+  uint64_t latePackets = 0;
+  uint64_t decodeErrors = 0;
+  uint64_t decoderResets = 0;
+  // Audio produced (per stream, not multiplied by channels) and CPU spent producing it
+  double audioSeconds = 0;
+  double cpuSeconds = 0;
+  // Real-time streams one fully loaded core can decode
+  double streamsPerCore = 0;
+  // From pushPacket() to the PCM callback returning, in microseconds
+  double p50LatencyUs = 0;
+  double p99LatencyUs = 0;
+  double maxLatencyUs = 0;
+  // Decoder state, packet ring and bookkeeping of one stream slot
+  size_t bytesPerStream = 0;
+};
+
+/**
+ Decodes Opus streams in a shared worker pool.
+
+ The decoder state of all streams lives in one contiguous arena, each slot
+ followed by the stream's packet ring, so a worker walking a batch of streams
+ touches a few adjacent pages instead of scattered heap blocks. A stream is
+ never decoded by two workers at once, which keeps its packets in order
+ without locking the decoder itself.
+
+ Missing packets, detected from the timestamps, are concealed by the decoder
+ (PLC), using the in-band FEC of the next packet for the last missing frame.
+ */
+class OpusDecodeService {
+ public:
+  // Called on a worker thread for every decoded or concealed frame. Calls for
+  // one stream are serialized, calls for different streams are concurrent.
+  using PcmCallback =
+      std::function<void(int streamId, const int16_t* pcm, int samplesPerChannel,
+                         int numberOfChannels, int64_t timestampMs, bool concealed)>;
+
+  explicit OpusDecodeService(const OpusDecodeServiceConfig& config);
+  ~OpusDecodeService();
+
+  bool start(PcmCallback callback);
+  void stop();
+
+  // Returns the stream id, or -1 if all slots are in use
+  int addStream();
+  void removeStream(int streamId);
+
+  // Thread safe. The packet is copied. Returns false if the stream queue is full.
+  bool pushPacket(int streamId, const uint8_t* packet, size_t length, int64_t timestampMs);
+
+  OpusDecodeServiceStats getStats();
+
+ private:
+  struct PacketSlot;
+  struct StreamState;
+  struct Worker;
+
+  uint8_t* slotBase(int streamId) const;
+  OpusDecoder* decoder(int streamId) const;
+  PacketSlot* packetSlot(int streamId, uint32_t index) const;
+
+  void workerLoop(Worker* worker);
+  void processStream(int streamId, Worker* worker);
+  void decodePacket(int streamId, const PacketSlot& packet, Worker* worker);
+  void emit(int streamId, Worker* worker, int samples, int64_t timestampMs, bool concealed);
+  void releaseSlot(int streamId);
+
+ private:
+  OpusDecodeServiceConfig config_;
+  PcmCallback callback_;
+
+  size_t decoderSize_ = 0;
+  size_t slotSize_ = 0;
+  uint8_t* arena_ = nullptr;
+  std::unique_ptr<StreamState[]> streams_;
+
+  std::mutex slotMutex_;
+  std::vector<int> freeSlots_;
+  std::atomic<uint64_t> droppedPackets_{0};
+
+  std::mutex readyMutex_;
+  std::condition_variable readyCond_;
+  std::deque<int> readyStreams_;
+  bool stopping_ = false;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+};
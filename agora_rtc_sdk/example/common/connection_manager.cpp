@@ -0,0 +1,317 @@
+#include "connection_manager.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <thread>
+
+#include "NGIAgoraLocalUser.h"
+#include "log.h"
+#include "sample_common.h"
+
+static int64_t elapsedMs(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                               since)
+      .count();
+}
+
+// Runs task(0..count-1) on at most parallel threads
+static void runBounded(int count, int parallel, const std::function<void(int)>& task) {
+  std::atomic<int> next(0);
+  std::vector<std::thread> workers;
+  int threads = std::max(1, std::min(parallel, count));
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back([&]() {
+      for (int index = next++; index < count; index = next++) {
+        task(index);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+static LatencyPercentiles percentiles(std::vector<int64_t> values) {
+  LatencyPercentiles result;
+  if (values.empty()) {
+    return result;
+  }
+  std::sort(values.begin(), values.end());
+  auto at = [&values](double p) {
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+  };
+  result.count = static_cast<int>(values.size());
+  result.p50 = at(0.5);
+  result.p90 = at(0.9);
+  result.p99 = at(0.99);
+  result.max = values.back();
+  return result;
+}
+
+void PooledConnection::markFirstFrameSent() {
+  int64_t expected = -1;
+  firstFrameMs.compare_exchange_strong(expected, elapsedMs(joinStart));
+}
+
+ConnectionManager::ConnectionManager(const ConnectionManagerConfig& config)
+    : config_(config), service_(nullptr), stats_(nullptr), failed_joins_(0) {}
+
+ConnectionManager::~ConnectionManager() {
+  disconnectAll();
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    for (auto& pooled : pool_) {
+      releaseConnection(*pooled);
+    }
+    pool_.clear();
+  }
+  factory_ = nullptr;
+  if (service_) {
+    service_->release();
+    service_ = nullptr;
+  }
+}
+
+bool ConnectionManager::initialize() {
+  auto start = std::chrono::steady_clock::now();
+  service_ = createAndInitAgoraService(false, true, true);
+  if (!service_) {
+    AG_LOG(ERROR, "Failed to creating Agora service!");
+    return false;
+  }
+  factory_ = service_->createMediaNodeFactory();
+  if (!factory_) {
+    AG_LOG(ERROR, "Failed to create media node factory!");
+    return false;
+  }
+  AG_LOG(INFO, "Service ready in %ld ms", static_cast<long>(elapsedMs(start)));
+  return prepare(config_.warmConnections);
+}
+
+std::shared_ptr<PooledConnection> ConnectionManager::createConnection() {
+  std::lock_guard<std::mutex> lock(create_mutex_);
+  std::shared_ptr<PooledConnection> pooled = std::make_shared<PooledConnection>();
+
+  agora::rtc::RtcConnectionConfiguration ccfg;
+  ccfg.autoSubscribeAudio = false;
+  ccfg.autoSubscribeVideo = false;
+  ccfg.clientRoleType = agora::rtc::CLIENT_ROLE_BROADCASTER;
+  pooled->connection = service_->createRtcConnection(ccfg);
+  if (!pooled->connection) {
+    AG_LOG(ERROR, "Failed to creating Agora connection!");
+    return nullptr;
+  }
+  pooled->observer = std::make_shared<SampleConnectionObserver>();
+  pooled->connection->registerObserver(pooled->observer.get());
+
+  if (config_.publishPcmAudio) {
+    pooled->audioSender = factory_->createAudioPcmDataSender();
+    if (pooled->audioSender) {
+      pooled->audioTrack = service_->createCustomAudioTrack(pooled->audioSender);
+    }
+    if (!pooled->audioTrack) {
+      AG_LOG(ERROR, "Failed to create audio track!");
+      releaseConnection(*pooled);
+      return nullptr;
+    }
+  }
+  if (config_.publishEncodedVideo) {
+    pooled->videoSender = factory_->createVideoEncodedImageSender();
+    agora::rtc::SenderOptions options;
+    options.codecType = config_.videoCodec;
+    options.ccMode = agora::rtc::TCcMode::CC_ENABLED;
+    if (pooled->videoSender) {
+      pooled->videoTrack = service_->createCustomVideoTrack(pooled->videoSender, options);
+    }
+    if (!pooled->videoTrack) {
+      AG_LOG(ERROR, "Failed to create video track!");
+      releaseConnection(*pooled);
+      return nullptr;
+    }
+  }
+  return pooled;
+}
+
+bool ConnectionManager::prepare(int count) {
+  while (warmCount() < count) {
+    std::shared_ptr<PooledConnection> pooled = createConnection();
+    if (!pooled) {
+      return false;
+    }
+    pooled->warm = true;
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    pool_.push_back(pooled);
+  }
+  return true;
+}
+
+int ConnectionManager::warmCount() {
+  std::lock_guard<std::mutex> lock(pool_mutex_);
+  return static_cast<int>(pool_.size());
+}
+
+std::shared_ptr<PooledConnection> ConnectionManager::acquire() {
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    if (!pool_.empty()) {
+      std::shared_ptr<PooledConnection> pooled = pool_.front();
+      pool_.pop_front();
+      return pooled;
+    }
+  }
+  return createConnection();
+}
+
+bool ConnectionManager::join(const std::string& appId, PooledConnection& pooled) {
+  agora::rtc::ILocalUser* localUser = pooled.connection->getLocalUser();
+  if (pooled.audioTrack) {
+    pooled.audioTrack->setEnabled(true);
+    localUser->publishAudio(pooled.audioTrack);
+  }
+  if (pooled.videoTrack) {
+    pooled.videoTrack->setEnabled(true);
+    localUser->publishVideo(pooled.videoTrack);
+  }
+  // before connect(), no stats are reported yet
+  if (stats_) {
+    pooled.localUserObserver = std::make_shared<SampleLocalUserObserver>(localUser);
+    stats_->attach(pooled.statsName, pooled.observer.get(), pooled.localUserObserver.get());
+    if (pooled.videoTrack) {
+      stats_->pollLocalVideoTrack(pooled.statsName, pooled.videoTrack);
+    }
+  }
+  if (pooled.connection->connect(appId.c_str(), pooled.target.channelId.c_str(),
+                                 pooled.target.userId.c_str())) {
+    AG_LOG(ERROR, "Failed to connect to Agora channel %s!", pooled.target.channelId.c_str());
+    return false;
+  }
+  if (pooled.observer->waitUntilConnected(config_.connectTimeoutMs) != 0) {
+    AG_LOG(ERROR, "Channel %s not connected after %d ms", pooled.target.channelId.c_str(),
+           config_.connectTimeoutMs);
+    return false;
+  }
+  pooled.connectedMs = elapsedMs(pooled.joinStart);
+  pooled.connected = true;
+  return true;
+}
+
+std::vector<std::shared_ptr<PooledConnection>> ConnectionManager::connectAll(
+    const std::string& appId, const std::vector<ConnectionTarget>& targets) {
+  std::vector<std::shared_ptr<PooledConnection>> results(targets.size());
+  auto start = std::chrono::steady_clock::now();
+
+  // Several targets may join one channel, those without a user id get theirs
+  // from the SDK, so names that repeat are numbered
+  std::vector<std::string> statsNames(targets.size());
+  std::map<std::string, int> nameCounts;
+  for (size_t i = 0; i < targets.size(); ++i) {
+    std::string name = targets[i].channelId + "/" +
+                       (targets[i].userId.empty() ? "0" : targets[i].userId);
+    int count = nameCounts[name]++;
+    statsNames[i] = count ? name + "#" + std::to_string(count) : name;
+  }
+
+  runBounded(static_cast<int>(targets.size()), config_.maxParallelConnects, [&](int index) {
+    auto joinStart = std::chrono::steady_clock::now();
+    std::shared_ptr<PooledConnection> pooled = acquire();
+    if (!pooled) {
+      std::lock_guard<std::mutex> lock(joined_mutex_);
+      ++failed_joins_;
+      return;
+    }
+    pooled->target = targets[index];
+    pooled->statsName = statsNames[index];
+    pooled->joinStart = joinStart;
+    pooled->createMs = pooled->warm ? 0 : elapsedMs(joinStart);
+    bool ok = join(appId, *pooled);
+    std::lock_guard<std::mutex> lock(joined_mutex_);
+    // failed ones are kept too, so disconnectAll() cleans them up
+    joined_.push_back(pooled);
+    if (ok) {
+      results[index] = pooled;
+    } else {
+      ++failed_joins_;
+    }
+  });
+
+  std::vector<std::shared_ptr<PooledConnection>> connected;
+  for (auto& pooled : results) {
+    if (pooled) {
+      connected.push_back(pooled);
+    }
+  }
+  AG_LOG(INFO, "Connected %zu of %zu channels in %ld ms, %d at once", connected.size(),
+         targets.size(), static_cast<long>(elapsedMs(start)), config_.maxParallelConnects);
+  return connected;
+}
+
+void ConnectionManager::releaseConnection(PooledConnection& pooled) {
+  if (pooled.connection) {
+    agora::rtc::ILocalUser* localUser = pooled.connection->getLocalUser();
+    if (pooled.audioTrack) {
+      localUser->unpublishAudio(pooled.audioTrack);
+    }
+    if (pooled.videoTrack) {
+      localUser->unpublishVideo(pooled.videoTrack);
+    }
+    pooled.connection->unregisterObserver(pooled.observer.get());
+    if (pooled.localUserObserver) {
+      pooled.localUserObserver->unregisterObserver();
+    }
+    // also after a join that timed out, the SDK may still be connecting
+    if (!pooled.target.channelId.empty() && pooled.connection->disconnect()) {
+      AG_LOG(ERROR, "Failed to disconnect from Agora channel %s!",
+             pooled.target.channelId.c_str());
+    }
+  }
+  if (stats_ && !pooled.statsName.empty()) {
+    stats_->removeConnection(pooled.statsName);
+  }
+  pooled.connected = false;
+  pooled.audioSender = nullptr;
+  pooled.audioTrack = nullptr;
+  pooled.videoSender = nullptr;
+  pooled.videoTrack = nullptr;
+  pooled.connection = nullptr;
+  pooled.observer.reset();
+  pooled.localUserObserver.reset();
+}
+
+void ConnectionManager::disconnectAll() {
+  std::vector<std::shared_ptr<PooledConnection>> joined;
+  {
+    std::lock_guard<std::mutex> lock(joined_mutex_);
+    joined.swap(joined_);
+  }
+  runBounded(static_cast<int>(joined.size()), config_.maxParallelConnects,
+             [&](int index) { releaseConnection(*joined[index]); });
+}
+
+ConnectionManagerReport ConnectionManager::getReport() {
+  ConnectionManagerReport report;
+  std::vector<int64_t> createMs;
+  std::vector<int64_t> connectedMs;
+  std::vector<int64_t> firstFrameMs;
+  std::lock_guard<std::mutex> lock(joined_mutex_);
+  for (auto& pooled : joined_) {
+    if (!pooled->connected) {
+      continue;
+    }
+    ++report.connected;
+    report.warm += pooled->warm ? 1 : 0;
+    if (!pooled->warm) {
+      createMs.push_back(pooled->createMs);
+    }
+    connectedMs.push_back(pooled->connectedMs);
+    if (pooled->firstFrameMs >= 0) {
+      firstFrameMs.push_back(pooled->firstFrameMs);
+    }
+  }
+  report.failed = failed_joins_;
+  report.timeToCreateMs = percentiles(createMs);
+  report.timeToConnectedMs = percentiles(connectedMs);
+  report.timeToFirstFrameMs = percentiles(firstFrameMs);
+  return report;
+}
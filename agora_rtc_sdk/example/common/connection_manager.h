@@ -0,0 +1,143 @@
+//  Agora RTC/MEDIA SDK
+//
+//  One service, a warm pool of publishing connections and concurrent joins.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "IAgoraService.h"
+#include "NGIAgoraAudioTrack.h"
+#include "NGIAgoraMediaNodeFactory.h"
+#include "NGIAgoraRtcConnection.h"
+#include "NGIAgoraVideoTrack.h"
+#include "sample_connection_observer.h"
+#include "sample_local_user_observer.h"
+#include "stats_collector.h"
+
+struct ConnectionManagerConfig {
+  // What every connection publishes, created with the connection
+  bool publishPcmAudio = true;
+  bool publishEncodedVideo = true;
+  agora::rtc::VIDEO_CODEC_TYPE videoCodec = agora::rtc::VIDEO_CODEC_H264;
+  // Connections created, with their senders and tracks, before any join
+  int warmConnections = 0;
+  // Joins in flight at once
+  int maxParallelConnects = 8;
+  int connectTimeoutMs = 3000;
+};
+
+struct ConnectionTarget {
+  std::string channelId;
+  std::string userId;
+};
+
+// A connection with everything needed to publish on it
+struct PooledConnection {
+  agora::agora_refptr<agora::rtc::IRtcConnection> connection;
+  std::shared_ptr<SampleConnectionObserver> observer;
+  // Only with a stats collector, reports the track stats of the connection
+  std::shared_ptr<SampleLocalUserObserver> localUserObserver;
+  agora::agora_refptr<agora::rtc::IAudioPcmDataSender> audioSender;
+  agora::agora_refptr<agora::rtc::ILocalAudioTrack> audioTrack;
+  agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> videoSender;
+  agora::agora_refptr<agora::rtc::ILocalVideoTrack> videoTrack;
+
+  ConnectionTarget target;
+  // Names the connection's stats series, unique among the joined connections
+  std::string statsName;
+  // Taken from the warm pool rather than created for the join
+  bool warm = false;
+  bool connected = false;
+  std::chrono::steady_clock::time_point joinStart;
+  // Time to create the connection, 0 when it was warm
+  int64_t createMs = 0;
+  // From the start of the join, -1 until it happened
+  int64_t connectedMs = -1;
+  std::atomic<int64_t> firstFrameMs{-1};
+
+  // Call after the first frame was sent successfully, later calls are ignored
+  void markFirstFrameSent();
+};
+
+struct LatencyPercentiles {
+  int count = 0;
+  int64_t p50 = 0;
+  int64_t p90 = 0;
+  int64_t p99 = 0;
+  int64_t max = 0;
+};
+
+struct ConnectionManagerReport {
+  int connected = 0;
+  int failed = 0;
+  int warm = 0;
+  // Of the connections created for their join, warm ones took no time
+  LatencyPercentiles timeToCreateMs;
+  LatencyPercentiles timeToConnectedMs;
+  LatencyPercentiles timeToFirstFrameMs;
+};
+
+/**
+ Joins many channels from one process.
+
+ The service, with its log file and license check, is set up once, and the
+ media node factory is shared. Connections for the pool are created up front
+ together with their senders and tracks, so a join only pays for connect():
+ connectAll() runs up to maxParallelConnects of them at once, taking warm
+ connections first and creating the rest on demand, and records for each the
+ time to connected and, once the app reports it, to the first sent frame.
+ */
+class ConnectionManager {
+ public:
+  explicit ConnectionManager(const ConnectionManagerConfig& config);
+  ~ConnectionManager();
+
+  bool initialize();
+  agora::base::IAgoraService* service() { return service_; }
+  // Connections feed their transport and track stats into it from connectAll()
+  // on, labelled with their channel and user
+  void setStatsCollector(StatsCollector* stats) { stats_ = stats; }
+
+  // Adds connections to the warm pool until it holds count of them
+  bool prepare(int count);
+  int warmCount();
+
+  // Returns the connections that connected, in the order of targets
+  std::vector<std::shared_ptr<PooledConnection>> connectAll(
+      const std::string& appId, const std::vector<ConnectionTarget>& targets);
+
+  // Unpublishes and disconnects everything connectAll() returned, in parallel
+  void disconnectAll();
+
+  ConnectionManagerReport getReport();
+
+ private:
+  std::shared_ptr<PooledConnection> createConnection();
+  std::shared_ptr<PooledConnection> acquire();
+  bool join(const std::string& appId, PooledConnection& pooled);
+  void releaseConnection(PooledConnection& pooled);
+
+  ConnectionManagerConfig config_;
+  agora::base::IAgoraService* service_;
+  agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory_;
+  StatsCollector* stats_;
+
+  // the SDK objects are created one at a time, joins run in parallel
+  std::mutex create_mutex_;
+  std::mutex pool_mutex_;
+  std::deque<std::shared_ptr<PooledConnection>> pool_;
+
+  std::mutex joined_mutex_;
+  std::vector<std::shared_ptr<PooledConnection>> joined_;
+  int failed_joins_;
+};
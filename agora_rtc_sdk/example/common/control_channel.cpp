@@ -0,0 +1,231 @@
+#include "control_channel.h"
+
+#include <algorithm>
+#include <random>
+
+#include "log.h"
+#include "sample_local_user_observer.h"
+
+#define CONTROL_PACKET_MAGIC (0xAC)
+#define CONTROL_HEADER_SIZE (8)
+#define CONTROL_RTT_SAMPLES (4096)
+
+bool MediaControlPacketTransport::start() {
+  if (!local_user_->getMediaControlPacketSender()) {
+    AG_LOG(ERROR, "No media control packet sender!");
+    return false;
+  }
+  if (local_user_->registerMediaControlPacketReceiver(this) != 0) {
+    AG_LOG(ERROR, "Failed to register media control packet receiver!");
+    return false;
+  }
+  registered_ = true;
+  return true;
+}
+
+void MediaControlPacketTransport::stop() {
+  if (registered_) {
+    local_user_->unregisterMediaControlPacketReceiver(this);
+    registered_ = false;
+  }
+}
+
+int MediaControlPacketTransport::send(const std::string& peer, const uint8_t* data,
+                                      size_t length) {
+  agora::rtc::IMediaControlPacketSender* sender = local_user_->getMediaControlPacketSender();
+  if (!sender) {
+    return -1;
+  }
+  if (peer.empty()) {
+    return sender->sendBroadcastMediaControlPacket(data, length);
+  }
+  return sender->sendPeerMediaControlPacket(peer.c_str(), data, length);
+}
+
+bool MediaControlPacketTransport::onMediaControlPacketReceived(agora::rtc::uid_t uid,
+                                                               const uint8_t* packet,
+                                                               size_t length) {
+  if (receive_callback_) {
+    receive_callback_(std::to_string(uid), packet, length);
+  }
+  return true;
+}
+
+bool DataStreamTransport::start() {
+  if (connection_->createDataStream(&stream_id_, reliable_, ordered_, false) != 0) {
+    AG_LOG(ERROR, "Failed to create data stream!");
+    return false;
+  }
+  observer_->setStreamMessageCallback(
+      [this](agora::user_id_t userId, int streamId, const char* data, size_t length) {
+        if (receive_callback_) {
+          receive_callback_(userId, reinterpret_cast<const uint8_t*>(data), length);
+        }
+      });
+  return true;
+}
+
+void DataStreamTransport::stop() {
+  // the SDK thread may be in the callback until the observer is unregistered
+  observer_->unregisterObserver();
+  observer_->setStreamMessageCallback(nullptr);
+}
+
+int DataStreamTransport::send(const std::string& peer, const uint8_t* data, size_t length) {
+  return connection_->sendStreamMessage(stream_id_, reinterpret_cast<const char*>(data), length);
+}
+
+ControlChannel::ControlChannel(ControlTransport* transport, int requestTimeoutMs)
+    : transport_(transport), request_timeout_(requestTimeoutMs), rtt_next_(0) {
+  // a random start keeps responses to another requester's sequence numbers
+  // apart on broadcast transports
+  std::random_device random;
+  next_seq_ = random();
+  transport_->setReceiveCallback(
+      [this](const std::string& from, const uint8_t* data, size_t length) {
+        onReceive(from, data, length);
+      });
+}
+
+ControlChannel::~ControlChannel() {
+  // no packet comes in once the transport stopped, only then the callback goes
+  transport_->stop();
+  transport_->setReceiveCallback(nullptr);
+}
+
+uint32_t ControlChannel::nextSeq() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return next_seq_++;
+}
+
+void ControlChannel::writeHeader(ControlWriter& writer, CONTROL_PACKET_KIND kind, uint16_t type,
+                                 uint32_t seq) {
+  writer.u8(CONTROL_PACKET_MAGIC);
+  writer.u8(static_cast<uint8_t>(kind));
+  writer.u16(type);
+  writer.u32(seq);
+}
+
+int ControlChannel::sendPacket(const std::string& peer, const std::vector<uint8_t>& packet) {
+  int ret = transport_->send(peer, packet.data(), packet.size());
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (ret == 0) {
+    ++stats_.sent;
+  } else {
+    ++stats_.sendFailures;
+  }
+  return ret;
+}
+
+void ControlChannel::addPending(uint32_t seq, const ResponseCallback& callback) {
+  expireRequests();
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_[seq] = {std::chrono::steady_clock::now(), callback};
+}
+
+void ControlChannel::removePending(uint32_t seq) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_.erase(seq);
+}
+
+void ControlChannel::expireRequests() {
+  std::vector<ResponseCallback> expired;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto deadline = std::chrono::steady_clock::now() - request_timeout_;
+    for (auto it = pending_.begin(); it != pending_.end();) {
+      if (it->second.sentAt < deadline) {
+        expired.push_back(it->second.callback);
+        it = pending_.erase(it);
+        ++stats_.timeouts;
+      } else {
+        ++it;
+      }
+    }
+  }
+  for (auto& callback : expired) {
+    if (callback) {
+      callback(nullptr, -1);
+    }
+  }
+}
+
+void ControlChannel::onReceive(const std::string& from, const uint8_t* data, size_t length) {
+  auto receivedAt = std::chrono::steady_clock::now();
+  ControlReader reader(data, length);
+  ControlPacket packet;
+  packet.from = from;
+  bool valid = reader.u8() == CONTROL_PACKET_MAGIC;
+  packet.kind = static_cast<CONTROL_PACKET_KIND>(reader.u8());
+  packet.type = reader.u16();
+  packet.seq = reader.u32();
+  packet.payload = data + CONTROL_HEADER_SIZE;
+  packet.length = length - std::min(length, static_cast<size_t>(CONTROL_HEADER_SIZE));
+  if (!valid || !reader.ok() || packet.kind > CONTROL_PACKET_RESPONSE) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.malformed;
+    return;
+  }
+
+  if (packet.kind != CONTROL_PACKET_RESPONSE) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_.received;
+    }
+    auto handler = handlers_.find(packet.type);
+    if (handler != handlers_.end()) {
+      handler->second(packet);
+    }
+    return;
+  }
+
+  ResponseCallback callback;
+  int64_t rttUs = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.received;
+    auto it = pending_.find(packet.seq);
+    // late, or another requester's on a broadcast transport
+    if (it == pending_.end()) {
+      return;
+    }
+    rttUs = std::chrono::duration_cast<std::chrono::microseconds>(receivedAt - it->second.sentAt)
+                .count();
+    callback = it->second.callback;
+    pending_.erase(it);
+    ++stats_.responses;
+    if (rtt_samples_.size() < CONTROL_RTT_SAMPLES) {
+      rtt_samples_.push_back(rttUs);
+    } else {
+      rtt_samples_[rtt_next_] = rttUs;
+    }
+    rtt_next_ = (rtt_next_ + 1) % CONTROL_RTT_SAMPLES;
+  }
+  if (callback) {
+    callback(&packet, rttUs);
+  }
+}
+
+ControlChannelStats ControlChannel::getStats() {
+  std::vector<int64_t> samples;
+  ControlChannelStats stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples = rtt_samples_;
+    stats = stats_;
+  }
+  if (samples.empty()) {
+    return stats;
+  }
+  std::sort(samples.begin(), samples.end());
+  int64_t sum = 0;
+  for (int64_t sample : samples) {
+    sum += sample;
+  }
+  stats.rttMinUs = samples.front();
+  stats.rttAvgUs = sum / static_cast<int64_t>(samples.size());
+  stats.rttP50Us = samples[samples.size() / 2];
+  stats.rttP99Us = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+  stats.rttMaxUs = samples.back();
+  return stats;
+}
@@ -0,0 +1,342 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Typed control messages with request/response and round trip times.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "NGIAgoraLocalUser.h"
+#include "NGIAgoraMediaNodeFactory.h"
+#include "NGIAgoraRtcConnection.h"
+
+class SampleLocalUserObserver;
+
+enum CONTROL_PACKET_KIND {
+  CONTROL_PACKET_EVENT = 0,
+  CONTROL_PACKET_REQUEST = 1,
+  CONTROL_PACKET_RESPONSE = 2,
+};
+
+// Little-endian, fixed width, appended to a buffer
+class ControlWriter {
+ public:
+  explicit ControlWriter(std::vector<uint8_t>& buffer) : buffer_(buffer) {}
+
+  void u8(uint8_t value) { buffer_.push_back(value); }
+  void u16(uint16_t value) { put(value, 2); }
+  void u32(uint32_t value) { put(value, 4); }
+  void u64(uint64_t value) { put(value, 8); }
+  void i32(int32_t value) { put(static_cast<uint32_t>(value), 4); }
+  void f32(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put(bits, 4);
+  }
+  void bytes(const uint8_t* data, size_t length) {
+    buffer_.insert(buffer_.end(), data, data + length);
+  }
+
+ private:
+  void put(uint64_t value, int size) {
+    for (int i = 0; i < size; ++i) {
+      buffer_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  std::vector<uint8_t>& buffer_;
+};
+
+// Reading past the end yields zeros and clears ok()
+class ControlReader {
+ public:
+  ControlReader(const uint8_t* data, size_t length) : data_(data), left_(length), ok_(true) {}
+
+  uint8_t u8() { return static_cast<uint8_t>(get(1)); }
+  uint16_t u16() { return static_cast<uint16_t>(get(2)); }
+  uint32_t u32() { return static_cast<uint32_t>(get(4)); }
+  uint64_t u64() { return get(8); }
+  int32_t i32() { return static_cast<int32_t>(get(4)); }
+  float f32() {
+    uint32_t bits = static_cast<uint32_t>(get(4));
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+  // The rest of the packet
+  void rest(std::vector<uint8_t>& out) {
+    out.assign(data_, data_ + left_);
+    data_ += left_;
+    left_ = 0;
+  }
+  bool ok() const { return ok_; }
+
+ private:
+  uint64_t get(size_t size) {
+    if (left_ < size) {
+      ok_ = false;
+      left_ = 0;
+      return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+      value |= static_cast<uint64_t>(data_[i]) << (8 * i);
+    }
+    data_ += size;
+    left_ -= size;
+    return value;
+  }
+
+  const uint8_t* data_;
+  size_t left_;
+  bool ok_;
+};
+
+// Messages have a TYPE, encode() and decode(). Types below 0x100 are taken
+// by the ones here.
+struct ControlPing {
+  static const uint16_t TYPE = 1;
+  // makes the packet as large as the traffic being measured
+  std::vector<uint8_t> padding;
+
+  void encode(ControlWriter& writer) const { writer.bytes(padding.data(), padding.size()); }
+  bool decode(ControlReader& reader) {
+    reader.rest(padding);
+    return reader.ok();
+  }
+};
+
+struct ControlCursorPosition {
+  static const uint16_t TYPE = 2;
+  // Normalized to the shared surface, 0..1
+  float x = 0;
+  float y = 0;
+  uint8_t buttons = 0;
+
+  void encode(ControlWriter& writer) const {
+    writer.f32(x);
+    writer.f32(y);
+    writer.u8(buttons);
+  }
+  bool decode(ControlReader& reader) {
+    x = reader.f32();
+    y = reader.f32();
+    buttons = reader.u8();
+    return reader.ok();
+  }
+};
+
+struct ControlInputEvent {
+  static const uint16_t TYPE = 3;
+  uint8_t device = 0;
+  uint8_t action = 0;
+  uint16_t code = 0;
+  int32_t value = 0;
+
+  void encode(ControlWriter& writer) const {
+    writer.u8(device);
+    writer.u8(action);
+    writer.u16(code);
+    writer.i32(value);
+  }
+  bool decode(ControlReader& reader) {
+    device = reader.u8();
+    action = reader.u8();
+    code = reader.u16();
+    value = reader.i32();
+    return reader.ok();
+  }
+};
+
+/**
+ Moves control packets. The media control packet path goes next to the
+ media, unreliable and without the data stream's framing; data streams are
+ kept for comparison and for SDKs that do not relay control packets.
+ */
+class ControlTransport {
+ public:
+  typedef std::function<void(const std::string& from, const uint8_t* data, size_t length)>
+      ReceiveCallback;
+
+  virtual ~ControlTransport() {}
+  virtual const char* name() const = 0;
+  virtual bool start() = 0;
+  virtual void stop() = 0;
+  // An empty peer sends to everyone in the channel
+  virtual int send(const std::string& peer, const uint8_t* data, size_t length) = 0;
+
+  // Set before start(), called on the SDK thread
+  void setReceiveCallback(const ReceiveCallback& callback) { receive_callback_ = callback; }
+
+ protected:
+  ReceiveCallback receive_callback_;
+};
+
+class MediaControlPacketTransport : public ControlTransport,
+                                    public agora::rtc::IMediaControlPacketReceiver {
+ public:
+  explicit MediaControlPacketTransport(agora::rtc::ILocalUser* localUser)
+      : local_user_(localUser), registered_(false) {}
+  ~MediaControlPacketTransport() { stop(); }
+
+  const char* name() const override { return "media control packet"; }
+  bool start() override;
+  void stop() override;
+  int send(const std::string& peer, const uint8_t* data, size_t length) override;
+
+  bool onMediaControlPacketReceived(agora::rtc::uid_t uid, const uint8_t* packet,
+                                    size_t length) override;
+
+ private:
+  agora::rtc::ILocalUser* local_user_;
+  bool registered_;
+};
+
+class DataStreamTransport : public ControlTransport {
+ public:
+  // Unreliable and unordered by default, the closest to control packets
+  DataStreamTransport(agora::rtc::IRtcConnection* connection, SampleLocalUserObserver* observer,
+                      bool reliable = false, bool ordered = false)
+      : connection_(connection),
+        observer_(observer),
+        reliable_(reliable),
+        ordered_(ordered),
+        stream_id_(-1) {}
+
+  const char* name() const override { return "data stream"; }
+  // Call before connect()
+  bool start() override;
+  // Unregisters the local user observer before its callback is cleared, so
+  // nothing else gets callbacks from it afterwards
+  void stop() override;
+  // Data streams only broadcast, peer is ignored
+  int send(const std::string& peer, const uint8_t* data, size_t length) override;
+
+ private:
+  agora::rtc::IRtcConnection* connection_;
+  SampleLocalUserObserver* observer_;
+  bool reliable_;
+  bool ordered_;
+  int stream_id_;
+};
+
+struct ControlPacket {
+  std::string from;
+  CONTROL_PACKET_KIND kind;
+  uint16_t type;
+  uint32_t seq;
+  const uint8_t* payload;
+  size_t length;
+
+  template <typename T>
+  bool decode(T& message) const {
+    ControlReader reader(payload, length);
+    return message.decode(reader);
+  }
+};
+
+struct ControlChannelStats {
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  uint64_t sendFailures = 0;
+  uint64_t malformed = 0;
+  uint64_t responses = 0;
+  uint64_t timeouts = 0;
+  // Round trips of the last 4096 answered requests, in microseconds
+  int64_t rttMinUs = 0;
+  int64_t rttAvgUs = 0;
+  int64_t rttP50Us = 0;
+  int64_t rttP99Us = 0;
+  int64_t rttMaxUs = 0;
+};
+
+/**
+ Typed messages over a ControlTransport.
+
+ Every packet starts with an 8 byte header: magic, kind, message type and a
+ sequence number that responses echo, so request() can match the response
+ and time the round trip with the local clock only. Handlers run on the
+ SDK thread that delivered the packet; cursor and input handlers should
+ hand off anything slow, e.g. to an EventReactor.
+ */
+class ControlChannel {
+ public:
+  typedef std::function<void(const ControlPacket& packet)> Handler;
+  // response is null when the request timed out
+  typedef std::function<void(const ControlPacket* response, int64_t rttUs)> ResponseCallback;
+
+  explicit ControlChannel(ControlTransport* transport, int requestTimeoutMs = 1000);
+  ~ControlChannel();
+
+  // Set before traffic starts, they are read without locking
+  void setHandler(uint16_t type, const Handler& handler) { handlers_[type] = handler; }
+
+  template <typename T>
+  int post(const std::string& peer, const T& message) {
+    return sendMessage(peer, CONTROL_PACKET_EVENT, message, nextSeq());
+  }
+
+  template <typename T>
+  int request(const std::string& peer, const T& message, const ResponseCallback& callback) {
+    uint32_t seq = nextSeq();
+    addPending(seq, callback);
+    int ret = sendMessage(peer, CONTROL_PACKET_REQUEST, message, seq);
+    if (ret != 0) {
+      removePending(seq);
+    }
+    return ret;
+  }
+
+  template <typename T>
+  int respond(const ControlPacket& request, const T& message) {
+    return sendMessage(request.from, CONTROL_PACKET_RESPONSE, message, request.seq);
+  }
+
+  // Fails requests older than the timeout, also done on every request
+  void expireRequests();
+  ControlChannelStats getStats();
+
+ private:
+  struct PendingRequest {
+    std::chrono::steady_clock::time_point sentAt;
+    ResponseCallback callback;
+  };
+
+  template <typename T>
+  int sendMessage(const std::string& peer, CONTROL_PACKET_KIND kind, const T& message,
+                  uint32_t seq) {
+    std::vector<uint8_t> packet;
+    packet.reserve(64);
+    ControlWriter writer(packet);
+    writeHeader(writer, kind, T::TYPE, seq);
+    message.encode(writer);
+    return sendPacket(peer, packet);
+  }
+
+  uint32_t nextSeq();
+  void writeHeader(ControlWriter& writer, CONTROL_PACKET_KIND kind, uint16_t type, uint32_t seq);
+  int sendPacket(const std::string& peer, const std::vector<uint8_t>& packet);
+  void addPending(uint32_t seq, const ResponseCallback& callback);
+  void removePending(uint32_t seq);
+  void onReceive(const std::string& from, const uint8_t* data, size_t length);
+
+  ControlTransport* transport_;
+  std::chrono::milliseconds request_timeout_;
+  std::unordered_map<uint16_t, Handler> handlers_;
+
+  std::mutex mutex_;
+  uint32_t next_seq_;
+  std::unordered_map<uint32_t, PendingRequest> pending_;
+  std::vector<int64_t> rtt_samples_;
+  size_t rtt_next_;
+  ControlChannelStats stats_;
+};
@@ -0,0 +1,393 @@
+#include "h264_frame_cipher.h"
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "common/log.h"
+
+#define H264_NAL_SLICE (1)
+#define H264_NAL_IDR_SLICE (5)
+#define H264_NAL_SPS (7)
+#define H264_NAL_PPS (8)
+#define H264_NAL_AUD (9)
+#define H264_CIPHER_TRAILER_SIZE (H264_CIPHER_IV_SIZE + H264_CIPHER_TAG_SIZE)
+// Enough for first_mb_in_slice, slice_type and pic_parameter_set_id
+#define H264_CIPHER_CLEAR_SLICE_BYTES (8)
+// Like rbsp_stop_one_bit, so an encrypted NAL unit never ends with a zero
+#define H264_CIPHER_STOP_BYTE (0x80)
+
+static const uint8_t kStartCode[] = {0, 0, 0, 1};
+
+H264FrameCipher::H264FrameCipher()
+    : ctx_(EVP_CIPHER_CTX_new()), has_key_(false) {}
+
+H264FrameCipher::~H264FrameCipher() { EVP_CIPHER_CTX_free(ctx_); }
+
+bool H264FrameCipher::setKey(const std::string& hexKey) {
+  if (hexKey.size() != 32 && hexKey.size() != 64) {
+    AG_LOG(ERROR, "The key must be 32 or 64 hex digits");
+    return false;
+  }
+  uint8_t key[32];
+  for (size_t i = 0; i < hexKey.size() / 2; ++i) {
+    unsigned int byte;
+    if (sscanf(hexKey.c_str() + 2 * i, "%2x", &byte) != 1) {
+      AG_LOG(ERROR, "The key must be 32 or 64 hex digits");
+      return false;
+    }
+    key[i] = static_cast<uint8_t>(byte);
+  }
+  const EVP_CIPHER* cipher = hexKey.size() == 32 ? EVP_aes_128_gcm() : EVP_aes_256_gcm();
+  // the key schedule is computed once here, frames only set the IV
+  bool ok = EVP_CipherInit_ex(ctx_, cipher, nullptr, key, nullptr, 1) == 1;
+  memset(key, 0, sizeof(key));
+  if (!ok) {
+    AG_LOG(ERROR, "Failed to set up AES-GCM");
+    return false;
+  }
+  has_key_ = true;
+  return true;
+}
+
+// 0x80 in every byte of v that is zero, and nowhere else
+static inline uint64_t zeroBytes(uint64_t v) {
+  return ~(((v & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | v) & 0x8080808080808080ULL;
+}
+
+static inline uint64_t load64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+const uint8_t* H264FrameCipher::findZeroPair(const uint8_t* p, const uint8_t* end) {
+  // a byte is the start of a pair when it is zero in both the block and the
+  // block one byte further on; random ciphertext has a pair in only one of
+  // about 1000 blocks of 64 bytes, so blocks are tested without branches
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  while (end - p >= 66) {
+    __m128i pairs = zero;
+    for (int i = 0; i < 64; i += 16) {
+      __m128i here = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 1));
+      pairs = _mm_or_si128(
+          pairs, _mm_and_si128(_mm_cmpeq_epi8(here, zero), _mm_cmpeq_epi8(next, zero)));
+    }
+    if (_mm_movemask_epi8(pairs)) {
+      break;
+    }
+    p += 64;
+  }
+#endif
+  while (end - p >= 34) {
+    uint64_t pairs = 0;
+    for (int i = 0; i < 32; i += 8) {
+      pairs |= zeroBytes(load64(p + i)) & zeroBytes(load64(p + i + 1));
+    }
+    if (pairs) {
+      break;
+    }
+    p += 32;
+  }
+  for (; end - p >= 3; ++p) {
+    if (p[0] == 0 && p[1] == 0) {
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+void H264FrameCipher::findNals(const uint8_t* frame, size_t length, std::vector<Nal>& nals) {
+  nals.clear();
+  size_t start = 0;
+  const uint8_t* end = frame + length;
+  for (const uint8_t* p = findZeroPair(frame, end); p; p = findZeroPair(p + 1, end)) {
+    if (p[2] != 1) {
+      continue;
+    }
+    size_t at = p - frame;
+    if (start) {
+      // a 4 byte start code leaves its leading zero behind
+      size_t nalEnd = frame[at - 1] == 0 ? at - 1 : at;
+      nals.push_back({start, nalEnd > start ? nalEnd - start : 0});
+    }
+    start = at + 3;
+    p += 2;
+  }
+  if (start && start < length) {
+    nals.push_back({start, length - start});
+  }
+}
+
+bool H264FrameCipher::isClearNal(uint8_t nalType) {
+  return nalType == H264_NAL_SPS || nalType == H264_NAL_PPS || nalType == H264_NAL_AUD;
+}
+
+size_t H264FrameCipher::clearPayloadBytes(uint8_t nalType, size_t payloadLength) {
+  bool slice = nalType == H264_NAL_SLICE || nalType == H264_NAL_IDR_SLICE;
+  return slice ? std::min<size_t>(H264_CIPHER_CLEAR_SLICE_BYTES, payloadLength) : 0;
+}
+
+int H264FrameCipher::lastEncryptedNal(const uint8_t* frame) const {
+  int last = -1;
+  for (size_t i = 0; i < nals_.size(); ++i) {
+    if (nals_[i].length > 0 && !isClearNal(frame[nals_[i].offset] & 0x1f)) {
+      last = static_cast<int>(i);
+    }
+  }
+  return last;
+}
+
+bool H264FrameCipher::needsEscape(const uint8_t* data, size_t length) {
+  const uint8_t* end = data + length;
+  for (const uint8_t* p = findZeroPair(data, end); p; p = findZeroPair(p + 1, end)) {
+    if (p[2] <= 3) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool H264FrameCipher::hasEscapes(const uint8_t* data, size_t length) {
+  const uint8_t* end = data + length;
+  for (const uint8_t* p = findZeroPair(data, end); p; p = findZeroPair(p + 1, end)) {
+    if (p[2] == 3) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void H264FrameCipher::escape(const uint8_t* data, size_t length, std::vector<uint8_t>& out) {
+  const uint8_t* p = data;
+  const uint8_t* end = data + length;
+  for (const uint8_t* pair = findZeroPair(p, end); pair; pair = findZeroPair(p, end)) {
+    // 00 00 followed by 00 to 03 would read as a start code, an 03 after
+    // the pair keeps it data
+    out.insert(out.end(), p, pair + 2);
+    if (pair[2] <= 3) {
+      out.push_back(3);
+    }
+    p = pair + 2;
+  }
+  out.insert(out.end(), p, end);
+}
+
+void H264FrameCipher::unescape(const uint8_t* data, size_t length, std::vector<uint8_t>& out) {
+  const uint8_t* p = data;
+  const uint8_t* end = data + length;
+  for (const uint8_t* pair = findZeroPair(p, end); pair; pair = findZeroPair(p, end)) {
+    out.insert(out.end(), p, pair + 2);
+    p = pair[2] == 3 ? pair + 3 : pair + 2;
+  }
+  out.insert(out.end(), p, end);
+}
+
+bool H264FrameCipher::setAad() {
+  int outLength = 0;
+  return EVP_CipherUpdate(ctx_, nullptr, &outLength, aad_.data(), static_cast<int>(aad_.size())) ==
+         1;
+}
+
+bool H264FrameCipher::encrypt(const uint8_t* frame, size_t length, const uint8_t*& out,
+                              size_t& outLength) {
+  findNals(frame, length, nals_);
+  int last = lastEncryptedNal(frame);
+  if (!has_key_ || last < 0) {
+    ++stats_.malformed;
+    return false;
+  }
+
+  // 96 random bits make a repeat under one key as unlikely as GCM needs,
+  // however many senders use it
+  uint8_t iv[H264_CIPHER_IV_SIZE];
+  if (RAND_bytes(iv, sizeof(iv)) != 1) {
+    return false;
+  }
+
+  // everything that stays in clear is authenticated
+  aad_.clear();
+  for (const Nal& nal : nals_) {
+    const uint8_t* data = frame + nal.offset;
+    if (nal.length == 0) {
+      continue;
+    }
+    size_t clear = isClearNal(data[0] & 0x1f)
+                       ? nal.length
+                       : 1 + clearPayloadBytes(data[0] & 0x1f, nal.length - 1);
+    aad_.insert(aad_.end(), data, data + clear);
+  }
+  if (EVP_CipherInit_ex(ctx_, nullptr, nullptr, nullptr, iv, 1) != 1 || !setAad()) {
+    return false;
+  }
+
+  out_.clear();
+  out_.reserve(length + length / 64 + nals_.size() + H264_CIPHER_TRAILER_SIZE + 16);
+  for (size_t i = 0; i < nals_.size(); ++i) {
+    const uint8_t* data = frame + nals_[i].offset;
+    size_t size = nals_[i].length;
+    if (size == 0) {
+      continue;
+    }
+    out_.insert(out_.end(), kStartCode, kStartCode + sizeof(kStartCode));
+    if (isClearNal(data[0] & 0x1f) || static_cast<int>(i) > last) {
+      out_.insert(out_.end(), data, data + size);
+      continue;
+    }
+    size_t clear = 1 + clearPayloadBytes(data[0] & 0x1f, size - 1);
+    out_.insert(out_.end(), data, data + clear);
+
+    // encrypt straight into the output, escaping is rarely needed
+    size_t at = out_.size();
+    size_t plainLength = size - clear;
+    out_.resize(at + plainLength + (static_cast<int>(i) == last ? H264_CIPHER_TRAILER_SIZE : 0));
+    uint8_t* cipher = out_.data() + at;
+    int written = 0;
+    if (EVP_CipherUpdate(ctx_, cipher, &written, data + clear, static_cast<int>(plainLength)) !=
+        1) {
+      return false;
+    }
+    if (static_cast<int>(i) == last) {
+      int finalLength = 0;
+      if (EVP_CipherFinal_ex(ctx_, cipher + written, &finalLength) != 1 ||
+          EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_GET_TAG, H264_CIPHER_TAG_SIZE,
+                              cipher + plainLength + H264_CIPHER_IV_SIZE) != 1) {
+        return false;
+      }
+      memcpy(cipher + plainLength, iv, H264_CIPHER_IV_SIZE);
+    }
+
+    // the clear slice bytes may end in zeros that pair with the ciphertext
+    uint8_t* payload = out_.data() + at - (clear - 1);
+    size_t payloadLength = out_.size() - (at - (clear - 1));
+    if (needsEscape(payload, payloadLength)) {
+      work_.assign(payload, payload + payloadLength);
+      out_.resize(out_.size() - payloadLength);
+      escape(work_.data(), work_.size(), out_);
+    }
+    out_.push_back(H264_CIPHER_STOP_BYTE);
+  }
+
+  ++stats_.frames;
+  stats_.bytes += length;
+  out = out_.data();
+  outLength = out_.size();
+  return true;
+}
+
+bool H264FrameCipher::decrypt(const uint8_t* frame, size_t length, const uint8_t*& out,
+                              size_t& outLength) {
+  findNals(frame, length, nals_);
+  int last = lastEncryptedNal(frame);
+  if (!has_key_ || last < 0) {
+    ++stats_.malformed;
+    return false;
+  }
+
+  // Unescape first, the clear slice bytes are part of the authenticated data
+  // and the trailer is at the end of the last encrypted NAL unit. Payloads
+  // without escapes, nearly all of them, are read in place.
+  work_.clear();
+  segments_.clear();
+  for (int i = 0; i <= last; ++i) {
+    const uint8_t* data = frame + nals_[i].offset;
+    size_t size = nals_[i].length;
+    Segment segment = {data + 1, 0, size > 0 ? size - 1 : 0};
+    if (size > 0 && !isClearNal(data[0] & 0x1f)) {
+      if (size < 2 || data[size - 1] != H264_CIPHER_STOP_BYTE) {
+        ++stats_.malformed;
+        return false;
+      }
+      segment.length = size - 2;
+      if (hasEscapes(segment.data, segment.length)) {
+        segment.offset = work_.size();
+        unescape(segment.data, segment.length, work_);
+        segment.length = work_.size() - segment.offset;
+        segment.data = nullptr;
+      }
+    }
+    segments_.push_back(segment);
+  }
+  for (Segment& segment : segments_) {
+    if (!segment.data) {
+      segment.data = work_.data() + segment.offset;
+    }
+  }
+
+  Segment& lastSegment = segments_[last];
+  if (lastSegment.length < H264_CIPHER_TRAILER_SIZE) {
+    ++stats_.malformed;
+    return false;
+  }
+  lastSegment.length -= H264_CIPHER_TRAILER_SIZE;
+  uint8_t iv[H264_CIPHER_IV_SIZE];
+  uint8_t tag[H264_CIPHER_TAG_SIZE];
+  memcpy(iv, lastSegment.data + lastSegment.length, H264_CIPHER_IV_SIZE);
+  memcpy(tag, lastSegment.data + lastSegment.length + H264_CIPHER_IV_SIZE, H264_CIPHER_TAG_SIZE);
+
+  aad_.clear();
+  for (size_t i = 0; i < nals_.size(); ++i) {
+    const uint8_t* data = frame + nals_[i].offset;
+    if (nals_[i].length == 0) {
+      continue;
+    }
+    if (isClearNal(data[0] & 0x1f) || static_cast<int>(i) > last) {
+      aad_.insert(aad_.end(), data, data + nals_[i].length);
+      continue;
+    }
+    const Segment& segment = segments_[i];
+    aad_.push_back(data[0]);
+    aad_.insert(aad_.end(), segment.data,
+                segment.data + clearPayloadBytes(data[0] & 0x1f, segment.length));
+  }
+  if (EVP_CipherInit_ex(ctx_, nullptr, nullptr, nullptr, iv, 0) != 1 || !setAad() ||
+      EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_SET_TAG, H264_CIPHER_TAG_SIZE, tag) != 1) {
+    return false;
+  }
+
+  out_.clear();
+  out_.reserve(length);
+  for (size_t i = 0; i < nals_.size(); ++i) {
+    const uint8_t* data = frame + nals_[i].offset;
+    size_t size = nals_[i].length;
+    if (size == 0) {
+      continue;
+    }
+    out_.insert(out_.end(), kStartCode, kStartCode + sizeof(kStartCode));
+    if (isClearNal(data[0] & 0x1f) || static_cast<int>(i) > last) {
+      out_.insert(out_.end(), data, data + size);
+      continue;
+    }
+    const Segment& segment = segments_[i];
+    size_t clear = clearPayloadBytes(data[0] & 0x1f, segment.length);
+    out_.push_back(data[0]);
+    out_.insert(out_.end(), segment.data, segment.data + clear);
+    size_t at = out_.size();
+    out_.resize(at + segment.length - clear);
+    int written = 0;
+    if (EVP_CipherUpdate(ctx_, out_.data() + at, &written, segment.data + clear,
+                         static_cast<int>(segment.length - clear)) != 1) {
+      return false;
+    }
+  }
+  uint8_t tail[16];
+  int finalLength = 0;
+  if (EVP_CipherFinal_ex(ctx_, tail, &finalLength) != 1) {
+    ++stats_.authFailures;
+    return false;
+  }
+
+  ++stats_.frames;
+  stats_.bytes += out_.size();
+  out = out_.data();
+  outLength = out_.size();
+  return true;
+}
@@ -0,0 +1,97 @@
+//  Agora RTC/MEDIA SDK
+//
+//  End-to-end encryption of H.264 access units with AES-GCM.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+#define H264_CIPHER_IV_SIZE (12)
+#define H264_CIPHER_TAG_SIZE (16)
+
+struct H264FrameCipherStats {
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+  // Decryption only: tag mismatch, wrong key or tampered frame
+  uint64_t authFailures = 0;
+  uint64_t malformed = 0;
+};
+
+/**
+ Encrypts Annex B access units so that only the endpoints can read them,
+ while the frame still parses as H.264 on the way.
+
+ Start codes, NAL header bytes, parameter sets (SPS, PPS, AUD) and the
+ first 8 bytes of every slice stay in clear, so servers and parsers can
+ still route, split access units, find key frames and read resolutions.
+ Everything else, slice data and SEI included, is encrypted with AES-GCM
+ as one stream per frame, with the clear bytes as additional authenticated
+ data. The 12 byte IV, random for every frame, and the 16 byte tag trail
+ the last encrypted NAL unit; senders share the key, so an IV never depends
+ on per-process state that could repeat. Emulation
+ prevention bytes and a final 0x80 keep the ciphertext from forming start
+ codes, so the frame stays about 30 bytes larger than the plain one.
+
+ One EVP context and one output buffer are reused for every frame, and the
+ payload is encrypted straight into the output; the few frames that need
+ escaping are found by an SSE2 scan for 00 00. OpenSSL picks AES-NI or VAES
+ with carry-less multiply for the GCM itself. Not thread-safe, use one per
+ sending or receiving thread.
+ */
+class H264FrameCipher {
+ public:
+  H264FrameCipher();
+  ~H264FrameCipher();
+
+  // 32 or 64 hex digits, AES-128 or AES-256
+  bool setKey(const std::string& hexKey);
+
+  // The output is valid until the next call
+  bool encrypt(const uint8_t* frame, size_t length, const uint8_t*& out, size_t& outLength);
+  bool decrypt(const uint8_t* frame, size_t length, const uint8_t*& out, size_t& outLength);
+
+  H264FrameCipherStats getStats() const { return stats_; }
+
+ private:
+  struct Nal {
+    size_t offset;
+    size_t length;
+  };
+
+  // Unescaped payload of a NAL unit, in the frame or at offset in work_
+  struct Segment {
+    const uint8_t* data;
+    size_t offset;
+    size_t length;
+  };
+
+  static void findNals(const uint8_t* frame, size_t length, std::vector<Nal>& nals);
+  static bool isClearNal(uint8_t nalType);
+  static size_t clearPayloadBytes(uint8_t nalType, size_t payloadLength);
+  int lastEncryptedNal(const uint8_t* frame) const;
+  // First 00 00 that is followed by another byte
+  static const uint8_t* findZeroPair(const uint8_t* p, const uint8_t* end);
+  static bool needsEscape(const uint8_t* data, size_t length);
+  static bool hasEscapes(const uint8_t* data, size_t length);
+  // Appends with emulation prevention, or removes it
+  static void escape(const uint8_t* data, size_t length, std::vector<uint8_t>& out);
+  static void unescape(const uint8_t* data, size_t length, std::vector<uint8_t>& out);
+
+  bool setAad();
+
+  EVP_CIPHER_CTX* ctx_;
+  bool has_key_;
+
+  std::vector<Nal> nals_;
+  std::vector<uint8_t> aad_;
+  std::vector<Segment> segments_;
+  std::vector<uint8_t> work_;
+  std::vector<uint8_t> out_;
+  H264FrameCipherStats stats_;
+};
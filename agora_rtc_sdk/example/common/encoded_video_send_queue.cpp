@@ -0,0 +1,143 @@
+#include "encoded_video_send_queue.h"
+
+#include "log.h"
+
+#define NAL_SLICE (1)
+#define NAL_IDR_SLICE (5)
+
+// Whether the first slice of an Annex B access unit may be referenced
+static bool isReferenceFrame(const uint8_t* data, int length) {
+  for (int i = 0; i + 3 < length; ++i) {
+    if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+      continue;
+    }
+    uint8_t header = data[i + 3];
+    int type = header & 0x1f;
+    if (type == NAL_SLICE || type == NAL_IDR_SLICE) {
+      return ((header >> 5) & 0x3) != 0;
+    }
+    i += 3;
+  }
+  // unknown layout, never drop it on its own
+  return true;
+}
+
+EncodedVideoSendQueue::EncodedVideoSendQueue(const EncodedVideoSendQueueConfig& config)
+    : config_(config), wait_key_frame_(false), key_frame_requested_(false), closed_(false) {}
+
+bool EncodedVideoSendQueue::overLimit(std::chrono::steady_clock::time_point now) const {
+  if (queue_.empty()) {
+    return false;
+  }
+  return static_cast<int>(queue_.size()) > config_.maxFrames ||
+         now - queue_.front().pushTime > std::chrono::milliseconds(config_.maxLatencyMs);
+}
+
+void EncodedVideoSendQueue::dropUntilKeyFrame() {
+  // the first frame may be a keyframe that is already late, skip past it
+  size_t next = 1;
+  while (next < queue_.size() && !queue_[next].frame->isKeyFrame) {
+    ++next;
+  }
+  stats_.droppedGopFrames += next;
+  queue_.erase(queue_.begin(), queue_.begin() + next);
+  if (queue_.empty()) {
+    wait_key_frame_ = true;
+  }
+}
+
+void EncodedVideoSendQueue::dropLateFrames(std::chrono::steady_clock::time_point now) {
+  if (!overLimit(now)) {
+    return;
+  }
+  size_t before = queue_.size();
+  for (auto it = queue_.begin(); it != queue_.end();) {
+    if (!it->isReference && !it->frame->isKeyFrame) {
+      it = queue_.erase(it);
+      ++stats_.droppedDisposableFrames;
+    } else {
+      ++it;
+    }
+  }
+  while (overLimit(now)) {
+    dropUntilKeyFrame();
+  }
+  if (queue_.size() != before) {
+    AG_LOG(WARNING, "Send queue behind, dropped %zu frames, %zu left",
+           before - queue_.size(), queue_.size());
+  }
+}
+
+void EncodedVideoSendQueue::push(std::unique_ptr<HelperH264Frame> frame) {
+  if (!frame) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.pushedFrames;
+  if (wait_key_frame_) {
+    if (!frame->isKeyFrame) {
+      ++stats_.droppedGopFrames;
+      return;
+    }
+    wait_key_frame_ = false;
+  }
+  bool isReference = isReferenceFrame(frame->buffer.get(), frame->bufferLen);
+  queue_.push_back({std::move(frame), isReference, now});
+  dropLateFrames(now);
+  cond_.notify_one();
+}
+
+std::unique_ptr<HelperH264Frame> EncodedVideoSendQueue::pop(int timeoutMs) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                 [this] { return closed_ || !queue_.empty(); });
+  // the sender may have stalled since the last push
+  dropLateFrames(std::chrono::steady_clock::now());
+  if (closed_ || queue_.empty()) {
+    return nullptr;
+  }
+  std::unique_ptr<HelperH264Frame> frame = std::move(queue_.front().frame);
+  queue_.pop_front();
+  ++stats_.sentFrames;
+  return frame;
+}
+
+void EncodedVideoSendQueue::requestKeyFrame() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.keyFrameJumps;
+  key_frame_requested_ = true;
+  size_t key = 0;
+  while (key < queue_.size() && !queue_[key].frame->isKeyFrame) {
+    ++key;
+  }
+  stats_.droppedGopFrames += key;
+  queue_.erase(queue_.begin(), queue_.begin() + key);
+  wait_key_frame_ = queue_.empty();
+}
+
+bool EncodedVideoSendQueue::takeKeyFrameRequest() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool requested = key_frame_requested_;
+  key_frame_requested_ = false;
+  return requested;
+}
+
+void EncodedVideoSendQueue::close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  closed_ = true;
+  cond_.notify_all();
+}
+
+EncodedVideoSendQueueStats EncodedVideoSendQueue::getStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  EncodedVideoSendQueueStats stats = stats_;
+  stats.queuedFrames = static_cast<int>(queue_.size());
+  if (!queue_.empty()) {
+    stats.queuedLatencyMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                 std::chrono::steady_clock::now() -
+                                                 queue_.front().pushTime)
+                                                 .count());
+  }
+  return stats;
+}
@@ -0,0 +1,90 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Send queue for pre-encoded H.264 that drops frames by GOP under congestion.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "file_parser/helper_h264_parser.h"
+
+struct EncodedVideoSendQueueConfig {
+  // Frames older than this are not worth sending any more
+  int maxLatencyMs = 300;
+  // Hard limit, whatever their age
+  int maxFrames = 90;
+};
+
+struct EncodedVideoSendQueueStats {
+  uint64_t pushedFrames = 0;
+  uint64_t sentFrames = 0;
+  // Non-reference frames dropped on their own
+  uint64_t droppedDisposableFrames = 0;
+  // Frames dropped with the rest of their GOP
+  uint64_t droppedGopFrames = 0;
+  // Intra requests answered from the queue or the source
+  uint64_t keyFrameJumps = 0;
+  int queuedFrames = 0;
+  int queuedLatencyMs = 0;
+};
+
+/**
+ Decouples a paced encoded video source from the thread that sends it.
+
+ Nothing is dropped while the sender keeps up. Once the oldest frame is older
+ than maxLatencyMs, frames that nothing references (nal_ref_idc 0) are
+ dropped first since they cost no picture quality; if that is not enough,
+ everything up to the next queued keyframe goes, so the receiver never gets
+ a delta frame whose reference was dropped. Without a queued keyframe the
+ delta frames are dropped as they arrive until one comes.
+
+ An intra request makes the queue restart at its first keyframe, or wait for
+ the next one, and is passed on to the source through takeKeyFrameRequest()
+ so a file source can seek to its next keyframe instead of playing out the
+ GOP.
+ */
+class EncodedVideoSendQueue {
+ public:
+  explicit EncodedVideoSendQueue(const EncodedVideoSendQueueConfig& config);
+
+  // From the source thread
+  void push(std::unique_ptr<HelperH264Frame> frame);
+  bool takeKeyFrameRequest();
+
+  // From the send thread. Returns nullptr after timeoutMs or once closed.
+  std::unique_ptr<HelperH264Frame> pop(int timeoutMs);
+
+  // From any thread, e.g. ILocalUserObserver::onIntraRequestReceived
+  void requestKeyFrame();
+  void close();
+
+  EncodedVideoSendQueueStats getStats();
+
+ private:
+  struct Entry {
+    std::unique_ptr<HelperH264Frame> frame;
+    bool isReference;
+    std::chrono::steady_clock::time_point pushTime;
+  };
+
+  void dropLateFrames(std::chrono::steady_clock::time_point now);
+  void dropUntilKeyFrame();
+  bool overLimit(std::chrono::steady_clock::time_point now) const;
+
+  EncodedVideoSendQueueConfig config_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Entry> queue_;
+  bool wait_key_frame_;
+  bool key_frame_requested_;
+  bool closed_;
+  EncodedVideoSendQueueStats stats_;
+};
@@ -0,0 +1,222 @@
+#include "event_reactor.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "log.h"
+
+EventReactor::EventReactor(const EventReactorConfig& config)
+    : config_(config), epoll_fd_(-1), work_fd_(-1), stop_fd_(-1), stop_requested_(false) {
+  config_.workerThreads = std::max(0, config_.workerThreads);
+  config_.maxBatch = std::max(1, config_.maxBatch);
+}
+
+EventReactor::~EventReactor() {
+  stop();
+  for (int fd : {epoll_fd_, work_fd_, stop_fd_}) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+bool EventReactor::start() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  work_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || work_fd_ < 0 || stop_fd_ < 0) {
+    AG_LOG(ERROR, "Failed to create reactor fds: %s", strerror(errno));
+    return false;
+  }
+  for (int fd : {work_fd_, stop_fd_}) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+      AG_LOG(ERROR, "Failed to watch reactor fd: %s", strerror(errno));
+      return false;
+    }
+  }
+  for (int i = 0; i < config_.workerThreads; ++i) {
+    workers_.emplace_back(&EventReactor::workerLoop, this);
+  }
+  return true;
+}
+
+void EventReactor::addQueue(int queueId, EVENT_PRIORITY priority) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  queues_[queueId].priority = priority;
+}
+
+bool EventReactor::post(int queueId, std::function<void()> event) {
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = queues_.find(queueId);
+    if (stop_requested_ || it == queues_.end()) {
+      ++stats_.droppedEvents;
+      return false;
+    }
+    EventQueue& queue = it->second;
+    queue.events.push_back(std::move(event));
+    ++stats_.postedEvents;
+    stats_.maxQueueDepth = std::max(stats_.maxQueueDepth, queue.events.size());
+    if (!queue.scheduled) {
+      queue.scheduled = true;
+      ready_[queue.priority].push_back(queueId);
+      wake = true;
+    }
+  }
+  // a queue that is already scheduled gets drained by its worker
+  if (wake) {
+    wakeWorker();
+  }
+  return true;
+}
+
+void EventReactor::wakeWorker() {
+  uint64_t one = 1;
+  if (write(work_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+    AG_LOG(ERROR, "Failed to wake reactor: %s", strerror(errno));
+  }
+}
+
+void EventReactor::requestStop() {
+  stop_requested_ = true;
+  if (stop_fd_ >= 0) {
+    uint64_t one = 1;
+    // nothing to do about a failure in a signal handler
+    ssize_t ret = write(stop_fd_, &one, sizeof(one));
+    (void)ret;
+  }
+}
+
+void EventReactor::wait() {
+  struct pollfd fd;
+  fd.fd = stop_fd_;
+  fd.events = POLLIN;
+  while (!stop_requested_) {
+    // the stop eventfd is never read, once set poll() keeps returning
+    if (poll(&fd, 1, -1) < 0 && errno != EINTR) {
+      AG_LOG(ERROR, "Failed to wait for stop: %s", strerror(errno));
+      return;
+    }
+  }
+}
+
+void EventReactor::stop() {
+  requestStop();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+
+  // post() refuses new events by now, run what was queued before, higher
+  // priority queues first and every queue in order
+  std::vector<std::function<void()>> pending;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int priority = 0; priority < EVENT_PRIORITY_COUNT; ++priority) {
+      for (auto& entry : queues_) {
+        EventQueue& queue = entry.second;
+        if (queue.priority != priority) {
+          continue;
+        }
+        for (auto& event : queue.events) {
+          pending.push_back(std::move(event));
+        }
+        queue.events.clear();
+        queue.scheduled = false;
+      }
+      ready_[priority].clear();
+    }
+  }
+  for (auto& event : pending) {
+    event();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.ranEvents += pending.size();
+}
+
+int EventReactor::takeReadyQueue() {
+  for (auto& ready : ready_) {
+    if (!ready.empty()) {
+      int queueId = ready.front();
+      ready.pop_front();
+      return queueId;
+    }
+  }
+  return -1;
+}
+
+void EventReactor::workerLoop() {
+  std::vector<std::function<void()>> batch;
+  while (!stop_requested_) {
+    int queueId = -1;
+    bool moreReady = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queueId = takeReadyQueue();
+      if (queueId >= 0) {
+        EventQueue& queue = queues_[queueId];
+        size_t count = std::min(queue.events.size(), static_cast<size_t>(config_.maxBatch));
+        for (size_t i = 0; i < count; ++i) {
+          batch.push_back(std::move(queue.events.front()));
+          queue.events.pop_front();
+        }
+        for (auto& ready : ready_) {
+          moreReady = moreReady || !ready.empty();
+        }
+      }
+    }
+
+    if (queueId < 0) {
+      // a post after the check above left the eventfd readable, so no wakeup
+      // is lost between the check and epoll_wait()
+      struct epoll_event events[2];
+      if (epoll_wait(epoll_fd_, events, 2, -1) < 0 && errno != EINTR) {
+        AG_LOG(ERROR, "Reactor epoll_wait failed: %s", strerror(errno));
+        return;
+      }
+      uint64_t count = 0;
+      ssize_t ret = read(work_fd_, &count, sizeof(count));
+      (void)ret;
+      continue;
+    }
+    // the eventfd was read by this worker, pass the wakeup on
+    if (moreReady) {
+      wakeWorker();
+    }
+
+    for (auto& event : batch) {
+      event();
+    }
+    size_t ran = batch.size();
+    batch.clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.ranEvents += ran;
+    ++stats_.batches;
+    EventQueue& queue = queues_[queueId];
+    if (queue.events.empty()) {
+      queue.scheduled = false;
+    } else {
+      // behind other ready queues of its priority, so one busy queue does
+      // not hold a worker for good
+      ready_[queue.priority].push_back(queueId);
+      wakeWorker();
+    }
+  }
+}
+
+EventReactorStats EventReactor::getStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
@@ -0,0 +1,103 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Moves work out of SDK callbacks onto our own threads, woken by eventfd.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum EVENT_PRIORITY {
+  EVENT_PRIORITY_HIGH = 0,
+  EVENT_PRIORITY_NORMAL,
+  EVENT_PRIORITY_LOW,
+  EVENT_PRIORITY_COUNT,
+};
+
+struct EventReactorConfig {
+  // 0 for none, only wait() and requestStop() are of use then
+  int workerThreads = 2;
+  // Events of one queue a worker runs before it looks for other work
+  int maxBatch = 32;
+};
+
+struct EventReactorStats {
+  uint64_t postedEvents = 0;
+  uint64_t ranEvents = 0;
+  uint64_t batches = 0;
+  // Posted after stop was requested
+  uint64_t droppedEvents = 0;
+  size_t maxQueueDepth = 0;
+};
+
+/**
+ A small reactor for SDK observers.
+
+ Callbacks post an event, a copy of what they were given and what to do with
+ it, and return; the work runs on the reactor's workers. Events go into
+ queues: one queue runs its events in order and never on two workers at once,
+ so e.g. one output file needs no locking, while different queues run in
+ parallel, higher priority queues first. A worker takes a batch of events
+ from a queue and runs them back to back.
+
+ Idle workers block in epoll_wait() on an eventfd, there is no polling.
+ requestStop() only sets a flag and writes an eventfd, so it may be called
+ from a signal handler; wait() returns on it, for the main thread to tear
+ down, and workers stop after the batch they are running. stop() then
+ drains what is left, so nothing posted before is lost.
+ */
+class EventReactor {
+ public:
+  explicit EventReactor(const EventReactorConfig& config);
+  ~EventReactor();
+
+  bool start();
+  // Events for queues that were not added are rejected
+  void addQueue(int queueId, EVENT_PRIORITY priority);
+  // Returns false after stop was requested
+  bool post(int queueId, std::function<void()> event);
+
+  // Async-signal-safe
+  void requestStop();
+  bool stopRequested() const { return stop_requested_; }
+  // Blocks until requestStop()
+  void wait();
+  // Requests stop and joins the workers, then runs the events still queued
+  // on the calling thread
+  void stop();
+
+  EventReactorStats getStats();
+
+ private:
+  struct EventQueue {
+    EVENT_PRIORITY priority = EVENT_PRIORITY_NORMAL;
+    std::deque<std::function<void()>> events;
+    // on a ready list, or taken by a worker
+    bool scheduled = false;
+  };
+
+  void workerLoop();
+  // Under mutex_, a queue id or -1
+  int takeReadyQueue();
+  void wakeWorker();
+
+  EventReactorConfig config_;
+  int epoll_fd_;
+  int work_fd_;
+  int stop_fd_;
+  std::atomic<bool> stop_requested_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::map<int, EventQueue> queues_;
+  std::deque<int> ready_[EVENT_PRIORITY_COUNT];
+  EventReactorStats stats_;
+};
@@ -0,0 +1,92 @@
+#include "helper_capture_parser.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/log.h"
+
+HelperCaptureFileParser::HelperCaptureFileParser(const char* filepath)
+    : file_path_(filepath), data_offset_(CAPTURE_FILE_MAGIC_SIZE), data_size_(0),
+      data_buffer_(nullptr) {}
+
+HelperCaptureFileParser::~HelperCaptureFileParser() {
+  if (data_buffer_) {
+    // unmap the file
+    if ((munmap((void*)data_buffer_, data_size_)) == -1) {
+      perror("munmap");
+    }
+  }
+}
+
+bool HelperCaptureFileParser::initialize() {
+  int fd;
+  struct stat sb;
+  void* mapped;
+
+  if ((fd = open(file_path_.c_str(), O_RDONLY)) < 0) {
+    perror(file_path_.c_str());
+    return false;
+  }
+
+  // get the file property
+  if ((fstat(fd, &sb)) == -1) {
+    perror("fstat");
+    close(fd);
+    return false;
+  }
+  if (sb.st_size < CAPTURE_FILE_MAGIC_SIZE) {
+    AG_LOG(ERROR, "%s is not a capture file", file_path_.c_str());
+    close(fd);
+    return false;
+  }
+
+  // map the file to process address space
+  if ((mapped = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == (void*)-1) {
+    perror("mmap");
+    close(fd);
+    return false;
+  }
+  close(fd);
+
+  data_size_ = sb.st_size;
+  data_buffer_ = (uint8_t*)mapped;
+  if (memcmp(data_buffer_, CAPTURE_FILE_MAGIC, CAPTURE_FILE_MAGIC_SIZE) != 0) {
+    AG_LOG(ERROR, "%s is not a capture file", file_path_.c_str());
+    return false;
+  }
+  // replay reads the file front to back
+  madvise(data_buffer_, data_size_, MADV_SEQUENTIAL);
+  AG_LOG(INFO, "Open capture file %s successfully", file_path_.c_str());
+  return true;
+}
+
+void HelperCaptureFileParser::setFileParseRestart() { data_offset_ = CAPTURE_FILE_MAGIC_SIZE; }
+
+std::unique_ptr<HelperCaptureRecord> HelperCaptureFileParser::getRecord() {
+  std::unique_ptr<HelperCaptureRecord> record;
+  if (!data_buffer_) {
+    return record;
+  }
+
+  // a capture cut short by a crash ends with a partial record
+  if (data_offset_ + sizeof(HelperCaptureRecordHeader) > data_size_) {
+    AG_LOG(INFO, "End of capture file, offset:%zu, size:%zu", data_offset_, data_size_);
+    data_offset_ = CAPTURE_FILE_MAGIC_SIZE;
+    return record;
+  }
+  HelperCaptureRecordHeader header;
+  memcpy(&header, data_buffer_ + data_offset_, sizeof(header));
+  if (data_offset_ + sizeof(header) + header.length > data_size_) {
+    AG_LOG(INFO, "End of capture file, offset:%zu, size:%zu", data_offset_, data_size_);
+    data_offset_ = CAPTURE_FILE_MAGIC_SIZE;
+    return record;
+  }
+
+  record.reset(new HelperCaptureRecord{header, data_buffer_ + data_offset_ + sizeof(header),
+                                       static_cast<int>(header.length)});
+  data_offset_ += sizeof(header) + header.length;
+  return record;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+// Send capture file, written by SendCaptureWriter: the magic below, then one
+// record per frame handed to the SDK, each a HelperCaptureRecordHeader
+// followed by the frame bytes. Little endian.
+#define CAPTURE_FILE_MAGIC "AGSNDCAP"
+#define CAPTURE_FILE_MAGIC_SIZE (8)
+
+enum HelperCaptureTrackType {
+  CAPTURE_ENCODED_VIDEO = 1,  // sendEncodedVideoImage
+  CAPTURE_PCM_AUDIO = 2,      // sendAudioPcmData
+  CAPTURE_ENCODED_AUDIO = 3,  // sendEncodedAudioFrame
+};
+
+#define CAPTURE_FLAG_KEY_FRAME (0x01)
+
+struct HelperCaptureRecordHeader {
+  int64_t timestampUs;  // since the capture started
+  uint32_t length;
+  uint8_t trackType;
+  uint8_t trackId;
+  uint8_t codec;  // VIDEO_CODEC_TYPE or AUDIO_CODEC_TYPE
+  uint8_t flags;
+  uint16_t width;
+  uint16_t height;
+  uint16_t framesPerSecond;
+  uint16_t channels;
+  uint32_t sampleRate;
+  uint32_t samplesPerChannel;
+};
+static_assert(sizeof(HelperCaptureRecordHeader) == 32, "capture record header must stay 32 bytes");
+
+struct HelperCaptureRecord {
+  HelperCaptureRecordHeader header;
+  // points into the mapped file, valid as long as the parser
+  const uint8_t* buffer;
+  int bufferLen;
+};
+
+class HelperCaptureFileParser {
+ public:
+  HelperCaptureFileParser(const char* filepath);
+  ~HelperCaptureFileParser();
+
+  bool initialize();
+  // Returns nullptr at the end of the file and starts over on the next call
+  std::unique_ptr<HelperCaptureRecord> getRecord();
+  void setFileParseRestart();
+
+ private:
+  std::string file_path_;
+  size_t data_offset_;
+  size_t data_size_;
+  uint8_t* data_buffer_;
+};
@@ -0,0 +1,100 @@
+#include "helper_h264_ladder.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "common/log.h"
+
+bool HelperH264Ladder::parseRenditions(const std::string& spec,
+                                       std::vector<HelperH264Rendition>& renditions) {
+  renditions.clear();
+  std::istringstream stream(spec);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    size_t at = item.rfind('@');
+    int bitrate = at == std::string::npos ? 0 : atoi(item.c_str() + at + 1);
+    if (at == 0 || bitrate <= 0) {
+      AG_LOG(ERROR, "Bad rendition '%s', expect file@bps", item.c_str());
+      return false;
+    }
+    renditions.push_back({item.substr(0, at), bitrate});
+  }
+  std::sort(renditions.begin(), renditions.end(),
+            [](const HelperH264Rendition& a, const HelperH264Rendition& b) {
+              return a.bitrateBps < b.bitrateBps;
+            });
+  return !renditions.empty();
+}
+
+HelperH264Ladder::HelperH264Ladder(const std::vector<HelperH264Rendition>& renditions)
+    : renditions_(renditions), frame_count_(0), position_(0), level_(0) {}
+
+bool HelperH264Ladder::initialize(int initialLevel) {
+  for (const auto& rendition : renditions_) {
+    std::unique_ptr<HelperH264FileParser> parser(
+        new HelperH264FileParser(rendition.filePath.c_str()));
+    if (!parser->initialize() || !parser->buildIndex()) {
+      AG_LOG(ERROR, "Failed to index rendition %s", rendition.filePath.c_str());
+      return false;
+    }
+    if (!parser->isKeyFrameAt(0)) {
+      AG_LOG(ERROR, "Rendition %s does not start with a keyframe", rendition.filePath.c_str());
+      return false;
+    }
+    // frames past the shortest file could not be switched to or from
+    if (parsers_.empty() || parser->frameCount() < frame_count_) {
+      frame_count_ = parser->frameCount();
+    }
+    AG_LOG(INFO, "Rendition %d: %s, %d bps, %zu frames", static_cast<int>(parsers_.size()),
+           rendition.filePath.c_str(), rendition.bitrateBps, parser->frameCount());
+    parsers_.push_back(std::move(parser));
+  }
+  if (parsers_.empty()) {
+    return false;
+  }
+  level_ = std::max(0, std::min(initialLevel, static_cast<int>(parsers_.size()) - 1));
+  return true;
+}
+
+std::vector<int> HelperH264Ladder::bitrates() const {
+  std::vector<int> bitrates;
+  for (const auto& rendition : renditions_) {
+    bitrates.push_back(rendition.bitrateBps);
+  }
+  return bitrates;
+}
+
+std::unique_ptr<HelperH264Frame> HelperH264Ladder::getH264Frame(int wantedLevel) {
+  if (parsers_.empty()) {
+    return nullptr;
+  }
+  if (position_ >= frame_count_) {
+    position_ = 0;
+  }
+  wantedLevel = std::max(0, std::min(wantedLevel, static_cast<int>(parsers_.size()) - 1));
+  if (wantedLevel != level_ && parsers_[wantedLevel]->isKeyFrameAt(position_)) {
+    AG_LOG(INFO, "Switch rendition %d -> %d at frame %zu", level_, wantedLevel, position_);
+    level_ = wantedLevel;
+  }
+  HelperH264FileParser& parser = *parsers_[level_];
+  if (parser.framePosition() != position_) {
+    parser.seekToFrame(position_);
+  }
+  ++position_;
+  return parser.getH264Frame();
+}
+
+void HelperH264Ladder::skipToKeyFrame() {
+  if (parsers_.empty()) {
+    return;
+  }
+  HelperH264FileParser& parser = *parsers_[level_];
+  while (position_ < frame_count_ && !parser.isKeyFrameAt(position_)) {
+    ++position_;
+  }
+  if (position_ >= frame_count_) {
+    position_ = 0;
+  }
+}
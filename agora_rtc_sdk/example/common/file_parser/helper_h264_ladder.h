@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "helper_h264_parser.h"
+
+struct HelperH264Rendition {
+  std::string filePath;
+  int bitrateBps;
+};
+
+/**
+ The same content encoded at several bitrates, one H.264 file per rendition,
+ read as one stream that can change rendition between frames.
+
+ Every file is indexed at initialize(), from its .idx file or a scan, so all
+ renditions are kept at the same frame number and a switch lands on the
+ frame that would have come next anyway. A switch only happens where the
+ target rendition has a keyframe, which is where GOPs of a ladder encoded
+ with a fixed GOP line up; until then the current rendition keeps playing.
+ */
+class HelperH264Ladder {
+ public:
+  // "file@bps,file@bps,...", sorted by bitrate on return
+  static bool parseRenditions(const std::string& spec,
+                              std::vector<HelperH264Rendition>& renditions);
+
+  explicit HelperH264Ladder(const std::vector<HelperH264Rendition>& renditions);
+
+  bool initialize(int initialLevel);
+
+  std::vector<int> bitrates() const;
+  int level() const { return level_; }
+
+  // The next frame, from wantedLevel if it can be switched to at this frame
+  std::unique_ptr<HelperH264Frame> getH264Frame(int wantedLevel);
+  // Moves to the next keyframe of the current rendition, e.g. for an intra
+  // request
+  void skipToKeyFrame();
+
+ private:
+  std::vector<HelperH264Rendition> renditions_;
+  std::vector<std::unique_ptr<HelperH264FileParser>> parsers_;
+  size_t frame_count_;
+  size_t position_;
+  int level_;
+};
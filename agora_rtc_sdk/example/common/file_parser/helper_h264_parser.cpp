@@ -1,6 +1,7 @@
 #include "helper_h264_parser.h"
 
 #include <fcntl.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -96,8 +97,23 @@ int exp_golomb_decode(uint8_t *buffer, int size, int &bitOffset)
 	return (1 << leadingZeroBits) - 1 + offset;
 }
 
+bool isH264IntraSlice(uint8_t nalType, const uint8_t *sliceHeader, int size)
+{
+	if (nalType == 5) { // IDR
+		return true;
+	}
+	if (nalType != 1 || size <= 0) {
+		return false;
+	}
+	int bitOffset = 0;
+	uint8_t *buffer = const_cast<uint8_t *>(sliceHeader);
+	exp_golomb_decode(buffer, size, bitOffset); // first_mb_in_slice
+	int slice_type = exp_golomb_decode(buffer, size, bitOffset) % 5;
+	return slice_type == 2 || slice_type == 4; // I or SI slice
+}
+
 HelperH264FileParser::HelperH264FileParser(const char *filepath)
-		: file_path_(filepath), data_buffer_(nullptr), data_offset_(0)
+		: file_path_(filepath), data_buffer_(nullptr), data_offset_(0), index_pos_(0)
 {
 }
 
@@ -140,12 +156,44 @@ bool HelperH264FileParser::initialize()
 
 	data_size_ = sb.st_size;
 	data_buffer_ = (uint8_t *)mapped;
+	loadIndex();
 	return true;
 }
 
+bool HelperH264FileParser::loadIndex()
+{
+	// one "offset length timestamp_ms key" line per frame, as AnnexBMuxer writes it
+	std::string indexPath = file_path_ + ".idx";
+	FILE *file = fopen(indexPath.c_str(), "r");
+	if (!file) {
+		return false;
+	}
+	char line[128];
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '#') {
+			continue;
+		}
+		long long offset, length, timestamp;
+		int key;
+		if (sscanf(line, "%lld %lld %lld %d", &offset, &length, &timestamp, &key) != 4 ||
+			offset < 0 || length <= 0 || offset + length > data_size_) {
+			AG_LOG(WARNING, "Ignore index %s, bad entry: %s", indexPath.c_str(), line);
+			index_.clear();
+			break;
+		}
+		index_.push_back({ (int)offset, (int)length, key != 0 });
+	}
+	fclose(file);
+	if (!index_.empty()) {
+		AG_LOG(INFO, "Read %zu frames from index %s", index_.size(), indexPath.c_str());
+	}
+	return !index_.empty();
+}
+
 void HelperH264FileParser::setFileParseRestart()
 {
 	data_offset_ = 0;
+	index_pos_ = 0;
 }
 
 void HelperH264FileParser::_getH264Frame(std::unique_ptr<HelperH264Frame> &h264Frame,
@@ -162,12 +210,31 @@ void HelperH264FileParser::_getH264Frame(std::unique_ptr<HelperH264Frame> &h264F
 std::unique_ptr<HelperH264Frame> HelperH264FileParser::getH264Frame()
 {
 	std::unique_ptr<HelperH264Frame> h264Frame = nullptr;
+	if (!index_.empty()) {
+		if (index_pos_ == index_.size()) {
+			AG_LOG(INFO, "End of video file, frames:%zu", index_.size());
+			index_pos_ = 0;
+			return h264Frame;
+		}
+		const IndexEntry &entry = index_[index_pos_++];
+		_getH264Frame(h264Frame, entry.isKeyFrame, entry.offset, entry.offset + entry.length - 1);
+		return h264Frame;
+	}
+	int frame_start = 0;
+	int frame_end = 0;
+	bool is_key_frame = false;
+	if (_nextH264Frame(frame_start, frame_end, is_key_frame)) {
+		_getH264Frame(h264Frame, is_key_frame, frame_start, frame_end);
+	}
+	return h264Frame;
+}
+
+bool HelperH264FileParser::_nextH264Frame(int &frame_start, int &frame_end, bool &key_frame)
+{
 	uint8_t nal_type = 0;
 	int nal_start = 0;
 	int nal_end = 0;
 	bool is_key_frame = false, is_sps = false, is_pps = false;
-	int frame_start = 0;
-	int frame_end = 0;
 	int ret;
 
 	// get first nalu for frame_start
@@ -176,7 +243,7 @@ std::unique_ptr<HelperH264Frame> HelperH264FileParser::getH264Frame()
 	if (ret == 0) {
 		AG_LOG(INFO, "End of video file, offset:%d, size:%d", data_offset_, data_size_);
 		data_offset_ = 0;
-		return h264Frame;
+		return false;
 	}
 	if (nal_type == 8) {
 		is_pps = true;
@@ -200,7 +267,7 @@ std::unique_ptr<HelperH264Frame> HelperH264FileParser::getH264Frame()
 		if (ret == 0) {
 			AG_LOG(INFO, "End of video file, offset:%d, size:%d", data_offset_, data_size_);
 			data_offset_ = 0;
-			return h264Frame;
+			return false;
 		}
 	}
 	int offset = data_offset_ + nal_start;
@@ -209,20 +276,10 @@ std::unique_ptr<HelperH264Frame> HelperH264FileParser::getH264Frame()
 	int bitOffset = 0;
 	int first_mb_in_slice =
 			exp_golomb_decode(&data_buffer_[offset], data_size_ - offset, bitOffset);
-	int slice_type = exp_golomb_decode(&data_buffer_[offset], data_size_ - offset, bitOffset);
-
-	if (nal_type == 5) { // IDR
-		is_key_frame = true;
-	} else {
-		slice_type %= 5;
-		if (slice_type == 2 || slice_type == 4) { // I SLICE
-			is_key_frame = true;
-		} else { // P SLICE
-			is_key_frame = false;
-		}
-	}
+	is_key_frame = isH264IntraSlice(nal_type, &data_buffer_[offset], data_size_ - offset);
 	int prev_first_mb_in_slice = first_mb_in_slice;
 	int prev_nal_type = nal_type;
+	key_frame = is_key_frame && is_pps && is_sps;
 
 	// judge the slice is the last slice in a frame or not
 	while (true) {
@@ -244,16 +301,70 @@ std::unique_ptr<HelperH264Frame> HelperH264FileParser::getH264Frame()
 		if (ret == 0) {
 			AG_LOG(INFO, "End of video file, offset:%d, size:%d", data_offset_, data_size_);
 			//printf("num_I is %d,num_P is %d",num_I,num_P);
-			_getH264Frame(h264Frame, is_key_frame && is_pps && is_sps, frame_start, frame_end);
+			// the last frame runs to the end of the file
+			frame_end = data_size_ - 1;
 			data_offset_ = 0;
-			return h264Frame;
+			return true;
 		}
 	}
 
 	frame_end = data_offset_ - 1;
 	//frame_end = data_offset_ + nal_end;
 	//data_offset_ += nal_end + 1;
-	_getH264Frame(h264Frame, is_key_frame && is_pps && is_sps, frame_start, frame_end);
+	return true;
+}
 
-	return h264Frame;
+bool HelperH264FileParser::buildIndex()
+{
+	if (!index_.empty()) {
+		return true;
+	}
+	// one pass over the mapped file, nothing is copied
+	std::vector<IndexEntry> index;
+	int saved_offset = data_offset_;
+	data_offset_ = 0;
+	int frame_start = 0;
+	int frame_end = 0;
+	bool is_key_frame = false;
+	do {
+		if (!_nextH264Frame(frame_start, frame_end, is_key_frame)) {
+			break;
+		}
+		index.push_back({ frame_start, frame_end - frame_start + 1, is_key_frame });
+	} while (data_offset_ != 0);
+	data_offset_ = saved_offset;
+	if (index.empty()) {
+		return false;
+	}
+	index_.swap(index);
+	index_pos_ = 0;
+	AG_LOG(INFO, "Indexed %zu frames of %s", index_.size(), file_path_.c_str());
+	return true;
+}
+
+bool HelperH264FileParser::isKeyFrameAt(size_t frame) const
+{
+	return frame < index_.size() && index_[frame].isKeyFrame;
+}
+
+bool HelperH264FileParser::seekToFrame(size_t frame)
+{
+	if (frame >= index_.size()) {
+		return false;
+	}
+	index_pos_ = frame;
+	return true;
+}
+
+bool HelperH264FileParser::seekToNextKeyFrame()
+{
+	if (index_.empty()) {
+		return false;
+	}
+	size_t frame = index_pos_;
+	while (frame < index_.size() && !index_[frame].isKeyFrame) {
+		frame++;
+	}
+	index_pos_ = frame < index_.size() ? frame : 0;
+	return true;
 }
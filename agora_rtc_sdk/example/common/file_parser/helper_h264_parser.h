@@ -1,5 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
 #include <memory>
 #include <string>
+#include <vector>
+
+// Whether a slice NAL unit of nalType makes an intra picture, from the
+// exp-Golomb coded slice header after the NAL header byte
+bool isH264IntraSlice(uint8_t nalType, const uint8_t* sliceHeader, int size);
 
 struct HelperH264Frame {
   bool isKeyFrame;
@@ -16,12 +25,34 @@ class HelperH264FileParser {
   bool initialize();
   void setFileParseRestart();
 
+  // Scans the file once for frame boundaries when there is no .idx file, so
+  // frames can be looked up by number. The scan does not copy frames.
+  bool buildIndex();
+  // Only with an index
+  size_t frameCount() const { return index_.size(); }
+  size_t framePosition() const { return index_pos_; }
+  bool isKeyFrameAt(size_t frame) const;
+  bool seekToFrame(size_t frame);
+  // To the first keyframe from the current frame on, wrapping to the start
+  bool seekToNextKeyFrame();
+
  private:
   void _getH264Frame(std::unique_ptr<HelperH264Frame>& h264Frame, bool is_key_frame,
                      int frame_start, int frame_end);
+  bool _nextH264Frame(int& frame_start, int& frame_end, bool& key_frame);
+  bool loadIndex();
+
+  struct IndexEntry {
+    int offset;
+    int length;
+    bool isKeyFrame;
+  };
 
   std::string file_path_;
   int data_offset_;
   int data_size_;
   uint8_t* data_buffer_;
+  // frames listed in <file>.idx, if there is one
+  std::vector<IndexEntry> index_;
+  size_t index_pos_;
 };
@@ -1,6 +1,7 @@
 #include "helper_h265_parser.h"
 
 #include <fcntl.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -96,7 +97,7 @@ int exp_golomb_decode(uint8_t *buffer, int size, int &bitOffset)
 }
 
 HelperH265FileParser::HelperH265FileParser(const char *filepath)
-		: file_path_(filepath), data_buffer_(nullptr), data_offset_(0)
+		: file_path_(filepath), data_buffer_(nullptr), data_offset_(0), index_pos_(0)
 {
 }
 
@@ -139,12 +140,44 @@ bool HelperH265FileParser::initialize()
 
 	data_size_ = sb.st_size;
 	data_buffer_ = (uint8_t *)mapped;
+	loadIndex();
 	return true;
 }
 
+bool HelperH265FileParser::loadIndex()
+{
+	// one "offset length timestamp_ms key" line per frame, as AnnexBMuxer writes it
+	std::string indexPath = file_path_ + ".idx";
+	FILE *file = fopen(indexPath.c_str(), "r");
+	if (!file) {
+		return false;
+	}
+	char line[128];
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '#') {
+			continue;
+		}
+		long long offset, length, timestamp;
+		int key;
+		if (sscanf(line, "%lld %lld %lld %d", &offset, &length, &timestamp, &key) != 4 ||
+			offset < 0 || length <= 0 || offset + length > data_size_) {
+			AG_LOG(WARNING, "Ignore index %s, bad entry: %s", indexPath.c_str(), line);
+			index_.clear();
+			break;
+		}
+		index_.push_back({ (int)offset, (int)length, key != 0 });
+	}
+	fclose(file);
+	if (!index_.empty()) {
+		AG_LOG(INFO, "Read %zu frames from index %s", index_.size(), indexPath.c_str());
+	}
+	return !index_.empty();
+}
+
 void HelperH265FileParser::setFileParseRestart()
 {
 	data_offset_ = 0;
+	index_pos_ = 0;
 }
 
 void HelperH265FileParser::_getH265Frame(std::unique_ptr<HelperH265Frame> &h265Frame,
@@ -161,6 +194,16 @@ void HelperH265FileParser::_getH265Frame(std::unique_ptr<HelperH265Frame> &h265F
 std::unique_ptr<HelperH265Frame> HelperH265FileParser::getH265Frame()
 {
 	std::unique_ptr<HelperH265Frame> h265Frame = nullptr;
+	if (!index_.empty()) {
+		if (index_pos_ == index_.size()) {
+			AG_LOG(INFO, "End of video file, frames:%zu", index_.size());
+			index_pos_ = 0;
+			return h265Frame;
+		}
+		const IndexEntry &entry = index_[index_pos_++];
+		_getH265Frame(h265Frame, entry.isKeyFrame, entry.offset, entry.offset + entry.length - 1);
+		return h265Frame;
+	}
 	uint8_t nal_type = 0;
 	int nal_start = 0;
 	int nal_end = 0;
@@ -1,5 +1,6 @@
 #include <memory>
 #include <string>
+#include <vector>
 
 struct HelperH265Frame {
   bool isKeyFrame;
@@ -19,9 +20,19 @@ class HelperH265FileParser {
  private:
   void _getH265Frame(std::unique_ptr<HelperH265Frame>& h265Frame, bool is_key_frame,
                      int frame_start, int frame_end);
+  bool loadIndex();
+
+  struct IndexEntry {
+    int offset;
+    int length;
+    bool isKeyFrame;
+  };
 
   std::string file_path_;
   int data_offset_;
   int data_size_;
   uint8_t* data_buffer_;
+  // frames listed in <file>.idx, if there is one
+  std::vector<IndexEntry> index_;
+  size_t index_pos_;
 };
@@ -0,0 +1,30 @@
+#include "helper_opus_packet.h"
+
+int opusPacketSamples(const uint8_t* packet, size_t length) {
+  static const int silk[] = {480, 960, 1920, 2880};
+  static const int hybrid[] = {480, 960};
+  static const int celt[] = {120, 240, 480, 960};
+  if (length < 1) {
+    return 0;
+  }
+  uint8_t config = packet[0] >> 3;
+  int frameSamples = config < 12 ? silk[config & 0x3]
+                                 : (config < 16 ? hybrid[config & 0x1] : celt[config & 0x3]);
+  int frames = 1;
+  switch (packet[0] & 0x3) {
+    case 0:
+      frames = 1;
+      break;
+    case 1:
+    case 2:
+      frames = 2;
+      break;
+    default:
+      if (length < 2) {
+        return 0;
+      }
+      frames = packet[1] & 0x3f;
+      break;
+  }
+  return frames * frameSamples;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Samples per channel at 48 kHz carried by an Opus packet, from its TOC byte
+// and frame count (RFC 6716, 3.1), 0 if malformed
+int opusPacketSamples(const uint8_t* packet, size_t length);
@@ -1,44 +1,39 @@
 #include "helper_opus_parser.h"
 
-#include <opusfile.h>
+#include <fcntl.h>
+#include <ogg/ogg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <cstring>
-#include <vector>
 
 #include "common/log.h"
+#include "helper_opus_packet.h"
 
-struct decode_context {
-  int current_packet{0};
-  int total_length{0};
-
-  int nsamples{0};
-  int nchannels;
-  int format;
-
-  unsigned char packet[960 * 2 * 2]{0};
-  long bytes{0};
-  long b_o_s{0};
-  long e_o_s{0};
-
-  ogg_int64_t granulepos;
-  ogg_int64_t packetno;
-};
+#define OPUS_HEAD_MIN_SIZE (19)
+#define OGG_READ_CHUNK_SIZE (64 * 1024)
 
+/**
+ Ogg demuxer that hands out the encoded Opus packets of the first Opus logical
+ stream in a file. Nothing is decoded: the packets are returned exactly as they
+ were muxed, together with their granule position.
+ */
 class OggOpusFileParser {
  public:
   explicit OggOpusFileParser(const char* filepath);
   virtual ~OggOpusFileParser();
 
  public:
-  // AudioFileParser
   bool open();
-  bool hasNext();
 
-  void getNext(char* buffer, int* length);
+  // Get the next audio packet. The packet data is owned by libogg and is valid
+  // until the next call. Returns false at the end of the stream.
+  bool readPacket(ogg_packet& packet);
 
   agora::rtc::AUDIO_CODEC_TYPE getCodecType();
   int getSampleRateHz();
@@ -46,99 +41,188 @@ class OggOpusFileParser {
   int reset();
 
  private:
-  void loadMetaInfo(OggOpusFile* oggOpusFile);
+  bool readPage(ogg_page& page);
+  bool readHeaders();
+  bool parseOpusHead(const ogg_packet& packet);
 
  private:
-  char* oggOpusFilePath_;
-  OggOpusFile* oggOpusFile_;
+  std::string filePath_;
+  uint8_t* data_buffer_;
+  long data_size_;
+  long data_offset_;
+
+  ogg_sync_state sync_;
+  ogg_stream_state stream_;
+  bool streamInitialized_;
+  bool eos_;
+
   int sampleRateHz_;
   int numberOfChannels_;
-  decode_context decode_context_;
-  bool eof;
+  int preSkip_;
 };
 
-int op_decode_cb(void* ctx, OpusMSDecoder* decoder, void* pcm, const ogg_packet* op, int nsamples,
-                 int nchannels, int format, int li) {
-  struct decode_context* context = (struct decode_context*)ctx;
-  context->nsamples = nsamples;
-  context->nchannels = nchannels;
-  context->format = format;
-
-  context->b_o_s = op->b_o_s;
-  context->e_o_s = op->e_o_s;
-  context->bytes = op->bytes;
-  context->granulepos = op->granulepos;
-  context->packetno = op->packetno;
-  memcpy(context->packet, op->packet, op->bytes);
-
-  context->total_length += op->bytes;
-  ++context->current_packet;
-
-  (void)pcm;
-  (void)decoder;
-  (void)li;
-
-  return 0;
-}
-
 OggOpusFileParser::OggOpusFileParser(const char* filepath)
-    : oggOpusFilePath_(strdup(filepath)),
-      oggOpusFile_(nullptr),
+    : filePath_(filepath),
+      data_buffer_(nullptr),
+      data_size_(0),
+      data_offset_(0),
+      streamInitialized_(false),
+      eos_(false),
       sampleRateHz_(48000),
       numberOfChannels_(0),
-      eof(false) {}
+      preSkip_(0) {
+  ogg_sync_init(&sync_);
+}
 
 OggOpusFileParser::~OggOpusFileParser() {
-  if (oggOpusFile_) {
-    op_free(oggOpusFile_);
+  if (streamInitialized_) {
+    ogg_stream_clear(&stream_);
   }
-  free(static_cast<void*>(oggOpusFilePath_));
-}
-
-void OggOpusFileParser::loadMetaInfo(OggOpusFile* oggOpusFile) {
-  const OpusHead* head = op_head(oggOpusFile, -1);
-  numberOfChannels_ = head->channel_count;
-  sampleRateHz_ = head->input_sample_rate;
-  if (op_seekable(oggOpusFile)) {
+  ogg_sync_clear(&sync_);
+  if (data_buffer_) {
+    // unmap the file
+    if ((munmap((void*)data_buffer_, data_size_)) == -1) {
+      perror("munmap");
+    }
   }
 }
 
 bool OggOpusFileParser::open() {
-  int ret = 0;
-  oggOpusFile_ = op_open_file(oggOpusFilePath_, &ret);
-  if (oggOpusFile_) {
-    op_set_decode_callback(oggOpusFile_, op_decode_cb, &decode_context_);
-    loadMetaInfo(oggOpusFile_);
+  int fd;
+  struct stat sb;
+  void* mapped;
+
+  if ((fd = ::open(filePath_.c_str(), O_RDONLY)) < 0) {
+    perror(filePath_.c_str());
+    return false;
+  }
+
+  // get the file property
+  if ((fstat(fd, &sb)) == -1) {
+    perror("fstat");
+    close(fd);
+    return false;
+  }
+
+  // map the file to process address space
+  if ((mapped = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == (void*)-1) {
+    perror("mmap");
+    close(fd);
+    return false;
   }
-  return oggOpusFile_ != nullptr;
+  close(fd);
+  madvise(mapped, sb.st_size, MADV_SEQUENTIAL);
+
+  data_size_ = sb.st_size;
+  data_buffer_ = (uint8_t*)mapped;
+  return readHeaders();
 }
 
-int OggOpusFileParser::reset() {
-  int ret = 0;
-  if (oggOpusFile_) {
-    ret = op_pcm_seek(oggOpusFile_, 0);
-    eof = false;
+bool OggOpusFileParser::readPage(ogg_page& page) {
+  while (ogg_sync_pageout(&sync_, &page) != 1) {
+    if (data_offset_ >= data_size_) {
+      return false;
+    }
+    long bytes = data_size_ - data_offset_;
+    if (bytes > OGG_READ_CHUNK_SIZE) {
+      bytes = OGG_READ_CHUNK_SIZE;
+    }
+    char* buffer = ogg_sync_buffer(&sync_, bytes);
+    if (!buffer) {
+      return false;
+    }
+    memcpy(buffer, &data_buffer_[data_offset_], bytes);
+    ogg_sync_wrote(&sync_, bytes);
+    data_offset_ += bytes;
   }
-  return ret;
+  return true;
 }
 
-bool OggOpusFileParser::hasNext() {
-  opus_int16 pcm[120 * 48 * 2];
-  int ret = op_read_stereo(oggOpusFile_, pcm, sizeof(pcm) / sizeof(*pcm));
-  return ret >= 0 && !eof;
+bool OggOpusFileParser::parseOpusHead(const ogg_packet& packet) {
+  if (packet.bytes < OPUS_HEAD_MIN_SIZE || memcmp(packet.packet, "OpusHead", 8) != 0) {
+    return false;
+  }
+  const unsigned char* head = packet.packet;
+  numberOfChannels_ = head[9];
+  preSkip_ = head[10] | (head[11] << 8);
+  sampleRateHz_ = head[12] | (head[13] << 8) | (head[14] << 16) | ((uint32_t)head[15] << 24);
+  return numberOfChannels_ > 0;
 }
 
-void OggOpusFileParser::getNext(char* buffer, int* length) {
-  if (*length > decode_context_.bytes) {
-    memcpy(buffer, decode_context_.packet, decode_context_.bytes);
-    *length = decode_context_.bytes;
+// Find the first Opus BOS page, then consume the OpusHead and OpusTags packets
+bool OggOpusFileParser::readHeaders() {
+  ogg_page page;
+  ogg_packet packet;
 
-    if (decode_context_.e_o_s) {
-      eof = true;
+  while (!streamInitialized_) {
+    if (!readPage(page)) {
+      AG_LOG(ERROR, "No Opus stream found in %s", filePath_.c_str());
+      return false;
     }
+    if (!ogg_page_bos(&page)) {
+      continue;
+    }
+    ogg_stream_init(&stream_, ogg_page_serialno(&page));
+    ogg_stream_pagein(&stream_, &page);
+    if (ogg_stream_packetout(&stream_, &packet) == 1 && parseOpusHead(packet)) {
+      streamInitialized_ = true;
+    } else {
+      // not an Opus logical stream
+      ogg_stream_clear(&stream_);
+    }
+  }
+
+  // OpusTags may span several pages
+  while (true) {
+    int ret = ogg_stream_packetout(&stream_, &packet);
+    if (ret == 1) {
+      break;
+    }
+    if (ret < 0 || !readPage(page)) {
+      AG_LOG(ERROR, "Missing OpusTags in %s", filePath_.c_str());
+      return false;
+    }
+    ogg_stream_pagein(&stream_, &page);
+  }
+  eos_ = false;
+  return true;
+}
+
+bool OggOpusFileParser::readPacket(ogg_packet& packet) {
+  ogg_page page;
+  while (true) {
+    int ret = ogg_stream_packetout(&stream_, &packet);
+    if (ret == 1) {
+      return true;
+    }
+    if (ret < 0) {
+      // hole in the data, the packet is lost; keep going with the next one
+      continue;
+    }
+    if (eos_ || !readPage(page)) {
+      return false;
+    }
+    // pages of other logical streams are ignored
+    if (ogg_page_serialno(&page) != stream_.serialno) {
+      continue;
+    }
+    if (ogg_page_eos(&page)) {
+      eos_ = true;
+    }
+    ogg_stream_pagein(&stream_, &page);
   }
 }
 
+int OggOpusFileParser::reset() {
+  if (streamInitialized_) {
+    ogg_stream_clear(&stream_);
+    streamInitialized_ = false;
+  }
+  ogg_sync_reset(&sync_);
+  data_offset_ = 0;
+  return readHeaders() ? 0 : -1;
+}
+
 agora::rtc::AUDIO_CODEC_TYPE OggOpusFileParser::getCodecType() {
   return agora::rtc::AUDIO_CODEC_OPUS;
 }
@@ -168,28 +252,32 @@ bool HelperOpusFileParser::initialize() {
 
 std::unique_ptr<HelperAudioFrame> HelperOpusFileParser::getAudioFrame(int frameSizeDuration) {
   std::unique_ptr<HelperAudioFrame> audioFrame = nullptr;
-  static uint8_t databuf[8192] = {0};
-  static int length = 8192;
-  static int bytesnum = 0;
-  agora::rtc::EncodedAudioFrameInfo audioFrameInfo;
-  audioFrameInfo.numberOfChannels = file_parser_->getNumberOfChannels();
-  audioFrameInfo.sampleRateHz = file_parser_->getSampleRateHz();
-  audioFrameInfo.codec = file_parser_->getCodecType();
-  // calculate Opus frame size
-  audioFrameInfo.samplesPerChannel = file_parser_->getSampleRateHz() * frameSizeDuration / 1000;
+  ogg_packet packet;
 
-  if (!file_parser_->hasNext()) {
+  if (!file_parser_->readPacket(packet)) {
     file_parser_->reset();
     return nullptr;
   }
-  length = 8192;
-  file_parser_->getNext(reinterpret_cast<char*>(databuf), &length);
-  if (length > 0) {
-    std::unique_ptr<char[]> buffer2(new char[length]);
-    memcpy(buffer2.get(), databuf, length);
-    audioFrame.reset(new HelperAudioFrame{audioFrameInfo, std::move(buffer2), length});
-
-    bytesnum += length;
+  if (packet.bytes <= 0) {
+    return nullptr;
   }
+
+  agora::rtc::EncodedAudioFrameInfo audioFrameInfo;
+  audioFrameInfo.numberOfChannels = file_parser_->getNumberOfChannels();
+  audioFrameInfo.sampleRateHz = file_parser_->getSampleRateHz();
+  audioFrameInfo.codec = file_parser_->getCodecType();
+  // take the Opus frame size from the packet itself, fall back to the configured duration
+  audioFrameInfo.samplesPerChannel = opusPacketSamples(packet.packet, packet.bytes);
+  if (audioFrameInfo.samplesPerChannel <= 0) {
+    audioFrameInfo.samplesPerChannel = file_parser_->getSampleRateHz() * frameSizeDuration / 1000;
+  }
+
+  // libogg owns the packet memory until the next read, so the frame keeps a copy. This is
+  // the second one, after readPage() fed the mapped file into the sync buffer
+  std::unique_ptr<char[]> buffer(new char[packet.bytes]);
+  memcpy(buffer.get(), packet.packet, packet.bytes);
+  audioFrame.reset(new HelperAudioFrame{audioFrameInfo, std::move(buffer), (int)packet.bytes,
+                                        (int64_t)packet.granulepos});
+  sent_audio_frames_++;
   return audioFrame;
 }
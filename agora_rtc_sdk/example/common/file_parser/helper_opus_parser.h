@@ -1,3 +1,6 @@
+#pragma once
+
+#include <memory>
 #include <string>
 
 #include "AgoraBase.h"
@@ -8,6 +11,8 @@ struct HelperAudioFrame {
   agora::rtc::EncodedAudioFrameInfo audioFrameInfo;
   std::unique_ptr<char[]> buffer;
   int bufferLen;
+  // granule position of the Ogg page the packet ends on, -1 if the page ends in another packet
+  int64_t granulePos;
 };
 
 class HelperOpusFileParser {
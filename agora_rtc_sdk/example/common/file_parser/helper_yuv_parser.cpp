@@ -0,0 +1,184 @@
+#include "helper_yuv_parser.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "common/log.h"
+
+// files up to this size are read in completely when they are mapped
+#define YUV_PRELOAD_LIMIT (256 * 1024 * 1024)
+// frames the kernel is asked to read ahead of the one being sent
+#define YUV_READAHEAD_FRAMES (2)
+#define YUV_PREFETCH_WAIT_MS (100)
+
+HelperYuvFileParser::HelperYuvFileParser(const char* filepath, int width, int height,
+                                         int prefetchFrames)
+    : file_path_(filepath),
+      width_(width),
+      height_(height),
+      frame_size_((size_t)width * height * 3 / 2),
+      data_buffer_(nullptr),
+      data_size_(0),
+      frame_count_(0),
+      next_frame_(0),
+      prefetch_frames_(prefetchFrames),
+      head_(0),
+      tail_(0),
+      holding_(false),
+      stopping_(false),
+      underruns_(0) {}
+
+HelperYuvFileParser::~HelperYuvFileParser() {
+  if (reader_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cond_.notify_all();
+    reader_.join();
+  }
+  for (auto buffer : pool_) {
+    free(buffer);
+  }
+  if (data_buffer_) {
+    // unmap the file
+    if ((munmap((void*)data_buffer_, data_size_)) == -1) {
+      perror("munmap");
+    }
+  }
+}
+
+bool HelperYuvFileParser::initialize() {
+  int fd;
+  struct stat sb;
+  void* mapped;
+
+  if (frame_size_ == 0) {
+    AG_LOG(ERROR, "Invalid video size %dx%d", width_, height_);
+    return false;
+  }
+
+  if ((fd = open(file_path_.c_str(), O_RDONLY)) < 0) {
+    perror(file_path_.c_str());
+    return false;
+  }
+
+  // get the file property
+  if ((fstat(fd, &sb)) == -1) {
+    perror("fstat");
+    close(fd);
+    return false;
+  }
+  if ((size_t)sb.st_size < frame_size_) {
+    AG_LOG(ERROR, "Video file %s is smaller than one %dx%d frame", file_path_.c_str(), width_,
+           height_);
+    close(fd);
+    return false;
+  }
+
+  // map the file to process address space, small files are faulted in right away
+  int flags = MAP_PRIVATE;
+  if (sb.st_size <= YUV_PRELOAD_LIMIT) {
+    flags |= MAP_POPULATE;
+  }
+  if ((mapped = mmap(NULL, sb.st_size, PROT_READ, flags, fd, 0)) == (void*)-1) {
+    perror("mmap");
+    close(fd);
+    return false;
+  }
+  close(fd);
+  madvise(mapped, sb.st_size, MADV_SEQUENTIAL);
+
+  data_buffer_ = (uint8_t*)mapped;
+  data_size_ = sb.st_size;
+  // a trailing partial frame is ignored
+  frame_count_ = data_size_ / frame_size_;
+
+  if (prefetch_frames_ > 0) {
+    // one buffer is held by the caller while the others are being filled
+    int poolSize = prefetch_frames_ < 2 ? 2 : prefetch_frames_;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < poolSize; ++i) {
+      void* buffer = nullptr;
+      if (posix_memalign(&buffer, pageSize, frame_size_) != 0) {
+        AG_LOG(ERROR, "Failed to allocate %zu bytes for video frame pool", frame_size_);
+        return false;
+      }
+      pool_.push_back((uint8_t*)buffer);
+    }
+    reader_ = std::thread(&HelperYuvFileParser::readerLoop, this);
+  }
+  AG_LOG(INFO, "Open video file %s successfully, %ld frames of %dx%d", file_path_.c_str(),
+         frame_count_, width_, height_);
+  return true;
+}
+
+void HelperYuvFileParser::readerLoop() {
+  while (true) {
+    uint64_t slot;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this] {
+        return stopping_ || tail_ - (head_ - (holding_ ? 1 : 0)) < pool_.size();
+      });
+      if (stopping_) {
+        return;
+      }
+      slot = tail_;
+    }
+
+    // page faults and disk reads happen here, not on the sending thread
+    memcpy(pool_[slot % pool_.size()], data_buffer_ + next_frame_ * frame_size_, frame_size_);
+    next_frame_ = (next_frame_ + 1) % frame_count_;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++tail_;
+    }
+    cond_.notify_all();
+  }
+}
+
+const uint8_t* HelperYuvFileParser::getYuvFrame() {
+  if (!data_buffer_) {
+    return nullptr;
+  }
+
+  if (pool_.empty()) {
+    const uint8_t* frame = data_buffer_ + next_frame_ * frame_size_;
+    next_frame_ = (next_frame_ + 1) % frame_count_;
+    // let the kernel read the next frames while this one is being sent
+    int64_t ahead = frame_count_ - next_frame_;
+    if (ahead > YUV_READAHEAD_FRAMES) {
+      ahead = YUV_READAHEAD_FRAMES;
+    }
+    if (ahead > 0) {
+      long pageSize = sysconf(_SC_PAGESIZE);
+      uintptr_t start = (uintptr_t)(data_buffer_ + next_frame_ * frame_size_) & ~(pageSize - 1);
+      uintptr_t end = (uintptr_t)(data_buffer_ + (next_frame_ + ahead) * frame_size_);
+      madvise((void*)start, end - start, MADV_WILLNEED);
+    }
+    return frame;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  // the previously returned buffer can be refilled now
+  holding_ = false;
+  cond_.notify_all();
+  if (!cond_.wait_for(lock, std::chrono::milliseconds(YUV_PREFETCH_WAIT_MS),
+                      [this] { return tail_ > head_; })) {
+    if (++underruns_ % 100 == 1) {
+      AG_LOG(WARNING, "Video file prefetch underrun (%lu)", underruns_);
+    }
+    return nullptr;
+  }
+  holding_ = true;
+  return pool_[head_++ % pool_.size()];
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Raw I420 video file source. The file is memory-mapped once; frames are
+// either handed out as pointers into the mapping, or copied ahead by a reader
+// thread into a small pool of page aligned buffers when prefetchFrames > 0.
+class HelperYuvFileParser {
+ public:
+  HelperYuvFileParser(const char* filepath, int width, int height, int prefetchFrames = 0);
+  ~HelperYuvFileParser();
+
+  bool initialize();
+  // Next frame, wrapping around at the end of the file. The buffer is valid
+  // until the next call. Returns nullptr if the prefetch pool runs dry.
+  const uint8_t* getYuvFrame();
+  int getFrameSize() const { return static_cast<int>(frame_size_); }
+
+ private:
+  void readerLoop();
+
+  std::string file_path_;
+  int width_;
+  int height_;
+  size_t frame_size_;
+  uint8_t* data_buffer_;
+  size_t data_size_;
+  int64_t frame_count_;
+  int64_t next_frame_;
+
+  // prefetch pool, tail_ is filled by the reader, head_ is handed out next
+  int prefetch_frames_;
+  std::vector<uint8_t*> pool_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  uint64_t head_;
+  uint64_t tail_;
+  bool holding_;
+  bool stopping_;
+  uint64_t underruns_;
+  std::thread reader_;
+};
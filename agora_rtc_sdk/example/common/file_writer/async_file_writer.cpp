@@ -0,0 +1,198 @@
+#include "async_file_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/log.h"
+
+AsyncFileWriter::AsyncFileWriter(size_t chunkSize, int maxChunks)
+    : chunk_size_(chunkSize),
+      max_chunks_(maxChunks),
+      open_(false),
+      file_size_(0),
+      queued_chunks_(0),
+      stopping_(false),
+      fd_(-1),
+      writer_(&AsyncFileWriter::writerLoop, this) {}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  close();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_one();
+  writer_.join();
+}
+
+std::unique_ptr<std::vector<uint8_t>> AsyncFileWriter::takeChunk() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!free_chunks_.empty()) {
+    std::unique_ptr<std::vector<uint8_t>> chunk = std::move(free_chunks_.back());
+    free_chunks_.pop_back();
+    return chunk;
+  }
+  std::unique_ptr<std::vector<uint8_t>> chunk(new std::vector<uint8_t>);
+  chunk->reserve(chunk_size_);
+  return chunk;
+}
+
+void AsyncFileWriter::enqueue(Op op) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (op.type == Op::DATA) {
+      ++queued_chunks_;
+    }
+    ops_.push_back(std::move(op));
+  }
+  cond_.notify_one();
+}
+
+void AsyncFileWriter::flushChunk() {
+  if (chunk_ && !chunk_->empty()) {
+    Op op;
+    op.type = Op::DATA;
+    op.data = std::move(chunk_);
+    enqueue(std::move(op));
+  }
+}
+
+void AsyncFileWriter::open(const std::string& filePath) {
+  close();
+  Op op;
+  op.type = Op::OPEN;
+  op.path = filePath;
+  enqueue(std::move(op));
+  open_ = true;
+  file_size_ = 0;
+}
+
+bool AsyncFileWriter::write(const struct iovec* iov, int count) {
+  if (!open_) {
+    return false;
+  }
+  size_t total = 0;
+  for (int i = 0; i < count; ++i) {
+    total += iov[i].iov_len;
+  }
+  size_t pending = chunk_ ? chunk_->size() : 0;
+  int needed = static_cast<int>((pending + total + chunk_size_ - 1) / chunk_size_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queued_chunks_ + needed > max_chunks_) {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < count; ++i) {
+    const uint8_t* data = static_cast<const uint8_t*>(iov[i].iov_base);
+    size_t size = iov[i].iov_len;
+    while (size > 0) {
+      if (!chunk_) {
+        chunk_ = takeChunk();
+      }
+      size_t room = chunk_size_ - chunk_->size();
+      size_t n = size < room ? size : room;
+      chunk_->insert(chunk_->end(), data, data + n);
+      data += n;
+      size -= n;
+      if (chunk_->size() == chunk_size_) {
+        flushChunk();
+      }
+    }
+  }
+  file_size_ += total;
+  return true;
+}
+
+bool AsyncFileWriter::write(const void* data, size_t size) {
+  struct iovec iov = {const_cast<void*>(data), size};
+  return write(&iov, 1);
+}
+
+void AsyncFileWriter::patch(uint64_t offset, const void* data, size_t size) {
+  if (!open_) {
+    return;
+  }
+  // anything buffered goes first, the patch may land in it
+  flushChunk();
+  Op op;
+  op.type = Op::PATCH;
+  op.offset = offset;
+  op.data.reset(new std::vector<uint8_t>(static_cast<const uint8_t*>(data),
+                                         static_cast<const uint8_t*>(data) + size));
+  enqueue(std::move(op));
+}
+
+void AsyncFileWriter::close() {
+  if (!open_) {
+    return;
+  }
+  flushChunk();
+  Op op;
+  op.type = Op::CLOSE;
+  enqueue(std::move(op));
+  open_ = false;
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = ::write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+void AsyncFileWriter::writerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return stopping_ || !ops_.empty(); });
+    // everything queued is carried out before the thread exits
+    if (ops_.empty()) {
+      return;
+    }
+    Op op = std::move(ops_.front());
+    ops_.pop_front();
+    lock.unlock();
+
+    switch (op.type) {
+      case Op::OPEN:
+        if ((fd_ = ::open(op.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+          AG_LOG(ERROR, "Failed to create file %s: %s", op.path.c_str(), strerror(errno));
+        } else {
+          AG_LOG(INFO, "Created file %s", op.path.c_str());
+        }
+        break;
+      case Op::DATA:
+        if (fd_ >= 0 && !writeAll(fd_, op.data->data(), op.data->size())) {
+          AG_LOG(ERROR, "Error writing file: %s", strerror(errno));
+        }
+        break;
+      case Op::PATCH:
+        if (fd_ >= 0 && pwrite(fd_, op.data->data(), op.data->size(), op.offset) < 0) {
+          AG_LOG(ERROR, "Error patching file: %s", strerror(errno));
+        }
+        break;
+      case Op::CLOSE:
+        if (fd_ >= 0) {
+          ::close(fd_);
+          fd_ = -1;
+        }
+        break;
+    }
+
+    lock.lock();
+    if (op.type == Op::DATA) {
+      --queued_chunks_;
+      op.data->clear();
+      free_chunks_.push_back(std::move(op.data));
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Buffered file output from a background thread. Callers append into fixed
+// size chunks; full chunks, opens, header patches and closes are queued in
+// order and carried out by the thread, so the caller never waits on the disk.
+// Once more than maxChunks are waiting a write is refused as a whole instead
+// of growing the backlog.
+class AsyncFileWriter {
+ public:
+  AsyncFileWriter(size_t chunkSize = 1 << 20, int maxChunks = 32);
+  ~AsyncFileWriter();
+
+  // Closes the current file, if any, and starts a new one
+  void open(const std::string& filePath);
+  // All or nothing; returns false if the backlog is full or no file is open
+  bool write(const struct iovec* iov, int count);
+  bool write(const void* data, size_t size);
+  // Overwrites bytes already written, e.g. a length field in a header
+  void patch(uint64_t offset, const void* data, size_t size);
+  void close();
+
+  bool isOpen() const { return open_; }
+  // Bytes written to the current file so far, queued ones included
+  uint64_t fileSize() const { return file_size_; }
+
+ private:
+  struct Op {
+    enum Type { OPEN, DATA, PATCH, CLOSE } type;
+    std::string path;
+    std::unique_ptr<std::vector<uint8_t>> data;
+    uint64_t offset;
+  };
+
+  void flushChunk();
+  void enqueue(Op op);
+  void writerLoop();
+  std::unique_ptr<std::vector<uint8_t>> takeChunk();
+
+  size_t chunk_size_;
+  int max_chunks_;
+
+  // only touched by the calling thread
+  bool open_;
+  uint64_t file_size_;
+  std::unique_ptr<std::vector<uint8_t>> chunk_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Op> ops_;
+  std::vector<std::unique_ptr<std::vector<uint8_t>>> free_chunks_;
+  int queued_chunks_;
+  bool stopping_;
+
+  // only touched by the writer thread
+  int fd_;
+  std::thread writer_;
+};
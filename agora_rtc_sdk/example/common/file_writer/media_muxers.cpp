@@ -0,0 +1,277 @@
+#include "media_muxers.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/log.h"
+
+#define DROP_LOG_INTERVAL (100)
+#define IVF_HEADER_SIZE (32)
+#define IVF_FRAME_HEADER_SIZE (12)
+#define WAV_HEADER_SIZE (44)
+
+static void putLe16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xff;
+  p[1] = v >> 8;
+}
+
+static void putLe32(uint8_t* p, uint32_t v) {
+  putLe16(p, v & 0xffff);
+  putLe16(p + 2, v >> 16);
+}
+
+static void putLe64(uint8_t* p, uint64_t v) {
+  putLe32(p, v & 0xffffffff);
+  putLe32(p + 4, v >> 32);
+}
+
+MediaMuxer::MediaMuxer(const std::string& filePath, size_t fileLimit)
+    : file_limit_(fileLimit), file_count_(0), dropped_frames_(0) {
+  size_t dot = filePath.rfind('.');
+  size_t slash = filePath.rfind('/');
+  if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+    base_ = filePath.substr(0, dot);
+    extension_ = filePath.substr(dot);
+  } else {
+    base_ = filePath;
+  }
+}
+
+void MediaMuxer::close() {
+  if (writer_.isOpen()) {
+    finishFile();
+    writer_.close();
+  }
+}
+
+bool MediaMuxer::prepareFile(bool entryPoint, bool forceNewFile) {
+  if (writer_.isOpen() && (forceNewFile || (entryPoint && writer_.fileSize() >= file_limit_))) {
+    close();
+  }
+  if (writer_.isOpen()) {
+    return true;
+  }
+  if (!entryPoint) {
+    return false;
+  }
+  current_file_ = (++file_count_ > 1) ? base_ + "_" + std::to_string(file_count_) + extension_
+                                      : base_ + extension_;
+  writer_.open(current_file_);
+  if (!startFile()) {
+    // a file without its header can not be parsed, so no frame may follow;
+    // the next entry point starts it over
+    if (dropped_frames_++ % DROP_LOG_INTERVAL == 0) {
+      AG_LOG(WARNING, "Writer of %s is behind, failed to start the file, %llu frames dropped",
+             current_file_.c_str(), (unsigned long long)dropped_frames_);
+    }
+    writer_.close();
+    --file_count_;
+    return false;
+  }
+  return true;
+}
+
+bool MediaMuxer::writeFrameData(const struct iovec* iov, int count) {
+  if (writer_.write(iov, count)) {
+    return true;
+  }
+  if (dropped_frames_++ % DROP_LOG_INTERVAL == 0) {
+    AG_LOG(WARNING, "Writer of %s is behind, %llu frames dropped so far", current_file_.c_str(),
+           (unsigned long long)dropped_frames_);
+  }
+  return false;
+}
+
+//
+// Y4M
+//
+
+Y4mMuxer::Y4mMuxer(const std::string& filePath, int frameRate, size_t fileLimit)
+    : MediaMuxer(filePath, fileLimit), frame_rate_(frameRate), width_(0), height_(0) {}
+
+Y4mMuxer::~Y4mMuxer() { close(); }
+
+bool Y4mMuxer::startFile() {
+  char header[128];
+  int len = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+                     width_, height_, frame_rate_);
+  return writer_.write(header, len);
+}
+
+bool Y4mMuxer::writeFrame(const uint8_t* y, int yStride, const uint8_t* u, int uStride,
+                          const uint8_t* v, int vStride, int width, int height) {
+  bool resized = width != width_ || height != height_;
+  width_ = width;
+  height_ = height;
+  // every frame is an entry point, only the header has to match
+  if (!prepareFile(true, resized)) {
+    return false;
+  }
+
+  static const char kFrameHeader[] = "FRAME\n";
+  int chromaWidth = (width + 1) / 2;
+  int chromaHeight = (height + 1) / 2;
+  rows_.clear();
+  rows_.push_back({const_cast<char*>(kFrameHeader), sizeof(kFrameHeader) - 1});
+  for (int row = 0; row < height; ++row) {
+    rows_.push_back({const_cast<uint8_t*>(y + row * yStride), static_cast<size_t>(width)});
+  }
+  for (int row = 0; row < chromaHeight; ++row) {
+    rows_.push_back({const_cast<uint8_t*>(u + row * uStride), static_cast<size_t>(chromaWidth)});
+  }
+  for (int row = 0; row < chromaHeight; ++row) {
+    rows_.push_back({const_cast<uint8_t*>(v + row * vStride), static_cast<size_t>(chromaWidth)});
+  }
+  return writeFrameData(rows_.data(), static_cast<int>(rows_.size()));
+}
+
+//
+// IVF
+//
+
+IvfMuxer::IvfMuxer(const std::string& filePath, const char* fourcc, size_t fileLimit)
+    : MediaMuxer(filePath, fileLimit),
+      width_(0),
+      height_(0),
+      frame_count_(0),
+      first_timestamp_(0) {
+  memcpy(fourcc_, fourcc, sizeof(fourcc_));
+}
+
+IvfMuxer::~IvfMuxer() { close(); }
+
+bool IvfMuxer::startFile() {
+  uint8_t header[IVF_HEADER_SIZE] = {'D', 'K', 'I', 'F'};
+  putLe16(header + 4, 0);  // version
+  putLe16(header + 6, IVF_HEADER_SIZE);
+  memcpy(header + 8, fourcc_, sizeof(fourcc_));
+  putLe16(header + 12, width_);
+  putLe16(header + 14, height_);
+  putLe32(header + 16, 1000);  // timebase 1/1000 s
+  putLe32(header + 20, 1);
+  frame_count_ = 0;
+  return writer_.write(header, sizeof(header));
+}
+
+void IvfMuxer::finishFile() {
+  uint8_t count[4];
+  putLe32(count, frame_count_);
+  writer_.patch(24, count, sizeof(count));
+}
+
+bool IvfMuxer::writeFrame(const uint8_t* data, size_t length, bool isKeyFrame,
+                          int64_t timestampMs, int width, int height) {
+  if (isKeyFrame && width > 0 && height > 0) {
+    width_ = width;
+    height_ = height;
+  }
+  if (!prepareFile(isKeyFrame)) {
+    return false;
+  }
+  // timestamps start from zero in every file
+  if (frame_count_ == 0) {
+    first_timestamp_ = timestampMs;
+  }
+
+  uint8_t frameHeader[IVF_FRAME_HEADER_SIZE];
+  putLe32(frameHeader, static_cast<uint32_t>(length));
+  putLe64(frameHeader + 4, static_cast<uint64_t>(timestampMs - first_timestamp_));
+  struct iovec iov[2] = {{frameHeader, sizeof(frameHeader)},
+                         {const_cast<uint8_t*>(data), length}};
+  if (!writeFrameData(iov, 2)) {
+    return false;
+  }
+  ++frame_count_;
+  return true;
+}
+
+//
+// Annex-B with index
+//
+
+AnnexBMuxer::AnnexBMuxer(const std::string& filePath, size_t fileLimit)
+    : MediaMuxer(filePath, fileLimit), index_(64 * 1024, 16) {}
+
+AnnexBMuxer::~AnnexBMuxer() { close(); }
+
+bool AnnexBMuxer::startFile() {
+  index_.open(currentFile() + ".idx");
+  static const char kIndexHeader[] = "# offset length timestamp_ms key\n";
+  if (!index_.write(kIndexHeader, sizeof(kIndexHeader) - 1)) {
+    AG_LOG(ERROR, "Failed to write the index header of %s", currentFile().c_str());
+    index_.close();
+    return false;
+  }
+  return true;
+}
+
+void AnnexBMuxer::finishFile() { index_.close(); }
+
+bool AnnexBMuxer::writeFrame(const uint8_t* data, size_t length, bool isKeyFrame,
+                             int64_t timestampMs) {
+  if (!prepareFile(isKeyFrame)) {
+    return false;
+  }
+  uint64_t offset = writer_.fileSize();
+  struct iovec iov = {const_cast<uint8_t*>(data), length};
+  if (!writeFrameData(&iov, 1)) {
+    return false;
+  }
+  char line[96];
+  int len = snprintf(line, sizeof(line), "%llu %zu %lld %d\n", (unsigned long long)offset, length,
+                     (long long)timestampMs, isKeyFrame ? 1 : 0);
+  if (!index_.write(line, len)) {
+    // Every indexed frame is still where its line says. Rotating keeps it
+    // that way, the frame just written stays unindexed at the end of the file
+    AG_LOG(WARNING, "Index of %s is behind, starting a new file at the next key frame",
+           currentFile().c_str());
+    close();
+    return false;
+  }
+  return true;
+}
+
+//
+// WAV
+//
+
+WavMuxer::WavMuxer(const std::string& filePath, int sampleRate, int numberOfChannels,
+                   size_t fileLimit)
+    : MediaMuxer(filePath, fileLimit), sample_rate_(sampleRate), channels_(numberOfChannels) {}
+
+WavMuxer::~WavMuxer() { close(); }
+
+bool WavMuxer::startFile() {
+  uint8_t header[WAV_HEADER_SIZE];
+  memcpy(header, "RIFF", 4);
+  putLe32(header + 4, 0);  // filled in by finishFile()
+  memcpy(header + 8, "WAVEfmt ", 8);
+  putLe32(header + 16, 16);
+  putLe16(header + 20, 1);  // PCM
+  putLe16(header + 22, channels_);
+  putLe32(header + 24, sample_rate_);
+  putLe32(header + 28, sample_rate_ * channels_ * sizeof(int16_t));
+  putLe16(header + 32, channels_ * sizeof(int16_t));
+  putLe16(header + 34, 16);
+  memcpy(header + 36, "data", 4);
+  putLe32(header + 40, 0);
+  return writer_.write(header, sizeof(header));
+}
+
+void WavMuxer::finishFile() {
+  uint8_t size[4];
+  uint32_t dataSize = static_cast<uint32_t>(writer_.fileSize() - WAV_HEADER_SIZE);
+  putLe32(size, dataSize + WAV_HEADER_SIZE - 8);
+  writer_.patch(4, size, sizeof(size));
+  putLe32(size, dataSize);
+  writer_.patch(40, size, sizeof(size));
+}
+
+bool WavMuxer::writeSamples(const int16_t* samples, int samplesPerChannel) {
+  if (!prepareFile(true)) {
+    return false;
+  }
+  struct iovec iov = {const_cast<int16_t*>(samples),
+                      samplesPerChannel * channels_ * sizeof(int16_t)};
+  return writeFrameData(&iov, 1);
+}
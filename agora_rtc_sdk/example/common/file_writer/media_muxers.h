@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "async_file_writer.h"
+
+// Common part of the muxers: file naming and rotation on top of an
+// AsyncFileWriter. The first file is filePath itself, later ones get a count
+// before the extension (video.h264, video_2.h264, ...). Files only start at
+// a point a player can start from, a keyframe for encoded video, so every
+// file is playable on its own. A new file is started at the first such
+// point after fileLimit bytes.
+class MediaMuxer {
+ public:
+  MediaMuxer(const std::string& filePath, size_t fileLimit);
+  virtual ~MediaMuxer() = default;
+
+  // Finishes the current file; the next frame starts a new one
+  void close();
+
+  uint64_t droppedFrames() const { return dropped_frames_; }
+
+ protected:
+  // Returns false if the frame has to be skipped because no file is open
+  // and the frame is not an entry point
+  bool prepareFile(bool entryPoint, bool forceNewFile = false);
+  bool writeFrameData(const struct iovec* iov, int count);
+
+  // Called right after a file is opened and right before it is closed. A file
+  // whose startFile() fails is abandoned without finishFile(), and the next
+  // entry point opens it again under the same name.
+  virtual bool startFile() { return true; }
+  virtual void finishFile() {}
+
+  const std::string& currentFile() const { return current_file_; }
+
+  AsyncFileWriter writer_;
+
+ private:
+  std::string base_;
+  std::string extension_;
+  size_t file_limit_;
+  int file_count_;
+  std::string current_file_;
+  uint64_t dropped_frames_;
+};
+
+// YUV4MPEG2 for raw I420 frames. Only the visible width of every row is
+// written. A resolution change starts a new file.
+class Y4mMuxer : public MediaMuxer {
+ public:
+  Y4mMuxer(const std::string& filePath, int frameRate, size_t fileLimit);
+  ~Y4mMuxer() override;
+
+  bool writeFrame(const uint8_t* y, int yStride, const uint8_t* u, int uStride, const uint8_t* v,
+                  int vStride, int width, int height);
+
+ private:
+  bool startFile() override;
+
+  int frame_rate_;
+  int width_;
+  int height_;
+  std::vector<struct iovec> rows_;
+};
+
+// IVF for VP8/VP9/AV1 frames, timestamps in milliseconds. The frame count in
+// the header is filled in when a file is finished.
+class IvfMuxer : public MediaMuxer {
+ public:
+  // fourcc as in the file, e.g. "VP80"
+  IvfMuxer(const std::string& filePath, const char* fourcc, size_t fileLimit);
+  ~IvfMuxer() override;
+
+  bool writeFrame(const uint8_t* data, size_t length, bool isKeyFrame, int64_t timestampMs,
+                  int width, int height);
+
+ private:
+  bool startFile() override;
+  void finishFile() override;
+
+  char fourcc_[4];
+  int width_;
+  int height_;
+  uint32_t frame_count_;
+  int64_t first_timestamp_;
+};
+
+// H.264/H.265 Annex-B elementary stream as received, plus a text index next
+// to every file (<file>.idx) with one "offset length timestamp_ms key" line
+// per frame. The file parsers use the index to hand out frames and keyframe
+// flags without scanning for start codes.
+class AnnexBMuxer : public MediaMuxer {
+ public:
+  AnnexBMuxer(const std::string& filePath, size_t fileLimit);
+  ~AnnexBMuxer() override;
+
+  bool writeFrame(const uint8_t* data, size_t length, bool isKeyFrame, int64_t timestampMs);
+
+ private:
+  bool startFile() override;
+  void finishFile() override;
+
+  AsyncFileWriter index_;
+};
+
+// 16 bit PCM WAV. The RIFF and data sizes are filled in when a file is
+// finished.
+class WavMuxer : public MediaMuxer {
+ public:
+  WavMuxer(const std::string& filePath, int sampleRate, int numberOfChannels, size_t fileLimit);
+  ~WavMuxer() override;
+
+  bool writeSamples(const int16_t* samples, int samplesPerChannel);
+
+ private:
+  bool startFile() override;
+  void finishFile() override;
+
+  int sample_rate_;
+  int channels_;
+};
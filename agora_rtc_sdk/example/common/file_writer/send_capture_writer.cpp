@@ -0,0 +1,80 @@
+#include "send_capture_writer.h"
+
+#include <string.h>
+
+#include "common/log.h"
+
+#define DROP_LOG_INTERVAL (100)
+
+SendCaptureWriter::SendCaptureWriter(const std::string& filePath)
+    : started_(false), dropped_records_(0) {
+  writer_.open(filePath);
+  writer_.write(CAPTURE_FILE_MAGIC, CAPTURE_FILE_MAGIC_SIZE);
+}
+
+SendCaptureWriter::~SendCaptureWriter() {
+  if (dropped_records_) {
+    AG_LOG(WARNING, "%llu capture records dropped because the writer fell behind",
+           (unsigned long long)dropped_records_);
+  }
+}
+
+void SendCaptureWriter::captureEncodedVideo(
+    int trackId, const uint8_t* imageBuffer, size_t length,
+    const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo) {
+  HelperCaptureRecordHeader header = {};
+  header.trackType = CAPTURE_ENCODED_VIDEO;
+  header.trackId = trackId;
+  header.codec = videoEncodedFrameInfo.codecType;
+  if (videoEncodedFrameInfo.frameType == agora::rtc::VIDEO_FRAME_TYPE_KEY_FRAME) {
+    header.flags |= CAPTURE_FLAG_KEY_FRAME;
+  }
+  header.width = videoEncodedFrameInfo.width;
+  header.height = videoEncodedFrameInfo.height;
+  header.framesPerSecond = videoEncodedFrameInfo.framesPerSecond;
+  writeRecord(header, imageBuffer, length);
+}
+
+void SendCaptureWriter::capturePcmAudio(int trackId, const void* audioData,
+                                        size_t samplesPerChannel, size_t bytesPerSample,
+                                        size_t numberOfChannels, uint32_t sampleRate) {
+  HelperCaptureRecordHeader header = {};
+  header.trackType = CAPTURE_PCM_AUDIO;
+  header.trackId = trackId;
+  header.channels = numberOfChannels;
+  header.sampleRate = sampleRate;
+  header.samplesPerChannel = samplesPerChannel;
+  writeRecord(header, audioData, samplesPerChannel * bytesPerSample * numberOfChannels);
+}
+
+void SendCaptureWriter::captureEncodedAudio(
+    int trackId, const uint8_t* payloadData, size_t payloadSize,
+    const agora::rtc::EncodedAudioFrameInfo& audioFrameInfo) {
+  HelperCaptureRecordHeader header = {};
+  header.trackType = CAPTURE_ENCODED_AUDIO;
+  header.trackId = trackId;
+  header.codec = audioFrameInfo.codec;
+  header.channels = audioFrameInfo.numberOfChannels;
+  header.sampleRate = audioFrameInfo.sampleRateHz;
+  header.samplesPerChannel = audioFrameInfo.samplesPerChannel;
+  writeRecord(header, payloadData, payloadSize);
+}
+
+void SendCaptureWriter::writeRecord(HelperCaptureRecordHeader& header, const void* data,
+                                    size_t length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  if (!started_) {
+    start_time_ = now;
+    started_ = true;
+  }
+  header.timestampUs =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - start_time_).count();
+  header.length = length;
+
+  struct iovec iov[2] = {{&header, sizeof(header)}, {const_cast<void*>(data), length}};
+  if (!writer_.write(iov, 2) && dropped_records_++ % DROP_LOG_INTERVAL == 0) {
+    AG_LOG(WARNING, "Capture writer is behind, %llu records dropped so far",
+           (unsigned long long)dropped_records_);
+  }
+}
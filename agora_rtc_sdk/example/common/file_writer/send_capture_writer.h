@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#include "AgoraBase.h"
+#include "async_file_writer.h"
+#include "common/file_parser/helper_capture_parser.h"
+
+// Logs every frame a sample hands to the SDK, with its send time relative to
+// the first one, in the format read by HelperCaptureFileParser. Call it next
+// to the send call; several send threads may share one writer. Records are
+// dropped, not waited for, if the disk falls behind.
+class SendCaptureWriter {
+ public:
+  SendCaptureWriter(const std::string& filePath);
+  ~SendCaptureWriter();
+
+  void captureEncodedVideo(int trackId, const uint8_t* imageBuffer, size_t length,
+                           const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo);
+  void capturePcmAudio(int trackId, const void* audioData, size_t samplesPerChannel,
+                       size_t bytesPerSample, size_t numberOfChannels, uint32_t sampleRate);
+  void captureEncodedAudio(int trackId, const uint8_t* payloadData, size_t payloadSize,
+                           const agora::rtc::EncodedAudioFrameInfo& audioFrameInfo);
+
+ private:
+  void writeRecord(HelperCaptureRecordHeader& header, const void* data, size_t length);
+
+  std::mutex mutex_;
+  AsyncFileWriter writer_;
+  bool started_;
+  std::chrono::steady_clock::time_point start_time_;
+  uint64_t dropped_records_;
+};
@@ -15,6 +15,17 @@ void waitBeforeNextSend(PacerInfo& pacer) {
   }
 }
 
+void waitUntilTimestamp(PacerInfo& pacer, int64_t timestampMs) {
+  ++pacer.sendTimes;
+  pacer.nextDurationInMs = timestampMs;
+  int64_t waitIntervalInMs =
+      timestampMs - std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - pacer.startTime)
+                        .count();
+  if (waitIntervalInMs > 0) {
+    usleep(waitIntervalInMs * 1000);
+  }
+}
 
 std::string getCurrentSystemTimeChrono() {
   auto now = std::chrono::system_clock::now();
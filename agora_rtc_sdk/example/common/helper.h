@@ -19,6 +19,10 @@ uint64_t now_ms_t();
 
 void waitBeforeNextSend(PacerInfo& pacer);
 
+// Waits until timestampMs after pacer.startTime, for frames that carry their
+// own send time instead of a fixed interval
+void waitUntilTimestamp(PacerInfo& pacer, int64_t timestampMs);
+
 std::string getCurrentSystemTimeChrono();
 
 void spendTimeInfoStatistics(uint64_t T1, uint64_t T2, int statistics_count);
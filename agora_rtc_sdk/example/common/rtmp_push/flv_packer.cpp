@@ -0,0 +1,159 @@
+#include "flv_packer.h"
+
+#include <cstring>
+
+#define FLV_CODEC_AVC (7)
+#define FLV_FRAME_KEY (1)
+#define FLV_FRAME_INTER (2)
+#define FLV_AVC_SEQUENCE_HEADER (0)
+#define FLV_AVC_NALU (1)
+// AAC, the rate, size and channel bits are fixed for AAC
+#define FLV_AUDIO_AAC (0xaf)
+#define FLV_AAC_SEQUENCE_HEADER (0)
+#define FLV_AAC_RAW (1)
+
+#define H264_NAL_IDR_SLICE (5)
+#define H264_NAL_SPS (7)
+#define H264_NAL_PPS (8)
+#define H264_NAL_AUD (9)
+
+static const int kAacSampleRates[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000,
+                                      22050, 16000, 12000, 11025, 8000,  7350};
+
+size_t FlvTagBody::size() const {
+  size_t total = 0;
+  for (const iovec& segment : segments) {
+    total += segment.iov_len;
+  }
+  return total;
+}
+
+bool FlvPacker::packVideo(const uint8_t* frame, size_t length, bool isKeyFrame,
+                          FlvTagBody& tag) {
+  // NAL units between start codes
+  std::vector<std::pair<const uint8_t*, size_t>> nals;
+  size_t start = 0;
+  for (size_t i = 0; i + 3 <= length; ++i) {
+    if (frame[i] == 0 && frame[i + 1] == 0 && frame[i + 2] == 1) {
+      if (start) {
+        size_t end = frame[i - 1] == 0 ? i - 1 : i;
+        nals.push_back({frame + start, end > start ? end - start : 0});
+      }
+      start = i + 3;
+      i += 2;
+    }
+  }
+  if (start && start < length) {
+    nals.push_back({frame + start, length - start});
+  }
+
+  tag.lengths.clear();
+  tag.lengths.reserve(nals.size() * 4);
+  std::vector<std::pair<const uint8_t*, size_t>> sent;
+  for (const auto& nal : nals) {
+    if (nal.second == 0) {
+      continue;
+    }
+    uint8_t type = nal.first[0] & 0x1f;
+    if (type == H264_NAL_SPS || type == H264_NAL_PPS) {
+      std::vector<uint8_t>& parameterSet = type == H264_NAL_SPS ? sps_ : pps_;
+      if (parameterSet.size() != nal.second ||
+          memcmp(parameterSet.data(), nal.first, nal.second) != 0) {
+        parameterSet.assign(nal.first, nal.first + nal.second);
+        updateVideoSequenceHeader();
+      }
+      continue;
+    }
+    if (type == H264_NAL_AUD) {
+      continue;
+    }
+    isKeyFrame = isKeyFrame || type == H264_NAL_IDR_SLICE;
+    for (int b = 0; b < 4; ++b) {
+      tag.lengths.push_back((nal.second >> (24 - 8 * b)) & 0xff);
+    }
+    sent.push_back(nal);
+  }
+  if (sent.empty()) {
+    return false;
+  }
+
+  tag.isKeyFrame = isKeyFrame;
+  tag.header = {static_cast<uint8_t>(((isKeyFrame ? FLV_FRAME_KEY : FLV_FRAME_INTER) << 4) |
+                                     FLV_CODEC_AVC),
+                FLV_AVC_NALU, 0, 0, 0};
+  // the lengths are complete now, so pointers into them stay valid
+  tag.segments.clear();
+  tag.segments.push_back({tag.header.data(), tag.header.size()});
+  for (size_t i = 0; i < sent.size(); ++i) {
+    tag.segments.push_back({&tag.lengths[i * 4], 4});
+    tag.segments.push_back({const_cast<uint8_t*>(sent[i].first), sent[i].second});
+  }
+  return true;
+}
+
+void FlvPacker::updateVideoSequenceHeader() {
+  if (sps_.size() < 4 || pps_.empty()) {
+    return;
+  }
+  std::vector<uint8_t>& header = video_sequence_header_;
+  header = {(FLV_FRAME_KEY << 4) | FLV_CODEC_AVC, FLV_AVC_SEQUENCE_HEADER, 0, 0, 0};
+  // AVCDecoderConfigurationRecord with 4 byte NAL unit lengths
+  header.push_back(1);
+  header.insert(header.end(), sps_.begin() + 1, sps_.begin() + 4);
+  header.push_back(0xff);
+  header.push_back(0xe1);
+  header.push_back(sps_.size() >> 8);
+  header.push_back(sps_.size() & 0xff);
+  header.insert(header.end(), sps_.begin(), sps_.end());
+  header.push_back(1);
+  header.push_back(pps_.size() >> 8);
+  header.push_back(pps_.size() & 0xff);
+  header.insert(header.end(), pps_.begin(), pps_.end());
+  video_sequence_header_changed_ = true;
+}
+
+bool FlvPacker::packAudio(const uint8_t* frame, size_t length, FlvTagBody& tag) {
+  if (length < 7 || frame[0] != 0xff || (frame[1] & 0xf0) != 0xf0) {
+    return false;
+  }
+  size_t headerSize = (frame[1] & 0x01) ? 7 : 9;
+  int profile = (frame[2] >> 6) & 0x03;
+  int rateIndex = (frame[2] >> 2) & 0x0f;
+  int channels = ((frame[2] & 0x01) << 2) | (frame[3] >> 6);
+  if (length <= headerSize ||
+      rateIndex >= static_cast<int>(sizeof(kAacSampleRates) / sizeof(kAacSampleRates[0]))) {
+    return false;
+  }
+
+  // AudioSpecificConfig: object type is the ADTS profile plus one
+  uint16_t config = ((profile + 1) << 11) | (rateIndex << 7) | (channels << 3);
+  if (audio_sequence_header_.size() != 4 || audio_sequence_header_[2] != (config >> 8) ||
+      audio_sequence_header_[3] != (config & 0xff)) {
+    audio_sequence_header_ = {FLV_AUDIO_AAC, FLV_AAC_SEQUENCE_HEADER,
+                              static_cast<uint8_t>(config >> 8),
+                              static_cast<uint8_t>(config & 0xff)};
+    audio_sequence_header_changed_ = true;
+    audio_sample_rate_ = kAacSampleRates[rateIndex];
+    audio_channels_ = channels;
+  }
+
+  tag.isKeyFrame = false;
+  tag.lengths.clear();
+  tag.header = {FLV_AUDIO_AAC, FLV_AAC_RAW};
+  tag.segments.clear();
+  tag.segments.push_back({tag.header.data(), tag.header.size()});
+  tag.segments.push_back({const_cast<uint8_t*>(frame + headerSize), length - headerSize});
+  return true;
+}
+
+bool FlvPacker::takeVideoSequenceHeaderChange() {
+  bool changed = video_sequence_header_changed_;
+  video_sequence_header_changed_ = false;
+  return changed;
+}
+
+bool FlvPacker::takeAudioSequenceHeaderChange() {
+  bool changed = audio_sequence_header_changed_;
+  audio_sequence_header_changed_ = false;
+  return changed;
+}
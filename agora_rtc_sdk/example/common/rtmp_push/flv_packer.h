@@ -0,0 +1,59 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Turns H.264 Annex B frames and ADTS AAC frames into FLV tag bodies.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <vector>
+
+/**
+ One FLV tag body as segments: a few bytes of its own plus pointers into
+ the source frame, which must outlive it. H.264 NAL units only get their
+ start codes replaced by lengths and AAC only loses its ADTS header, so
+ nothing is decoded or copied.
+ */
+struct FlvTagBody {
+  std::vector<uint8_t> header;
+  // NAL unit lengths, 4 bytes each
+  std::vector<uint8_t> lengths;
+  std::vector<iovec> segments;
+  bool isKeyFrame = false;
+
+  size_t size() const;
+};
+
+class FlvPacker {
+ public:
+  // SPS and PPS are kept for the sequence header and left out of the tag.
+  // False if the frame has no NAL units to send.
+  bool packVideo(const uint8_t* frame, size_t length, bool isKeyFrame, FlvTagBody& tag);
+  // False without an ADTS header
+  bool packAudio(const uint8_t* frame, size_t length, FlvTagBody& tag);
+
+  // AVCDecoderConfigurationRecord and AudioSpecificConfig tags, empty until
+  // the first SPS and PPS, or the first AAC frame
+  const std::vector<uint8_t>& videoSequenceHeader() const { return video_sequence_header_; }
+  const std::vector<uint8_t>& audioSequenceHeader() const { return audio_sequence_header_; }
+  // Set when a sequence header changed and has to be sent again
+  bool takeVideoSequenceHeaderChange();
+  bool takeAudioSequenceHeaderChange();
+
+  int audioSampleRate() const { return audio_sample_rate_; }
+  int audioChannels() const { return audio_channels_; }
+
+ private:
+  void updateVideoSequenceHeader();
+
+  std::vector<uint8_t> sps_;
+  std::vector<uint8_t> pps_;
+  std::vector<uint8_t> video_sequence_header_;
+  std::vector<uint8_t> audio_sequence_header_;
+  bool video_sequence_header_changed_ = false;
+  bool audio_sequence_header_changed_ = false;
+  int audio_sample_rate_ = 0;
+  int audio_channels_ = 0;
+};
@@ -0,0 +1,260 @@
+#include "local_rtmp_server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "common/helper.h"
+#include "common/log.h"
+#include "rtmp_protocol.h"
+
+#define LOCAL_RTMP_WINDOW_ACK_SIZE (2500000)
+#define LOCAL_RTMP_RECEIVE_BUFFER (32 * 1024)
+#define FLV_TAG_AUDIO (8)
+#define FLV_TAG_VIDEO (9)
+#define FLV_TAG_SCRIPT (18)
+
+// What a data message starts with when it is meant to be stored
+static const uint8_t kSetDataFrame[] = {0x02, 0x00, 0x0d, '@', 's', 'e', 't', 'D',
+                                        'a',  't',  'a',  'F', 'r', 'a', 'm', 'e'};
+
+static bool sendServerMessage(int fd, RtmpChunkWriter& writer, uint32_t csid, uint8_t type,
+                              uint32_t streamId, std::vector<uint8_t>& payload) {
+  std::vector<uint8_t> headers;
+  std::vector<iovec> iov;
+  iovec body = {payload.data(), payload.size()};
+  writer.write(csid, type, 0, streamId, &body, 1, headers, iov);
+  return rtmpSendIov(fd, iov.data(), static_cast<int>(iov.size()));
+}
+
+static void putStatus(AmfWriter& writer, const char* code, const char* description) {
+  writer.beginObject()
+      .key("level")
+      .string("status")
+      .key("code")
+      .string(code)
+      .key("description")
+      .string(description)
+      .endObject();
+}
+
+LocalRtmpServer::~LocalRtmpServer() { stop(); }
+
+bool LocalRtmpServer::start(int port, const std::string& flvPath) {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) {
+    return false;
+  }
+  int reuse = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  // accepted sockets inherit it
+  int receiveBuffer = LOCAL_RTMP_RECEIVE_BUFFER;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  socklen_t addressLength = sizeof(address);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(listen_fd_, 16) != 0 ||
+      getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &addressLength) != 0) {
+    AG_LOG(ERROR, "Local rtmp server failed to listen on port %d: %s", port, strerror(errno));
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  port_ = ntohs(address.sin_port);
+
+  if (!flvPath.empty()) {
+    flv_file_ = fopen(flvPath.c_str(), "wb");
+    if (!flv_file_) {
+      AG_LOG(ERROR, "Failed to open %s", flvPath.c_str());
+    } else {
+      // audio and video, then the size of the tag before the first
+      static const uint8_t kFlvHeader[] = {'F', 'L', 'V', 1, 0x05, 0, 0, 0, 9, 0, 0, 0, 0};
+      fwrite(kFlvHeader, 1, sizeof(kFlvHeader), flv_file_);
+    }
+  }
+
+  running_ = true;
+  accept_thread_ = std::thread(&LocalRtmpServer::acceptLoop, this);
+  AG_LOG(INFO, "Local rtmp server listening on rtmp://127.0.0.1:%d", port_);
+  return true;
+}
+
+void LocalRtmpServer::stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  // wakes accept() and every recv()
+  shutdown(listen_fd_, SHUT_RDWR);
+  accept_thread_.join();
+  close(listen_fd_);
+  listen_fd_ = -1;
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int fd : client_fds_) {
+      shutdown(fd, SHUT_RDWR);
+    }
+    threads.swap(client_threads_);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  if (flv_file_) {
+    fclose(flv_file_);
+    flv_file_ = nullptr;
+  }
+}
+
+void LocalRtmpServer::stall(int ms) { stall_until_ms_ = now_ms_t() + ms; }
+
+LocalRtmpServerStats LocalRtmpServer::getStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void LocalRtmpServer::acceptLoop() {
+  while (running_) {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+      close(fd);
+      break;
+    }
+    ++stats_.connections;
+    client_fds_.insert(fd);
+    client_threads_.emplace_back(&LocalRtmpServer::serve, this, fd);
+  }
+}
+
+void LocalRtmpServer::serve(int fd) {
+  RtmpChunkReader reader;
+  RtmpChunkWriter writer;
+  bool ok = rtmpServerHandshake(fd);
+
+  auto onMessage = [&](RtmpMessage& message) {
+    std::vector<uint8_t>& payload = message.payload;
+    if (message.type == RTMP_MSG_VIDEO || message.type == RTMP_MSG_AUDIO) {
+      if (payload.size() < 2) {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      // AVCPacketType or AACPacketType 0 is a sequence header
+      if (payload[1] == 0) {
+        ++stats_.sequenceHeaders;
+      } else if (message.type == RTMP_MSG_VIDEO) {
+        ++stats_.videoFrames;
+        stats_.keyFrames += (payload[0] >> 4) == 1 ? 1 : 0;
+      } else {
+        ++stats_.audioFrames;
+      }
+      stats_.mediaBytes += payload.size();
+      writeFlvTag(message.type == RTMP_MSG_VIDEO ? FLV_TAG_VIDEO : FLV_TAG_AUDIO,
+                  message.timestamp, payload.data(), payload.size());
+      return;
+    }
+    if (message.type == RTMP_MSG_DATA_AMF0) {
+      if (payload.size() > sizeof(kSetDataFrame) &&
+          memcmp(payload.data(), kSetDataFrame, sizeof(kSetDataFrame)) == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        writeFlvTag(FLV_TAG_SCRIPT, 0, payload.data() + sizeof(kSetDataFrame),
+                    payload.size() - sizeof(kSetDataFrame));
+      }
+      return;
+    }
+    if (message.type != RTMP_MSG_COMMAND_AMF0) {
+      return;
+    }
+
+    std::vector<AmfValue> values;
+    if (!decodeAmf(payload.data(), payload.size(), values) || values.size() < 2) {
+      return;
+    }
+    const std::string& name = values[0].string;
+    double transactionId = values[1].number;
+    std::vector<uint8_t> response;
+    AmfWriter amf(response);
+    if (name == "connect") {
+      std::vector<uint8_t> control;
+      rtmpControlMessage(RTMP_MSG_WINDOW_ACK_SIZE, LOCAL_RTMP_WINDOW_ACK_SIZE, control);
+      ok = ok && sendServerMessage(fd, writer, RTMP_CSID_CONTROL, RTMP_MSG_WINDOW_ACK_SIZE, 0,
+                                   control);
+      rtmpControlMessage(RTMP_MSG_SET_PEER_BANDWIDTH, LOCAL_RTMP_WINDOW_ACK_SIZE, control);
+      ok = ok && sendServerMessage(fd, writer, RTMP_CSID_CONTROL, RTMP_MSG_SET_PEER_BANDWIDTH, 0,
+                                   control);
+      rtmpControlMessage(RTMP_MSG_SET_CHUNK_SIZE, RTMP_OUT_CHUNK_SIZE, control);
+      ok = ok && sendServerMessage(fd, writer, RTMP_CSID_CONTROL, RTMP_MSG_SET_CHUNK_SIZE, 0,
+                                   control);
+      writer.setChunkSize(RTMP_OUT_CHUNK_SIZE);
+      amf.string("_result").number(transactionId);
+      amf.beginObject().key("fmsVer").string("FMS/3,0,1,123").endObject();
+      putStatus(amf, "NetConnection.Connect.Success", "Connection succeeded.");
+    } else if (name == "createStream") {
+      amf.string("_result").number(transactionId).null().number(1);
+    } else if (name == "publish") {
+      amf.string("onStatus").number(0).null();
+      putStatus(amf, "NetStream.Publish.Start", "Start publishing.");
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_.publishes;
+    } else {
+      return;
+    }
+    ok = ok && sendServerMessage(fd, writer, RTMP_CSID_COMMAND, RTMP_MSG_COMMAND_AMF0,
+                                 message.streamId, response);
+  };
+
+  uint8_t buffer[16 * 1024];
+  while (ok && running_) {
+    if (static_cast<int64_t>(now_ms_t()) < stall_until_ms_) {
+      usleep(10000);
+      continue;
+    }
+    ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0 || !reader.feed(buffer, received, onMessage)) {
+      break;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  client_fds_.erase(fd);
+  close(fd);
+}
+
+void LocalRtmpServer::writeFlvTag(uint8_t type, uint32_t timestamp, const uint8_t* data,
+                                  size_t length) {
+  if (!flv_file_) {
+    return;
+  }
+  uint8_t header[11] = {type,
+                        static_cast<uint8_t>(length >> 16),
+                        static_cast<uint8_t>(length >> 8),
+                        static_cast<uint8_t>(length),
+                        static_cast<uint8_t>(timestamp >> 16),
+                        static_cast<uint8_t>(timestamp >> 8),
+                        static_cast<uint8_t>(timestamp),
+                        static_cast<uint8_t>(timestamp >> 24),
+                        0,
+                        0,
+                        0};
+  uint32_t tagSize = sizeof(header) + length;
+  uint8_t trailer[4] = {static_cast<uint8_t>(tagSize >> 24), static_cast<uint8_t>(tagSize >> 16),
+                        static_cast<uint8_t>(tagSize >> 8), static_cast<uint8_t>(tagSize)};
+  fwrite(header, 1, sizeof(header), flv_file_);
+  fwrite(data, 1, length, flv_file_);
+  fwrite(trailer, 1, sizeof(trailer), flv_file_);
+}
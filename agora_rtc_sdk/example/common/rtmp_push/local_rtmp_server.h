@@ -0,0 +1,67 @@
+//  Agora RTC/MEDIA SDK
+//
+//  An RTMP server on localhost that accepts publishers and counts what they send.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LocalRtmpServerStats {
+  uint64_t connections = 0;
+  uint64_t publishes = 0;
+  uint64_t videoFrames = 0;
+  uint64_t keyFrames = 0;
+  uint64_t audioFrames = 0;
+  uint64_t sequenceHeaders = 0;
+  uint64_t mediaBytes = 0;
+};
+
+/**
+ Stands in for a real ingest server when trying the push samples: it does
+ the handshake, answers connect, createStream and publish, and takes audio
+ and video messages. What it received can be written to an FLV file to check
+ it with any player.
+
+ Its receive buffers are small, so a stall() soon holds up the publisher the
+ way a congested link would, rather than being absorbed by loopback buffers.
+ */
+class LocalRtmpServer {
+ public:
+  LocalRtmpServer() = default;
+  ~LocalRtmpServer();
+
+  // Port 0 picks a free one, see port()
+  bool start(int port, const std::string& flvPath = "");
+  void stop();
+  int port() const { return port_; }
+  // Stops reading from publishers for ms, like an endpoint that hangs
+  void stall(int ms);
+
+  LocalRtmpServerStats getStats();
+
+ private:
+  void acceptLoop();
+  void serve(int fd);
+  void writeFlvTag(uint8_t type, uint32_t timestamp, const uint8_t* data, size_t length);
+
+  int listen_fd_ = -1;
+  int port_ = 0;
+  std::atomic<bool> running_{false};
+  std::atomic<int64_t> stall_until_ms_{0};
+  std::thread accept_thread_;
+
+  std::mutex mutex_;
+  std::set<int> client_fds_;
+  std::vector<std::thread> client_threads_;
+  LocalRtmpServerStats stats_;
+  FILE* flv_file_ = nullptr;
+};
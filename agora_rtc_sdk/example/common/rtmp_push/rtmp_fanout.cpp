@@ -0,0 +1,28 @@
+#include "rtmp_fanout.h"
+
+RtmpFanout::~RtmpFanout() { stop(); }
+
+void RtmpFanout::addDestination(const RtmpPushConfig& config,
+                                agora::rtc::IRtmpConnectionObserver* observer) {
+  pipelines_.emplace_back(new RtmpPushPipeline(config, observer));
+}
+
+void RtmpFanout::start() {
+  for (auto& pipeline : pipelines_) {
+    pipeline->start();
+  }
+}
+
+void RtmpFanout::stop() {
+  for (auto& pipeline : pipelines_) {
+    pipeline->stop();
+  }
+}
+
+int RtmpFanout::push(const EncodedMediaFramePtr& frame) {
+  int queued = 0;
+  for (auto& pipeline : pipelines_) {
+    queued += pipeline->push(frame) ? 1 : 0;
+  }
+  return queued;
+}
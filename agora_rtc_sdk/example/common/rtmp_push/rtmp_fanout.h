@@ -0,0 +1,40 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Sends one encoded stream to several RTMP destinations.
+//
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "rtmp_push_pipeline.h"
+
+/**
+ The stream is encoded once and every frame is shared by reference, so adding
+ a destination costs a queue entry per frame rather than another encoder.
+
+ Each destination is a pipeline of its own: its own queue, sender thread and
+ reconnects, and its own observer. push() only takes each pipeline's lock
+ long enough to queue the frame, so a destination that stalls drops frames
+ from its own queue while the others keep going.
+ */
+class RtmpFanout {
+ public:
+  ~RtmpFanout();
+
+  // Before start()
+  void addDestination(const RtmpPushConfig& config,
+                      agora::rtc::IRtmpConnectionObserver* observer = nullptr);
+  void start();
+  void stop();
+
+  // Destinations that queued the frame
+  int push(const EncodedMediaFramePtr& frame);
+
+  size_t size() const { return pipelines_.size(); }
+  RtmpPushPipeline& destination(size_t index) { return *pipelines_[index]; }
+
+ private:
+  std::vector<std::unique_ptr<RtmpPushPipeline>> pipelines_;
+};
@@ -0,0 +1,467 @@
+#include "rtmp_protocol.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cstring>
+
+#define RTMP_VERSION (3)
+#define RTMP_HANDSHAKE_SIZE (1536)
+#define RTMP_EXTENDED_TIMESTAMP (0xffffff)
+
+#define AMF0_NUMBER (0x00)
+#define AMF0_BOOLEAN (0x01)
+#define AMF0_STRING (0x02)
+#define AMF0_OBJECT (0x03)
+#define AMF0_NULL (0x05)
+#define AMF0_UNDEFINED (0x06)
+#define AMF0_ECMA_ARRAY (0x08)
+#define AMF0_OBJECT_END (0x09)
+
+static void putBe16(std::vector<uint8_t>& out, uint16_t value) {
+  out.push_back(value >> 8);
+  out.push_back(value & 0xff);
+}
+
+static void putBe24(std::vector<uint8_t>& out, uint32_t value) {
+  out.push_back((value >> 16) & 0xff);
+  out.push_back((value >> 8) & 0xff);
+  out.push_back(value & 0xff);
+}
+
+static void putBe32(std::vector<uint8_t>& out, uint32_t value) {
+  putBe16(out, value >> 16);
+  putBe16(out, value & 0xffff);
+}
+
+static uint32_t readBe24(const uint8_t* p) { return (p[0] << 16) | (p[1] << 8) | p[2]; }
+
+static uint32_t readBe32(const uint8_t* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+const AmfValue* AmfValue::find(const std::string& name) const {
+  for (const auto& property : properties) {
+    if (property.first == name) {
+      return &property.second;
+    }
+  }
+  return nullptr;
+}
+
+AmfWriter& AmfWriter::number(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  out_.push_back(AMF0_NUMBER);
+  putBe32(out_, bits >> 32);
+  putBe32(out_, bits & 0xffffffff);
+  return *this;
+}
+
+AmfWriter& AmfWriter::boolean(bool value) {
+  out_.push_back(AMF0_BOOLEAN);
+  out_.push_back(value ? 1 : 0);
+  return *this;
+}
+
+AmfWriter& AmfWriter::string(const std::string& value) {
+  out_.push_back(AMF0_STRING);
+  putString(value);
+  return *this;
+}
+
+AmfWriter& AmfWriter::null() {
+  out_.push_back(AMF0_NULL);
+  return *this;
+}
+
+AmfWriter& AmfWriter::beginObject() {
+  out_.push_back(AMF0_OBJECT);
+  return *this;
+}
+
+AmfWriter& AmfWriter::beginEcmaArray(uint32_t count) {
+  out_.push_back(AMF0_ECMA_ARRAY);
+  putBe32(out_, count);
+  return *this;
+}
+
+AmfWriter& AmfWriter::key(const std::string& name) {
+  putString(name);
+  return *this;
+}
+
+AmfWriter& AmfWriter::endObject() {
+  putBe16(out_, 0);
+  out_.push_back(AMF0_OBJECT_END);
+  return *this;
+}
+
+void AmfWriter::putString(const std::string& value) {
+  putBe16(out_, static_cast<uint16_t>(value.size()));
+  out_.insert(out_.end(), value.begin(), value.end());
+}
+
+static bool decodeAmfValue(const uint8_t*& p, const uint8_t* end, AmfValue& value, int depth);
+
+static bool decodeAmfString(const uint8_t*& p, const uint8_t* end, std::string& value) {
+  if (end - p < 2) {
+    return false;
+  }
+  size_t length = (p[0] << 8) | p[1];
+  p += 2;
+  if (static_cast<size_t>(end - p) < length) {
+    return false;
+  }
+  value.assign(reinterpret_cast<const char*>(p), length);
+  p += length;
+  return true;
+}
+
+static bool decodeAmfProperties(const uint8_t*& p, const uint8_t* end, AmfValue& value,
+                                int depth) {
+  value.type = AmfValue::OBJECT;
+  while (true) {
+    if (end - p >= 3 && p[0] == 0 && p[1] == 0 && p[2] == AMF0_OBJECT_END) {
+      p += 3;
+      return true;
+    }
+    std::string name;
+    AmfValue property;
+    if (!decodeAmfString(p, end, name) || !decodeAmfValue(p, end, property, depth + 1)) {
+      return false;
+    }
+    value.properties.emplace_back(std::move(name), std::move(property));
+  }
+}
+
+static bool decodeAmfValue(const uint8_t*& p, const uint8_t* end, AmfValue& value, int depth) {
+  if (p >= end || depth > 8) {
+    return false;
+  }
+  uint8_t marker = *p++;
+  switch (marker) {
+    case AMF0_NUMBER: {
+      if (end - p < 8) {
+        return false;
+      }
+      uint64_t bits = (static_cast<uint64_t>(readBe32(p)) << 32) | readBe32(p + 4);
+      memcpy(&value.number, &bits, sizeof(bits));
+      value.type = AmfValue::NUMBER;
+      p += 8;
+      return true;
+    }
+    case AMF0_BOOLEAN:
+      if (p >= end) {
+        return false;
+      }
+      value.type = AmfValue::BOOLEAN;
+      value.boolean = *p++ != 0;
+      return true;
+    case AMF0_STRING:
+      value.type = AmfValue::STRING;
+      return decodeAmfString(p, end, value.string);
+    case AMF0_OBJECT:
+      return decodeAmfProperties(p, end, value, depth);
+    case AMF0_ECMA_ARRAY:
+      if (end - p < 4) {
+        return false;
+      }
+      p += 4;
+      return decodeAmfProperties(p, end, value, depth);
+    case AMF0_NULL:
+    case AMF0_UNDEFINED:
+      value.type = AmfValue::NULL_VALUE;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool decodeAmf(const uint8_t* data, size_t length, std::vector<AmfValue>& values) {
+  values.clear();
+  const uint8_t* p = data;
+  const uint8_t* end = data + length;
+  while (p < end) {
+    AmfValue value;
+    if (!decodeAmfValue(p, end, value, 0)) {
+      return false;
+    }
+    values.push_back(std::move(value));
+  }
+  return true;
+}
+
+void RtmpChunkWriter::write(uint32_t csid, uint8_t type, uint32_t timestamp, uint32_t streamId,
+                            const iovec* payload, int count, std::vector<uint8_t>& headers,
+                            std::vector<iovec>& iov) const {
+  size_t length = 0;
+  for (int i = 0; i < count; ++i) {
+    length += payload[i].iov_len;
+  }
+  bool extended = timestamp >= RTMP_EXTENDED_TIMESTAMP;
+  size_t chunks = std::max<size_t>(1, (length + chunk_size_ - 1) / chunk_size_);
+
+  // headers first, their addresses only settle once they are all written
+  headers.clear();
+  headers.reserve(chunks * 16);
+  std::vector<size_t> ends;
+  ends.reserve(chunks);
+  headers.push_back(csid & 0x3f);
+  putBe24(headers, extended ? RTMP_EXTENDED_TIMESTAMP : timestamp);
+  putBe24(headers, static_cast<uint32_t>(length));
+  headers.push_back(type);
+  // the message stream id is the one little endian field
+  for (int i = 0; i < 4; ++i) {
+    headers.push_back((streamId >> (8 * i)) & 0xff);
+  }
+  if (extended) {
+    putBe32(headers, timestamp);
+  }
+  ends.push_back(headers.size());
+  for (size_t c = 1; c < chunks; ++c) {
+    headers.push_back(0xc0 | (csid & 0x3f));
+    if (extended) {
+      putBe32(headers, timestamp);
+    }
+    ends.push_back(headers.size());
+  }
+
+  iov.clear();
+  iov.reserve(chunks * 2 + count);
+  int segment = 0;
+  size_t segmentOffset = 0;
+  size_t headerStart = 0;
+  for (size_t c = 0; c < chunks; ++c) {
+    iov.push_back({headers.data() + headerStart, ends[c] - headerStart});
+    headerStart = ends[c];
+    size_t left = std::min<size_t>(chunk_size_, length - c * chunk_size_);
+    while (left > 0 && segment < count) {
+      size_t take = std::min(left, payload[segment].iov_len - segmentOffset);
+      if (take > 0) {
+        iov.push_back({static_cast<uint8_t*>(payload[segment].iov_base) + segmentOffset, take});
+      }
+      left -= take;
+      segmentOffset += take;
+      if (segmentOffset == payload[segment].iov_len) {
+        ++segment;
+        segmentOffset = 0;
+      }
+    }
+  }
+}
+
+size_t RtmpChunkReader::parseChunk(const uint8_t* p, size_t available,
+                                   const MessageCallback& callback, bool& broken) {
+  if (available < 1) {
+    return 0;
+  }
+  uint8_t fmt = p[0] >> 6;
+  uint32_t csid = p[0] & 0x3f;
+  size_t offset = 1;
+  if (csid == 0) {
+    if (available < 2) {
+      return 0;
+    }
+    csid = 64 + p[1];
+    offset = 2;
+  } else if (csid == 1) {
+    if (available < 3) {
+      return 0;
+    }
+    csid = 64 + p[1] + (p[2] << 8);
+    offset = 3;
+  }
+  static const size_t kHeaderSizes[] = {11, 7, 3, 0};
+  if (available < offset + kHeaderSizes[fmt]) {
+    return 0;
+  }
+
+  ChunkStream& stream = streams_[csid];
+  const uint8_t* header = p + offset;
+  offset += kHeaderSizes[fmt];
+  bool newMessage = stream.payload.empty();
+  uint32_t timestampField = 0;
+  if (fmt <= 2) {
+    timestampField = readBe24(header);
+    stream.extendedTimestamp = timestampField == RTMP_EXTENDED_TIMESTAMP;
+  }
+  if (fmt <= 1) {
+    uint32_t length = readBe24(header + 3);
+    uint8_t type = header[6];
+    if (!newMessage && (length != stream.length || type != stream.type)) {
+      broken = true;
+      return 0;
+    }
+    stream.length = length;
+    stream.type = type;
+  }
+  if (fmt == 0) {
+    stream.streamId = header[7] | (header[8] << 8) | (header[9] << 16) |
+                      (static_cast<uint32_t>(header[10]) << 24);
+  }
+  if (stream.extendedTimestamp) {
+    if (available < offset + 4) {
+      return 0;
+    }
+    if (fmt <= 2) {
+      timestampField = readBe32(p + offset);
+    }
+    offset += 4;
+  }
+
+  size_t left = stream.length - stream.payload.size();
+  size_t take = std::min<size_t>(left, chunk_size_);
+  if (available < offset + take) {
+    return 0;
+  }
+  // the timestamp is taken when a message starts, continuation chunks keep it
+  if (newMessage) {
+    if (fmt == 0) {
+      stream.timestamp = timestampField;
+      stream.timestampDelta = 0;
+    } else if (fmt <= 2) {
+      stream.timestampDelta = timestampField;
+      stream.timestamp += timestampField;
+    } else {
+      stream.timestamp += stream.timestampDelta;
+    }
+  }
+  stream.payload.insert(stream.payload.end(), p + offset, p + offset + take);
+  offset += take;
+
+  if (stream.payload.size() == stream.length) {
+    RtmpMessage message;
+    message.type = stream.type;
+    message.timestamp = stream.timestamp;
+    message.streamId = stream.streamId;
+    message.payload.swap(stream.payload);
+    stream.payload.clear();
+    if (message.type == RTMP_MSG_SET_CHUNK_SIZE && message.payload.size() >= 4) {
+      chunk_size_ = std::max<uint32_t>(1, readBe32(message.payload.data()) & 0x7fffffff);
+    }
+    callback(message);
+  }
+  return offset;
+}
+
+bool RtmpChunkReader::feed(const uint8_t* data, size_t length, const MessageCallback& callback) {
+  pending_.insert(pending_.end(), data, data + length);
+  size_t offset = 0;
+  bool broken = false;
+  while (size_t used = parseChunk(pending_.data() + offset, pending_.size() - offset, callback,
+                                  broken)) {
+    offset += used;
+  }
+  pending_.erase(pending_.begin(), pending_.begin() + offset);
+  return !broken;
+}
+
+bool rtmpSendAll(int fd, const void* data, size_t length) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  while (length > 0) {
+    ssize_t sent = send(fd, p, length, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    p += sent;
+    length -= sent;
+  }
+  return true;
+}
+
+bool rtmpSendIov(int fd, iovec* iov, int count) {
+  while (count > 0) {
+    msghdr header = {};
+    header.msg_iov = iov;
+    header.msg_iovlen = std::min(count, IOV_MAX);
+    ssize_t sent = sendmsg(fd, &header, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    // skip what went out, a partial iovec is advanced in place
+    while (count > 0 && static_cast<size_t>(sent) >= iov->iov_len) {
+      sent -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0 && sent > 0) {
+      iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + sent;
+      iov->iov_len -= sent;
+    }
+  }
+  return true;
+}
+
+bool rtmpRecvAll(int fd, void* data, size_t length) {
+  uint8_t* p = static_cast<uint8_t*>(data);
+  while (length > 0) {
+    ssize_t received = recv(fd, p, length, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    p += received;
+    length -= received;
+  }
+  return true;
+}
+
+static void fillHandshake(uint8_t* packet) {
+  uint32_t now = static_cast<uint32_t>(time(nullptr));
+  for (int i = 0; i < 4; ++i) {
+    packet[i] = (now >> (24 - 8 * i)) & 0xff;
+  }
+  memset(packet + 4, 0, 4);
+  for (int i = 8; i < RTMP_HANDSHAKE_SIZE; ++i) {
+    packet[i] = rand() & 0xff;
+  }
+}
+
+bool rtmpClientHandshake(int fd) {
+  std::vector<uint8_t> c0c1(1 + RTMP_HANDSHAKE_SIZE);
+  c0c1[0] = RTMP_VERSION;
+  fillHandshake(&c0c1[1]);
+  std::vector<uint8_t> s0s1s2(1 + 2 * RTMP_HANDSHAKE_SIZE);
+  if (!rtmpSendAll(fd, c0c1.data(), c0c1.size()) ||
+      !rtmpRecvAll(fd, s0s1s2.data(), s0s1s2.size()) || s0s1s2[0] != RTMP_VERSION) {
+    return false;
+  }
+  // C2 echoes S1
+  return rtmpSendAll(fd, &s0s1s2[1], RTMP_HANDSHAKE_SIZE);
+}
+
+bool rtmpServerHandshake(int fd) {
+  std::vector<uint8_t> c0c1(1 + RTMP_HANDSHAKE_SIZE);
+  if (!rtmpRecvAll(fd, c0c1.data(), c0c1.size()) || c0c1[0] != RTMP_VERSION) {
+    return false;
+  }
+  std::vector<uint8_t> s0s1s2(1 + 2 * RTMP_HANDSHAKE_SIZE);
+  s0s1s2[0] = RTMP_VERSION;
+  fillHandshake(&s0s1s2[1]);
+  // S2 echoes C1
+  memcpy(&s0s1s2[1 + RTMP_HANDSHAKE_SIZE], &c0c1[1], RTMP_HANDSHAKE_SIZE);
+  std::vector<uint8_t> c2(RTMP_HANDSHAKE_SIZE);
+  return rtmpSendAll(fd, s0s1s2.data(), s0s1s2.size()) && rtmpRecvAll(fd, c2.data(), c2.size());
+}
+
+void rtmpControlMessage(uint8_t type, uint32_t value, std::vector<uint8_t>& payload) {
+  payload.clear();
+  putBe32(payload, value);
+  if (type == RTMP_MSG_SET_PEER_BANDWIDTH) {
+    // dynamic limit
+    payload.push_back(2);
+  }
+}
@@ -0,0 +1,146 @@
+//  Agora RTC/MEDIA SDK
+//
+//  The parts of RTMP a publisher and a test server need: handshake, chunk
+//  streams and AMF0 commands.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define RTMP_DEFAULT_PORT (1935)
+#define RTMP_DEFAULT_CHUNK_SIZE (128)
+#define RTMP_OUT_CHUNK_SIZE (4096)
+
+enum RTMP_MESSAGE_TYPE {
+  RTMP_MSG_SET_CHUNK_SIZE = 1,
+  RTMP_MSG_ACKNOWLEDGEMENT = 3,
+  RTMP_MSG_USER_CONTROL = 4,
+  RTMP_MSG_WINDOW_ACK_SIZE = 5,
+  RTMP_MSG_SET_PEER_BANDWIDTH = 6,
+  RTMP_MSG_AUDIO = 8,
+  RTMP_MSG_VIDEO = 9,
+  RTMP_MSG_DATA_AMF0 = 18,
+  RTMP_MSG_COMMAND_AMF0 = 20,
+};
+
+// Chunk stream ids, one per kind of message as most encoders do
+enum RTMP_CHUNK_STREAM {
+  RTMP_CSID_CONTROL = 2,
+  RTMP_CSID_COMMAND = 3,
+  RTMP_CSID_AUDIO = 4,
+  RTMP_CSID_DATA = 5,
+  RTMP_CSID_VIDEO = 6,
+};
+
+struct AmfValue {
+  enum Type { NUMBER, BOOLEAN, STRING, OBJECT, NULL_VALUE };
+  Type type = NULL_VALUE;
+  double number = 0;
+  bool boolean = false;
+  std::string string;
+  // Objects and ECMA arrays
+  std::vector<std::pair<std::string, AmfValue>> properties;
+
+  const AmfValue* find(const std::string& name) const;
+};
+
+// Appends AMF0 values to a buffer
+class AmfWriter {
+ public:
+  explicit AmfWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+  AmfWriter& number(double value);
+  AmfWriter& boolean(bool value);
+  AmfWriter& string(const std::string& value);
+  AmfWriter& null();
+  AmfWriter& beginObject();
+  AmfWriter& beginEcmaArray(uint32_t count);
+  // Name of the next property of an object or ECMA array
+  AmfWriter& key(const std::string& name);
+  AmfWriter& endObject();
+
+ private:
+  void putString(const std::string& value);
+
+  std::vector<uint8_t>& out_;
+};
+
+// Decodes the values of a command or data message, false on types it does
+// not know or on truncation
+bool decodeAmf(const uint8_t* data, size_t length, std::vector<AmfValue>& values);
+
+struct RtmpMessage {
+  uint8_t type = 0;
+  uint32_t timestamp = 0;
+  uint32_t streamId = 0;
+  std::vector<uint8_t> payload;
+};
+
+/**
+ Splits messages into chunks. The payload is given as segments and never
+ copied: the chunk headers go to a buffer of their own and the result is a
+ list of iovecs for writev, so one frame can be sent to many connections.
+ Every message starts with a full type 0 header.
+ */
+class RtmpChunkWriter {
+ public:
+  void setChunkSize(uint32_t chunkSize) { chunk_size_ = chunkSize; }
+  uint32_t chunkSize() const { return chunk_size_; }
+
+  // Replaces headers and iov
+  void write(uint32_t csid, uint8_t type, uint32_t timestamp, uint32_t streamId,
+             const iovec* payload, int count, std::vector<uint8_t>& headers,
+             std::vector<iovec>& iov) const;
+
+ private:
+  uint32_t chunk_size_ = RTMP_DEFAULT_CHUNK_SIZE;
+};
+
+// Reassembles messages from the chunks of any number of chunk streams
+class RtmpChunkReader {
+ public:
+  typedef std::function<void(RtmpMessage& message)> MessageCallback;
+
+  void setChunkSize(uint32_t chunkSize) { chunk_size_ = chunkSize; }
+  // false when the stream is broken
+  bool feed(const uint8_t* data, size_t length, const MessageCallback& callback);
+
+ private:
+  struct ChunkStream {
+    uint32_t timestamp = 0;
+    uint32_t timestampDelta = 0;
+    uint32_t length = 0;
+    uint8_t type = 0;
+    uint32_t streamId = 0;
+    bool extendedTimestamp = false;
+    std::vector<uint8_t> payload;
+  };
+
+  // Size of the chunk at p, 0 if it is incomplete
+  size_t parseChunk(const uint8_t* p, size_t available, const MessageCallback& callback,
+                    bool& broken);
+
+  uint32_t chunk_size_ = RTMP_DEFAULT_CHUNK_SIZE;
+  std::map<uint32_t, ChunkStream> streams_;
+  std::vector<uint8_t> pending_;
+};
+
+// Blocking socket helpers, false on error or timeout
+bool rtmpSendAll(int fd, const void* data, size_t length);
+bool rtmpSendIov(int fd, iovec* iov, int count);
+bool rtmpRecvAll(int fd, void* data, size_t length);
+
+// The plain handshake, C0 to C2 and S0 to S2 without digests
+bool rtmpClientHandshake(int fd);
+bool rtmpServerHandshake(int fd);
+
+// A protocol control message: set chunk size, window ack size or ack
+void rtmpControlMessage(uint8_t type, uint32_t value, std::vector<uint8_t>& payload);
@@ -0,0 +1,351 @@
+#include "rtmp_publisher.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "common/log.h"
+
+#define RTMP_FLASH_VERSION "FMLE/3.0 (compatible; FMSc/1.0)"
+#define RTMP_USER_CONTROL_PING_REQUEST (6)
+#define RTMP_USER_CONTROL_PING_RESPONSE (7)
+#define FLV_VIDEO_CODEC_AVC (7)
+#define FLV_AUDIO_CODEC_AAC (10)
+
+bool parseRtmpUrl(const std::string& url, RtmpUrl& parsed) {
+  static const std::string kScheme = "rtmp://";
+  if (url.compare(0, kScheme.size(), kScheme) != 0) {
+    return false;
+  }
+  std::string rest = url.substr(kScheme.size());
+  size_t pathStart = rest.find('/');
+  size_t streamStart = rest.rfind('/');
+  if (pathStart == std::string::npos || streamStart == pathStart) {
+    return false;
+  }
+  std::string hostPort = rest.substr(0, pathStart);
+  parsed.app = rest.substr(pathStart + 1, streamStart - pathStart - 1);
+  parsed.stream = rest.substr(streamStart + 1);
+  size_t colon = hostPort.rfind(':');
+  if (colon != std::string::npos) {
+    parsed.port = atoi(hostPort.c_str() + colon + 1);
+    hostPort.resize(colon);
+  }
+  parsed.host = hostPort;
+  if (parsed.host.empty() || parsed.app.empty() || parsed.stream.empty() || parsed.port <= 0) {
+    return false;
+  }
+  parsed.tcUrl = kScheme + parsed.host + ":" + std::to_string(parsed.port) + "/" + parsed.app;
+  return true;
+}
+
+static int connectTcp(const std::string& host, int port, int timeoutMs, int sendBufferBytes) {
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+    AG_LOG(ERROR, "Failed to resolve %s", host.c_str());
+    return -1;
+  }
+  int fd = -1;
+  for (addrinfo* address = addresses; address; address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    // also bounds connect() on Linux
+    timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    if (sendBufferBytes > 0) {
+      setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendBufferBytes, sizeof(sendBufferBytes));
+    }
+    if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+      break;
+    }
+    ::close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addresses);
+  return fd;
+}
+
+static std::string onStatusField(const std::vector<AmfValue>& values, const char* name) {
+  if (values.size() < 4) {
+    return "";
+  }
+  const AmfValue* field = values[3].find(name);
+  return field && field->type == AmfValue::STRING ? field->string : "";
+}
+
+RtmpPublisher::~RtmpPublisher() { close(); }
+
+bool RtmpPublisher::connect(const std::string& url, int timeoutMs, int sendBufferBytes) {
+  close();
+  RtmpUrl parsed;
+  if (!parseRtmpUrl(url, parsed)) {
+    AG_LOG(ERROR, "Invalid rtmp url %s", url.c_str());
+    return false;
+  }
+  fd_ = connectTcp(parsed.host, parsed.port, timeoutMs, sendBufferBytes);
+  if (fd_ < 0) {
+    AG_LOG(ERROR, "Failed to connect to %s:%d", parsed.host.c_str(), parsed.port);
+    return false;
+  }
+  if (!rtmpClientHandshake(fd_)) {
+    AG_LOG(ERROR, "Rtmp handshake with %s:%d failed", parsed.host.c_str(), parsed.port);
+    close();
+    return false;
+  }
+
+  // large chunks, a video frame goes out in few of them
+  std::vector<uint8_t> control;
+  rtmpControlMessage(RTMP_MSG_SET_CHUNK_SIZE, RTMP_OUT_CHUNK_SIZE, control);
+  iovec body = {control.data(), control.size()};
+  if (!sendMessage(RTMP_CSID_CONTROL, RTMP_MSG_SET_CHUNK_SIZE, 0, &body, 1)) {
+    close();
+    return false;
+  }
+  writer_.setChunkSize(RTMP_OUT_CHUNK_SIZE);
+
+  std::vector<uint8_t> command;
+  std::vector<AmfValue> response;
+  AmfWriter(command)
+      .string("connect")
+      .number(1)
+      .beginObject()
+      .key("app")
+      .string(parsed.app)
+      .key("type")
+      .string("nonprivate")
+      .key("flashVer")
+      .string(RTMP_FLASH_VERSION)
+      .key("tcUrl")
+      .string(parsed.tcUrl)
+      .endObject();
+  if (!sendCommand(command, 0) || !waitForResponse(1, response) ||
+      response[0].string != "_result") {
+    AG_LOG(ERROR, "Rtmp connect to %s rejected: %s", parsed.tcUrl.c_str(),
+           onStatusField(response, "description").c_str());
+    close();
+    return false;
+  }
+
+  // what most servers expect from an encoder, their answers are not needed
+  command.clear();
+  AmfWriter(command).string("releaseStream").number(2).null().string(parsed.stream);
+  std::vector<uint8_t> fcPublish;
+  AmfWriter(fcPublish).string("FCPublish").number(3).null().string(parsed.stream);
+  if (!sendCommand(command, 0) || !sendCommand(fcPublish, 0)) {
+    close();
+    return false;
+  }
+
+  command.clear();
+  AmfWriter(command).string("createStream").number(4).null();
+  if (!sendCommand(command, 0) || !waitForResponse(4, response) ||
+      response[0].string != "_result" || response.size() < 4 ||
+      response[3].type != AmfValue::NUMBER) {
+    AG_LOG(ERROR, "Rtmp createStream failed");
+    close();
+    return false;
+  }
+  stream_id_ = static_cast<uint32_t>(response[3].number);
+
+  command.clear();
+  AmfWriter(command).string("publish").number(5).null().string(parsed.stream).string("live");
+  if (!sendCommand(command, stream_id_) || !waitForResponse(0, response) ||
+      onStatusField(response, "code") != "NetStream.Publish.Start") {
+    AG_LOG(ERROR, "Rtmp publish of %s rejected: %s %s", parsed.stream.c_str(),
+           onStatusField(response, "code").c_str(),
+           onStatusField(response, "description").c_str());
+    close();
+    return false;
+  }
+  commands_.clear();
+  return true;
+}
+
+void RtmpPublisher::close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  fd_ = -1;
+  stream_id_ = 0;
+  writer_ = RtmpChunkWriter();
+  reader_ = RtmpChunkReader();
+  commands_.clear();
+  failed_ = false;
+  bytes_received_ = 0;
+  acked_bytes_ = 0;
+  window_ack_size_ = 0;
+}
+
+bool RtmpPublisher::sendMetadata(const RtmpMetadata& metadata) {
+  std::vector<uint8_t> data;
+  AmfWriter writer(data);
+  writer.string("@setDataFrame").string("onMetaData").beginEcmaArray(8);
+  writer.key("width").number(metadata.width);
+  writer.key("height").number(metadata.height);
+  writer.key("framerate").number(metadata.frameRate);
+  writer.key("videocodecid").number(FLV_VIDEO_CODEC_AVC);
+  writer.key("audiocodecid").number(FLV_AUDIO_CODEC_AAC);
+  writer.key("audiosamplerate").number(metadata.audioSampleRate);
+  writer.key("stereo").boolean(metadata.audioChannels > 1);
+  writer.key("encoder").string("agora rtc sdk sample");
+  writer.endObject();
+  iovec body = {data.data(), data.size()};
+  return sendMessage(RTMP_CSID_DATA, RTMP_MSG_DATA_AMF0, 0, &body, 1);
+}
+
+bool RtmpPublisher::sendVideo(uint32_t timestampMs, const iovec* body, int count) {
+  return sendMessage(RTMP_CSID_VIDEO, RTMP_MSG_VIDEO, timestampMs, body, count);
+}
+
+bool RtmpPublisher::sendAudio(uint32_t timestampMs, const iovec* body, int count) {
+  return sendMessage(RTMP_CSID_AUDIO, RTMP_MSG_AUDIO, timestampMs, body, count);
+}
+
+bool RtmpPublisher::sendMessage(uint32_t csid, uint8_t type, uint32_t timestamp,
+                                const iovec* body, int count) {
+  if (fd_ < 0) {
+    return false;
+  }
+  // protocol control messages always go on stream 0
+  uint32_t streamId = csid == RTMP_CSID_CONTROL ? 0 : stream_id_;
+  writer_.write(csid, type, timestamp, streamId, body, count, headers_, iov_);
+  size_t length = 0;
+  for (const iovec& segment : iov_) {
+    length += segment.iov_len;
+  }
+  if (!rtmpSendIov(fd_, iov_.data(), static_cast<int>(iov_.size()))) {
+    AG_LOG(ERROR, "Rtmp send failed: %s", strerror(errno));
+    return false;
+  }
+  bytes_sent_ += length;
+  return true;
+}
+
+bool RtmpPublisher::sendCommand(const std::vector<uint8_t>& command, uint32_t streamId) {
+  iovec body = {const_cast<uint8_t*>(command.data()), command.size()};
+  uint32_t savedStreamId = stream_id_;
+  stream_id_ = streamId;
+  bool sent = sendMessage(RTMP_CSID_COMMAND, RTMP_MSG_COMMAND_AMF0, 0, &body, 1);
+  stream_id_ = savedStreamId;
+  return sent;
+}
+
+bool RtmpPublisher::waitForResponse(double transactionId, std::vector<AmfValue>& response) {
+  response.clear();
+  uint8_t buffer[4096];
+  while (true) {
+    for (std::vector<AmfValue>& values : commands_) {
+      if (values.size() < 2 || values[0].type != AmfValue::STRING) {
+        continue;
+      }
+      bool matches = transactionId == 0 ? values[0].string == "onStatus"
+                                        : (values[0].string == "_result" ||
+                                           values[0].string == "_error") &&
+                                              values[1].number == transactionId;
+      if (matches) {
+        response.swap(values);
+        commands_.clear();
+        return true;
+      }
+    }
+    commands_.clear();
+    // bounded by SO_RCVTIMEO
+    ssize_t received = recv(fd_, buffer, sizeof(buffer), 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    bytes_received_ += received;
+    if (!reader_.feed(buffer, received, [this](RtmpMessage& message) { handleMessage(message); })) {
+      return false;
+    }
+  }
+}
+
+bool RtmpPublisher::poll() {
+  if (fd_ < 0) {
+    return false;
+  }
+  uint8_t buffer[4096];
+  while (!failed_) {
+    ssize_t received = recv(fd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (received <= 0) {
+      AG_LOG(ERROR, "Rtmp server closed the connection");
+      return false;
+    }
+    bytes_received_ += received;
+    if (!reader_.feed(buffer, received, [this](RtmpMessage& message) { handleMessage(message); })) {
+      return false;
+    }
+  }
+  commands_.clear();
+  return !failed_;
+}
+
+void RtmpPublisher::handleMessage(RtmpMessage& message) {
+  const std::vector<uint8_t>& payload = message.payload;
+  switch (message.type) {
+    case RTMP_MSG_USER_CONTROL:
+      if (payload.size() >= 6 &&
+          ((payload[0] << 8) | payload[1]) == RTMP_USER_CONTROL_PING_REQUEST) {
+        std::vector<uint8_t> pong = {0, RTMP_USER_CONTROL_PING_RESPONSE, payload[2], payload[3],
+                                     payload[4], payload[5]};
+        iovec body = {pong.data(), pong.size()};
+        failed_ = failed_ || !sendMessage(RTMP_CSID_CONTROL, RTMP_MSG_USER_CONTROL, 0, &body, 1);
+      }
+      break;
+    case RTMP_MSG_WINDOW_ACK_SIZE:
+      if (payload.size() >= 4) {
+        window_ack_size_ =
+            (payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) | payload[3];
+      }
+      break;
+    case RTMP_MSG_COMMAND_AMF0: {
+      std::vector<AmfValue> values;
+      if (!decodeAmf(payload.data(), payload.size(), values)) {
+        break;
+      }
+      if (!values.empty() && values[0].string == "onStatus" &&
+          onStatusField(values, "level") == "error") {
+        AG_LOG(ERROR, "Rtmp onStatus %s: %s", onStatusField(values, "code").c_str(),
+               onStatusField(values, "description").c_str());
+        failed_ = true;
+      }
+      commands_.push_back(std::move(values));
+      break;
+    }
+    default:
+      break;
+  }
+
+  // servers stop reading from peers that never acknowledge
+  if (window_ack_size_ && bytes_received_ - acked_bytes_ >= window_ack_size_) {
+    std::vector<uint8_t> ack;
+    rtmpControlMessage(RTMP_MSG_ACKNOWLEDGEMENT, static_cast<uint32_t>(bytes_received_), ack);
+    iovec body = {ack.data(), ack.size()};
+    sendMessage(RTMP_CSID_CONTROL, RTMP_MSG_ACKNOWLEDGEMENT, 0, &body, 1);
+    acked_bytes_ = bytes_received_;
+  }
+}
@@ -0,0 +1,87 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Minimal RTMP publisher that sends FLV tags as they are, no encoder involved.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <string>
+#include <vector>
+
+#include "rtmp_protocol.h"
+
+struct RtmpUrl {
+  std::string host;
+  int port = RTMP_DEFAULT_PORT;
+  std::string app;
+  std::string stream;
+  // rtmp://host:port/app, what the connect command carries
+  std::string tcUrl;
+};
+
+// rtmp://host[:port]/app[/more]/stream, the last path element is the stream
+bool parseRtmpUrl(const std::string& url, RtmpUrl& parsed);
+
+struct RtmpMetadata {
+  int width = 0;
+  int height = 0;
+  int frameRate = 0;
+  int audioSampleRate = 0;
+  int audioChannels = 0;
+};
+
+/**
+ One publishing connection: connect, releaseStream, FCPublish, createStream
+ and publish, then audio and video messages. Blocking, meant for a thread of
+ its own; every socket call is bounded by timeoutMs so a stalled server ends
+ in an error rather than a hang. What the server sends once publishing is
+ read in poll(): chunk size changes, pings and onStatus errors.
+ */
+class RtmpPublisher {
+ public:
+  RtmpPublisher() = default;
+  ~RtmpPublisher();
+  RtmpPublisher(const RtmpPublisher&) = delete;
+  RtmpPublisher& operator=(const RtmpPublisher&) = delete;
+
+  // Up to NetStream.Publish.Start, sendBufferBytes 0 keeps the system's SO_SNDBUF
+  bool connect(const std::string& url, int timeoutMs, int sendBufferBytes = 0);
+  void close();
+  bool isConnected() const { return fd_ >= 0; }
+
+  bool sendMetadata(const RtmpMetadata& metadata);
+  // FLV tag bodies as segments, the bytes are not copied
+  bool sendVideo(uint32_t timestampMs, const iovec* body, int count);
+  bool sendAudio(uint32_t timestampMs, const iovec* body, int count);
+
+  // Reads what the server sent without blocking, false once it went away or
+  // rejected the stream
+  bool poll();
+
+  uint64_t bytesSent() const { return bytes_sent_; }
+
+ private:
+  bool sendMessage(uint32_t csid, uint8_t type, uint32_t timestamp, const iovec* body,
+                   int count);
+  bool sendCommand(const std::vector<uint8_t>& command, uint32_t streamId);
+  // Reads until a _result or _error for the transaction, or an onStatus
+  // when transactionId is 0
+  bool waitForResponse(double transactionId, std::vector<AmfValue>& response);
+  void handleMessage(RtmpMessage& message);
+
+  int fd_ = -1;
+  uint32_t stream_id_ = 0;
+  RtmpChunkWriter writer_;
+  RtmpChunkReader reader_;
+  std::vector<uint8_t> headers_;
+  std::vector<iovec> iov_;
+  std::vector<std::vector<AmfValue>> commands_;
+  bool failed_ = false;
+  uint64_t bytes_sent_ = 0;
+  uint64_t bytes_received_ = 0;
+  uint64_t acked_bytes_ = 0;
+  uint32_t window_ack_size_ = 0;
+};
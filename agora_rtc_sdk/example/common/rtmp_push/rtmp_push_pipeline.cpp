@@ -0,0 +1,263 @@
+#include "rtmp_push_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "common/log.h"
+
+#define RTMP_PUSH_POLL_MS (20)
+
+RtmpPushPipeline::RtmpPushPipeline(const RtmpPushConfig& config,
+                                   agora::rtc::IRtmpConnectionObserver* observer)
+    : config_(config), observer_(observer) {}
+
+RtmpPushPipeline::~RtmpPushPipeline() { stop(); }
+
+void RtmpPushPipeline::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (thread_.joinable()) {
+    return;
+  }
+  stopped_ = false;
+  thread_ = std::thread(&RtmpPushPipeline::run, this);
+}
+
+void RtmpPushPipeline::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+  }
+  cond_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool RtmpPushPipeline::push(const EncodedMediaFramePtr& frame) {
+  bool isVideo = frame->kind == EncodedMediaFrame::VIDEO_H264;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+      return false;
+    }
+    uint64_t& dropped = isVideo ? stats_.droppedVideoFrames : stats_.droppedAudioFrames;
+    if (isVideo && wait_key_frame_ && !frame->isKeyFrame) {
+      ++dropped;
+      return false;
+    }
+    if (queue_.size() >= static_cast<size_t>(config_.maxQueuedFrames)) {
+      if (!isVideo || !frame->isKeyFrame) {
+        ++dropped;
+        wait_key_frame_ = wait_key_frame_ || isVideo;
+        return false;
+      }
+      // nothing queued is worth sending once a key frame is waiting
+      for (const EncodedMediaFramePtr& queued : queue_) {
+        bool queuedVideo = queued->kind == EncodedMediaFrame::VIDEO_H264;
+        ++(queuedVideo ? stats_.poppedVideoFrames : stats_.poppedAudioFrames);
+        ++(queuedVideo ? stats_.droppedVideoFrames : stats_.droppedAudioFrames);
+      }
+      queue_.clear();
+    }
+    if (isVideo) {
+      wait_key_frame_ = false;
+    }
+    ++(isVideo ? stats_.pushedVideoFrames : stats_.pushedAudioFrames);
+    queue_.push_back(frame);
+  }
+  cond_.notify_one();
+  return true;
+}
+
+RtmpPushStats RtmpPushPipeline::getStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void RtmpPushPipeline::waitFor(int ms) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait_for(lock, std::chrono::milliseconds(ms), [this] { return stopped_; });
+}
+
+void RtmpPushPipeline::run() {
+  agora::rtc::RtmpConnectionInfo info;
+  bool everConnected = false;
+  bool reconnecting = false;
+  int backoffMs = config_.reconnectIntervalMs;
+  auto nextStats = std::chrono::steady_clock::now() +
+                   std::chrono::milliseconds(config_.statsIntervalMs);
+
+  while (true) {
+    // also while reconnecting, that is when the backlog grows
+    auto now = std::chrono::steady_clock::now();
+    if (now >= nextStats) {
+      reportStatistics();
+      nextStats = now + std::chrono::milliseconds(config_.statsIntervalMs);
+    }
+
+    if (!publisher_.isConnected()) {
+      if (everConnected && !reconnecting) {
+        reconnecting = true;
+        if (observer_) {
+          observer_->onReconnecting(info);
+        }
+      }
+      if (!connect()) {
+        AG_LOG(ERROR, "Failed to publish to %s, retrying in %d ms", config_.url.c_str(),
+               backoffMs);
+        waitFor(backoffMs);
+        backoffMs = std::min(backoffMs * 2, config_.reconnectIntervalMs * 8);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopped_) {
+          break;
+        }
+        continue;
+      }
+      backoffMs = config_.reconnectIntervalMs;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.connected = true;
+        stats_.reconnects += everConnected ? 1 : 0;
+      }
+      if (observer_) {
+        if (everConnected) {
+          observer_->onReconnected(info);
+        } else {
+          observer_->onConnected(info);
+        }
+      }
+      everConnected = true;
+      reconnecting = false;
+    }
+
+    EncodedMediaFramePtr frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait_for(lock, std::chrono::milliseconds(RTMP_PUSH_POLL_MS),
+                     [this] { return stopped_ || !queue_.empty(); });
+      if (stopped_) {
+        break;
+      }
+      if (!queue_.empty()) {
+        frame = std::move(queue_.front());
+        queue_.pop_front();
+        ++(frame->kind == EncodedMediaFrame::VIDEO_H264 ? stats_.poppedVideoFrames
+                                                         : stats_.poppedAudioFrames);
+      }
+    }
+
+    bool ok = !frame || sendFrame(*frame);
+    ok = ok && publisher_.poll();
+    if (!ok) {
+      AG_LOG(ERROR, "Lost the rtmp connection to %s", config_.url.c_str());
+      publisher_.close();
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.connected = false;
+    }
+  }
+
+  bool wasConnected = publisher_.isConnected();
+  publisher_.close();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.connected = false;
+  }
+  if (observer_ && wasConnected) {
+    observer_->onDisconnected(info);
+  }
+}
+
+bool RtmpPushPipeline::connect() {
+  if (!publisher_.connect(config_.url, config_.timeoutMs, config_.sendBufferBytes)) {
+    return false;
+  }
+  send_key_frame_ = true;
+  video_header_sent_ = false;
+  audio_header_sent_ = false;
+  has_base_timestamp_ = false;
+
+  RtmpMetadata metadata;
+  metadata.width = config_.videoWidth;
+  metadata.height = config_.videoHeight;
+  metadata.frameRate = config_.videoFrameRate;
+  metadata.audioSampleRate = packer_.audioSampleRate();
+  metadata.audioChannels = packer_.audioChannels();
+  if (!publisher_.sendMetadata(metadata)) {
+    publisher_.close();
+    return false;
+  }
+  AG_LOG(INFO, "Publishing to %s", config_.url.c_str());
+  return true;
+}
+
+bool RtmpPushPipeline::sendFrame(const EncodedMediaFrame& frame) {
+  bool isVideo = frame.kind == EncodedMediaFrame::VIDEO_H264;
+  bool packed = isVideo ? packer_.packVideo(frame.data.data(), frame.data.size(),
+                                            frame.isKeyFrame, tag_)
+                        : packer_.packAudio(frame.data.data(), frame.data.size(), tag_);
+  // a delta frame is useless to a server that has not seen its key frame
+  bool usable = packed && (!isVideo || !send_key_frame_ || tag_.isKeyFrame) &&
+                !(isVideo ? packer_.videoSequenceHeader() : packer_.audioSequenceHeader()).empty();
+  if (!usable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++(isVideo ? stats_.droppedVideoFrames : stats_.droppedAudioFrames);
+    return true;
+  }
+
+  if (!has_base_timestamp_) {
+    has_base_timestamp_ = true;
+    base_timestamp_ = frame.timestampMs;
+  }
+  int32_t timestamp = static_cast<int32_t>(frame.timestampMs - base_timestamp_);
+  timestamp = std::max(timestamp, 0);
+
+  bool headerChanged = isVideo ? packer_.takeVideoSequenceHeaderChange()
+                               : packer_.takeAudioSequenceHeaderChange();
+  bool& headerSent = isVideo ? video_header_sent_ : audio_header_sent_;
+  if (headerChanged || !headerSent) {
+    const std::vector<uint8_t>& header =
+        isVideo ? packer_.videoSequenceHeader() : packer_.audioSequenceHeader();
+    iovec body = {const_cast<uint8_t*>(header.data()), header.size()};
+    if (!(isVideo ? publisher_.sendVideo(timestamp, &body, 1)
+                  : publisher_.sendAudio(timestamp, &body, 1))) {
+      return false;
+    }
+    headerSent = true;
+  }
+
+  size_t size = tag_.size();
+  if (!(isVideo ? publisher_.sendVideo(timestamp, tag_.segments.data(),
+                                       static_cast<int>(tag_.segments.size()))
+                : publisher_.sendAudio(timestamp, tag_.segments.data(),
+                                       static_cast<int>(tag_.segments.size())))) {
+    return false;
+  }
+  if (isVideo) {
+    send_key_frame_ = false;
+    video_bytes_ += size;
+    ++video_frames_;
+  } else {
+    audio_bytes_ += size;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++(isVideo ? stats_.sentVideoFrames : stats_.sentAudioFrames);
+  stats_.bytesSent = publisher_.bytesSent();
+  return true;
+}
+
+void RtmpPushPipeline::reportStatistics() {
+  uint64_t intervalMs = std::max(1, config_.statsIntervalMs);
+  uint64_t videoKbps = video_bytes_ * 8 / intervalMs;
+  uint64_t audioKbps = audio_bytes_ * 8 / intervalMs;
+  uint64_t frameRate = video_frames_ * 1000 / intervalMs;
+  video_bytes_ = 0;
+  audio_bytes_ = 0;
+  video_frames_ = 0;
+  if (!observer_) {
+    return;
+  }
+  RtmpPushStats stats = getStats();
+  observer_->onTransferStatistics(config_.videoWidth, config_.videoHeight, videoKbps, audioKbps,
+                                  frameRate, stats.pushedVideoFrames, stats.poppedVideoFrames);
+}
@@ -0,0 +1,133 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Pushes pre-encoded H.264 and AAC to an RTMP server without transcoding.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NGIAgoraRtmpConnection.h"
+#include "flv_packer.h"
+#include "rtmp_publisher.h"
+
+// One encoded frame, shared as is by every pipeline it is pushed to
+struct EncodedMediaFrame {
+  enum Kind { VIDEO_H264, AUDIO_AAC };
+  Kind kind = VIDEO_H264;
+  bool isKeyFrame = false;
+  uint32_t timestampMs = 0;
+  // Annex B access unit, or one ADTS frame
+  std::vector<uint8_t> data;
+};
+
+typedef std::shared_ptr<const EncodedMediaFrame> EncodedMediaFramePtr;
+
+struct RtmpPushConfig {
+  std::string url;
+  // Frames of both kinds waiting to be sent
+  int maxQueuedFrames = 150;
+  // Bounds connect and every send, a stalled server counts as disconnected
+  int timeoutMs = 5000;
+  // Kernel send buffer, 0 keeps the system default. A small one leaves a slow
+  // server's backlog in the queue, where stale frames are dropped, instead of
+  // seconds of it in the socket
+  int sendBufferBytes = 0;
+  // Doubles on every failed attempt, up to 8 times this
+  int reconnectIntervalMs = 1000;
+  int statsIntervalMs = 1000;
+  // For onMetaData and onTransferStatistics
+  int videoWidth = 0;
+  int videoHeight = 0;
+  int videoFrameRate = 0;
+};
+
+struct RtmpPushStats {
+  // Taken into and out of the queue, popped includes frames flushed from it
+  uint64_t pushedVideoFrames = 0;
+  uint64_t poppedVideoFrames = 0;
+  uint64_t pushedAudioFrames = 0;
+  uint64_t poppedAudioFrames = 0;
+  uint64_t sentVideoFrames = 0;
+  uint64_t sentAudioFrames = 0;
+  // Never queued, flushed, or skipped while waiting for a key frame
+  uint64_t droppedVideoFrames = 0;
+  uint64_t droppedAudioFrames = 0;
+  uint64_t bytesSent = 0;
+  int reconnects = 0;
+  bool connected = false;
+
+  // The same difference as push_video_frame_cnt - pop_video_frame_cnt in
+  // IRtmpConnectionObserver::onTransferStatistics
+  uint64_t videoBacklog() const { return pushedVideoFrames - poppedVideoFrames; }
+};
+
+/**
+ Frames are pushed from any thread and never block it; a sender thread packs
+ them into FLV tags and writes them to the server, so the frames go out as
+ they were encoded.
+
+ When the queue is full the frame is dropped, and video keeps being dropped
+ until the next key frame. A key frame that finds the queue full replaces
+ everything in it, so a destination that fell behind jumps back to live.
+
+ A lost connection is retried with backoff. Each new connection starts with
+ metadata, the sequence headers and a key frame. The observer, if any, gets
+ the connection events and onTransferStatistics on the sender thread; the
+ RtmpConnectionInfo passed along carries no details.
+ */
+class RtmpPushPipeline {
+ public:
+  RtmpPushPipeline(const RtmpPushConfig& config,
+                   agora::rtc::IRtmpConnectionObserver* observer = nullptr);
+  ~RtmpPushPipeline();
+
+  void start();
+  void stop();
+
+  // False if the frame was dropped
+  bool push(const EncodedMediaFramePtr& frame);
+
+  RtmpPushStats getStats();
+  const RtmpPushConfig& getConfig() const { return config_; }
+
+ private:
+  void run();
+  bool connect();
+  bool sendFrame(const EncodedMediaFrame& frame);
+  void reportStatistics();
+  void waitFor(int ms);
+
+  RtmpPushConfig config_;
+  agora::rtc::IRtmpConnectionObserver* observer_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<EncodedMediaFramePtr> queue_;
+  bool wait_key_frame_ = false;
+  bool stopped_ = true;
+  RtmpPushStats stats_;
+  std::thread thread_;
+
+  // Sender thread only
+  RtmpPublisher publisher_;
+  FlvPacker packer_;
+  FlvTagBody tag_;
+  bool send_key_frame_ = true;
+  bool video_header_sent_ = false;
+  bool audio_header_sent_ = false;
+  bool has_base_timestamp_ = false;
+  uint32_t base_timestamp_ = 0;
+  uint64_t video_bytes_ = 0;
+  uint64_t audio_bytes_ = 0;
+  uint64_t video_frames_ = 0;
+};
@@ -0,0 +1,211 @@
+#include "rtp_depacketizer.h"
+
+#include "common/file_parser/helper_h264_parser.h"
+#include "common/file_parser/helper_opus_packet.h"
+
+#define H264_NAL_SLICE (1)
+#define H264_NAL_IDR (5)
+#define H264_NAL_SPS (7)
+#define H264_NAL_PPS (8)
+#define H264_NAL_STAP_A (24)
+#define H264_NAL_FU_A (28)
+#define H264_FRAME_RESERVE (256 * 1024)
+
+static const uint8_t kStartCode[] = {0, 0, 0, 1};
+
+H264RtpDepacketizer::H264RtpDepacketizer(const FrameCallback& callback)
+    : callback_(callback),
+      in_frame_(false),
+      sps_end_(0),
+      timestamp_(0),
+      corrupted_(false),
+      in_fragment_(false),
+      has_sps_(false),
+      has_pps_(false),
+      has_slice_(false),
+      intra_(false),
+      wait_key_frame_(true),
+      frames_(0),
+      key_frames_(0),
+      dropped_(0),
+      malformed_(0) {
+  frame_.reserve(H264_FRAME_RESERVE);
+}
+
+void H264RtpDepacketizer::noteNal(uint8_t nalType, const uint8_t* nal, size_t length) {
+  if (nalType == H264_NAL_SPS) {
+    has_sps_ = true;
+  } else if (nalType == H264_NAL_PPS) {
+    has_pps_ = true;
+  } else if ((nalType == H264_NAL_SLICE || nalType == H264_NAL_IDR) && !has_slice_) {
+    // the first slice tells the picture type, the header follows the NAL header byte
+    has_slice_ = true;
+    intra_ = length > 1 && isH264IntraSlice(nalType, nal + 1, static_cast<int>(length - 1));
+  }
+}
+
+void H264RtpDepacketizer::appendNal(const uint8_t* nal, size_t length) {
+  if (length == 0) {
+    corrupted_ = true;
+    return;
+  }
+  uint8_t nalType = nal[0] & 0x1f;
+  noteNal(nalType, nal, length);
+  if (nalType == H264_NAL_SPS || nalType == H264_NAL_PPS) {
+    std::vector<uint8_t>& cached = nalType == H264_NAL_SPS ? sps_ : pps_;
+    cached.assign(kStartCode, kStartCode + sizeof(kStartCode));
+    cached.insert(cached.end(), nal, nal + length);
+  }
+  frame_.insert(frame_.end(), kStartCode, kStartCode + sizeof(kStartCode));
+  frame_.insert(frame_.end(), nal, nal + length);
+  if (nalType == H264_NAL_SPS) {
+    sps_end_ = frame_.size();
+  }
+}
+
+void H264RtpDepacketizer::push(const RtpPacket& packet, bool afterLoss) {
+  if (in_frame_ && (afterLoss || packet.timestamp != timestamp_)) {
+    // no marker bit, the loss may have taken it or the end of the frame
+    if (afterLoss) {
+      corrupted_ = true;
+    }
+    finishFrame();
+  }
+  if (afterLoss) {
+    wait_key_frame_ = true;
+  }
+  if (packet.payloadLength == 0) {
+    ++malformed_;
+    return;
+  }
+  if (!in_frame_) {
+    in_frame_ = true;
+    timestamp_ = packet.timestamp;
+  }
+
+  const uint8_t* payload = packet.payload;
+  size_t length = packet.payloadLength;
+  uint8_t nalType = payload[0] & 0x1f;
+  if (nalType >= H264_NAL_SLICE && nalType < H264_NAL_STAP_A) {
+    in_fragment_ = false;
+    appendNal(payload, length);
+  } else if (nalType == H264_NAL_STAP_A) {
+    in_fragment_ = false;
+    size_t offset = 1;
+    while (offset + 2 <= length) {
+      size_t size = (payload[offset] << 8) | payload[offset + 1];
+      offset += 2;
+      if (offset + size > length) {
+        ++malformed_;
+        corrupted_ = true;
+        break;
+      }
+      appendNal(payload + offset, size);
+      offset += size;
+    }
+  } else if (nalType == H264_NAL_FU_A && length > 2) {
+    bool start = payload[1] & 0x80;
+    bool end = payload[1] & 0x40;
+    if (start) {
+      uint8_t header = (payload[0] & 0xe0) | (payload[1] & 0x1f);
+      frame_.insert(frame_.end(), kStartCode, kStartCode + sizeof(kStartCode));
+      frame_.push_back(header);
+      // the slice header is in the first fragment
+      noteNal(header & 0x1f, payload + 1, length - 1);
+      in_fragment_ = true;
+    } else if (!in_fragment_) {
+      // the start fragment is missing
+      corrupted_ = true;
+    }
+    frame_.insert(frame_.end(), payload + 2, payload + length);
+    if (end) {
+      in_fragment_ = false;
+    }
+  } else {
+    // STAP-B, MTAP and FU-B are for interleaved mode only
+    ++malformed_;
+    corrupted_ = true;
+  }
+
+  if (packet.marker) {
+    finishFrame();
+  }
+}
+
+void H264RtpDepacketizer::finishFrame() {
+  if (in_fragment_ || !has_slice_) {
+    corrupted_ = true;
+  }
+  if (intra_ && !corrupted_) {
+    // in front of everything else, PPS after SPS
+    if (!has_pps_ && !pps_.empty()) {
+      frame_.insert(frame_.begin() + (has_sps_ ? sps_end_ : 0), pps_.begin(), pps_.end());
+      has_pps_ = true;
+    }
+    if (!has_sps_ && !sps_.empty()) {
+      frame_.insert(frame_.begin(), sps_.begin(), sps_.end());
+      has_sps_ = true;
+    }
+  }
+  bool keyFrame = has_sps_ && has_pps_ && intra_;
+  if (corrupted_ || (wait_key_frame_ && !keyFrame)) {
+    dropFrame();
+    return;
+  }
+  wait_key_frame_ = false;
+  ++frames_;
+  if (keyFrame) {
+    ++key_frames_;
+  }
+  callback_(frame_.data(), frame_.size(), timestamp_, keyFrame);
+  resetFrame();
+}
+
+void H264RtpDepacketizer::dropFrame() {
+  ++dropped_;
+  resetFrame();
+}
+
+void H264RtpDepacketizer::resetFrame() {
+  frame_.clear();
+  in_frame_ = false;
+  sps_end_ = 0;
+  corrupted_ = false;
+  in_fragment_ = false;
+  has_sps_ = false;
+  has_pps_ = false;
+  has_slice_ = false;
+  intra_ = false;
+}
+
+RtpDepacketizerStats H264RtpDepacketizer::getStats() const {
+  RtpDepacketizerStats stats;
+  stats.frames = frames_;
+  stats.keyFrames = key_frames_;
+  stats.dropped = dropped_;
+  stats.malformed = malformed_;
+  return stats;
+}
+
+OpusRtpDepacketizer::OpusRtpDepacketizer(const FrameCallback& callback)
+    : callback_(callback), frames_(0), malformed_(0) {}
+
+void OpusRtpDepacketizer::push(const RtpPacket& packet, bool afterLoss) {
+  // every packet stands alone, a loss needs nothing but the decoder's
+  // concealment on the far side
+  int samples = opusPacketSamples(packet.payload, packet.payloadLength);
+  if (samples == 0) {
+    ++malformed_;
+    return;
+  }
+  ++frames_;
+  callback_(packet.payload, packet.payloadLength, packet.timestamp, samples,
+            (packet.payload[0] & 0x4) ? 2 : 1);
+}
+
+RtpDepacketizerStats OpusRtpDepacketizer::getStats() const {
+  RtpDepacketizerStats stats;
+  stats.frames = frames_;
+  stats.malformed = malformed_;
+  return stats;
+}
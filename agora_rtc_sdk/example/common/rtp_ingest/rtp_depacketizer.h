@@ -0,0 +1,95 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Assembles H.264 and Opus frames from RTP payloads in sequence order.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "rtp_jitter_buffer.h"
+
+struct RtpDepacketizerStats {
+  uint64_t frames = 0;
+  uint64_t keyFrames = 0;
+  // Incomplete, or between a loss and the next key frame
+  uint64_t dropped = 0;
+  // Payloads that could not be parsed
+  uint64_t malformed = 0;
+};
+
+/**
+ H.264 over RTP, RFC 6184: single NAL unit, STAP-A and FU-A packets in
+ non-interleaved mode. Frames come out as Annex B access units with 4 byte
+ start codes, built in one buffer that keeps its capacity from frame to
+ frame. A frame ends at the marker bit or at the next timestamp.
+
+ A key frame has SPS, PPS and an intra slice, the same rule the file parser
+ uses. Senders often put the parameter sets in their own access unit, or
+ send them only once, so the last ones seen are kept and put in front of
+ an intra picture that comes without them. After a loss nothing goes out
+ until the next key frame, since the frames after it would reference a
+ picture the receiver never got.
+ */
+class H264RtpDepacketizer {
+ public:
+  typedef std::function<void(const uint8_t* data, size_t length, uint32_t timestamp,
+                             bool keyFrame)>
+      FrameCallback;
+
+  explicit H264RtpDepacketizer(const FrameCallback& callback);
+
+  void push(const RtpPacket& packet, bool afterLoss);
+  RtpDepacketizerStats getStats() const;
+
+ private:
+  void appendNal(const uint8_t* nal, size_t length);
+  void noteNal(uint8_t nalType, const uint8_t* nal, size_t length);
+  void finishFrame();
+  void dropFrame();
+  void resetFrame();
+
+  FrameCallback callback_;
+  std::vector<uint8_t> frame_;
+  // the last parameter sets, with their start codes
+  std::vector<uint8_t> sps_;
+  std::vector<uint8_t> pps_;
+  bool in_frame_;
+  // where a cached PPS goes when the frame has its own SPS
+  size_t sps_end_;
+  uint32_t timestamp_;
+  bool corrupted_;
+  bool in_fragment_;
+  bool has_sps_;
+  bool has_pps_;
+  bool has_slice_;
+  bool intra_;
+  bool wait_key_frame_;
+
+  std::atomic<uint64_t> frames_;
+  std::atomic<uint64_t> key_frames_;
+  std::atomic<uint64_t> dropped_;
+  std::atomic<uint64_t> malformed_;
+};
+
+// Opus over RTP, RFC 7587: every payload is one Opus packet
+class OpusRtpDepacketizer {
+ public:
+  typedef std::function<void(const uint8_t* data, size_t length, uint32_t timestamp,
+                             int samplesPerChannel, int channels)>
+      FrameCallback;
+
+  explicit OpusRtpDepacketizer(const FrameCallback& callback);
+
+  void push(const RtpPacket& packet, bool afterLoss);
+  RtpDepacketizerStats getStats() const;
+
+ private:
+  FrameCallback callback_;
+  std::atomic<uint64_t> frames_;
+  std::atomic<uint64_t> malformed_;
+};
@@ -0,0 +1,177 @@
+#include "rtp_ingest.h"
+
+#include <chrono>
+#include <cstdlib>
+
+#include "common/log.h"
+
+#define OPUS_SAMPLE_RATE (48000)
+#define H264_RTP_CLOCK_RATE (90000)
+
+static int64_t nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+RtpTimestampMapper::RtpTimestampMapper(int clockRate, int64_t maxJumpMs)
+    : clock_rate_(clockRate),
+      max_jump_ms_(maxJumpMs),
+      started_(false),
+      last_(0),
+      ticks_(0),
+      base_ms_(0) {}
+
+int64_t RtpTimestampMapper::toMs(uint32_t timestamp) {
+  // the difference as signed 32 bits unwraps, and steps back for reordering
+  int64_t delta = static_cast<int32_t>(timestamp - last_);
+  if (!started_ || std::abs(delta) * 1000 / clock_rate_ > max_jump_ms_) {
+    started_ = true;
+    ticks_ = 0;
+    base_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count();
+  } else {
+    ticks_ += delta;
+  }
+  last_ = timestamp;
+  return base_ms_ + ticks_ * 1000 / clock_rate_;
+}
+
+RtpIngest::Stream::Stream(const RtpIngestConfig& config, int port)
+    : name(""),
+      payloadType(-1),
+      source(config.listenAddress, port, config.batchSize),
+      jitterBuffer(config.latencyMs, config.jitterBufferPackets),
+      otherPayloadTypes(0) {}
+
+RtpIngest::RtpIngest(const RtpIngestConfig& config,
+                     agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> videoSender,
+                     agora::agora_refptr<agora::rtc::IAudioEncodedFrameSender> audioSender)
+    : config_(config),
+      video_sender_(videoSender),
+      audio_sender_(audioSender),
+      video_clock_(H264_RTP_CLOCK_RATE),
+      audio_clock_(OPUS_SAMPLE_RATE),
+      send_failures_(0) {
+  if (config_.videoPort && video_sender_) {
+    video_.reset(new Stream(config_, config_.videoPort));
+    video_->name = "video";
+    video_->payloadType = config_.videoPayloadType;
+    h264_.reset(new H264RtpDepacketizer(
+        [this](const uint8_t* data, size_t length, uint32_t timestamp, bool keyFrame) {
+          onVideoFrame(data, length, timestamp, keyFrame);
+        }));
+    H264RtpDepacketizer* depacketizer = h264_.get();
+    video_->jitterBuffer.setOutputCallback(
+        [depacketizer](const RtpPacket& packet, bool afterLoss) {
+          depacketizer->push(packet, afterLoss);
+        });
+  }
+  if (config_.audioPort && audio_sender_) {
+    audio_.reset(new Stream(config_, config_.audioPort));
+    audio_->name = "audio";
+    audio_->payloadType = config_.audioPayloadType;
+    opus_.reset(new OpusRtpDepacketizer([this](const uint8_t* data, size_t length,
+                                               uint32_t timestamp, int samplesPerChannel,
+                                               int channels) {
+      onAudioFrame(data, length, timestamp, samplesPerChannel, channels);
+    }));
+    OpusRtpDepacketizer* depacketizer = opus_.get();
+    audio_->jitterBuffer.setOutputCallback(
+        [depacketizer](const RtpPacket& packet, bool afterLoss) {
+          depacketizer->push(packet, afterLoss);
+        });
+  }
+}
+
+RtpIngest::~RtpIngest() { stop(); }
+
+bool RtpIngest::startStream(Stream& stream) {
+  Stream* s = &stream;
+  return stream.source.start(
+      [s](const uint8_t* data, size_t length) {
+        // the payload type is the second byte, checked before anything is copied
+        if (s->payloadType >= 0 && length > 1 && (data[1] & 0x7f) != s->payloadType) {
+          ++s->otherPayloadTypes;
+          return;
+        }
+        int64_t now = nowMs();
+        s->jitterBuffer.insert(data, length, now);
+        s->jitterBuffer.poll(now);
+      },
+      [s]() { s->jitterBuffer.poll(nowMs()); });
+}
+
+bool RtpIngest::start() {
+  if (!video_ && !audio_) {
+    AG_LOG(ERROR, "No RTP port with a sender to ingest!");
+    return false;
+  }
+  if ((video_ && !startStream(*video_)) || (audio_ && !startStream(*audio_))) {
+    stop();
+    return false;
+  }
+  return true;
+}
+
+void RtpIngest::stop() {
+  if (video_) {
+    video_->source.stop();
+  }
+  if (audio_) {
+    audio_->source.stop();
+  }
+}
+
+void RtpIngest::onVideoFrame(const uint8_t* data, size_t length, uint32_t timestamp,
+                             bool keyFrame) {
+  agora::rtc::EncodedVideoFrameInfo info;
+  info.rotation = agora::rtc::VIDEO_ORIENTATION_0;
+  info.codecType = agora::rtc::VIDEO_CODEC_H264;
+  info.framesPerSecond = config_.frameRate;
+  info.frameType = keyFrame ? agora::rtc::VIDEO_FRAME_TYPE::VIDEO_FRAME_TYPE_KEY_FRAME
+                            : agora::rtc::VIDEO_FRAME_TYPE::VIDEO_FRAME_TYPE_DELTA_FRAME;
+  info.captureTimeMs = video_clock_.toMs(timestamp);
+  if (!video_sender_->sendEncodedVideoImage(data, length, info)) {
+    ++send_failures_;
+  }
+}
+
+void RtpIngest::onAudioFrame(const uint8_t* data, size_t length, uint32_t timestamp,
+                             int samplesPerChannel, int channels) {
+  agora::rtc::EncodedAudioFrameInfo info;
+  info.codec = agora::rtc::AUDIO_CODEC_OPUS;
+  info.sampleRateHz = OPUS_SAMPLE_RATE;
+  info.samplesPerChannel = samplesPerChannel;
+  info.numberOfChannels = channels;
+  info.captureTimeMs = audio_clock_.toMs(timestamp);
+  if (!audio_sender_->sendEncodedAudioFrame(data, length, info)) {
+    ++send_failures_;
+  }
+}
+
+void RtpIngest::logStats() {
+  for (Stream* stream : {video_.get(), audio_.get()}) {
+    if (!stream) {
+      continue;
+    }
+    UdpPacketSourceStats udp = stream->source.getStats();
+    RtpJitterBufferStats jitter = stream->jitterBuffer.getStats();
+    RtpDepacketizerStats frames =
+        stream == video_.get() ? h264_->getStats() : opus_->getStats();
+    AG_LOG(INFO,
+           "%s: %llu packets in %llu batches, other payload types %llu, malformed %llu, "
+           "duplicates %llu, reordered %llu, late %llu, lost %llu, resets %llu",
+           stream->name, (unsigned long long)udp.packets, (unsigned long long)udp.batches,
+           (unsigned long long)stream->otherPayloadTypes.load(),
+           (unsigned long long)(jitter.malformed + frames.malformed),
+           (unsigned long long)jitter.duplicates, (unsigned long long)jitter.reordered,
+           (unsigned long long)jitter.late, (unsigned long long)jitter.lost,
+           (unsigned long long)jitter.resets);
+    AG_LOG(INFO, "%s: %llu frames sent, %llu key frames, %llu dropped", stream->name,
+           (unsigned long long)frames.frames, (unsigned long long)frames.keyFrames,
+           (unsigned long long)frames.dropped);
+  }
+  AG_LOG(INFO, "send failures %llu", (unsigned long long)send_failures_.load());
+}
@@ -0,0 +1,102 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Receives H.264 and Opus over RTP/UDP and sends them as encoded frames.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "AgoraBase.h"
+#include "NGIAgoraMediaNode.h"
+
+#include "common/udp_packet_io.h"
+#include "rtp_depacketizer.h"
+#include "rtp_jitter_buffer.h"
+
+struct RtpIngestConfig {
+  std::string listenAddress = "127.0.0.1";
+  // 0 for none
+  int videoPort = 0;
+  int audioPort = 0;
+  // Packets with other payload types are dropped, -1 takes any
+  int videoPayloadType = -1;
+  int audioPayloadType = -1;
+  // How long a gap is waited for before it counts as lost
+  int latencyMs = 50;
+  size_t jitterBufferPackets = 1024;
+  int batchSize = 32;
+  // RTP does not carry it, EncodedVideoFrameInfo wants it
+  int frameRate = 30;
+};
+
+/**
+ Maps the RTP timestamps of one stream onto wall clock milliseconds. The
+ first timestamp is taken as now, later ones count from it at the stream's
+ clock rate, unwrapped past 32 bits. A jump of more than maxJumpMs, e.g.
+ a restarted sender, starts over from now.
+ */
+class RtpTimestampMapper {
+ public:
+  RtpTimestampMapper(int clockRate, int64_t maxJumpMs = 10000);
+
+  int64_t toMs(uint32_t timestamp);
+
+ private:
+  int clock_rate_;
+  int64_t max_jump_ms_;
+  bool started_;
+  uint32_t last_;
+  // from the first timestamp, in clock ticks
+  int64_t ticks_;
+  int64_t base_ms_;
+};
+
+/**
+ One receive thread per port runs the whole path: recvmmsg into the
+ socket's buffers, a copy into the jitter buffer, frames assembled in the
+ depacketizer's buffer and handed to the sender, which copies them in turn.
+ Nothing else is allocated per packet or per frame.
+ */
+class RtpIngest {
+ public:
+  RtpIngest(const RtpIngestConfig& config,
+            agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> videoSender,
+            agora::agora_refptr<agora::rtc::IAudioEncodedFrameSender> audioSender);
+  ~RtpIngest();
+
+  bool start();
+  void stop();
+  void logStats();
+
+ private:
+  struct Stream {
+    Stream(const RtpIngestConfig& config, int port);
+
+    const char* name;
+    int payloadType;
+    UdpPacketSource source;
+    RtpJitterBuffer jitterBuffer;
+    std::atomic<uint64_t> otherPayloadTypes;
+  };
+
+  bool startStream(Stream& stream);
+  void onVideoFrame(const uint8_t* data, size_t length, uint32_t timestamp, bool keyFrame);
+  void onAudioFrame(const uint8_t* data, size_t length, uint32_t timestamp,
+                    int samplesPerChannel, int channels);
+
+  RtpIngestConfig config_;
+  agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> video_sender_;
+  agora::agora_refptr<agora::rtc::IAudioEncodedFrameSender> audio_sender_;
+
+  std::unique_ptr<Stream> video_;
+  std::unique_ptr<Stream> audio_;
+  std::unique_ptr<H264RtpDepacketizer> h264_;
+  std::unique_ptr<OpusRtpDepacketizer> opus_;
+  // used on the receive thread of their stream only
+  RtpTimestampMapper video_clock_;
+  RtpTimestampMapper audio_clock_;
+  std::atomic<uint64_t> send_failures_;
+};
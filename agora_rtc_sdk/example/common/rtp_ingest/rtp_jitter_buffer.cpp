@@ -0,0 +1,173 @@
+#include "rtp_jitter_buffer.h"
+
+#include <cstring>
+
+bool parseRtpPacket(const uint8_t* data, size_t length, RtpPacket& packet) {
+  if (length < 12 || (data[0] >> 6) != 2) {
+    return false;
+  }
+  bool padding = data[0] & 0x20;
+  bool extension = data[0] & 0x10;
+  size_t offset = 12 + 4 * (data[0] & 0x0f);
+  if (extension) {
+    if (length < offset + 4) {
+      return false;
+    }
+    offset += 4 + 4 * ((data[offset + 2] << 8) | data[offset + 3]);
+  }
+  size_t end = length;
+  if (padding) {
+    if (length == 0 || data[length - 1] > length) {
+      return false;
+    }
+    end -= data[length - 1];
+  }
+  if (end < offset) {
+    return false;
+  }
+
+  packet.marker = data[1] & 0x80;
+  packet.payloadType = data[1] & 0x7f;
+  packet.seq = (data[2] << 8) | data[3];
+  parseRtpTimestamp(data, length, packet.timestamp);
+  packet.ssrc = (static_cast<uint32_t>(data[8]) << 24) | (static_cast<uint32_t>(data[9]) << 16) |
+                (static_cast<uint32_t>(data[10]) << 8) | data[11];
+  packet.payload = data + offset;
+  packet.payloadLength = end - offset;
+  return true;
+}
+
+RtpJitterBuffer::RtpJitterBuffer(int latencyMs, size_t capacity)
+    : latency_ms_(latencyMs),
+      slots_(capacity > 0 ? capacity : 1),
+      started_(false),
+      ssrc_(0),
+      next_seq_(0),
+      highest_seq_(0),
+      buffered_(0),
+      after_loss_(false),
+      received_(0),
+      malformed_(0),
+      duplicates_(0),
+      late_(0),
+      reordered_(0),
+      lost_(0),
+      resets_(0) {}
+
+void RtpJitterBuffer::reset(const RtpPacket& packet) {
+  if (started_) {
+    ++resets_;
+    for (auto& slot : slots_) {
+      slot.filled = false;
+    }
+  }
+  started_ = true;
+  ssrc_ = packet.ssrc;
+  next_seq_ = packet.seq;
+  highest_seq_ = packet.seq;
+  buffered_ = 0;
+  // whatever came before is gone, a decoder has to know
+  after_loss_ = resets_ > 0;
+}
+
+int64_t RtpJitterBuffer::unwrap(uint16_t seq) const {
+  int16_t delta = static_cast<int16_t>(seq - static_cast<uint16_t>(highest_seq_));
+  return highest_seq_ + delta;
+}
+
+bool RtpJitterBuffer::insert(const uint8_t* data, size_t length, int64_t nowMs) {
+  RtpPacket packet;
+  if (length > UDP_MAX_PACKET_SIZE || !parseRtpPacket(data, length, packet)) {
+    ++malformed_;
+    return false;
+  }
+  ++received_;
+  if (!started_ || packet.ssrc != ssrc_) {
+    reset(packet);
+  }
+
+  int64_t seq = unwrap(packet.seq);
+  if (seq < next_seq_) {
+    ++late_;
+    return false;
+  }
+  if (seq >= next_seq_ + static_cast<int64_t>(slots_.size())) {
+    // too far ahead to wait for the gap, make room
+    skipTo(seq - slots_.size() + 1);
+  }
+  Slot& slot = slots_[seq % slots_.size()];
+  if (slot.filled) {
+    ++duplicates_;
+    return false;
+  }
+  slot.filled = true;
+  slot.seq = seq;
+  slot.arrivalMs = nowMs;
+  slot.length = length;
+  memcpy(slot.data, data, length);
+  ++buffered_;
+  if (seq > highest_seq_) {
+    highest_seq_ = seq;
+  } else if (seq < highest_seq_) {
+    ++reordered_;
+  }
+  return true;
+}
+
+void RtpJitterBuffer::release(Slot& slot) {
+  RtpPacket packet;
+  parseRtpPacket(slot.data, slot.length, packet);
+  slot.filled = false;
+  --buffered_;
+  bool afterLoss = after_loss_;
+  after_loss_ = false;
+  if (output_) {
+    output_(packet, afterLoss);
+  }
+}
+
+void RtpJitterBuffer::skipTo(int64_t seq) {
+  for (; next_seq_ < seq; ++next_seq_) {
+    Slot& slot = slots_[next_seq_ % slots_.size()];
+    if (slot.filled && slot.seq == next_seq_) {
+      release(slot);
+    } else {
+      ++lost_;
+      after_loss_ = true;
+    }
+  }
+}
+
+void RtpJitterBuffer::poll(int64_t nowMs) {
+  while (buffered_ > 0) {
+    Slot& slot = slots_[next_seq_ % slots_.size()];
+    if (slot.filled && slot.seq == next_seq_) {
+      release(slot);
+      ++next_seq_;
+      continue;
+    }
+    // a gap, the first packet after it decides how long it is waited for
+    int64_t seq = next_seq_ + 1;
+    while (seq <= highest_seq_ && !slots_[seq % slots_.size()].filled) {
+      ++seq;
+    }
+    if (seq > highest_seq_ || nowMs - slots_[seq % slots_.size()].arrivalMs < latency_ms_) {
+      break;
+    }
+    lost_ += seq - next_seq_;
+    after_loss_ = true;
+    next_seq_ = seq;
+  }
+}
+
+RtpJitterBufferStats RtpJitterBuffer::getStats() const {
+  RtpJitterBufferStats stats;
+  stats.received = received_;
+  stats.malformed = malformed_;
+  stats.duplicates = duplicates_;
+  stats.late = late_;
+  stats.reordered = reordered_;
+  stats.lost = lost_;
+  stats.resets = resets_;
+  return stats;
+}
@@ -0,0 +1,100 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Reorders RTP packets of one stream and gives up on gaps after a latency.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "common/udp_packet_io.h"
+
+// A parsed view of a packet, valid as long as the bytes it was parsed from
+struct RtpPacket {
+  uint16_t seq = 0;
+  uint32_t timestamp = 0;
+  uint32_t ssrc = 0;
+  uint8_t payloadType = 0;
+  bool marker = false;
+  const uint8_t* payload = nullptr;
+  size_t payloadLength = 0;
+};
+
+// Fixed header, CSRCs, header extension and padding (RFC 3550, 5.1 and 5.3.1)
+bool parseRtpPacket(const uint8_t* data, size_t length, RtpPacket& packet);
+
+struct RtpJitterBufferStats {
+  uint64_t received = 0;
+  uint64_t malformed = 0;
+  uint64_t duplicates = 0;
+  // Came after their place was given up on
+  uint64_t late = 0;
+  // Came after a packet with a higher sequence number
+  uint64_t reordered = 0;
+  uint64_t lost = 0;
+  // The SSRC changed and the buffer started over
+  uint64_t resets = 0;
+};
+
+/**
+ Packets are copied into slots allocated once, indexed by sequence number,
+ and come out in sequence order. A packet that follows the last one out
+ leaves at once, so an in-order stream sees no added delay; a gap is held
+ for at most latencyMs after the packet behind it arrived, then skipped and
+ the next packet is flagged afterLoss.
+
+ Not thread-safe: insert() and poll() are meant for the receive thread,
+ getStats() may be called from anywhere.
+ */
+class RtpJitterBuffer {
+ public:
+  typedef std::function<void(const RtpPacket& packet, bool afterLoss)> OutputCallback;
+
+  RtpJitterBuffer(int latencyMs, size_t capacity = 1024);
+
+  void setOutputCallback(const OutputCallback& callback) { output_ = callback; }
+  // Copies the packet, false if it was dropped
+  bool insert(const uint8_t* data, size_t length, int64_t nowMs);
+  // Hands out what is due
+  void poll(int64_t nowMs);
+  RtpJitterBufferStats getStats() const;
+
+ private:
+  struct Slot {
+    bool filled = false;
+    int64_t seq = 0;
+    int64_t arrivalMs = 0;
+    size_t length = 0;
+    uint8_t data[UDP_MAX_PACKET_SIZE];
+  };
+
+  void reset(const RtpPacket& packet);
+  int64_t unwrap(uint16_t seq) const;
+  void release(Slot& slot);
+  // Hands out or gives up on everything before seq
+  void skipTo(int64_t seq);
+
+  int latency_ms_;
+  std::vector<Slot> slots_;
+  OutputCallback output_;
+
+  bool started_;
+  uint32_t ssrc_;
+  // Extended sequence numbers, they do not wrap
+  int64_t next_seq_;
+  int64_t highest_seq_;
+  size_t buffered_;
+  bool after_loss_;
+
+  std::atomic<uint64_t> received_;
+  std::atomic<uint64_t> malformed_;
+  std::atomic<uint64_t> duplicates_;
+  std::atomic<uint64_t> late_;
+  std::atomic<uint64_t> reordered_;
+  std::atomic<uint64_t> lost_;
+  std::atomic<uint64_t> resets_;
+};
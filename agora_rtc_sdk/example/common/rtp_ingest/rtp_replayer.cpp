@@ -0,0 +1,302 @@
+#include "rtp_replayer.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#include "common/file_parser/helper_h264_parser.h"
+#include "common/log.h"
+#include "rtp_jitter_buffer.h"
+
+#define PCAP_MAGIC_US (0xa1b2c3d4)
+#define PCAP_MAGIC_NS (0xa1b23c4d)
+#define PCAP_LINKTYPE_NULL (0)
+#define PCAP_LINKTYPE_ETHERNET (1)
+#define PCAP_LINKTYPE_RAW (101)
+#define PCAP_LINKTYPE_LINUX_SLL (113)
+#define ETHERTYPE_IPV4 (0x0800)
+#define ETHERTYPE_VLAN (0x8100)
+#define IP_PROTOCOL_UDP (17)
+#define REPLAY_SSRC (0x52504c59)
+
+static uint32_t readU32(const uint8_t* data, bool swap) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return swap ? __builtin_bswap32(value) : value;
+}
+
+static uint16_t readBe16(const uint8_t* data) { return (data[0] << 8) | data[1]; }
+
+// The IPv4 UDP payload of a link layer frame, null if it is something else
+static const uint8_t* udpPayload(const uint8_t* frame, size_t length, uint32_t linkType,
+                                 int& dstPort, size_t& payloadLength) {
+  size_t offset = 0;
+  uint16_t etherType = ETHERTYPE_IPV4;
+  switch (linkType) {
+    case PCAP_LINKTYPE_NULL:
+      offset = 4;
+      break;
+    case PCAP_LINKTYPE_ETHERNET:
+      if (length < 14) {
+        return nullptr;
+      }
+      etherType = readBe16(frame + 12);
+      offset = 14;
+      if (etherType == ETHERTYPE_VLAN && length >= 18) {
+        etherType = readBe16(frame + 16);
+        offset = 18;
+      }
+      break;
+    case PCAP_LINKTYPE_RAW:
+      break;
+    case PCAP_LINKTYPE_LINUX_SLL:
+      if (length < 16) {
+        return nullptr;
+      }
+      etherType = readBe16(frame + 14);
+      offset = 16;
+      break;
+    default:
+      return nullptr;
+  }
+  if (etherType != ETHERTYPE_IPV4 || length < offset + 20 || (frame[offset] >> 4) != 4) {
+    return nullptr;
+  }
+  const uint8_t* ip = frame + offset;
+  size_t ipHeader = (ip[0] & 0x0f) * 4;
+  // fragments other than the first carry no UDP header
+  bool fragment = (readBe16(ip + 6) & 0x3fff) != 0;
+  if (ip[9] != IP_PROTOCOL_UDP || fragment || length < offset + ipHeader + 8) {
+    return nullptr;
+  }
+  const uint8_t* udp = ip + ipHeader;
+  size_t udpLength = readBe16(udp + 4);
+  if (udpLength < 8 || length < offset + ipHeader + udpLength) {
+    return nullptr;
+  }
+  dstPort = readBe16(udp + 2);
+  payloadLength = udpLength - 8;
+  return udp + 8;
+}
+
+void RtpReplayer::addPacket(int64_t timeUs, RTP_REPLAY_STREAM stream, const uint8_t* data,
+                            size_t length) {
+  packets_.push_back({timeUs, stream, std::vector<uint8_t>(data, data + length)});
+}
+
+bool RtpReplayer::loadPcap(const std::string& path, int videoPort, int audioPort) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    AG_LOG(ERROR, "Failed to open %s", path.c_str());
+    return false;
+  }
+  uint8_t header[24];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+    fclose(file);
+    return false;
+  }
+  uint32_t magic = readU32(header, false);
+  bool swap =
+      magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+  magic = readU32(header, swap);
+  if (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS) {
+    AG_LOG(ERROR, "%s is not a pcap capture", path.c_str());
+    fclose(file);
+    return false;
+  }
+  int64_t fractionPerUs = magic == PCAP_MAGIC_NS ? 1000 : 1;
+  uint32_t linkType = readU32(header + 20, swap) & 0x0fffffff;
+
+  std::vector<uint8_t> frame;
+  int64_t firstUs = -1;
+  size_t skipped = 0;
+  uint8_t record[16];
+  while (fread(record, 1, sizeof(record), file) == sizeof(record)) {
+    int64_t timeUs = readU32(record, swap) * 1000000LL + readU32(record + 4, swap) / fractionPerUs;
+    uint32_t captured = readU32(record + 8, swap);
+    frame.resize(captured);
+    if (fread(frame.data(), 1, captured, file) != captured) {
+      break;
+    }
+    int dstPort = 0;
+    size_t length = 0;
+    const uint8_t* payload = udpPayload(frame.data(), captured, linkType, dstPort, length);
+    RtpPacket rtp;
+    if (!payload || !parseRtpPacket(payload, length, rtp) ||
+        (dstPort != videoPort && dstPort != audioPort)) {
+      ++skipped;
+      continue;
+    }
+    if (firstUs < 0) {
+      firstUs = timeUs;
+    }
+    addPacket(timeUs - firstUs, dstPort == videoPort ? RTP_REPLAY_VIDEO : RTP_REPLAY_AUDIO,
+              payload, length);
+  }
+  fclose(file);
+  computeRounds();
+  AG_LOG(INFO, "Loaded %zu RTP packets from %s, skipped %zu", packets_.size(), path.c_str(),
+         skipped);
+  return !packets_.empty();
+}
+
+bool RtpReplayer::loadH264File(const std::string& path, int frameRate, int payloadType,
+                               size_t mtu) {
+  HelperH264FileParser parser(path.c_str());
+  if (!parser.initialize()) {
+    return false;
+  }
+  std::vector<uint8_t> packet;
+  uint16_t seq = 0;
+  int64_t frameIndex = 0;
+  for (std::unique_ptr<HelperH264Frame> frame = parser.getH264Frame(); frame;
+       frame = parser.getH264Frame(), ++frameIndex) {
+    const uint8_t* data = frame->buffer.get();
+    size_t size = frame->bufferLen;
+    uint32_t timestamp = static_cast<uint32_t>(frameIndex * 90000 / frameRate);
+    int64_t timeUs = frameIndex * 1000000 / frameRate;
+
+    // NAL units between start codes
+    std::vector<std::pair<size_t, size_t>> nals;
+    size_t start = 0;
+    for (size_t i = 0; i + 3 <= size; ++i) {
+      if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+        if (start) {
+          size_t end = i > 0 && data[i - 1] == 0 ? i - 1 : i;
+          nals.push_back({start, end - start});
+        }
+        start = i + 3;
+        i += 2;
+      }
+    }
+    if (start && start < size) {
+      nals.push_back({start, size - start});
+    }
+
+    for (size_t n = 0; n < nals.size(); ++n) {
+      const uint8_t* nal = data + nals[n].first;
+      size_t nalSize = nals[n].second;
+      bool lastNal = n + 1 == nals.size();
+      if (nalSize == 0) {
+        continue;
+      }
+      // FU-A: indicator and header replace the NAL header byte
+      size_t chunk = nalSize + 1 <= mtu ? nalSize : mtu - 2;
+      size_t offset = nalSize + 1 <= mtu ? 0 : 1;
+      bool fragmented = offset == 1;
+      while (offset < nalSize) {
+        size_t take = std::min(chunk, nalSize - offset);
+        bool lastPacket = offset + take == nalSize;
+        packet.assign(12, 0);
+        packet[0] = 0x80;
+        packet[1] = ((lastNal && lastPacket) ? 0x80 : 0) | (payloadType & 0x7f);
+        packet[2] = seq >> 8;
+        packet[3] = seq & 0xff;
+        for (int i = 0; i < 4; ++i) {
+          packet[4 + i] = timestamp >> (24 - 8 * i);
+          packet[8 + i] = REPLAY_SSRC >> (24 - 8 * i);
+        }
+        if (fragmented) {
+          packet.push_back((nal[0] & 0xe0) | 28);
+          packet.push_back((offset == 1 ? 0x80 : 0) | (lastPacket ? 0x40 : 0) | (nal[0] & 0x1f));
+        }
+        packet.insert(packet.end(), nal + offset, nal + offset + take);
+        addPacket(timeUs, RTP_REPLAY_VIDEO, packet.data(), packet.size());
+        ++seq;
+        offset += take;
+      }
+    }
+  }
+  computeRounds();
+  AG_LOG(INFO, "Packetized %ld frames of %s into %zu RTP packets", static_cast<long>(frameIndex),
+         path.c_str(), packets_.size());
+  return !packets_.empty();
+}
+
+void RtpReplayer::computeRounds() {
+  if (packets_.empty()) {
+    return;
+  }
+  // a round lasts as long as the packets plus one average gap
+  int64_t span = packets_.back().timeUs - packets_.front().timeUs;
+  round_duration_us_ = span + span / std::max<int64_t>(packets_.size() - 1, 1);
+
+  for (int stream = 0; stream < RTP_REPLAY_STREAM_COUNT; ++stream) {
+    RtpPacket first, last;
+    bool found = false;
+    int timestampSteps = 0;
+    for (const Packet& packet : packets_) {
+      RtpPacket rtp;
+      if (packet.stream != stream || !parseRtpPacket(packet.data.data(), packet.data.size(), rtp)) {
+        continue;
+      }
+      if (!found) {
+        first = rtp;
+        found = true;
+      } else if (rtp.timestamp != last.timestamp) {
+        ++timestampSteps;
+      }
+      last = rtp;
+    }
+    if (found) {
+      uint32_t timestampSpan = last.timestamp - first.timestamp;
+      rounds_[stream].seq = static_cast<uint16_t>(last.seq - first.seq + 1);
+      rounds_[stream].timestamp =
+          timestampSpan + (timestampSteps ? timestampSpan / timestampSteps : 0);
+    }
+  }
+}
+
+bool RtpReplayer::start(const std::string& address, int videoPort, int audioPort, bool loop) {
+  if (packets_.empty()) {
+    return false;
+  }
+  if ((videoPort && !sinks_[RTP_REPLAY_VIDEO].open(address, videoPort)) ||
+      (audioPort && !sinks_[RTP_REPLAY_AUDIO].open(address, audioPort))) {
+    return false;
+  }
+  stopping_ = false;
+  thread_ = std::thread(&RtpReplayer::replayLoop, this, loop);
+  return true;
+}
+
+void RtpReplayer::stop() {
+  stopping_ = true;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void RtpReplayer::replayLoop(bool loop) {
+  std::vector<uint8_t> packet;
+  auto startTime = std::chrono::steady_clock::now();
+  for (int64_t round = 0; !stopping_; ++round) {
+    for (size_t i = 0; i < packets_.size() && !stopping_; ++i) {
+      const Packet& source = packets_[i];
+      UdpPacketSink& sink = sinks_[source.stream];
+      if (!sink.isOpen()) {
+        continue;
+      }
+      std::this_thread::sleep_until(startTime + std::chrono::microseconds(
+                                                    round * round_duration_us_ + source.timeUs));
+      packet = source.data;
+      uint16_t seq = readBe16(&packet[2]) + round * rounds_[source.stream].seq;
+      uint32_t timestamp;
+      parseRtpTimestamp(packet.data(), packet.size(), timestamp);
+      timestamp += round * rounds_[source.stream].timestamp;
+      packet[2] = seq >> 8;
+      packet[3] = seq & 0xff;
+      for (int b = 0; b < 4; ++b) {
+        packet[4 + b] = timestamp >> (24 - 8 * b);
+      }
+      sink.send(packet.data(), packet.size());
+    }
+    if (!loop) {
+      break;
+    }
+  }
+  AG_LOG(INFO, "Replay finished");
+}
@@ -0,0 +1,69 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Replays RTP from a capture or an H.264 file to local UDP ports.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/udp_packet_io.h"
+
+enum RTP_REPLAY_STREAM {
+  RTP_REPLAY_VIDEO = 0,
+  RTP_REPLAY_AUDIO = 1,
+  RTP_REPLAY_STREAM_COUNT,
+};
+
+/**
+ Stands in for an on-prem encoder so the ingest can run without one.
+ Packets are loaded up front and sent at their original pace from a thread
+ of their own. When looping, sequence numbers and timestamps carry on from
+ the previous round, so the receiver sees one continuous stream.
+ */
+class RtpReplayer {
+ public:
+  RtpReplayer() : stopping_(false) {}
+  ~RtpReplayer() { stop(); }
+
+  // IPv4 UDP payloads sent to videoPort or audioPort in a pcap (not pcapng)
+  // capture, over Ethernet, Linux cooked, raw IP or loopback
+  bool loadPcap(const std::string& path, int videoPort, int audioPort);
+  // An Annex B file as single NAL unit and FU-A packets of at most mtu bytes
+  bool loadH264File(const std::string& path, int frameRate, int payloadType = 96,
+                    size_t mtu = 1200);
+  size_t packetCount() const { return packets_.size(); }
+
+  bool start(const std::string& address, int videoPort, int audioPort, bool loop);
+  void stop();
+
+ private:
+  struct Packet {
+    int64_t timeUs;
+    RTP_REPLAY_STREAM stream;
+    std::vector<uint8_t> data;
+  };
+
+  // Sequence number and timestamp advance per round, per stream
+  struct Round {
+    uint16_t seq = 0;
+    uint32_t timestamp = 0;
+  };
+
+  void addPacket(int64_t timeUs, RTP_REPLAY_STREAM stream, const uint8_t* data, size_t length);
+  void computeRounds();
+  void replayLoop(bool loop);
+
+  std::vector<Packet> packets_;
+  Round rounds_[RTP_REPLAY_STREAM_COUNT];
+  int64_t round_duration_us_ = 0;
+  UdpPacketSink sinks_[RTP_REPLAY_STREAM_COUNT];
+
+  std::atomic<bool> stopping_;
+  std::thread thread_;
+};
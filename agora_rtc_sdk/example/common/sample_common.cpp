@@ -8,6 +8,8 @@
 #include "sample_common.h"
 
 #include "log.h"
+#include "startup_profiler.h"
+#include <future>
 #include <iostream>
 #include <string>
 #include <fstream>
@@ -31,6 +33,32 @@
 #define INTERNAL_RTC_KEY_LOCAL_IP                             "rtc.local.ip"
 #define INTERNAL_RTC_KEY_RTC_UDP_SEND_FD                      "rtc.udp_send_fd"
 
+static bool fastStart = false;
+// Set by a fast start until finishAgoraServiceStartup() ran
+static agora::base::IAgoraService* pendingService = nullptr;
+static std::future<int> pendingCertificateRead;
+static std::string pendingCertificate;
+static int deferredStartupResult = 0;
+
+void setAgoraServiceFastStart(bool enable) { fastStart = enable; }
+
+static int readCertificate(std::string& cert);
+static int verifyCertificate(const std::string& cert);
+
+// Log file and license, what a sample needs before it connects but not
+// before it can create connections
+static int setupLogAndLicense(agora::base::IAgoraService* service, const std::string& cert) {
+  {
+    StartupProfiler::Scope phase("setLogFile");
+    AG_LOG(INFO, "Created log file at %s", DEFAULT_LOG_PATH);
+    if (service->setLogFile(DEFAULT_LOG_PATH, DEFAULT_LOG_SIZE) != 0) {
+      return -1;
+    }
+  }
+  StartupProfiler::Scope phase("verifyLicense");
+  return verifyCertificate(cert);
+}
+
 // @WARNING : IAgoraService is Global singleton ！！Just create it once and make sure you don't destroy it before process end.
 // @WARNING : Be careful when you Mult_thread programming！！
 agora::base::IAgoraService* createAndInitAgoraService(bool enableAudioDevice,
@@ -39,7 +67,10 @@ agora::base::IAgoraService* createAndInitAgoraService(bool enableAudioDevice,
                                                       agora::rtc::AUDIO_SCENARIO_TYPE audioSenario,
                                                       bool enableuseStringUid,bool enablelowDelay,const char* appid) {
   int32_t buildNum = 0;
-  getAgoraSdkVersion(&buildNum);
+  {
+    StartupProfiler::Scope phase("getAgoraSdkVersion");
+    getAgoraSdkVersion(&buildNum);
+  }
 #if defined(SDK_BUILD_NUM)
   if ( buildNum != SDK_BUILD_NUM ) {
     AG_LOG(ERROR, "SDK VERSION CHECK FAILED!\nSDK version: %d\nAPI Version: %d\n", buildNum, SDK_BUILD_NUM);
@@ -47,7 +78,11 @@ agora::base::IAgoraService* createAndInitAgoraService(bool enableAudioDevice,
   }
 #endif
   AG_LOG(INFO, "SDK version: %d\n", buildNum);
-  auto service = createAgoraService();
+  agora::base::IAgoraService* service = nullptr;
+  {
+    StartupProfiler::Scope phase("createAgoraService");
+    service = createAgoraService();
+  }
   agora::base::AgoraServiceConfiguration scfg;
   scfg.appId = appid;
   scfg.enableAudioProcessor = enableAudioProcessor;
@@ -59,18 +94,47 @@ agora::base::IAgoraService* createAndInitAgoraService(bool enableAudioDevice,
   if(enablelowDelay){
     scfg.channelProfile = agora::CHANNEL_PROFILE_TYPE::CHANNEL_PROFILE_CLOUD_GAMING;
   }
-  if (service->initialize(scfg) != agora::ERR_OK) {
-    return nullptr;
+  {
+    StartupProfiler::Scope phase("initialize");
+    if (service->initialize(scfg) != agora::ERR_OK) {
+      return nullptr;
+    }
   }
 
-  AG_LOG(INFO, "Created log file at %s", DEFAULT_LOG_PATH);
-  if (service->setLogFile(DEFAULT_LOG_PATH, DEFAULT_LOG_SIZE) != 0) {
-    return nullptr;
+  if (fastStart) {
+    // Only the certificate file is read in the background, every call into the
+    // SDK stays on this thread. SDK logs go to its default location until
+    // finishAgoraServiceStartup() called setLogFile()
+    pendingService = service;
+    pendingCertificateRead = std::async(std::launch::async, []() {
+      StartupProfiler::Scope phase("readCertificate", true);
+      return readCertificate(pendingCertificate);
+    });
+    return service;
   }
- if(verifyLicense() != 0) return nullptr;
+  std::string cert;
+  if (readCertificate(cert) != 0 || setupLogAndLicense(service, cert) != 0) return nullptr;
   return service;
 }
 
+int finishAgoraServiceStartup() {
+  if (!pendingService) {
+    return deferredStartupResult;
+  }
+  agora::base::IAgoraService* service = pendingService;
+  pendingService = nullptr;
+  int result = pendingCertificateRead.get();
+  if (result == 0) {
+    result = setupLogAndLicense(service, pendingCertificate);
+  }
+  pendingCertificate.clear();
+  if (result != 0) {
+    AG_LOG(ERROR, "Deferred log file setup or license verification failed: %d", result);
+  }
+  deferredStartupResult = result;
+  return result;
+}
+
 class LicenseCallbackImpl : public agora::base::LicenseCallback
 {
 public:
@@ -96,63 +160,57 @@ public:
 
 static const std::string CERTIFICATE_FILE = "certificate.bin";
 
-int verifyLicense()
-{
+// Reads certificate.bin, leaves cert empty without a license check
+static int readCertificate(std::string& cert) {
 #ifdef LICENSE_CHECK
-  // Step1: read the certificate buffer from the certificate.bin file
-  char* cert_buffer = NULL;
-  int cert_length = 0;
   std::ifstream f_cert(CERTIFICATE_FILE.c_str(), std::ios::binary);
-  if (f_cert) {
-    f_cert.seekg(0, f_cert.end);
-    cert_length = f_cert.tellg();
-    f_cert.seekg(0, f_cert.beg);
-
-    cert_buffer = new char[cert_length + 1];
-    AG_LOG(INFO, "cert_length: %d", cert_length);
-    memset(cert_buffer, 0, cert_length + 1);
-    f_cert.read(cert_buffer, cert_length);
-    if (!cert_buffer || f_cert.gcount() < cert_length) {
-      f_cert.close();
-      if (cert_buffer) {
-        delete[] cert_buffer;
-        cert_buffer = NULL;
-      }
-      AG_LOG(ERROR, "read %s failed", CERTIFICATE_FILE.c_str());
-      return -1;
-    }
-    else {
-      f_cert.close();
-    }
-  }
-  else {
+  if (!f_cert) {
     AG_LOG(ERROR, "%s doesn't exist", CERTIFICATE_FILE.c_str());
     return -1;
   }
-  AG_LOG(INFO, "certificate: %s", cert_buffer);
+  f_cert.seekg(0, f_cert.end);
+  int cert_length = f_cert.tellg();
+  f_cert.seekg(0, f_cert.beg);
+  AG_LOG(INFO, "cert_length: %d", cert_length);
+  cert.assign(cert_length, '\0');
+  f_cert.read(&cert[0], cert_length);
+  if (f_cert.gcount() < cert_length) {
+    AG_LOG(ERROR, "read %s failed", CERTIFICATE_FILE.c_str());
+    cert.clear();
+    return -1;
+  }
+#endif
+  return 0;
+}
 
-  // Step3: register callback of license state
+static int verifyCertificate(const std::string& cert) {
+#ifdef LICENSE_CHECK
+  // register callback of license state
   LicenseCallbackImpl *cb = static_cast<LicenseCallbackImpl *>(getAgoraLicenseCallback());
   if (!cb) {
     cb = new LicenseCallbackImpl();
     setAgoraLicenseCallback(static_cast<agora::base::LicenseCallback *>(cb));
   }
 
-  // Step4: verify the license with credential and certificate
-  int result = getAgoraCertificateVerifyResult(NULL, 0, cert_buffer, cert_length);
+  // verify the license with credential and certificate
+  int result = getAgoraCertificateVerifyResult(NULL, 0, cert.data(),
+                                               static_cast<int>(cert.size()));
   AG_LOG(INFO, "verify result: %d", result);
-
-  if (cert_buffer) {
-    delete[] cert_buffer;
-    cert_buffer = NULL;
-  }
-
   return result;
 #else
   return 0;
 #endif
 }
 
+int verifyLicense()
+{
+  std::string cert;
+  if (readCertificate(cert) != 0) {
+    return -1;
+  }
+  return verifyCertificate(cert);
+}
+
 int32_t getLocalIP(agora::agora_refptr<agora::rtc::IRtcConnection>& connection, std::string& ip) {
   int32_t retIntValue = -1;
   const char* intKey = INTERNAL_RTC_KEY_RTC_UDP_SEND_FD;
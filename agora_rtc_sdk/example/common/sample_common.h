@@ -21,6 +21,16 @@ agora::base::IAgoraService* createAndInitAgoraService(bool enableAudioDevice,
 
 int verifyLicense();
 
+// With fast start, createAndInitAgoraService() returns right after
+// IAgoraService::initialize() and only reads the license certificate on a
+// background thread. finishAgoraServiceStartup() then sets up the log file and
+// verifies the license on the calling thread, call it from the thread that
+// uses the service, e.g. right after connect() so it overlaps the handshake,
+// and always before releasing the service.
+void setAgoraServiceFastStart(bool enable);
+// Finishes the deferred startup, returns its result, 0 without fast start
+int finishAgoraServiceStartup();
+
 static inline std::string to_string(int val) {
   char str[32] = {0};
   snprintf(str, sizeof(str), "%d", val);
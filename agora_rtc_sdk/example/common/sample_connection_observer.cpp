@@ -59,42 +59,52 @@ void SampleConnectionObserver::onUplinkNetworkInfoUpdated(const agora::rtc::Upli
 {
 	AG_LOG(INFO, "onBandwidthEstimationUpdated: video_encoder_target_bitrate_bps %d\n",
 		   info.video_encoder_target_bitrate_bps);
+	if (uplink_bitrate_callback_) {
+		uplink_bitrate_callback_(info.video_encoder_target_bitrate_bps);
+	}
 }
 
 void SampleConnectionObserver::onUserJoined(agora::user_id_t userId)
 {
 	AG_LOG(INFO, "onUserJoined: userId %s\n", userId);
+	if (user_joined_callback_) {
+		user_joined_callback_(userId);
+	}
 }
 
 void SampleConnectionObserver::onUserLeft(agora::user_id_t userId,
 										  agora::rtc::USER_OFFLINE_REASON_TYPE reason)
 {
 	AG_LOG(INFO, "onUserLeft: userId %s, reason %d\n", userId, reason);
+	if (user_left_callback_) {
+		user_left_callback_(userId);
+	}
 }
 /************for rtmp*************************/
 void RtmpConnectionObserver::onConnected(const agora::rtc::RtmpConnectionInfo &connectionInfo)
 {
-	AG_LOG(INFO, "onConnected: rtmp connect successfully.");
+	AG_LOG(INFO, "%sonConnected: rtmp connect successfully.", log_prefix_.c_str());
 	connect_ready_.Set();
 }
 void RtmpConnectionObserver::onDisconnected(const agora::rtc::RtmpConnectionInfo &connectionInfo)
 {
-	AG_LOG(INFO, "onDisconnected:");
+	AG_LOG(INFO, "%sonDisconnected:", log_prefix_.c_str());
 	disconnect_ready_.Set();
 }
 void RtmpConnectionObserver::onReconnecting(const agora::rtc::RtmpConnectionInfo &connectionInfo)
 {
-	AG_LOG(INFO, "onReconnecting:");
+	++reconnecting_count_;
+	AG_LOG(INFO, "%sonReconnecting:", log_prefix_.c_str());
 }
 void RtmpConnectionObserver::onReconnected(const agora::rtc::RtmpConnectionInfo &connectionInfo)
 {
-	AG_LOG(INFO, "onReconnected:");
+	AG_LOG(INFO, "%sonReconnected:", log_prefix_.c_str());
 }
 void RtmpConnectionObserver::onConnectionFailure(
 		const agora::rtc::RtmpConnectionInfo &connectionInfo,
 		agora::rtc::RTMP_CONNECTION_ERROR errCode)
 {
-	AG_LOG(INFO, "onConnectionFailure: errcode = %d", errCode);
+	AG_LOG(INFO, "%sonConnectionFailure: errcode = %d", log_prefix_.c_str(), errCode);
 }
 void RtmpConnectionObserver::onTransferStatistics(uint64_t video_width, uint64_t video_height,
 												  uint64_t video_bitrate, uint64_t audio_bitrate,
@@ -102,8 +112,10 @@ void RtmpConnectionObserver::onTransferStatistics(uint64_t video_width, uint64_t
 												  uint64_t push_video_frame_cnt,
 												  uint64_t pop_video_frame_cnt)
 {
+	push_video_frame_cnt_ = push_video_frame_cnt;
+	pop_video_frame_cnt_ = pop_video_frame_cnt;
 	AG_LOG(INFO,
-		   "video_bitrate: %lu, audio_bitrate: %lu, video_frame_rate: %lu, push_video_frame_cnt: %lu, pop_video_frame_cnt: %lu",
-		   video_bitrate, audio_bitrate, video_frame_rate, push_video_frame_cnt,
-		   pop_video_frame_cnt);
+		   "%svideo_bitrate: %lu, audio_bitrate: %lu, video_frame_rate: %lu, push_video_frame_cnt: %lu, pop_video_frame_cnt: %lu, backlog: %lu",
+		   log_prefix_.c_str(), video_bitrate, audio_bitrate, video_frame_rate, push_video_frame_cnt,
+		   pop_video_frame_cnt, push_video_frame_cnt - pop_video_frame_cnt);
 }
\ No newline at end of file
@@ -1,3 +1,9 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+
 #include "NGIAgoraRtcConnection.h"
 #include "NGIAgoraRtmpConnection.h"
 #include "sample_event.h"
@@ -12,6 +18,31 @@ public:
 	{
 		return connect_ready_.Wait(waitMs);
 	}
+	// Set before registering as network observer, called on the SDK thread
+	// with every video_encoder_target_bitrate_bps estimate
+	void setUplinkBitrateCallback(const std::function<void(int)> &callback)
+	{
+		uplink_bitrate_callback_ = callback;
+	}
+	// Set before registering, called on the SDK thread with every transport
+	// stats report
+	void setTransportStatsCallback(
+		const std::function<void(const agora::rtc::RtcStats &)> &callback)
+	{
+		transport_stats_callback_ = callback;
+	}
+	// Set before registering, called on the SDK thread when a remote user
+	// joins the channel
+	void setUserJoinedCallback(const std::function<void(agora::user_id_t)> &callback)
+	{
+		user_joined_callback_ = callback;
+	}
+	// Set before registering, called on the SDK thread when a remote user
+	// leaves the channel
+	void setUserLeftCallback(const std::function<void(agora::user_id_t)> &callback)
+	{
+		user_left_callback_ = callback;
+	}
 
 public: // IRtcConnectionObserver
 	void onConnected(const agora::rtc::TConnectionInfo &connectionInfo,
@@ -42,6 +73,9 @@ public: // IRtcConnectionObserver
 	void onUserLeft(agora::user_id_t userId, agora::rtc::USER_OFFLINE_REASON_TYPE reason) override;
 	void onTransportStats(const agora::rtc::RtcStats &stats) override
 	{
+		if (transport_stats_callback_) {
+			transport_stats_callback_(stats);
+		}
 	}
 	void onLastmileProbeResult(const agora::rtc::LastmileProbeResult &result) override
 	{
@@ -56,17 +90,35 @@ public: // INetworkObserver
 private:
 	SampleEvent connect_ready_;
 	SampleEvent disconnect_ready_;
+	std::function<void(int)> uplink_bitrate_callback_;
+	std::function<void(const agora::rtc::RtcStats &)> transport_stats_callback_;
+	std::function<void(agora::user_id_t)> user_joined_callback_;
+	std::function<void(agora::user_id_t)> user_left_callback_;
 };
 
 class RtmpConnectionObserver : public agora::rtc::IRtmpConnectionObserver {
 public:
-	RtmpConnectionObserver()
+	// The name prefixes every log line, to tell destinations apart
+	explicit RtmpConnectionObserver(const std::string &name = "")
+			: log_prefix_(name.empty() ? "" : name + " ")
 	{
 	}
 	int waitUntilConnected(int waitMs)
 	{
 		return connect_ready_.Wait(waitMs);
 	}
+	int getReconnectingCount() const
+	{
+		return reconnecting_count_;
+	}
+	// Video frames pushed but not yet popped for sending, as of the last
+	// onTransferStatistics
+	uint64_t getVideoBacklog() const
+	{
+		// pop first: it is stored last, so push is at least as new
+		uint64_t popped = pop_video_frame_cnt_;
+		return push_video_frame_cnt_ - popped;
+	}
 
 public:
 	void onConnected(const agora::rtc::RtmpConnectionInfo &connectionInfo) override;
@@ -82,4 +134,8 @@ public:
 private:
 	SampleEvent connect_ready_;
 	SampleEvent disconnect_ready_;
+	std::string log_prefix_;
+	std::atomic<int> reconnecting_count_{ 0 };
+	std::atomic<uint64_t> push_video_frame_cnt_{ 0 };
+	std::atomic<uint64_t> pop_video_frame_cnt_{ 0 };
 };
\ No newline at end of file
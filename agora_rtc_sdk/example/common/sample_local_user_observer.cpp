@@ -13,16 +13,26 @@ SampleLocalUserObserver::SampleLocalUserObserver(agora::rtc::IRtcConnection *con
 {
 	local_user_ = connection_->getLocalUser();
 	local_user_->registerLocalUserObserver(this);
+	registered_ = true;
 }
 
 SampleLocalUserObserver::SampleLocalUserObserver(agora::rtc::ILocalUser *user) : local_user_(user)
 {
 	local_user_->registerLocalUserObserver(this);
+	registered_ = true;
 }
 
 SampleLocalUserObserver::~SampleLocalUserObserver()
 {
-	local_user_->unregisterLocalUserObserver(this);
+	unregisterObserver();
+}
+
+void SampleLocalUserObserver::unregisterObserver()
+{
+	if (registered_) {
+		local_user_->unregisterLocalUserObserver(this);
+		registered_ = false;
+	}
 }
 
 agora::rtc::ILocalUser *SampleLocalUserObserver::GetLocalUser()
@@ -68,6 +78,9 @@ void SampleLocalUserObserver::onUserAudioTrackSubscribed(
 		agora::rtc::AudioEncFrameRecvParams para;
 		remote_audio_track_->registerAudioEncodedFrameReceiver(audio_encoded_receiver_,para);
 	}
+	if (remote_audio_track_ && audio_packet_receiver_) {
+		remote_audio_track_->registerMediaPacketReceiver(audio_packet_receiver_);
+	}
 }
 
 void SampleLocalUserObserver::onUserVideoTrackSubscribed(
@@ -81,6 +94,9 @@ void SampleLocalUserObserver::onUserVideoTrackSubscribed(
 	if (remote_video_track_ && video_encoded_receiver_) {
 		local_user_->registerVideoEncodedFrameObserver(video_encoded_receiver_);
 	}
+	if (remote_video_track_ && video_packet_receiver_) {
+		remote_video_track_->registerMediaPacketReceiver(video_packet_receiver_);
+	}
 	if (remote_video_track_ && video_frame_observer_) {
 		local_user_->registerVideoFrameObserver(video_frame_observer_);
 	}
@@ -194,4 +210,7 @@ void SampleLocalUserObserver::onUserAudioTrackStateChanged(
 void SampleLocalUserObserver::onIntraRequestReceived()
 {
 	AG_LOG(INFO, "onIntraRequestReceived");
+	if (intra_request_callback_) {
+		intra_request_callback_();
+	}
 }
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <functional>
 #include <map>
 #include <mutex>
 
@@ -34,6 +35,10 @@ class SampleLocalUserObserver : public agora::rtc::ILocalUserObserver {
   SampleLocalUserObserver(agora::rtc::ILocalUser* user);
   virtual ~SampleLocalUserObserver();
 
+  // No callback runs once this returns, so callbacks others set can be cleared
+  // safely. The destructor does it too
+  void unregisterObserver();
+
  public:
   agora::rtc::ILocalUser* GetLocalUser();
   void PublishAudioTrack(agora::agora_refptr<agora::rtc::ILocalAudioTrack> audioTrack);
@@ -55,6 +60,25 @@ class SampleLocalUserObserver : public agora::rtc::ILocalUserObserver {
     audio_encoded_receiver_ = observer;
   }
 
+  // Registered on the remote tracks as they are subscribed, the connection
+  // must be configured to receive media packets. Only the last track of each
+  // kind is kept for unsetMediaPacketReceivers(), subscribe one remote user
+  void setMediaPacketReceivers(agora::rtc::IMediaPacketReceiver* audioReceiver,
+                               agora::rtc::IMediaPacketReceiver* videoReceiver) {
+    audio_packet_receiver_ = audioReceiver;
+    video_packet_receiver_ = videoReceiver;
+  }
+
+  void unsetMediaPacketReceivers() {
+    std::lock_guard<std::mutex> _(observer_lock_);
+    if (remote_audio_track_ && audio_packet_receiver_) {
+      remote_audio_track_->unregisterMediaPacketReceiver(audio_packet_receiver_);
+    }
+    if (remote_video_track_ && video_packet_receiver_) {
+      remote_video_track_->unregisterMediaPacketReceiver(video_packet_receiver_);
+    }
+  }
+
   void setAudioFrameObserver(agora::media::IAudioFrameObserverBase* observer) {
     audio_frame_observer_ = observer;
   }
@@ -82,11 +106,42 @@ class SampleLocalUserObserver : public agora::rtc::ILocalUserObserver {
     }
   }
 
+  // Invoked from the SDK thread when a remote subscriber asks for a key frame
+  void setIntraRequestCallback(std::function<void()> callback) {
+    intra_request_callback_ = callback;
+  }
+
+  // Invoked from the SDK thread with every statistics report, set before the
+  // reports start
+  void setLocalAudioStatsCallback(std::function<void(const agora::rtc::LocalAudioStats&)> callback) {
+    local_audio_stats_callback_ = callback;
+  }
+
+  void setRemoteVideoStatsCallback(
+      std::function<void(const agora::rtc::RemoteVideoTrackStats&)> callback) {
+    remote_video_stats_callback_ = callback;
+  }
+
+  void setRemoteAudioStatsCallback(
+      std::function<void(const agora::rtc::RemoteAudioTrackStats&)> callback) {
+    remote_audio_stats_callback_ = callback;
+  }
+
   void setEnableVideoMix(bool enable){
        enable_video_mix_ = enable;
   }
 
+  // Takes data stream messages instead of printing them, set before they come
+  void setStreamMessageCallback(
+      std::function<void(agora::user_id_t, int, const char*, size_t)> callback) {
+    stream_message_callback_ = callback;
+  }
+
 void onStreamMessage(agora::user_id_t userId, int streamId, const char* data, size_t length) {
+        if (stream_message_callback_) {
+          stream_message_callback_(userId, streamId, data, length);
+          return;
+        }
         printf("the message is %s \n",data);
     }
 
@@ -128,7 +183,11 @@ void onStreamMessage(agora::user_id_t userId, int streamId, const char* data, si
                                     int elapsed) ;
 
   void onRemoteVideoTrackStatistics(agora::agora_refptr<agora::rtc::IRemoteVideoTrack> videoTrack,
-                                    const agora::rtc::RemoteVideoTrackStats& stats) override {}
+                                    const agora::rtc::RemoteVideoTrackStats& stats) override {
+    if (remote_video_stats_callback_) {
+      remote_video_stats_callback_(stats);
+    }
+  }
 
   void onLocalVideoTrackStateChanged(agora::agora_refptr<agora::rtc::ILocalVideoTrack> videoTrack,
                                      agora::rtc::LOCAL_VIDEO_STREAM_STATE state,
@@ -140,10 +199,18 @@ void onStreamMessage(agora::user_id_t userId, int streamId, const char* data, si
   void onAudioVolumeIndication(const agora::rtc::AudioVolumeInformation* speakers,
                                unsigned int speakerNumber, int totalVolume) override {}
 
-  void onLocalAudioTrackStatistics(const agora::rtc::LocalAudioStats& stats) override {}
+  void onLocalAudioTrackStatistics(const agora::rtc::LocalAudioStats& stats) override {
+    if (local_audio_stats_callback_) {
+      local_audio_stats_callback_(stats);
+    }
+  }
 
   void onRemoteAudioTrackStatistics(agora::agora_refptr<agora::rtc::IRemoteAudioTrack> audioTrack,
-                                    const agora::rtc::RemoteAudioTrackStats& stats) override {}
+                                    const agora::rtc::RemoteAudioTrackStats& stats) override {
+    if (remote_audio_stats_callback_) {
+      remote_audio_stats_callback_(stats);
+    }
+  }
                                   
   //void onRemoteVideoStreamInfoUpdated(const agora::rtc::RemoteVideoStreamInfo& info) override {}
   
@@ -193,6 +260,7 @@ void onStreamMessage(agora::user_id_t userId, int streamId, const char* data, si
 
   agora::rtc::IRtcConnection* connection_{nullptr};
   agora::rtc::ILocalUser* local_user_{nullptr};
+  bool registered_{false};
 
   agora::agora_refptr<agora::rtc::IRemoteAudioTrack> remote_audio_track_;
   agora::agora_refptr<agora::rtc::IRemoteVideoTrack> remote_video_track_;
@@ -202,6 +270,9 @@ void onStreamMessage(agora::user_id_t userId, int streamId, const char* data, si
   agora::media::IVideoEncodedFrameObserver* video_encoded_receiver_{nullptr};
   agora::rtc::IAudioEncodedFrameReceiver* audio_encoded_receiver_{nullptr};
 
+  agora::rtc::IMediaPacketReceiver* audio_packet_receiver_{nullptr};
+  agora::rtc::IMediaPacketReceiver* video_packet_receiver_{nullptr};
+
   agora::media::IAudioFrameObserverBase* audio_frame_observer_{nullptr};
   agora::rtc::IVideoFrameObserver2* video_frame_observer_{nullptr};
 
@@ -209,6 +280,12 @@ void onStreamMessage(agora::user_id_t userId, int streamId, const char* data, si
   std::map<std::string ,videoInfo> remote_source_map_;
 
 
+  std::function<void()> intra_request_callback_;
+  std::function<void(const agora::rtc::LocalAudioStats&)> local_audio_stats_callback_;
+  std::function<void(const agora::rtc::RemoteVideoTrackStats&)> remote_video_stats_callback_;
+  std::function<void(const agora::rtc::RemoteAudioTrackStats&)> remote_audio_stats_callback_;
+  std::function<void(agora::user_id_t, int, const char*, size_t)> stream_message_callback_;
+
   std::mutex observer_lock_;
   bool use_string_uid_{false};
   std::string  user_string_; 
@@ -0,0 +1,54 @@
+#include "startup_profiler.h"
+
+#include <algorithm>
+
+#include "log.h"
+
+static int64_t toUs(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+StartupProfiler& StartupProfiler::instance() {
+  static StartupProfiler profiler;
+  return profiler;
+}
+
+StartupProfiler::Scope::Scope(const char* name, bool deferred)
+    : name_(name), deferred_(deferred), start_(std::chrono::steady_clock::now()) {}
+
+StartupProfiler::Scope::~Scope() {
+  StartupProfiler::instance().record(name_, start_, std::chrono::steady_clock::now(), deferred_);
+}
+
+void StartupProfiler::record(const char* name, std::chrono::steady_clock::time_point start,
+                             std::chrono::steady_clock::time_point end, bool deferred) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!started_ || start < origin_) {
+    // phases recorded so far move with the origin
+    int64_t shiftUs = started_ ? toUs(origin_ - start) : 0;
+    for (auto& phase : phases_) {
+      phase.startUs += shiftUs;
+    }
+    origin_ = start;
+    started_ = true;
+  }
+  phases_.push_back({name, toUs(start - origin_), toUs(end - start), deferred});
+}
+
+std::vector<StartupPhase> StartupProfiler::phases() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return phases_;
+}
+
+void StartupProfiler::report() {
+  std::vector<StartupPhase> all = phases();
+  int64_t criticalUs = 0;
+  for (const auto& phase : all) {
+    AG_LOG(INFO, "Startup: %-24s at %7.1f ms took %7.1f ms%s", phase.name.c_str(),
+           phase.startUs / 1000.0, phase.durationUs / 1000.0, phase.deferred ? " (deferred)" : "");
+    if (!phase.deferred) {
+      criticalUs = std::max(criticalUs, phase.startUs + phase.durationUs);
+    }
+  }
+  AG_LOG(INFO, "Startup: critical path done after %.1f ms", criticalUs / 1000.0);
+}
@@ -0,0 +1,59 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Wall time per startup phase, for cold start tuning.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct StartupPhase {
+  std::string name;
+  // From the first phase the profiler saw
+  int64_t startUs;
+  int64_t durationUs;
+  // Ran off the critical path, on a background thread or on first use
+  bool deferred;
+};
+
+/**
+ Collects how long each step between process start and the first media
+ frame took. One instance is shared by the process, createAndInitAgoraService()
+ records its own phases into it and samples add theirs, e.g. connect.
+ */
+class StartupProfiler {
+ public:
+  static StartupProfiler& instance();
+
+  // Times a phase from construction to destruction
+  class Scope {
+   public:
+    Scope(const char* name, bool deferred = false);
+    ~Scope();
+
+   private:
+    const char* name_;
+    bool deferred_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  void record(const char* name, std::chrono::steady_clock::time_point start,
+              std::chrono::steady_clock::time_point end, bool deferred);
+  std::vector<StartupPhase> phases();
+
+  // Logs every phase and when the last one that was not deferred ended
+  void report();
+
+ private:
+  StartupProfiler() = default;
+
+  std::mutex mutex_;
+  bool started_ = false;
+  std::chrono::steady_clock::time_point origin_;
+  std::vector<StartupPhase> phases_;
+};
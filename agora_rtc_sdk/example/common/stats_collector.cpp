@@ -0,0 +1,471 @@
+#include "stats_collector.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+#include "log.h"
+#include "sample_connection_observer.h"
+#include "sample_local_user_observer.h"
+
+static int64_t nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+StatsRing::StatsRing(size_t capacity)
+    : slots_(new Slot[std::max<size_t>(1, capacity)]),
+      capacity_(std::max<size_t>(1, capacity)),
+      head_(0) {}
+
+void StatsRing::push(int64_t timeMs, const double* values, int count) {
+  uint64_t ticket = head_.fetch_add(1, std::memory_order_relaxed);
+  Slot& slot = slots_[ticket % capacity_];
+  // odd while being written, 2 * ticket + 2 once this ticket is readable
+  slot.seq.store(2 * ticket + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.timeMs.store(timeMs, std::memory_order_relaxed);
+  for (int i = 0; i < STATS_MAX_METRICS; ++i) {
+    slot.values[i].store(i < count ? values[i] : 0, std::memory_order_relaxed);
+  }
+  slot.seq.store(2 * ticket + 2, std::memory_order_release);
+}
+
+bool StatsRing::read(uint64_t ticket, StatsPoint& point) const {
+  const Slot& slot = slots_[ticket % capacity_];
+  uint64_t expected = 2 * ticket + 2;
+  if (slot.seq.load(std::memory_order_acquire) != expected) {
+    return false;
+  }
+  point.timeMs = slot.timeMs.load(std::memory_order_relaxed);
+  for (int i = 0; i < STATS_MAX_METRICS; ++i) {
+    point.values[i] = slot.values[i].load(std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.seq.load(std::memory_order_relaxed) == expected;
+}
+
+std::vector<StatsPoint> StatsRing::snapshot(size_t maxPoints, int64_t sinceMs) const {
+  std::vector<StatsPoint> points;
+  uint64_t head = head_.load(std::memory_order_acquire);
+  uint64_t count = std::min<uint64_t>(head, std::min(maxPoints, capacity_));
+  for (uint64_t ticket = head - count; ticket < head; ++ticket) {
+    StatsPoint point;
+    if (read(ticket, point) && point.timeMs > sinceMs) {
+      points.push_back(point);
+    }
+  }
+  return points;
+}
+
+bool StatsRing::latest(StatsPoint& point) const {
+  uint64_t head = head_.load(std::memory_order_acquire);
+  // the newest slot may still be in flight, fall back to the one before
+  for (uint64_t ticket = head; ticket > 0 && head - ticket < 2; --ticket) {
+    if (read(ticket - 1, point)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+StatsSeries::StatsSeries(STATS_SERIES_KIND kind, const std::string& connection,
+                         const std::string& stream, size_t capacity)
+    : kind_(kind), connection_(connection), stream_(stream), ring_(capacity) {}
+
+const char* StatsSeries::kindName(STATS_SERIES_KIND kind) {
+  switch (kind) {
+    case STATS_TRANSPORT:
+      return "transport";
+    case STATS_LOCAL_VIDEO:
+      return "local_video";
+    case STATS_LOCAL_AUDIO:
+      return "local_audio";
+    case STATS_REMOTE_VIDEO:
+      return "remote_video";
+    case STATS_REMOTE_AUDIO:
+      return "remote_audio";
+    default:
+      return "unknown";
+  }
+}
+
+const std::vector<const char*>& StatsSeries::metricNames(STATS_SERIES_KIND kind) {
+  // in the order record() pushes them
+  static const std::vector<const char*> names[STATS_SERIES_KIND_COUNT] = {
+      {"tx_kbps", "rx_kbps", "gateway_rtt_ms", "lastmile_delay_ms", "tx_loss_pct", "rx_loss_pct",
+       "cpu_app_pct", "users"},
+      {"target_kbps", "media_kbps", "total_kbps", "encode_fps", "width", "height",
+       "uplink_cost_ms"},
+      {"sent_kbps", "sample_rate", "channels"},
+      {"received_kbps", "packet_loss_pct", "frame_loss_pct", "delay_ms", "decode_fps",
+       "frozen_rate_pct", "total_frozen_ms", "width"},
+      {"received_kbps", "loss_pct", "network_delay_ms", "jitter_buffer_ms", "frozen_rate_pct",
+       "total_frozen_ms"},
+  };
+  return names[kind];
+}
+
+void StatsSeries::push(std::initializer_list<double> values) {
+  ring_.push(nowMs(), values.begin(), static_cast<int>(values.size()));
+}
+
+void StatsSeries::record(const agora::rtc::RtcStats& stats) {
+  push({static_cast<double>(stats.txKBitRate), static_cast<double>(stats.rxKBitRate),
+        static_cast<double>(stats.gatewayRtt), static_cast<double>(stats.lastmileDelay),
+        static_cast<double>(stats.txPacketLossRate), static_cast<double>(stats.rxPacketLossRate),
+        stats.cpuAppUsage, static_cast<double>(stats.userCount)});
+}
+
+void StatsSeries::record(const agora::rtc::LocalVideoTrackStats& stats) {
+  push({stats.target_media_bitrate_bps / 1000.0, stats.media_bitrate_bps / 1000.0,
+        stats.total_bitrate_bps / 1000.0, static_cast<double>(stats.encode_frame_rate),
+        static_cast<double>(stats.width), static_cast<double>(stats.height),
+        static_cast<double>(stats.uplink_cost_time_ms)});
+}
+
+void StatsSeries::record(const agora::rtc::LocalAudioStats& stats) {
+  push({static_cast<double>(stats.sentBitrate), static_cast<double>(stats.sentSampleRate),
+        static_cast<double>(stats.numChannels)});
+}
+
+void StatsSeries::record(const agora::rtc::RemoteVideoTrackStats& stats) {
+  push({static_cast<double>(stats.receivedBitrate), static_cast<double>(stats.packetLossRate),
+        static_cast<double>(stats.frameLossRate), static_cast<double>(stats.delay),
+        static_cast<double>(stats.decoderOutputFrameRate), static_cast<double>(stats.frozenRate),
+        static_cast<double>(stats.totalFrozenTime), static_cast<double>(stats.width)});
+}
+
+void StatsSeries::record(const agora::rtc::RemoteAudioTrackStats& stats) {
+  push({static_cast<double>(stats.received_bitrate), static_cast<double>(stats.audio_loss_rate),
+        static_cast<double>(stats.network_transport_delay),
+        static_cast<double>(stats.jitter_buffer_delay), static_cast<double>(stats.frozen_rate),
+        static_cast<double>(stats.total_frozen_time)});
+}
+
+StatsCollector::StatsCollector(const StatsCollectorConfig& config)
+    : config_(config), stopping_(false), listen_fd_(-1) {}
+
+StatsCollector::~StatsCollector() { stop(); }
+
+bool StatsCollector::start() {
+  if (config_.prometheusPort > 0) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config_.prometheusPort);
+    inet_pton(AF_INET, config_.prometheusAddress.c_str(), &addr.sin_addr);
+    if (listen_fd_ < 0 || bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd_, 16) != 0) {
+      AG_LOG(ERROR, "Failed to serve stats on %s:%d: %s", config_.prometheusAddress.c_str(),
+             config_.prometheusPort, strerror(errno));
+      return false;
+    }
+    AG_LOG(INFO, "Serving stats on http://%s:%d/metrics", config_.prometheusAddress.c_str(),
+           config_.prometheusPort);
+    serve_thread_ = std::thread(&StatsCollector::serveLoop, this);
+  }
+  poll_thread_ = std::thread(&StatsCollector::pollLoop, this);
+  return true;
+}
+
+void StatsCollector::stop() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    stopping_ = true;
+  }
+  stop_cv_.notify_all();
+  if (listen_fd_ >= 0) {
+    // wakes accept()
+    shutdown(listen_fd_, SHUT_RDWR);
+  }
+  if (poll_thread_.joinable()) {
+    poll_thread_.join();
+  }
+  if (serve_thread_.joinable()) {
+    serve_thread_.join();
+  }
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+  }
+  std::lock_guard<std::mutex> lock(series_mutex_);
+  local_video_.clear();
+}
+
+std::shared_ptr<StatsSeries> StatsCollector::series(STATS_SERIES_KIND kind,
+                                                    const std::string& connection,
+                                                    const std::string& stream) {
+  std::lock_guard<std::mutex> lock(series_mutex_);
+  SeriesKey key(kind, connection, stream);
+  auto it = series_.find(key);
+  if (it != series_.end()) {
+    return it->second;
+  }
+  // a report racing removeConnection() must not bring the connection back
+  if (connections_.find(connection) == connections_.end()) {
+    return nullptr;
+  }
+  std::shared_ptr<StatsSeries> entry =
+      std::make_shared<StatsSeries>(kind, connection, stream, config_.ringSize);
+  series_[key] = entry;
+  return entry;
+}
+
+void StatsCollector::attach(const std::string& connection,
+                            SampleConnectionObserver* connObserver,
+                            SampleLocalUserObserver* localUserObserver) {
+  {
+    std::lock_guard<std::mutex> lock(series_mutex_);
+    connections_.insert(connection);
+  }
+  if (connObserver) {
+    std::shared_ptr<StatsSeries> transport = series(STATS_TRANSPORT, connection, "");
+    connObserver->setTransportStatsCallback(
+        [transport](const agora::rtc::RtcStats& stats) { transport->record(stats); });
+  }
+  if (!localUserObserver) {
+    return;
+  }
+  std::shared_ptr<StatsSeries> localAudio = series(STATS_LOCAL_AUDIO, connection, "");
+  localUserObserver->setLocalAudioStatsCallback(
+      [localAudio](const agora::rtc::LocalAudioStats& stats) { localAudio->record(stats); });
+  // remote series are per user, found by uid on every report
+  localUserObserver->setRemoteVideoStatsCallback(
+      [this, connection](const agora::rtc::RemoteVideoTrackStats& stats) {
+        std::shared_ptr<StatsSeries> remote =
+            series(STATS_REMOTE_VIDEO, connection, std::to_string(stats.uid));
+        if (remote) {
+          remote->record(stats);
+        }
+      });
+  localUserObserver->setRemoteAudioStatsCallback(
+      [this, connection](const agora::rtc::RemoteAudioTrackStats& stats) {
+        std::shared_ptr<StatsSeries> remote =
+            series(STATS_REMOTE_AUDIO, connection, std::to_string(stats.uid));
+        if (remote) {
+          remote->record(stats);
+        }
+      });
+}
+
+void StatsCollector::pollLocalVideoTrack(const std::string& connection,
+                                         agora::agora_refptr<agora::rtc::ILocalVideoTrack> track) {
+  {
+    std::lock_guard<std::mutex> lock(series_mutex_);
+    connections_.insert(connection);
+  }
+  series(STATS_LOCAL_VIDEO, connection, "");
+  std::lock_guard<std::mutex> lock(series_mutex_);
+  local_video_.insert(std::make_pair(connection, track));
+}
+
+void StatsCollector::removeConnection(const std::string& connection) {
+  std::lock_guard<std::mutex> lock(series_mutex_);
+  connections_.erase(connection);
+  local_video_.erase(connection);
+  for (auto it = series_.begin(); it != series_.end();) {
+    if (std::get<1>(it->first) == connection) {
+      it = series_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void StatsCollector::pollLoop() {
+  auto next = std::chrono::steady_clock::now();
+  auto nextJson = next + std::chrono::milliseconds(config_.jsonIntervalMs);
+  int64_t lastJsonMs = 0;
+  std::vector<std::pair<std::shared_ptr<StatsSeries>,
+                        agora::agora_refptr<agora::rtc::ILocalVideoTrack>>> polled;
+  while (true) {
+    next += std::chrono::milliseconds(config_.intervalMs);
+    {
+      std::unique_lock<std::mutex> lock(stop_mutex_);
+      if (stop_cv_.wait_until(lock, next, [this]() { return stopping_; })) {
+        break;
+      }
+    }
+
+    // getStatistics() runs outside the lock, on a copy of the list
+    polled.clear();
+    {
+      std::lock_guard<std::mutex> lock(series_mutex_);
+      for (auto& entry : local_video_) {
+        auto found = series_.find(SeriesKey(STATS_LOCAL_VIDEO, entry.first, ""));
+        if (found != series_.end()) {
+          polled.push_back(std::make_pair(found->second, entry.second));
+        }
+      }
+    }
+    for (auto& entry : polled) {
+      agora::rtc::LocalVideoTrackStats stats;
+      if (entry.second->getStatistics(stats)) {
+        entry.first->record(stats);
+      }
+    }
+
+    if (!config_.jsonFile.empty() && std::chrono::steady_clock::now() >= nextJson) {
+      nextJson += std::chrono::milliseconds(config_.jsonIntervalMs);
+      int64_t snapshotMs = nowMs();
+      writeJson(lastJsonMs);
+      lastJsonMs = snapshotMs;
+    }
+  }
+  if (!config_.jsonFile.empty()) {
+    writeJson(lastJsonMs);
+  }
+}
+
+void StatsCollector::writeJson(int64_t sinceMs) {
+  std::string json = jsonSnapshot(sinceMs);
+  // readers never see a half written file
+  std::string tmpFile = config_.jsonFile + ".tmp";
+  FILE* file = fopen(tmpFile.c_str(), "w");
+  if (!file) {
+    AG_LOG(ERROR, "Failed to write stats to %s", tmpFile.c_str());
+    return;
+  }
+  fwrite(json.data(), 1, json.size(), file);
+  fclose(file);
+  if (rename(tmpFile.c_str(), config_.jsonFile.c_str()) != 0) {
+    AG_LOG(ERROR, "Failed to rename %s: %s", tmpFile.c_str(), strerror(errno));
+  }
+}
+
+static std::string escapeLabel(const std::string& value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+std::string StatsCollector::prometheusText() {
+  std::vector<std::shared_ptr<StatsSeries>> all;
+  {
+    std::lock_guard<std::mutex> lock(series_mutex_);
+    for (auto& entry : series_) {
+      all.push_back(entry.second);
+    }
+  }
+  // grouped by metric, which the map order by kind keeps together
+  std::ostringstream text;
+  for (int kind = 0; kind < STATS_SERIES_KIND_COUNT; ++kind) {
+    const std::vector<const char*>& names =
+        StatsSeries::metricNames(static_cast<STATS_SERIES_KIND>(kind));
+    for (size_t metric = 0; metric < names.size(); ++metric) {
+      bool typed = false;
+      for (auto& series : all) {
+        StatsPoint point;
+        if (series->kind() != kind || !series->ring().latest(point)) {
+          continue;
+        }
+        std::string name = std::string("agora_") +
+                           StatsSeries::kindName(static_cast<STATS_SERIES_KIND>(kind)) + "_" +
+                           names[metric];
+        if (!typed) {
+          text << "# TYPE " << name << " gauge\n";
+          typed = true;
+        }
+        text << name << "{connection=\"" << escapeLabel(series->connection()) << "\"";
+        if (!series->stream().empty()) {
+          text << ",stream=\"" << escapeLabel(series->stream()) << "\"";
+        }
+        text << "} " << point.values[metric] << " " << point.timeMs << "\n";
+      }
+    }
+  }
+  return text.str();
+}
+
+std::string StatsCollector::jsonSnapshot(int64_t sinceMs) {
+  std::vector<std::shared_ptr<StatsSeries>> all;
+  {
+    std::lock_guard<std::mutex> lock(series_mutex_);
+    for (auto& entry : series_) {
+      all.push_back(entry.second);
+    }
+  }
+  std::ostringstream json;
+  json << "{\"timeMs\":" << nowMs() << ",\"series\":[";
+  for (size_t i = 0; i < all.size(); ++i) {
+    const std::vector<const char*>& names = StatsSeries::metricNames(all[i]->kind());
+    json << (i ? "," : "") << "{\"kind\":\"" << StatsSeries::kindName(all[i]->kind())
+         << "\",\"connection\":\"" << escapeLabel(all[i]->connection()) << "\",\"stream\":\""
+         << escapeLabel(all[i]->stream()) << "\",\"metrics\":[\"timeMs\"";
+    for (const char* name : names) {
+      json << ",\"" << name << "\"";
+    }
+    json << "],\"points\":[";
+    std::vector<StatsPoint> points = all[i]->ring().snapshot(config_.ringSize, sinceMs);
+    for (size_t p = 0; p < points.size(); ++p) {
+      json << (p ? "," : "") << "[" << points[p].timeMs;
+      for (size_t metric = 0; metric < names.size(); ++metric) {
+        json << "," << points[p].values[metric];
+      }
+      json << "]";
+    }
+    json << "]}";
+  }
+  json << "]}\n";
+  return json.str();
+}
+
+void StatsCollector::serveLoop() {
+  while (true) {
+    int client = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+      {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        if (stopping_) {
+          return;
+        }
+      }
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      AG_LOG(ERROR, "Stopped serving stats: %s", strerror(errno));
+      return;
+    }
+    // a client that sends nothing must not hold up stop()
+    struct timeval timeout = {1, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    // any request gets the metrics, scrapers only ask for /metrics
+    char request[1024];
+    ssize_t ret = recv(client, request, sizeof(request), 0);
+    (void)ret;
+    std::string body = prometheusText();
+    std::ostringstream response;
+    response << "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+             << body.size() << "\r\nConnection: close\r\n\r\n"
+             << body;
+    std::string data = response.str();
+    for (size_t sent = 0; sent < data.size();) {
+      ssize_t n = send(client, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) {
+        break;
+      }
+      sent += n;
+    }
+    close(client);
+  }
+}
@@ -0,0 +1,173 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Per connection and per track statistics, kept as time series and exported.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "AgoraBase.h"
+#include "NGIAgoraAudioTrack.h"
+#include "NGIAgoraRtcConnection.h"
+#include "NGIAgoraVideoTrack.h"
+
+class SampleConnectionObserver;
+class SampleLocalUserObserver;
+
+#define STATS_MAX_METRICS (8)
+
+enum STATS_SERIES_KIND {
+  STATS_TRANSPORT = 0,
+  STATS_LOCAL_VIDEO,
+  STATS_LOCAL_AUDIO,
+  STATS_REMOTE_VIDEO,
+  STATS_REMOTE_AUDIO,
+  STATS_SERIES_KIND_COUNT,
+};
+
+struct StatsPoint {
+  int64_t timeMs = 0;
+  double values[STATS_MAX_METRICS] = {0};
+};
+
+/**
+ Fixed size ring of the latest points of one series, lock-free.
+
+ A writer claims a slot with one fetch_add and publishes it with a sequence
+ number, seqlock style; readers skip slots that are being written or were
+ overwritten while they read. Writers never wait, which keeps the cost in
+ SDK callbacks to a few stores.
+ */
+class StatsRing {
+ public:
+  explicit StatsRing(size_t capacity);
+
+  void push(int64_t timeMs, const double* values, int count);
+  // Up to maxPoints of the newest points newer than sinceMs, oldest first
+  std::vector<StatsPoint> snapshot(size_t maxPoints, int64_t sinceMs = 0) const;
+  bool latest(StatsPoint& point) const;
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> seq{0};
+    std::atomic<int64_t> timeMs{0};
+    std::atomic<double> values[STATS_MAX_METRICS];
+  };
+
+  bool read(uint64_t ticket, StatsPoint& point) const;
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t capacity_;
+  std::atomic<uint64_t> head_;
+};
+
+class StatsSeries {
+ public:
+  StatsSeries(STATS_SERIES_KIND kind, const std::string& connection, const std::string& stream,
+              size_t capacity);
+
+  static const char* kindName(STATS_SERIES_KIND kind);
+  static const std::vector<const char*>& metricNames(STATS_SERIES_KIND kind);
+
+  STATS_SERIES_KIND kind() const { return kind_; }
+  const std::string& connection() const { return connection_; }
+  const std::string& stream() const { return stream_; }
+  const StatsRing& ring() const { return ring_; }
+
+  void record(const agora::rtc::RtcStats& stats);
+  void record(const agora::rtc::LocalVideoTrackStats& stats);
+  void record(const agora::rtc::LocalAudioStats& stats);
+  void record(const agora::rtc::RemoteVideoTrackStats& stats);
+  void record(const agora::rtc::RemoteAudioTrackStats& stats);
+
+ private:
+  void push(std::initializer_list<double> values);
+
+  STATS_SERIES_KIND kind_;
+  std::string connection_;
+  std::string stream_;
+  StatsRing ring_;
+};
+
+struct StatsCollectorConfig {
+  // How often tracks are polled, callbacks come at the SDK's own pace
+  int intervalMs = 1000;
+  // Points kept per series, 5 minutes at 1 s
+  size_t ringSize = 300;
+  // Serve the latest points as Prometheus text on this port, 0 for off
+  int prometheusPort = 0;
+  std::string prometheusAddress = "127.0.0.1";
+  // Write the points since the last snapshot to this file, empty for off
+  std::string jsonFile;
+  int jsonIntervalMs = 10000;
+};
+
+/**
+ Keeps a ring per connection and per track and exports them.
+
+ Transport stats and the track statistics callbacks come in through the
+ sample observers, attach() points them at the collector. Local video tracks
+ report only when asked and are polled every intervalMs on the collector
+ thread. Series are looked up once per callback under a mutex that only
+ creation and removal contend on; the points go into the rings lock-free.
+ */
+class StatsCollector {
+ public:
+  explicit StatsCollector(const StatsCollectorConfig& config);
+  ~StatsCollector();
+
+  bool start();
+  void stop();
+
+  // Creates the series on first use, nullptr once the connection is removed
+  // or before it is attached
+  std::shared_ptr<StatsSeries> series(STATS_SERIES_KIND kind, const std::string& connection,
+                                      const std::string& stream);
+
+  // Set before the observers are registered, they call in on SDK threads
+  void attach(const std::string& connection, SampleConnectionObserver* connObserver,
+              SampleLocalUserObserver* localUserObserver);
+  void pollLocalVideoTrack(const std::string& connection,
+                           agora::agora_refptr<agora::rtc::ILocalVideoTrack> track);
+  // Stops polling the connection's tracks and drops its series
+  void removeConnection(const std::string& connection);
+
+  std::string prometheusText();
+  // Points newer than sinceMs of every series
+  std::string jsonSnapshot(int64_t sinceMs);
+
+ private:
+  typedef std::tuple<int, std::string, std::string> SeriesKey;
+
+  void pollLoop();
+  void serveLoop();
+  void writeJson(int64_t sinceMs);
+
+  StatsCollectorConfig config_;
+
+  std::mutex series_mutex_;
+  std::map<SeriesKey, std::shared_ptr<StatsSeries>> series_;
+  // attached and not yet removed, only these get new series
+  std::set<std::string> connections_;
+  std::multimap<std::string, agora::agora_refptr<agora::rtc::ILocalVideoTrack>> local_video_;
+
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cv_;
+  bool stopping_;
+  std::thread poll_thread_;
+  std::thread serve_thread_;
+  int listen_fd_;
+};
@@ -0,0 +1,169 @@
+#include "udp_packet_io.h"
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "log.h"
+
+#define UDP_RECEIVE_BUFFER_SIZE (4 * 1024 * 1024)
+#define UDP_POLL_TIMEOUT_MS (100)
+
+bool parseRtpTimestamp(const uint8_t* packet, size_t length, uint32_t& timestamp) {
+  if (length < 12 || (packet[0] >> 6) != 2) {
+    return false;
+  }
+  timestamp = (static_cast<uint32_t>(packet[4]) << 24) | (static_cast<uint32_t>(packet[5]) << 16) |
+              (static_cast<uint32_t>(packet[6]) << 8) | packet[7];
+  return true;
+}
+
+static bool resolveAddress(const std::string& address, int port, struct sockaddr_in& addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  return inet_pton(AF_INET, address.c_str(), &addr.sin_addr) == 1;
+}
+
+UdpPacketSource::UdpPacketSource(const std::string& address, int port, int batchSize)
+    : address_(address),
+      port_(port),
+      batch_size_(batchSize > 0 ? batchSize : 1),
+      fd_(-1),
+      tick_interval_(UDP_POLL_TIMEOUT_MS),
+      stopping_(false),
+      packets_(0),
+      bytes_(0),
+      batches_(0),
+      truncated_(0) {}
+
+UdpPacketSource::~UdpPacketSource() { stop(); }
+
+bool UdpPacketSource::start(const PacketCallback& callback, const TickCallback& tick,
+                            int tickIntervalMs) {
+  struct sockaddr_in addr;
+  if (!resolveAddress(address_, port_, addr)) {
+    AG_LOG(ERROR, "Invalid address %s", address_.c_str());
+    return false;
+  }
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd_ < 0) {
+    AG_LOG(ERROR, "Failed to create UDP socket: %s", strerror(errno));
+    return false;
+  }
+  // bursts of a key frame's packets arrive faster than one thread sends them
+  int bufferSize = UDP_RECEIVE_BUFFER_SIZE;
+  setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+  if (bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    AG_LOG(ERROR, "Failed to bind %s:%d: %s", address_.c_str(), port_, strerror(errno));
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  callback_ = callback;
+  tick_ = tick;
+  tick_interval_ = tick ? tickIntervalMs : UDP_POLL_TIMEOUT_MS;
+  buffers_.reset(new uint8_t[batch_size_ * UDP_MAX_PACKET_SIZE]);
+  stopping_ = false;
+  thread_ = std::thread(&UdpPacketSource::receiveLoop, this);
+  AG_LOG(INFO, "Receiving packets on %s:%d", address_.c_str(), port_);
+  return true;
+}
+
+void UdpPacketSource::stop() {
+  stopping_ = true;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+UdpPacketSourceStats UdpPacketSource::getStats() const {
+  UdpPacketSourceStats stats;
+  stats.packets = packets_;
+  stats.bytes = bytes_;
+  stats.batches = batches_;
+  stats.truncated = truncated_;
+  return stats;
+}
+
+void UdpPacketSource::receiveLoop() {
+  std::vector<struct mmsghdr> messages(batch_size_);
+  std::vector<struct iovec> iovecs(batch_size_);
+  for (int i = 0; i < batch_size_; ++i) {
+    iovecs[i].iov_base = buffers_.get() + i * UDP_MAX_PACKET_SIZE;
+    iovecs[i].iov_len = UDP_MAX_PACKET_SIZE;
+  }
+
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  while (!stopping_) {
+    int ready = poll(&pfd, 1, tick_interval_);
+    if (ready > 0) {
+      receiveBatch(messages, iovecs);
+    }
+    if (tick_) {
+      tick_();
+    }
+  }
+}
+
+void UdpPacketSource::receiveBatch(std::vector<struct mmsghdr>& messages,
+                                   std::vector<struct iovec>& iovecs) {
+  // recvmmsg overwrites the headers, set them up again each time
+  for (int i = 0; i < batch_size_; ++i) {
+    memset(&messages[i], 0, sizeof(messages[i]));
+    messages[i].msg_hdr.msg_iov = &iovecs[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+  }
+  int count = recvmmsg(fd_, messages.data(), batch_size_, MSG_DONTWAIT, nullptr);
+  if (count <= 0) {
+    return;
+  }
+  ++batches_;
+  for (int i = 0; i < count; ++i) {
+    if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      ++truncated_;
+      continue;
+    }
+    size_t length = messages[i].msg_len;
+    ++packets_;
+    bytes_ += length;
+    callback_(static_cast<const uint8_t*>(iovecs[i].iov_base), length);
+  }
+}
+
+bool UdpPacketSink::open(const std::string& address, int port) {
+  close();
+  if (!resolveAddress(address, port, to_)) {
+    AG_LOG(ERROR, "Invalid address %s", address.c_str());
+    return false;
+  }
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd_ < 0) {
+    AG_LOG(ERROR, "Failed to create UDP socket: %s", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void UdpPacketSink::close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+int UdpPacketSink::send(const uint8_t* data, size_t length) {
+  ssize_t sent =
+      sendto(fd_, data, length, 0, reinterpret_cast<const struct sockaddr*>(&to_), sizeof(to_));
+  return sent == static_cast<ssize_t>(length) ? 0 : -1;
+}
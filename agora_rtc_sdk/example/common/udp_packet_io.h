@@ -0,0 +1,88 @@
+//  Agora RTC/MEDIA SDK
+//
+//  UDP packet source and sink for forwarding already packetized media.
+//
+
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define UDP_MAX_PACKET_SIZE (1500)
+
+// Timestamp of an RTP packet (RFC 3550, 5.1), false if it does not look like one
+bool parseRtpTimestamp(const uint8_t* packet, size_t length, uint32_t& timestamp);
+
+struct UdpPacketSourceStats {
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  // recvmmsg calls that returned packets, packets / batches is the batching
+  uint64_t batches = 0;
+  // Larger than UDP_MAX_PACKET_SIZE, cut off by the kernel and dropped
+  uint64_t truncated = 0;
+};
+
+/**
+ Receives datagrams on its own thread, up to batchSize per recvmmsg call,
+ straight into buffers allocated once at start(). The callback gets a
+ pointer into those buffers and must be done with it when it returns, so
+ a packet reaches IMediaPacketSender without any copy of our own.
+ */
+class UdpPacketSource {
+ public:
+  typedef std::function<void(const uint8_t* data, size_t length)> PacketCallback;
+  // After every batch, and every tickIntervalMs while nothing comes
+  typedef std::function<void()> TickCallback;
+
+  UdpPacketSource(const std::string& address, int port, int batchSize = 32);
+  ~UdpPacketSource();
+
+  bool start(const PacketCallback& callback, const TickCallback& tick = nullptr,
+             int tickIntervalMs = 10);
+  void stop();
+  UdpPacketSourceStats getStats() const;
+
+ private:
+  void receiveLoop();
+  void receiveBatch(std::vector<struct mmsghdr>& messages, std::vector<struct iovec>& iovecs);
+
+  std::string address_;
+  int port_;
+  int batch_size_;
+  int fd_;
+  PacketCallback callback_;
+  TickCallback tick_;
+  int tick_interval_;
+  std::unique_ptr<uint8_t[]> buffers_;
+
+  std::atomic<bool> stopping_;
+  std::thread thread_;
+  std::atomic<uint64_t> packets_;
+  std::atomic<uint64_t> bytes_;
+  std::atomic<uint64_t> batches_;
+  std::atomic<uint64_t> truncated_;
+};
+
+// Sends datagrams to one address, safe to call from any thread
+class UdpPacketSink {
+ public:
+  UdpPacketSink() : fd_(-1) {}
+  ~UdpPacketSink() { close(); }
+
+  bool open(const std::string& address, int port);
+  void close();
+  bool isOpen() const { return fd_ >= 0; }
+  int send(const uint8_t* data, size_t length);
+
+ private:
+  int fd_;
+  struct sockaddr_in to_;
+};
@@ -0,0 +1,180 @@
+#include "hw_encoder_scheduler.h"
+
+#include <dlfcn.h>
+#include <glob.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "common/log.h"
+
+#define NVENC_LIBRARY "libnvidia-encode.so.1"
+#define NVENC_VERSION_SYMBOL "NvEncodeAPIGetMaxSupportedVersion"
+
+const char* videoEncoderPathName(VIDEO_ENCODER_PATH path) {
+  return path == VIDEO_ENCODER_HARDWARE ? "hardware" : "software";
+}
+
+static bool hasNvidiaDevice() {
+  if (access("/dev/nvidiactl", R_OK | W_OK) != 0) {
+    return false;
+  }
+  glob_t found;
+  bool ok = glob("/dev/nvidia[0-9]*", 0, nullptr, &found) == 0 && found.gl_pathc > 0;
+  globfree(&found);
+  return ok;
+}
+
+static HwEncoderCapability probeNvenc() {
+  HwEncoderCapability capability;
+  capability.provider = "nv";
+  if (!hasNvidiaDevice()) {
+    capability.detail = "no accessible /dev/nvidia device";
+    return capability;
+  }
+  void* library = dlopen(NVENC_LIBRARY, RTLD_LAZY | RTLD_LOCAL);
+  if (!library) {
+    capability.detail = std::string(NVENC_LIBRARY) + " not loadable";
+    return capability;
+  }
+  // Loading the library only proves it is installed, the driver answering
+  // the version query proves it matches the kernel module.
+  typedef int (*GetMaxSupportedVersion)(uint32_t*);
+  auto getVersion = reinterpret_cast<GetMaxSupportedVersion>(dlsym(library, NVENC_VERSION_SYMBOL));
+  uint32_t version = 0;
+  if (!getVersion) {
+    capability.detail = std::string(NVENC_LIBRARY) + " has no " NVENC_VERSION_SYMBOL;
+  } else if (getVersion(&version) != 0) {
+    capability.detail = "driver does not answer the NVENC version query";
+  } else {
+    capability.available = true;
+    capability.detail =
+        "NVENC API " + std::to_string(version >> 4) + "." + std::to_string(version & 0xf);
+  }
+  dlclose(library);
+  return capability;
+}
+
+HwEncoderCapability probeHwEncoder(const std::string& provider) {
+  if (provider == "nv") {
+    return probeNvenc();
+  }
+  HwEncoderCapability capability;
+  capability.provider = provider;
+  capability.detail = "no probe for this provider";
+  return capability;
+}
+
+HwEncoderScheduler::HwEncoderScheduler(const HwEncoderSchedulerConfig& config,
+                                       const HwEncoderCapability& capability,
+                                       const SwitchCallback& onSwitch)
+    : config_(config), capability_(capability), on_switch_(onSwitch) {}
+
+void HwEncoderScheduler::addTrack(const std::string& trackId, VIDEO_ENCODER_PATH path,
+                                  bool preferHardware) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Track& track = tracks_[trackId];
+  track = Track();
+  track.preferHardware = preferHardware;
+  track.pathSince = std::chrono::steady_clock::now();
+  track.retryDelayMs = config_.retryHardwareAfterMs;
+  track.report.path = path;
+  AG_LOG(INFO, "Track %s encodes on %s", trackId.c_str(), videoEncoderPathName(path));
+}
+
+void HwEncoderScheduler::removeTrack(const std::string& trackId) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  tracks_.erase(trackId);
+}
+
+bool HwEncoderScheduler::switchPath(const std::string& trackId, Track& track,
+                                    VIDEO_ENCODER_PATH path,
+                                    std::chrono::steady_clock::time_point now) {
+  if (!on_switch_ || !on_switch_(trackId, path)) {
+    AG_LOG(ERROR, "Track %s could not switch to the %s encoder", trackId.c_str(),
+           videoEncoderPathName(path));
+    return false;
+  }
+  AG_LOG(INFO, "Track %s switched to the %s encoder", trackId.c_str(),
+         videoEncoderPathName(path));
+  track.report.path = path;
+  track.report.switched = true;
+  track.report.consecutiveBadSamples = 0;
+  track.pathSince = now;
+  // frames queued in the old encoder say nothing about the new one
+  track.hasBaseline = false;
+  return true;
+}
+
+EncoderTrackReport HwEncoderScheduler::onSample(const std::string& trackId,
+                                                const EncoderTrackSample& sample) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = tracks_.find(trackId);
+  if (it == tracks_.end()) {
+    return EncoderTrackReport();
+  }
+  Track& track = it->second;
+  EncoderTrackReport& report = track.report;
+  report.switched = false;
+  report.encodeLatencyMs = sample.encodeLatencyMs;
+  report.encodeFrameRate = sample.encodeFrameRate;
+  if (sample.encodeLatencyMs > 0) {
+    ++track.latencySamples;
+    track.totalLatencyMs += sample.encodeLatencyMs;
+    report.averageEncodeLatencyMs =
+        static_cast<double>(track.totalLatencyMs) / track.latencySamples;
+    report.maxEncodeLatencyMs = std::max(report.maxEncodeLatencyMs, sample.encodeLatencyMs);
+  }
+
+  if (!track.hasBaseline) {
+    track.hasBaseline = true;
+    track.lastFramesSent = sample.framesSent;
+    track.lastFramesEncoded = sample.framesEncoded;
+    report.backlogFrames = 0;
+    return report;
+  }
+  // unsigned differences survive the counters wrapping
+  int sent = static_cast<int>(sample.framesSent - track.lastFramesSent);
+  int encoded = static_cast<int>(sample.framesEncoded - track.lastFramesEncoded);
+  track.lastFramesSent = sample.framesSent;
+  track.lastFramesEncoded = sample.framesEncoded;
+  report.backlogFrames = std::max(0, sent - encoded);
+
+  bool bad = (config_.maxEncodeLatencyMs > 0 &&
+              sample.encodeLatencyMs > config_.maxEncodeLatencyMs) ||
+             (config_.maxBacklogFrames > 0 && report.backlogFrames > config_.maxBacklogFrames);
+  report.consecutiveBadSamples = bad ? report.consecutiveBadSamples + 1 : 0;
+
+  if (report.path == VIDEO_ENCODER_HARDWARE) {
+    if (report.consecutiveBadSamples >= config_.badSamplesToFallback &&
+        switchPath(trackId, track, VIDEO_ENCODER_SOFTWARE, sample.time)) {
+      ++report.fallbacks;
+      track.nextRetry = sample.time + std::chrono::milliseconds(track.retryDelayMs);
+      track.retryDelayMs *= 2;
+    } else if (!bad && config_.retryHardwareAfterMs > 0 &&
+               sample.time - track.pathSince >=
+                   std::chrono::milliseconds(config_.retryHardwareAfterMs)) {
+      // hardware held up for a full retry period, forget earlier trouble
+      track.retryDelayMs = config_.retryHardwareAfterMs;
+    }
+  } else if (track.preferHardware && capability_.available && config_.retryHardwareAfterMs > 0 &&
+             report.fallbacks > 0 && report.hardwareRetries < config_.maxHardwareRetries &&
+             sample.time >= track.nextRetry) {
+    if (switchPath(trackId, track, VIDEO_ENCODER_HARDWARE, sample.time)) {
+      ++report.hardwareRetries;
+    } else {
+      track.nextRetry = sample.time + std::chrono::milliseconds(track.retryDelayMs);
+    }
+  }
+  return report;
+}
+
+bool HwEncoderScheduler::getReport(const std::string& trackId, EncoderTrackReport& report) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = tracks_.find(trackId);
+  if (it == tracks_.end()) {
+    return false;
+  }
+  report = it->second.report;
+  return true;
+}
@@ -0,0 +1,129 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Hardware video encoder probe and per track encoder selection.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+enum VIDEO_ENCODER_PATH {
+  VIDEO_ENCODER_SOFTWARE = 0,
+  VIDEO_ENCODER_HARDWARE = 1,
+};
+
+const char* videoEncoderPathName(VIDEO_ENCODER_PATH path);
+
+struct HwEncoderCapability {
+  bool available = false;
+  std::string provider;
+  // What was found, or why the encoder can not be used
+  std::string detail;
+};
+
+// Looks for a usable encoder of the given engine.video.hw_encoder_provider,
+// without creating an encode session. Only "nv" (NVENC) is known: it needs
+// the device nodes and a driver library that reports an API version.
+HwEncoderCapability probeHwEncoder(const std::string& provider);
+
+struct HwEncoderSchedulerConfig {
+  // A sample is bad when the SDK reported latency is above this
+  int maxEncodeLatencyMs = 150;
+  // or when this many more frames were sent than encoded since the last one
+  int maxBacklogFrames = 15;
+  // Consecutive bad samples on hardware before falling back to software
+  int badSamplesToFallback = 3;
+  // Time on software before hardware is tried again, doubled after every
+  // fallback. 0 never tries again.
+  int retryHardwareAfterMs = 60000;
+  int maxHardwareRetries = 3;
+};
+
+// One reading of a local video track, usually once a second
+struct EncoderTrackSample {
+  std::chrono::steady_clock::time_point time;
+  // Frames handed to the track by the app
+  uint32_t framesSent = 0;
+  // LocalVideoTrackStats::frames_encoded
+  uint32_t framesEncoded = 0;
+  int encodeFrameRate = 0;
+  // LocalVideoTrackStats::uplink_cost_time_ms, capture to packetization
+  int encodeLatencyMs = 0;
+};
+
+struct EncoderTrackReport {
+  VIDEO_ENCODER_PATH path = VIDEO_ENCODER_SOFTWARE;
+  int encodeLatencyMs = 0;
+  double averageEncodeLatencyMs = 0;
+  int maxEncodeLatencyMs = 0;
+  // Sent but not encoded since the previous sample, dropped frames included
+  int backlogFrames = 0;
+  int encodeFrameRate = 0;
+  int consecutiveBadSamples = 0;
+  int fallbacks = 0;
+  int hardwareRetries = 0;
+  // The encoder was switched while handling this sample
+  bool switched = false;
+};
+
+/**
+ Picks the encoder of every local video track from what it measures.
+
+ A track starts on the path it was created with. Each sample is compared with
+ the thresholds; a hardware encoder that stays behind for badSamplesToFallback
+ samples is swapped for software through the switch callback, which is
+ expected to reconfigure the live track rather than recreate it. Hardware is
+ tried again after retryHardwareAfterMs, with backoff, as long as the probe
+ found it. Nothing here talks to the SDK, so the policy runs the same with or
+ without a GPU.
+ */
+class HwEncoderScheduler {
+ public:
+  // Returns false if the encoder could not be changed, the track then stays
+  // on its current path.
+  using SwitchCallback = std::function<bool(const std::string& trackId, VIDEO_ENCODER_PATH path)>;
+
+  HwEncoderScheduler(const HwEncoderSchedulerConfig& config,
+                     const HwEncoderCapability& capability, const SwitchCallback& onSwitch);
+
+  // The path the track was created with. Hardware is only tried again later
+  // on tracks added with preferHardware.
+  void addTrack(const std::string& trackId, VIDEO_ENCODER_PATH path, bool preferHardware);
+  void removeTrack(const std::string& trackId);
+
+  // Thread safe. The switch callback runs on the calling thread with the
+  // scheduler locked, so it must not call back into it.
+  EncoderTrackReport onSample(const std::string& trackId, const EncoderTrackSample& sample);
+
+  bool getReport(const std::string& trackId, EncoderTrackReport& report);
+
+ private:
+  struct Track {
+    bool preferHardware = false;
+    bool hasBaseline = false;
+    uint32_t lastFramesSent = 0;
+    uint32_t lastFramesEncoded = 0;
+    std::chrono::steady_clock::time_point pathSince;
+    std::chrono::steady_clock::time_point nextRetry;
+    int retryDelayMs = 0;
+    uint64_t latencySamples = 0;
+    int64_t totalLatencyMs = 0;
+    EncoderTrackReport report;
+  };
+
+  bool switchPath(const std::string& trackId, Track& track, VIDEO_ENCODER_PATH path,
+                  std::chrono::steady_clock::time_point now);
+
+  HwEncoderSchedulerConfig config_;
+  HwEncoderCapability capability_;
+  SwitchCallback on_switch_;
+
+  std::mutex mutex_;
+  std::map<std::string, Track> tracks_;
+};
@@ -0,0 +1,108 @@
+#include "i420_file_writer.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "common/log.h"
+
+#define DROP_LOG_INTERVAL (100)
+
+I420FileWriter::I420FileWriter(const std::string& filePath, size_t fileLimit, int queueFrames)
+    : file_path_(filePath),
+      file_limit_(fileLimit),
+      queue_frames_(queueFrames),
+      dropped_frames_(0),
+      stopping_(false),
+      file_(nullptr),
+      file_count_(0),
+      file_size_(0),
+      writer_(&I420FileWriter::writerLoop, this) {}
+
+I420FileWriter::~I420FileWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_one();
+  writer_.join();
+  if (file_) {
+    fclose(file_);
+  }
+  if (dropped_frames_) {
+    AG_LOG(WARNING, "%llu frames dropped because the writer fell behind",
+           (unsigned long long)dropped_frames_);
+  }
+}
+
+bool I420FileWriter::pushFrame(const PixelPlanes& planes, int width, int height) {
+  // frames still queued keep the old pool alive until they are written
+  if (!pool_ || pool_->width() != width || pool_->height() != height) {
+    pool_ = I420BufferPool::create(width, height, queue_frames_);
+    if (!pool_) {
+      return false;
+    }
+  }
+
+  std::shared_ptr<I420BufferPool::Buffer> frame = pool_->acquire();
+  if (!frame) {
+    if (dropped_frames_++ % DROP_LOG_INTERVAL == 0) {
+      AG_LOG(WARNING, "Writer is behind, %llu frames dropped so far",
+             (unsigned long long)dropped_frames_);
+    }
+    return false;
+  }
+  if (convertToI420(RAW_PIXEL_I420, planes, width, height, frame->planes) != 0) {
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(frame));
+  }
+  cond_.notify_one();
+  return true;
+}
+
+void I420FileWriter::writerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    // whatever was queued is still written on shutdown
+    if (queue_.empty()) {
+      return;
+    }
+    std::shared_ptr<I420BufferPool::Buffer> frame = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    writeFrame(*frame);
+    // back to the pool before waiting again
+    frame.reset();
+    lock.lock();
+  }
+}
+
+void I420FileWriter::writeFrame(const I420BufferPool::Buffer& frame) {
+  if (!file_) {
+    std::string fileName =
+        (++file_count_ > 1) ? (file_path_ + std::to_string(file_count_)) : file_path_;
+    if (!(file_ = fopen(fileName.c_str(), "w+"))) {
+      AG_LOG(ERROR, "Failed to create received video file %s", fileName.c_str());
+      return;
+    }
+    AG_LOG(INFO, "Created file %s to save received YUV frames", fileName.c_str());
+  }
+
+  size_t writeBytes = pixelBufferSize(RAW_PIXEL_I420, frame.width, frame.height);
+  if (fwrite(frame.data, 1, writeBytes, file_) != writeBytes) {
+    AG_LOG(ERROR, "Error writing decoded video data: %s", strerror(errno));
+    return;
+  }
+  file_size_ += writeBytes;
+
+  // Close the file if size limit is reached
+  if (file_size_ >= file_limit_) {
+    fclose(file_);
+    file_ = nullptr;
+    file_size_ = 0;
+  }
+}
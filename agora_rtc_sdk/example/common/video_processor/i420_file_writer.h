@@ -0,0 +1,57 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Asynchronous dump of received I420 frames.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "pixel_converter.h"
+
+// Writes I420 frames to a file from its own thread. pushFrame() only copies
+// the visible width of every row into a pooled contiguous buffer, so the SDK
+// thread calling it never waits on the disk and padded strides never reach
+// the file. Frames are dropped, not queued without bound, when the writer
+// falls queueFrames behind. A new file, suffixed with its count, is started
+// whenever fileLimit bytes have been written.
+class I420FileWriter {
+ public:
+  I420FileWriter(const std::string& filePath, size_t fileLimit, int queueFrames = 8);
+  ~I420FileWriter();
+
+  bool pushFrame(const PixelPlanes& planes, int width, int height);
+
+  uint64_t droppedFrames() const { return dropped_frames_; }
+
+ private:
+  void writerLoop();
+  void writeFrame(const I420BufferPool::Buffer& frame);
+
+  std::string file_path_;
+  size_t file_limit_;
+  int queue_frames_;
+
+  // only touched by the pushing thread
+  std::shared_ptr<I420BufferPool> pool_;
+  uint64_t dropped_frames_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::shared_ptr<I420BufferPool::Buffer>> queue_;
+  bool stopping_;
+
+  // only touched by the writer thread
+  FILE* file_;
+  int file_count_;
+  size_t file_size_;
+  std::thread writer_;
+};
@@ -0,0 +1,822 @@
+#include "pixel_converter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_CONVERTER_X86 1
+#endif
+
+#define POOL_BUFFER_ALIGNMENT (64)
+
+// BT.601 limited range, 7 bit Y and 8 bit UV coefficients in memory byte order
+static const int8_t kBgraToY[4] = {13, 65, 33, 0};
+static const int8_t kBgraToU[4] = {112, -74, -38, 0};
+static const int8_t kBgraToV[4] = {-18, -94, 112, 0};
+static const int8_t kRgbaToY[4] = {33, 65, 13, 0};
+static const int8_t kRgbaToU[4] = {-38, -74, 112, 0};
+static const int8_t kRgbaToV[4] = {112, -94, -18, 0};
+
+// YUV to RGB in 6 bit fixed point: 1.164 * 64, 1.596 * 64, 0.391 * 64, 0.813 * 64, 2.018 * 64
+#define YUV_TO_RGB_Y (74)
+#define YUV_TO_RGB_VR (102)
+#define YUV_TO_RGB_UG (25)
+#define YUV_TO_RGB_VG (52)
+#define YUV_TO_RGB_UB (129)
+
+static inline uint8_t clamp255(int v) { return v < 0 ? 0 : (v > 255 ? 255 : v); }
+static inline uint8_t avg2(uint8_t a, uint8_t b) { return (a + b + 1) >> 1; }
+
+struct PixelRowKernels {
+  void (*rgb32ToYRow)(const uint8_t* src, uint8_t* y, int width, const int8_t* coefY);
+  void (*rgb32ToUVRow)(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v,
+                       int width, const int8_t* coefU, const int8_t* coefV);
+  void (*yuy2ToYRow)(const uint8_t* src, uint8_t* y, int width);
+  void (*yuy2ToUVRow)(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v,
+                      int width);
+  void (*splitUVRow)(const uint8_t* src, uint8_t* u, uint8_t* v, int chromaWidth);
+  void (*mergeUVRow)(const uint8_t* u, const uint8_t* v, uint8_t* dst, int chromaWidth);
+  void (*averageRow)(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int width);
+  void (*i420ToRgb32Row)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst,
+                         int width, bool rgba);
+  void (*i420ToYuy2Row)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst,
+                        int width);
+};
+
+//
+// Scalar rows, also used for the tails the SIMD rows leave
+//
+
+static void rgb32ToYRow_C(const uint8_t* src, uint8_t* y, int width, const int8_t* c) {
+  for (int x = 0; x < width; ++x, src += 4) {
+    y[x] = ((c[0] * src[0] + c[1] * src[1] + c[2] * src[2] + 64) >> 7) + 16;
+  }
+}
+
+static void rgb32ToUVRow_C(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v,
+                           int width, const int8_t* cu, const int8_t* cv) {
+  for (int x = 0; x < width; x += 2) {
+    // the last column of an odd width is paired with itself
+    int next = (x + 1 < width) ? 4 : 0;
+    int p[3];
+    for (int i = 0; i < 3; ++i) {
+      p[i] = avg2(avg2(src0[i], src1[i]), avg2(src0[next + i], src1[next + i]));
+    }
+    u[x / 2] = ((cu[0] * p[0] + cu[1] * p[1] + cu[2] * p[2]) >> 8) + 128;
+    v[x / 2] = ((cv[0] * p[0] + cv[1] * p[1] + cv[2] * p[2]) >> 8) + 128;
+    src0 += 8;
+    src1 += 8;
+  }
+}
+
+static void yuy2ToYRow_C(const uint8_t* src, uint8_t* y, int width) {
+  for (int x = 0; x < width; ++x) {
+    y[x] = src[x * 2];
+  }
+}
+
+static void yuy2ToUVRow_C(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v,
+                          int width) {
+  for (int x = 0; x < (width + 1) / 2; ++x) {
+    u[x] = avg2(src0[x * 4 + 1], src1[x * 4 + 1]);
+    v[x] = avg2(src0[x * 4 + 3], src1[x * 4 + 3]);
+  }
+}
+
+static void splitUVRow_C(const uint8_t* src, uint8_t* u, uint8_t* v, int chromaWidth) {
+  for (int x = 0; x < chromaWidth; ++x) {
+    u[x] = src[x * 2];
+    v[x] = src[x * 2 + 1];
+  }
+}
+
+static void mergeUVRow_C(const uint8_t* u, const uint8_t* v, uint8_t* dst, int chromaWidth) {
+  for (int x = 0; x < chromaWidth; ++x) {
+    dst[x * 2] = u[x];
+    dst[x * 2 + 1] = v[x];
+  }
+}
+
+static void averageRow_C(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int width) {
+  for (int x = 0; x < width; ++x) {
+    dst[x] = avg2(src0[x], src1[x]);
+  }
+}
+
+static void i420ToRgb32Row_C(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst,
+                             int width, bool rgba) {
+  int r = rgba ? 0 : 2;
+  int b = rgba ? 2 : 0;
+  for (int x = 0; x < width; ++x, dst += 4) {
+    int y1 = (y[x] - 16) * YUV_TO_RGB_Y;
+    int u1 = u[x / 2] - 128;
+    int v1 = v[x / 2] - 128;
+    dst[r] = clamp255((y1 + YUV_TO_RGB_VR * v1 + 32) >> 6);
+    dst[1] = clamp255((y1 - YUV_TO_RGB_UG * u1 - YUV_TO_RGB_VG * v1 + 32) >> 6);
+    dst[b] = clamp255((y1 + YUV_TO_RGB_UB * u1 + 32) >> 6);
+    dst[3] = 255;
+  }
+}
+
+static void i420ToYuy2Row_C(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst,
+                            int width) {
+  for (int x = 0; x < width; x += 2, dst += 4) {
+    dst[0] = y[x];
+    dst[1] = u[x / 2];
+    dst[2] = (x + 1 < width) ? y[x + 1] : y[x];
+    dst[3] = v[x / 2];
+  }
+}
+
+#ifdef PIXEL_CONVERTER_X86
+
+// 4 bytes from any address, memcpy keeps it free of alignment and aliasing assumptions
+static inline int32_t loadInt32(const void* p) {
+  int32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+//
+// SSSE3 rows
+//
+
+__attribute__((target("ssse3"))) static void rgb32ToYRow_SSSE3(const uint8_t* src, uint8_t* y,
+                                                                 int width, const int8_t* c) {
+  const __m128i coef = _mm_set1_epi32(loadInt32(c));
+  const __m128i round = _mm_set1_epi16(64);
+  const __m128i offset = _mm_set1_epi8(16);
+  int x = 0;
+  for (; x + 16 <= width; x += 16, src += 64) {
+    __m128i p0 = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)src), coef);
+    __m128i p1 = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(src + 16)), coef);
+    __m128i p2 = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(src + 32)), coef);
+    __m128i p3 = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(src + 48)), coef);
+    __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_hadd_epi16(p0, p1), round), 7);
+    __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_hadd_epi16(p2, p3), round), 7);
+    _mm_storeu_si128((__m128i*)(y + x), _mm_adds_epu8(_mm_packus_epi16(lo, hi), offset));
+  }
+  rgb32ToYRow_C(src, y + x, width - x, c);
+}
+
+// Averages 2x2 blocks of 8 pixels from each row into 4 pixels
+__attribute__((target("ssse3"))) static inline __m128i average2x2_SSSE3(const uint8_t* src0,
+                                                                         const uint8_t* src1) {
+  __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)src0),
+                           _mm_loadu_si128((const __m128i*)src1));
+  __m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(src0 + 16)),
+                           _mm_loadu_si128((const __m128i*)(src1 + 16)));
+  __m128 fa = _mm_castsi128_ps(a);
+  __m128 fb = _mm_castsi128_ps(b);
+  __m128i even = _mm_castps_si128(_mm_shuffle_ps(fa, fb, 0x88));
+  __m128i odd = _mm_castps_si128(_mm_shuffle_ps(fa, fb, 0xdd));
+  return _mm_avg_epu8(even, odd);
+}
+
+__attribute__((target("ssse3"))) static void rgb32ToUVRow_SSSE3(const uint8_t* src0,
+                                                                  const uint8_t* src1, uint8_t* u,
+                                                                  uint8_t* v, int width,
+                                                                  const int8_t* cu,
+                                                                  const int8_t* cv) {
+  const __m128i coefU = _mm_set1_epi32(loadInt32(cu));
+  const __m128i coefV = _mm_set1_epi32(loadInt32(cv));
+  const __m128i bias = _mm_set1_epi8((char)0x80);
+  int x = 0;
+  for (; x + 16 <= width; x += 16, src0 += 64, src1 += 64) {
+    __m128i q0 = average2x2_SSSE3(src0, src1);
+    __m128i q1 = average2x2_SSSE3(src0 + 32, src1 + 32);
+    __m128i su = _mm_srai_epi16(
+        _mm_hadd_epi16(_mm_maddubs_epi16(q0, coefU), _mm_maddubs_epi16(q1, coefU)), 8);
+    __m128i sv = _mm_srai_epi16(
+        _mm_hadd_epi16(_mm_maddubs_epi16(q0, coefV), _mm_maddubs_epi16(q1, coefV)), 8);
+    __m128i uv = _mm_add_epi8(_mm_packs_epi16(su, sv), bias);
+    _mm_storel_epi64((__m128i*)(u + x / 2), uv);
+    _mm_storel_epi64((__m128i*)(v + x / 2), _mm_unpackhi_epi64(uv, uv));
+  }
+  rgb32ToUVRow_C(src0, src1, u + x / 2, v + x / 2, width - x, cu, cv);
+}
+
+__attribute__((target("ssse3"))) static void yuy2ToYRow_SSSE3(const uint8_t* src, uint8_t* y,
+                                                                int width) {
+  const __m128i mask = _mm_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + x * 2)), mask);
+    __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + x * 2 + 16)), mask);
+    _mm_storeu_si128((__m128i*)(y + x), _mm_packus_epi16(a, b));
+  }
+  yuy2ToYRow_C(src + x * 2, y + x, width - x);
+}
+
+__attribute__((target("ssse3"))) static void yuy2ToUVRow_SSSE3(const uint8_t* src0,
+                                                                 const uint8_t* src1, uint8_t* u,
+                                                                 uint8_t* v, int width) {
+  const __m128i mask = _mm_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(src0 + x * 2)),
+                             _mm_loadu_si128((const __m128i*)(src1 + x * 2)));
+    __m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(src0 + x * 2 + 16)),
+                             _mm_loadu_si128((const __m128i*)(src1 + x * 2 + 16)));
+    // U0 V0 U1 V1 ...
+    __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+    __m128i split = _mm_packus_epi16(_mm_and_si128(uv, mask), _mm_srli_epi16(uv, 8));
+    _mm_storel_epi64((__m128i*)(u + x / 2), split);
+    _mm_storel_epi64((__m128i*)(v + x / 2), _mm_unpackhi_epi64(split, split));
+  }
+  yuy2ToUVRow_C(src0 + x * 2, src1 + x * 2, u + x / 2, v + x / 2, width - x);
+}
+
+__attribute__((target("ssse3"))) static void splitUVRow_SSSE3(const uint8_t* src, uint8_t* u,
+                                                                uint8_t* v, int chromaWidth) {
+  const __m128i shuffle = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+  int x = 0;
+  for (; x + 8 <= chromaWidth; x += 8) {
+    __m128i uv = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x * 2)), shuffle);
+    _mm_storel_epi64((__m128i*)(u + x), uv);
+    _mm_storel_epi64((__m128i*)(v + x), _mm_unpackhi_epi64(uv, uv));
+  }
+  splitUVRow_C(src + x * 2, u + x, v + x, chromaWidth - x);
+}
+
+__attribute__((target("ssse3"))) static void mergeUVRow_SSSE3(const uint8_t* u, const uint8_t* v,
+                                                                uint8_t* dst, int chromaWidth) {
+  int x = 0;
+  for (; x + 16 <= chromaWidth; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(u + x));
+    __m128i b = _mm_loadu_si128((const __m128i*)(v + x));
+    _mm_storeu_si128((__m128i*)(dst + x * 2), _mm_unpacklo_epi8(a, b));
+    _mm_storeu_si128((__m128i*)(dst + x * 2 + 16), _mm_unpackhi_epi8(a, b));
+  }
+  mergeUVRow_C(u + x, v + x, dst + x * 2, chromaWidth - x);
+}
+
+__attribute__((target("ssse3"))) static void averageRow_SSSE3(const uint8_t* src0,
+                                                                const uint8_t* src1, uint8_t* dst,
+                                                                int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    _mm_storeu_si128((__m128i*)(dst + x),
+                     _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(src0 + x)),
+                                  _mm_loadu_si128((const __m128i*)(src1 + x))));
+  }
+  averageRow_C(src0 + x, src1 + x, dst + x, width - x);
+}
+
+// 8 pixels: Y and upsampled U, V widened to 16 bits in, packed 32 bit pixels out
+__attribute__((target("ssse3"))) static inline void yuvToRgb32_SSSE3(__m128i y16, __m128i u16,
+                                                                       __m128i v16, bool rgba,
+                                                                       uint8_t* dst) {
+  const __m128i round = _mm_set1_epi16(32);
+  __m128i y1 = _mm_mullo_epi16(_mm_sub_epi16(y16, _mm_set1_epi16(16)),
+                               _mm_set1_epi16(YUV_TO_RGB_Y));
+  __m128i u1 = _mm_sub_epi16(u16, _mm_set1_epi16(128));
+  __m128i v1 = _mm_sub_epi16(v16, _mm_set1_epi16(128));
+  __m128i r = _mm_srai_epi16(
+      _mm_adds_epi16(_mm_adds_epi16(y1, _mm_mullo_epi16(v1, _mm_set1_epi16(YUV_TO_RGB_VR))),
+                     round),
+      6);
+  __m128i g = _mm_srai_epi16(
+      _mm_adds_epi16(
+          _mm_subs_epi16(_mm_subs_epi16(y1, _mm_mullo_epi16(u1, _mm_set1_epi16(YUV_TO_RGB_UG))),
+                         _mm_mullo_epi16(v1, _mm_set1_epi16(YUV_TO_RGB_VG))),
+          round),
+      6);
+  __m128i b = _mm_srai_epi16(
+      _mm_adds_epi16(_mm_adds_epi16(y1, _mm_mullo_epi16(u1, _mm_set1_epi16(YUV_TO_RGB_UB))),
+                     round),
+      6);
+  __m128i first = rgba ? r : b;
+  __m128i third = rgba ? b : r;
+  // first0-7 third0-7, g0-7 a0-7
+  __m128i ft = _mm_packus_epi16(first, third);
+  __m128i ga = _mm_packus_epi16(g, _mm_set1_epi16(255));
+  __m128i fg = _mm_unpacklo_epi8(ft, ga);
+  __m128i ta = _mm_unpackhi_epi8(ft, ga);
+  _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(fg, ta));
+  _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(fg, ta));
+}
+
+__attribute__((target("ssse3"))) static void i420ToRgb32Row_SSSE3(const uint8_t* y,
+                                                                    const uint8_t* u,
+                                                                    const uint8_t* v,
+                                                                    uint8_t* dst, int width,
+                                                                    bool rgba) {
+  const __m128i zero = _mm_setzero_si128();
+  int x = 0;
+  for (; x + 8 <= width; x += 8, dst += 32) {
+    __m128i y8 = _mm_loadl_epi64((const __m128i*)(y + x));
+    __m128i u8 = _mm_cvtsi32_si128(loadInt32(u + x / 2));
+    __m128i v8 = _mm_cvtsi32_si128(loadInt32(v + x / 2));
+    yuvToRgb32_SSSE3(_mm_unpacklo_epi8(y8, zero),
+                     _mm_unpacklo_epi8(_mm_unpacklo_epi8(u8, u8), zero),
+                     _mm_unpacklo_epi8(_mm_unpacklo_epi8(v8, v8), zero), rgba, dst);
+  }
+  i420ToRgb32Row_C(y + x, u + x / 2, v + x / 2, dst, width - x, rgba);
+}
+
+__attribute__((target("ssse3"))) static void i420ToYuy2Row_SSSE3(const uint8_t* y,
+                                                                   const uint8_t* u,
+                                                                   const uint8_t* v,
+                                                                   uint8_t* dst, int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i y16 = _mm_loadu_si128((const __m128i*)(y + x));
+    __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(u + x / 2)),
+                                   _mm_loadl_epi64((const __m128i*)(v + x / 2)));
+    _mm_storeu_si128((__m128i*)(dst + x * 2), _mm_unpacklo_epi8(y16, uv));
+    _mm_storeu_si128((__m128i*)(dst + x * 2 + 16), _mm_unpackhi_epi8(y16, uv));
+  }
+  i420ToYuy2Row_C(y + x, u + x / 2, v + x / 2, dst + x * 2, width - x);
+}
+
+//
+// AVX2 rows. 256 bit pack/hadd work per 128 bit lane, the permutes restore pixel order.
+//
+
+__attribute__((target("avx2"))) static void rgb32ToYRow_AVX2(const uint8_t* src, uint8_t* y,
+                                                               int width, const int8_t* c) {
+  const __m256i coef = _mm256_set1_epi32(loadInt32(c));
+  const __m256i round = _mm256_set1_epi16(64);
+  const __m256i offset = _mm256_set1_epi8(16);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int x = 0;
+  for (; x + 32 <= width; x += 32, src += 128) {
+    __m256i p0 = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)src), coef);
+    __m256i p1 = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(src + 32)), coef);
+    __m256i p2 = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(src + 64)), coef);
+    __m256i p3 = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(src + 96)), coef);
+    __m256i lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_hadd_epi16(p0, p1), round), 7);
+    __m256i hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_hadd_epi16(p2, p3), round), 7);
+    __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), order);
+    _mm256_storeu_si256((__m256i*)(y + x), _mm256_adds_epu8(packed, offset));
+  }
+  rgb32ToYRow_SSSE3(src, y + x, width - x, c);
+}
+
+__attribute__((target("avx2"))) static inline __m256i average2x2_AVX2(const uint8_t* src0,
+                                                                       const uint8_t* src1) {
+  __m256i a = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)src0),
+                              _mm256_loadu_si256((const __m256i*)src1));
+  __m256i b = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(src0 + 32)),
+                              _mm256_loadu_si256((const __m256i*)(src1 + 32)));
+  __m256 fa = _mm256_castsi256_ps(a);
+  __m256 fb = _mm256_castsi256_ps(b);
+  __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(fa, fb, 0x88));
+  __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(fa, fb, 0xdd));
+  return _mm256_avg_epu8(even, odd);
+}
+
+__attribute__((target("avx2"))) static void rgb32ToUVRow_AVX2(const uint8_t* src0,
+                                                                 const uint8_t* src1, uint8_t* u,
+                                                                 uint8_t* v, int width,
+                                                                 const int8_t* cu,
+                                                                 const int8_t* cv) {
+  const __m256i coefU = _mm256_set1_epi32(loadInt32(cu));
+  const __m256i coefV = _mm256_set1_epi32(loadInt32(cv));
+  const __m256i bias = _mm256_set1_epi8((char)0x80);
+  const __m256i order =
+      _mm256_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15, 0, 1, 8, 9, 2, 3,
+                       10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+  int x = 0;
+  for (; x + 32 <= width; x += 32, src0 += 128, src1 += 128) {
+    __m256i q0 = average2x2_AVX2(src0, src1);
+    __m256i q1 = average2x2_AVX2(src0 + 64, src1 + 64);
+    __m256i su = _mm256_srai_epi16(
+        _mm256_hadd_epi16(_mm256_maddubs_epi16(q0, coefU), _mm256_maddubs_epi16(q1, coefU)), 8);
+    __m256i sv = _mm256_srai_epi16(
+        _mm256_hadd_epi16(_mm256_maddubs_epi16(q0, coefV), _mm256_maddubs_epi16(q1, coefV)), 8);
+    __m256i uv = _mm256_add_epi8(_mm256_packs_epi16(su, sv), bias);
+    // U in the low lane, V in the high lane, then pixel order within each lane
+    uv = _mm256_shuffle_epi8(_mm256_permute4x64_epi64(uv, 0xd8), order);
+    _mm_storeu_si128((__m128i*)(u + x / 2), _mm256_castsi256_si128(uv));
+    _mm_storeu_si128((__m128i*)(v + x / 2), _mm256_extracti128_si256(uv, 1));
+  }
+  rgb32ToUVRow_SSSE3(src0, src1, u + x / 2, v + x / 2, width - x, cu, cv);
+}
+
+__attribute__((target("avx2"))) static void yuy2ToYRow_AVX2(const uint8_t* src, uint8_t* y,
+                                                              int width) {
+  const __m256i mask = _mm256_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m256i a = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(src + x * 2)), mask);
+    __m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(src + x * 2 + 32)), mask);
+    _mm256_storeu_si256((__m256i*)(y + x),
+                        _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+  }
+  yuy2ToYRow_SSSE3(src + x * 2, y + x, width - x);
+}
+
+__attribute__((target("avx2"))) static void yuy2ToUVRow_AVX2(const uint8_t* src0,
+                                                               const uint8_t* src1, uint8_t* u,
+                                                               uint8_t* v, int width) {
+  const __m256i mask = _mm256_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m256i a = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(src0 + x * 2)),
+                                _mm256_loadu_si256((const __m256i*)(src1 + x * 2)));
+    __m256i b = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(src0 + x * 2 + 32)),
+                                _mm256_loadu_si256((const __m256i*)(src1 + x * 2 + 32)));
+    __m256i uv = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)), 0xd8);
+    __m256i split = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(_mm256_and_si256(uv, mask), _mm256_srli_epi16(uv, 8)), 0xd8);
+    _mm_storeu_si128((__m128i*)(u + x / 2), _mm256_castsi256_si128(split));
+    _mm_storeu_si128((__m128i*)(v + x / 2), _mm256_extracti128_si256(split, 1));
+  }
+  yuy2ToUVRow_SSSE3(src0 + x * 2, src1 + x * 2, u + x / 2, v + x / 2, width - x);
+}
+
+__attribute__((target("avx2"))) static void splitUVRow_AVX2(const uint8_t* src, uint8_t* u,
+                                                              uint8_t* v, int chromaWidth) {
+  const __m256i shuffle =
+      _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15, 0, 2, 4, 6, 8, 10,
+                       12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+  int x = 0;
+  for (; x + 16 <= chromaWidth; x += 16) {
+    __m256i uv = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + x * 2)), shuffle);
+    uv = _mm256_permute4x64_epi64(uv, 0xd8);
+    _mm_storeu_si128((__m128i*)(u + x), _mm256_castsi256_si128(uv));
+    _mm_storeu_si128((__m128i*)(v + x), _mm256_extracti128_si256(uv, 1));
+  }
+  splitUVRow_SSSE3(src + x * 2, u + x, v + x, chromaWidth - x);
+}
+
+__attribute__((target("avx2"))) static void averageRow_AVX2(const uint8_t* src0,
+                                                              const uint8_t* src1, uint8_t* dst,
+                                                              int width) {
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    _mm256_storeu_si256((__m256i*)(dst + x),
+                        _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(src0 + x)),
+                                        _mm256_loadu_si256((const __m256i*)(src1 + x))));
+  }
+  averageRow_SSSE3(src0 + x, src1 + x, dst + x, width - x);
+}
+
+__attribute__((target("avx2"))) static void i420ToRgb32Row_AVX2(const uint8_t* y,
+                                                                  const uint8_t* u,
+                                                                  const uint8_t* v, uint8_t* dst,
+                                                                  int width, bool rgba) {
+  const __m256i round = _mm256_set1_epi16(32);
+  const __m256i alpha = _mm256_set1_epi16(255);
+  int x = 0;
+  for (; x + 16 <= width; x += 16, dst += 64) {
+    __m128i u8 = _mm_loadl_epi64((const __m128i*)(u + x / 2));
+    __m128i v8 = _mm_loadl_epi64((const __m128i*)(v + x / 2));
+    __m256i y16 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x)));
+    __m256i u16 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u8, u8));
+    __m256i v16 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v8, v8));
+
+    __m256i y1 = _mm256_mullo_epi16(_mm256_sub_epi16(y16, _mm256_set1_epi16(16)),
+                                    _mm256_set1_epi16(YUV_TO_RGB_Y));
+    __m256i u1 = _mm256_sub_epi16(u16, _mm256_set1_epi16(128));
+    __m256i v1 = _mm256_sub_epi16(v16, _mm256_set1_epi16(128));
+    __m256i r = _mm256_srai_epi16(
+        _mm256_adds_epi16(
+            _mm256_adds_epi16(y1, _mm256_mullo_epi16(v1, _mm256_set1_epi16(YUV_TO_RGB_VR))),
+            round),
+        6);
+    __m256i g = _mm256_srai_epi16(
+        _mm256_adds_epi16(
+            _mm256_subs_epi16(
+                _mm256_subs_epi16(y1, _mm256_mullo_epi16(u1, _mm256_set1_epi16(YUV_TO_RGB_UG))),
+                _mm256_mullo_epi16(v1, _mm256_set1_epi16(YUV_TO_RGB_VG))),
+            round),
+        6);
+    __m256i b = _mm256_srai_epi16(
+        _mm256_adds_epi16(
+            _mm256_adds_epi16(y1, _mm256_mullo_epi16(u1, _mm256_set1_epi16(YUV_TO_RGB_UB))),
+            round),
+        6);
+
+    __m256i ft = _mm256_packus_epi16(rgba ? r : b, rgba ? b : r);
+    __m256i ga = _mm256_packus_epi16(g, alpha);
+    __m256i fg = _mm256_unpacklo_epi8(ft, ga);
+    __m256i ta = _mm256_unpackhi_epi8(ft, ga);
+    // pixels 0-3 8-11 and 4-7 12-15
+    __m256i p0 = _mm256_unpacklo_epi16(fg, ta);
+    __m256i p1 = _mm256_unpackhi_epi16(fg, ta);
+    _mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256((__m256i*)(dst + 32), _mm256_permute2x128_si256(p0, p1, 0x31));
+  }
+  i420ToRgb32Row_SSSE3(y + x, u + x / 2, v + x / 2, dst, width - x, rgba);
+}
+
+#endif  // PIXEL_CONVERTER_X86
+
+static const PixelRowKernels kRowKernelsC = {
+    rgb32ToYRow_C,  rgb32ToUVRow_C, yuy2ToYRow_C,     yuy2ToUVRow_C,  splitUVRow_C,
+    mergeUVRow_C,   averageRow_C,   i420ToRgb32Row_C, i420ToYuy2Row_C};
+
+#ifdef PIXEL_CONVERTER_X86
+static const PixelRowKernels kRowKernelsSSSE3 = {
+    rgb32ToYRow_SSSE3, rgb32ToUVRow_SSSE3, yuy2ToYRow_SSSE3,     yuy2ToUVRow_SSSE3,
+    splitUVRow_SSSE3,  mergeUVRow_SSSE3,   averageRow_SSSE3,     i420ToRgb32Row_SSSE3,
+    i420ToYuy2Row_SSSE3};
+
+// merging and YUY2 packing are store bound, the SSSE3 rows are as fast
+static const PixelRowKernels kRowKernelsAVX2 = {
+    rgb32ToYRow_AVX2, rgb32ToUVRow_AVX2, yuy2ToYRow_AVX2,     yuy2ToUVRow_AVX2,
+    splitUVRow_AVX2,  mergeUVRow_SSSE3,  averageRow_AVX2,     i420ToRgb32Row_AVX2,
+    i420ToYuy2Row_SSSE3};
+#endif
+
+static PixelSimdLevel detectSimdLevel() {
+#ifdef PIXEL_CONVERTER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return PIXEL_SIMD_AVX2;
+  if (__builtin_cpu_supports("ssse3")) return PIXEL_SIMD_SSSE3;
+#endif
+  return PIXEL_SIMD_NONE;
+}
+
+static std::atomic<int>& currentSimdLevel() {
+  static std::atomic<int> level(detectSimdLevel());
+  return level;
+}
+
+static const PixelRowKernels& rowKernels() {
+  switch (currentSimdLevel().load(std::memory_order_relaxed)) {
+#ifdef PIXEL_CONVERTER_X86
+    case PIXEL_SIMD_AVX2:
+      return kRowKernelsAVX2;
+    case PIXEL_SIMD_SSSE3:
+      return kRowKernelsSSSE3;
+#endif
+    default:
+      return kRowKernelsC;
+  }
+}
+
+PixelSimdLevel getPixelSimdLevel() {
+  return static_cast<PixelSimdLevel>(currentSimdLevel().load());
+}
+
+PixelSimdLevel setPixelSimdLevel(PixelSimdLevel level) {
+  PixelSimdLevel supported = detectSimdLevel();
+  currentSimdLevel().store(level < supported ? level : supported);
+  return getPixelSimdLevel();
+}
+
+PixelPlanes pixelBufferPlanes(RawPixelFormat format, uint8_t* buffer, int width, int height) {
+  PixelPlanes planes;
+  int chromaWidth = (width + 1) / 2;
+  int chromaHeight = (format == RAW_PIXEL_I422) ? height : (height + 1) / 2;
+  planes.data[0] = buffer;
+  switch (format) {
+    case RAW_PIXEL_I420:
+    case RAW_PIXEL_I422:
+      planes.stride[0] = width;
+      planes.data[1] = buffer + width * height;
+      planes.stride[1] = chromaWidth;
+      planes.data[2] = planes.data[1] + chromaWidth * chromaHeight;
+      planes.stride[2] = chromaWidth;
+      break;
+    case RAW_PIXEL_NV12:
+    case RAW_PIXEL_NV21:
+      planes.stride[0] = width;
+      planes.data[1] = buffer + width * height;
+      planes.stride[1] = chromaWidth * 2;
+      break;
+    case RAW_PIXEL_YUY2:
+      planes.stride[0] = chromaWidth * 4;
+      break;
+    case RAW_PIXEL_RGBA:
+    case RAW_PIXEL_BGRA:
+      planes.stride[0] = width * 4;
+      break;
+  }
+  return planes;
+}
+
+int pixelBufferSize(RawPixelFormat format, int width, int height) {
+  int chromaWidth = (width + 1) / 2;
+  switch (format) {
+    case RAW_PIXEL_I420:
+      return width * height + 2 * chromaWidth * ((height + 1) / 2);
+    case RAW_PIXEL_I422:
+      return width * height + 2 * chromaWidth * height;
+    case RAW_PIXEL_NV12:
+    case RAW_PIXEL_NV21:
+      return width * height + 2 * chromaWidth * ((height + 1) / 2);
+    case RAW_PIXEL_YUY2:
+      return chromaWidth * 4 * height;
+    case RAW_PIXEL_RGBA:
+    case RAW_PIXEL_BGRA:
+      return width * 4 * height;
+  }
+  return 0;
+}
+
+// Moves the planes of src to the top left corner of the crop rectangle
+static PixelPlanes cropPlanes(RawPixelFormat format, const PixelPlanes& src, int left, int top) {
+  PixelPlanes planes = src;
+  switch (format) {
+    case RAW_PIXEL_I420:
+      planes.data[0] += top * src.stride[0] + left;
+      planes.data[1] += top / 2 * src.stride[1] + left / 2;
+      planes.data[2] += top / 2 * src.stride[2] + left / 2;
+      break;
+    case RAW_PIXEL_I422:
+      planes.data[0] += top * src.stride[0] + left;
+      planes.data[1] += top * src.stride[1] + left / 2;
+      planes.data[2] += top * src.stride[2] + left / 2;
+      break;
+    case RAW_PIXEL_NV12:
+    case RAW_PIXEL_NV21:
+      planes.data[0] += top * src.stride[0] + left;
+      planes.data[1] += top / 2 * src.stride[1] + left;
+      break;
+    case RAW_PIXEL_YUY2:
+      planes.data[0] += top * src.stride[0] + left * 2;
+      break;
+    case RAW_PIXEL_RGBA:
+    case RAW_PIXEL_BGRA:
+      planes.data[0] += top * src.stride[0] + left * 4;
+      break;
+  }
+  return planes;
+}
+
+int convertToI420(RawPixelFormat srcFormat, const PixelPlanes& src, int width, int height,
+                  const PixelPlanes& dst, const PixelCrop* crop) {
+  int left = 0, top = 0, cropWidth = width, cropHeight = height;
+  if (crop) {
+    // keep chroma sites aligned
+    left = crop->left & ~1;
+    top = crop->top & ~1;
+    cropWidth = crop->width > 0 ? crop->width : width - left;
+    cropHeight = crop->height > 0 ? crop->height : height - top;
+  }
+  if (!src.data[0] || !dst.data[0] || !dst.data[1] || !dst.data[2] || left < 0 || top < 0 ||
+      cropWidth <= 0 || cropHeight <= 0 || left + cropWidth > width ||
+      top + cropHeight > height) {
+    return -1;
+  }
+
+  const PixelRowKernels& k = rowKernels();
+  PixelPlanes s = cropPlanes(srcFormat, src, left, top);
+  int chromaWidth = (cropWidth + 1) / 2;
+  for (int row = 0; row < cropHeight; row += 2) {
+    // the last row of an odd height is paired with itself
+    int next = (row + 1 < cropHeight) ? 1 : 0;
+    uint8_t* y0 = dst.data[0] + row * dst.stride[0];
+    uint8_t* u = dst.data[1] + row / 2 * dst.stride[1];
+    uint8_t* v = dst.data[2] + row / 2 * dst.stride[2];
+
+    switch (srcFormat) {
+      case RAW_PIXEL_I420:
+        memcpy(y0, s.data[0] + row * s.stride[0], cropWidth);
+        if (next) memcpy(y0 + dst.stride[0], s.data[0] + (row + 1) * s.stride[0], cropWidth);
+        memcpy(u, s.data[1] + row / 2 * s.stride[1], chromaWidth);
+        memcpy(v, s.data[2] + row / 2 * s.stride[2], chromaWidth);
+        break;
+      case RAW_PIXEL_I422:
+        memcpy(y0, s.data[0] + row * s.stride[0], cropWidth);
+        if (next) memcpy(y0 + dst.stride[0], s.data[0] + (row + 1) * s.stride[0], cropWidth);
+        k.averageRow(s.data[1] + row * s.stride[1], s.data[1] + (row + next) * s.stride[1], u,
+                     chromaWidth);
+        k.averageRow(s.data[2] + row * s.stride[2], s.data[2] + (row + next) * s.stride[2], v,
+                     chromaWidth);
+        break;
+      case RAW_PIXEL_NV12:
+      case RAW_PIXEL_NV21:
+        memcpy(y0, s.data[0] + row * s.stride[0], cropWidth);
+        if (next) memcpy(y0 + dst.stride[0], s.data[0] + (row + 1) * s.stride[0], cropWidth);
+        if (srcFormat == RAW_PIXEL_NV12) {
+          k.splitUVRow(s.data[1] + row / 2 * s.stride[1], u, v, chromaWidth);
+        } else {
+          k.splitUVRow(s.data[1] + row / 2 * s.stride[1], v, u, chromaWidth);
+        }
+        break;
+      case RAW_PIXEL_YUY2: {
+        const uint8_t* p0 = s.data[0] + row * s.stride[0];
+        const uint8_t* p1 = p0 + next * s.stride[0];
+        k.yuy2ToYRow(p0, y0, cropWidth);
+        if (next) k.yuy2ToYRow(p1, y0 + dst.stride[0], cropWidth);
+        k.yuy2ToUVRow(p0, p1, u, v, cropWidth);
+        break;
+      }
+      case RAW_PIXEL_RGBA:
+      case RAW_PIXEL_BGRA: {
+        bool rgba = srcFormat == RAW_PIXEL_RGBA;
+        const int8_t* coefY = rgba ? kRgbaToY : kBgraToY;
+        const uint8_t* p0 = s.data[0] + row * s.stride[0];
+        const uint8_t* p1 = p0 + next * s.stride[0];
+        k.rgb32ToYRow(p0, y0, cropWidth, coefY);
+        if (next) k.rgb32ToYRow(p1, y0 + dst.stride[0], cropWidth, coefY);
+        k.rgb32ToUVRow(p0, p1, u, v, cropWidth, rgba ? kRgbaToU : kBgraToU,
+                       rgba ? kRgbaToV : kBgraToV);
+        break;
+      }
+      default:
+        return -1;
+    }
+  }
+  return 0;
+}
+
+int convertFromI420(const PixelPlanes& src, int width, int height, RawPixelFormat dstFormat,
+                    const PixelPlanes& dst) {
+  if (!src.data[0] || !src.data[1] || !src.data[2] || !dst.data[0] || width <= 0 ||
+      height <= 0) {
+    return -1;
+  }
+
+  const PixelRowKernels& k = rowKernels();
+  int chromaWidth = (width + 1) / 2;
+  for (int row = 0; row < height; ++row) {
+    const uint8_t* y = src.data[0] + row * src.stride[0];
+    const uint8_t* u = src.data[1] + row / 2 * src.stride[1];
+    const uint8_t* v = src.data[2] + row / 2 * src.stride[2];
+    uint8_t* out = dst.data[0] + row * dst.stride[0];
+
+    switch (dstFormat) {
+      case RAW_PIXEL_I420:
+        memcpy(out, y, width);
+        if ((row & 1) == 0) {
+          memcpy(dst.data[1] + row / 2 * dst.stride[1], u, chromaWidth);
+          memcpy(dst.data[2] + row / 2 * dst.stride[2], v, chromaWidth);
+        }
+        break;
+      case RAW_PIXEL_I422:
+        memcpy(out, y, width);
+        memcpy(dst.data[1] + row * dst.stride[1], u, chromaWidth);
+        memcpy(dst.data[2] + row * dst.stride[2], v, chromaWidth);
+        break;
+      case RAW_PIXEL_NV12:
+      case RAW_PIXEL_NV21:
+        memcpy(out, y, width);
+        if ((row & 1) == 0) {
+          uint8_t* uv = dst.data[1] + row / 2 * dst.stride[1];
+          if (dstFormat == RAW_PIXEL_NV12) {
+            k.mergeUVRow(u, v, uv, chromaWidth);
+          } else {
+            k.mergeUVRow(v, u, uv, chromaWidth);
+          }
+        }
+        break;
+      case RAW_PIXEL_YUY2:
+        k.i420ToYuy2Row(y, u, v, out, width);
+        break;
+      case RAW_PIXEL_RGBA:
+      case RAW_PIXEL_BGRA:
+        k.i420ToRgb32Row(y, u, v, out, width, dstFormat == RAW_PIXEL_RGBA);
+        break;
+      default:
+        return -1;
+    }
+  }
+  return 0;
+}
+
+std::shared_ptr<I420BufferPool> I420BufferPool::create(int width, int height, int count) {
+  if (width <= 0 || height <= 0 || count <= 0) {
+    return nullptr;
+  }
+  std::shared_ptr<I420BufferPool> pool(new I420BufferPool(width, height));
+  size_t size = pixelBufferSize(RAW_PIXEL_I420, width, height);
+  for (int i = 0; i < count; ++i) {
+    void* data = nullptr;
+    if (posix_memalign(&data, POOL_BUFFER_ALIGNMENT, size) != 0) {
+      return nullptr;
+    }
+    std::unique_ptr<Buffer> buffer(new Buffer);
+    buffer->data = static_cast<uint8_t*>(data);
+    buffer->width = width;
+    buffer->height = height;
+    buffer->planes = pixelBufferPlanes(RAW_PIXEL_I420, buffer->data, width, height);
+    pool->free_.push_back(buffer.get());
+    pool->buffers_.push_back(std::move(buffer));
+  }
+  return pool;
+}
+
+I420BufferPool::~I420BufferPool() {
+  for (auto& buffer : buffers_) {
+    free(buffer->data);
+  }
+}
+
+std::shared_ptr<I420BufferPool::Buffer> I420BufferPool::acquire() {
+  Buffer* buffer;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+      return nullptr;
+    }
+    buffer = free_.back();
+    free_.pop_back();
+  }
+  // the deleter keeps the pool alive until the buffer is back
+  std::shared_ptr<I420BufferPool> self = shared_from_this();
+  return std::shared_ptr<Buffer>(buffer, [self](Buffer* b) { self->release(b); });
+}
+
+void I420BufferPool::release(Buffer* buffer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_.push_back(buffer);
+}
@@ -0,0 +1,94 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Pixel format conversion to and from I420 for custom video tracks.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+enum RawPixelFormat {
+  RAW_PIXEL_I420 = 0,
+  RAW_PIXEL_I422,
+  RAW_PIXEL_NV12,
+  RAW_PIXEL_NV21,
+  RAW_PIXEL_YUY2,
+  // byte order in memory: R G B A
+  RAW_PIXEL_RGBA,
+  // byte order in memory: B G R A
+  RAW_PIXEL_BGRA,
+};
+
+enum PixelSimdLevel {
+  PIXEL_SIMD_NONE = 0,
+  PIXEL_SIMD_SSSE3,
+  PIXEL_SIMD_AVX2,
+};
+
+// Up to three planes. Packed formats use plane 0 only, NV12/NV21 use 0 and 1.
+struct PixelPlanes {
+  uint8_t* data[3] = {nullptr, nullptr, nullptr};
+  int stride[3] = {0, 0, 0};
+};
+
+struct PixelCrop {
+  int left = 0;
+  int top = 0;
+  int width = 0;  // 0 means up to the right edge
+  int height = 0;  // 0 means up to the bottom edge
+};
+
+// Planes of a tightly packed buffer (stride == width), which is the layout
+// ExternalVideoFrame expects, and the size of such a buffer
+PixelPlanes pixelBufferPlanes(RawPixelFormat format, uint8_t* buffer, int width, int height);
+int pixelBufferSize(RawPixelFormat format, int width, int height);
+
+// Converts the crop rectangle of src into dst, which has the size of the crop.
+// Odd crop offsets are rounded down to keep chroma aligned. Colors are BT.601
+// limited range. Returns 0 on success, -1 on bad arguments.
+int convertToI420(RawPixelFormat srcFormat, const PixelPlanes& src, int width, int height,
+                  const PixelPlanes& dst, const PixelCrop* crop = nullptr);
+int convertFromI420(const PixelPlanes& src, int width, int height, RawPixelFormat dstFormat,
+                    const PixelPlanes& dst);
+
+// The best level the CPU supports is used by default. Lower levels can be
+// forced for benchmarking; the returned level is the one in effect.
+PixelSimdLevel getPixelSimdLevel();
+PixelSimdLevel setPixelSimdLevel(PixelSimdLevel level);
+
+// Fixed set of reusable contiguous I420 buffers. A buffer goes back to the pool
+// when the last shared_ptr to it is released, so a frame handed to the SDK can
+// be reused as soon as sendVideoFrame() returns.
+class I420BufferPool : public std::enable_shared_from_this<I420BufferPool> {
+ public:
+  struct Buffer {
+    uint8_t* data;
+    int width;
+    int height;
+    PixelPlanes planes;
+  };
+
+  static std::shared_ptr<I420BufferPool> create(int width, int height, int count);
+  ~I420BufferPool();
+
+  // Returns nullptr if every buffer is in use
+  std::shared_ptr<Buffer> acquire();
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+ private:
+  I420BufferPool(int width, int height) : width_(width), height_(height) {}
+  void release(Buffer* buffer);
+
+  int width_;
+  int height_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+  std::vector<Buffer*> free_;
+};
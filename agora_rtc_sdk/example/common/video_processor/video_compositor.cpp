@@ -0,0 +1,336 @@
+#include "video_compositor.h"
+
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "common/log.h"
+
+// Black in limited range
+#define BACKGROUND_LUMA (16)
+#define BACKGROUND_CHROMA (128)
+#define MIN_PLACED_SIZE (4)
+
+VideoCompositor::VideoCompositor(const VideoCompositorConfig& config)
+    : config_(config),
+      tile_rows_(0),
+      tile_count_(0),
+      layout_order_(0),
+      skipped_source_frames_(0),
+      dropped_source_frames_(0),
+      generation_(0),
+      next_tile_(0),
+      tiles_done_(0),
+      stopping_(false),
+      composed_frames_(0),
+      last_compose_ms_(0),
+      total_compose_ms_(0) {}
+
+VideoCompositor::~VideoCompositor() {
+  {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    stopping_ = true;
+  }
+  work_cond_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+bool VideoCompositor::initialize() {
+  // chroma rows must not be shared by two tiles
+  if (config_.width < MIN_PLACED_SIZE || config_.height < MIN_PLACED_SIZE ||
+      (config_.width & 1) || (config_.height & 1) || config_.tileRows <= 0) {
+    AG_LOG(ERROR, "Bad compositor canvas %dx%d, tile rows %d", config_.width, config_.height,
+           config_.tileRows);
+    return false;
+  }
+  canvas_pool_ = I420BufferPool::create(config_.width, config_.height, config_.poolSize);
+  if (!canvas_pool_) {
+    return false;
+  }
+  tile_rows_ = (config_.tileRows + 1) & ~1;
+  tile_count_ = (config_.height + tile_rows_ - 1) / tile_rows_;
+
+  int threads = config_.workerCount;
+  if (threads <= 0) {
+    threads = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+  }
+  // the thread calling compose() is one of them
+  for (int i = 1; i < threads && i < tile_count_; ++i) {
+    workers_.emplace_back(&VideoCompositor::workerLoop, this);
+  }
+  AG_LOG(INFO, "Compositor %dx%d, %d tiles of %d rows, %d threads", config_.width,
+         config_.height, tile_count_, tile_rows_, static_cast<int>(workers_.size()) + 1);
+  return true;
+}
+
+void VideoCompositor::addSource(const std::string& id) {
+  std::lock_guard<std::mutex> lock(source_mutex_);
+  sources_[id];
+}
+
+bool VideoCompositor::updateSource(const std::string& id, const PixelPlanes& planes, int width,
+                                   int height) {
+  std::shared_ptr<I420BufferPool> pool;
+  {
+    std::lock_guard<std::mutex> lock(source_mutex_);
+    auto it = sources_.find(id);
+    if (it == sources_.end()) {
+      return false;
+    }
+    Source& source = it->second;
+    // frames still held by a compose() keep the old pool alive
+    if (!source.pool || source.pool->width() != width || source.pool->height() != height) {
+      source.pool = I420BufferPool::create(width, height, config_.poolSize);
+    }
+    pool = source.pool;
+  }
+  if (!pool) {
+    return false;
+  }
+
+  // copied without the lock, compose() only waits for the pointer swap
+  std::shared_ptr<I420BufferPool::Buffer> frame = pool->acquire();
+  if (!frame || convertToI420(RAW_PIXEL_I420, planes, width, height, frame->planes) != 0) {
+    std::lock_guard<std::mutex> lock(source_mutex_);
+    ++dropped_source_frames_;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(source_mutex_);
+  auto it = sources_.find(id);
+  if (it == sources_.end()) {
+    return false;
+  }
+  if (it->second.latest && !it->second.used) {
+    ++skipped_source_frames_;
+  }
+  it->second.latest = std::move(frame);
+  it->second.updateTime = std::chrono::steady_clock::now();
+  it->second.used = false;
+  return true;
+}
+
+void VideoCompositor::removeSource(const std::string& id) {
+  std::lock_guard<std::mutex> lock(source_mutex_);
+  sources_.erase(id);
+}
+
+void VideoCompositor::setLayout(const std::string& id, const CompositorRect& rect) {
+  std::lock_guard<std::mutex> lock(source_mutex_);
+  auto it = sources_.find(id);
+  if (it == sources_.end()) {
+    return;
+  }
+  it->second.hasLayout = true;
+  it->second.layoutOrder = ++layout_order_;
+  it->second.layout = rect;
+}
+
+void VideoCompositor::clearLayout(const std::string& id) {
+  std::lock_guard<std::mutex> lock(source_mutex_);
+  auto it = sources_.find(id);
+  if (it != sources_.end()) {
+    it->second.hasLayout = false;
+  }
+}
+
+// Even offsets and sizes keep every chroma sample inside one rectangle
+static CompositorRect alignRect(const CompositorRect& rect, int canvasWidth, int canvasHeight) {
+  CompositorRect aligned;
+  aligned.x = std::max(0, rect.x) & ~1;
+  aligned.y = std::max(0, rect.y) & ~1;
+  aligned.width = std::min(rect.width, canvasWidth - aligned.x) & ~1;
+  aligned.height = std::min(rect.height, canvasHeight - aligned.y) & ~1;
+  return aligned;
+}
+
+static CompositorRect fitRect(const CompositorRect& cell, int width, int height) {
+  CompositorRect fitted = cell;
+  if (static_cast<int64_t>(width) * cell.height > static_cast<int64_t>(height) * cell.width) {
+    fitted.height = static_cast<int>(static_cast<int64_t>(height) * cell.width / width) & ~1;
+  } else {
+    fitted.width = static_cast<int>(static_cast<int64_t>(width) * cell.height / height) & ~1;
+  }
+  fitted.x += ((cell.width - fitted.width) / 2) & ~1;
+  fitted.y += ((cell.height - fitted.height) / 2) & ~1;
+  return fitted;
+}
+
+void VideoCompositor::placeSources(std::vector<Placement>& placements) {
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(source_mutex_);
+  std::vector<Source*> grid;
+  std::vector<Source*> fixed;
+  for (auto& it : sources_) {
+    if (!it.second.latest ||
+        (config_.sourceTimeoutMs > 0 &&
+         now - it.second.updateTime > std::chrono::milliseconds(config_.sourceTimeoutMs))) {
+      continue;
+    }
+    (it.second.hasLayout ? fixed : grid).push_back(&it.second);
+  }
+  std::sort(fixed.begin(), fixed.end(),
+            [](const Source* a, const Source* b) { return a->layoutOrder < b->layoutOrder; });
+
+  int columns = static_cast<int>(ceil(sqrt(static_cast<double>(grid.size()))));
+  int rows = columns ? (static_cast<int>(grid.size()) + columns - 1) / columns : 0;
+  std::vector<std::pair<Source*, CompositorRect>> cells;
+  for (size_t i = 0; i < grid.size(); ++i) {
+    int cellWidth = config_.width / columns;
+    int cellHeight = config_.height / rows;
+    CompositorRect cell = {static_cast<int>(i % columns) * cellWidth,
+                           static_cast<int>(i / columns) * cellHeight, cellWidth, cellHeight};
+    cells.emplace_back(grid[i], alignRect(cell, config_.width, config_.height));
+  }
+  for (Source* source : fixed) {
+    cells.emplace_back(source, alignRect(source->layout, config_.width, config_.height));
+  }
+
+  for (auto& cell : cells) {
+    Source& source = *cell.first;
+    const I420BufferPool::Buffer& frame = *source.latest;
+    CompositorRect rect = cell.second;
+    if (config_.keepAspectRatio) {
+      rect = fitRect(rect, frame.width, frame.height);
+    }
+    if (rect.width < MIN_PLACED_SIZE || rect.height < MIN_PLACED_SIZE) {
+      continue;
+    }
+    if (!source.scaler || source.scaler->srcWidth() != frame.width ||
+        source.scaler->srcHeight() != frame.height || source.placed.width != rect.width ||
+        source.placed.height != rect.height) {
+      // exact 2:1 steps are box filtered, anything else is bilinear
+      source.scaler = std::make_shared<I420RowScaler>(frame.width, frame.height, rect.width,
+                                                      rect.height, SCALE_FILTER_BOX);
+      if (!source.scaler->valid()) {
+        source.scaler.reset();
+        continue;
+      }
+    }
+    source.placed = rect;
+    source.used = true;
+    placements.push_back({source.latest, source.scaler, rect});
+  }
+}
+
+void VideoCompositor::drawTile(int tile, const PixelPlanes& canvas,
+                               std::vector<uint8_t>& rowBuffer) {
+  int top = tile * tile_rows_;
+  int bottom = std::min(top + tile_rows_, config_.height);
+
+  for (int row = top; row < bottom; ++row) {
+    memset(canvas.data[0] + row * canvas.stride[0], BACKGROUND_LUMA, config_.width);
+  }
+  for (int p = 1; p < 3; ++p) {
+    for (int row = top / 2; row < bottom / 2; ++row) {
+      memset(canvas.data[p] + row * canvas.stride[p], BACKGROUND_CHROMA, config_.width / 2);
+    }
+  }
+
+  for (const Placement& placement : placements_) {
+    const CompositorRect& rect = placement.rect;
+    int first = std::max(top, rect.y);
+    int last = std::min(bottom, rect.y + rect.height);
+    if (first >= last) {
+      continue;
+    }
+    if (rowBuffer.size() < static_cast<size_t>(placement.scaler->srcWidth())) {
+      rowBuffer.resize(placement.scaler->srcWidth());
+    }
+    PixelPlanes dst;
+    for (int p = 0; p < 3; ++p) {
+      int shift = p ? 1 : 0;
+      dst.data[p] = canvas.data[p] + (rect.y >> shift) * canvas.stride[p] + (rect.x >> shift);
+      dst.stride[p] = canvas.stride[p];
+    }
+    placement.scaler->scaleRows(placement.frame->planes, dst, first - rect.y, last - rect.y,
+                                rowBuffer.data());
+  }
+}
+
+void VideoCompositor::runTiles(std::vector<uint8_t>& rowBuffer) {
+  std::unique_lock<std::mutex> lock(work_mutex_);
+  while (next_tile_ < tile_count_) {
+    int tile = next_tile_++;
+    lock.unlock();
+    drawTile(tile, canvas_planes_, rowBuffer);
+    lock.lock();
+    if (++tiles_done_ == tile_count_) {
+      done_cond_.notify_all();
+    }
+  }
+}
+
+void VideoCompositor::workerLoop() {
+  std::vector<uint8_t> rowBuffer;
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(work_mutex_);
+      work_cond_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+      if (stopping_) {
+        return;
+      }
+      seen = generation_;
+    }
+    runTiles(rowBuffer);
+  }
+}
+
+std::shared_ptr<I420BufferPool::Buffer> VideoCompositor::compose() {
+  if (!canvas_pool_) {
+    return nullptr;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::shared_ptr<I420BufferPool::Buffer> canvas = canvas_pool_->acquire();
+  if (!canvas) {
+    return nullptr;
+  }
+
+  placeSources(placements_);
+  canvas_planes_ = canvas->planes;
+  {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    ++generation_;
+    next_tile_ = 0;
+    tiles_done_ = 0;
+  }
+  work_cond_.notify_all();
+
+  runTiles(row_buffer_);
+  {
+    std::unique_lock<std::mutex> lock(work_mutex_);
+    done_cond_.wait(lock, [this] { return tiles_done_ == tile_count_; });
+  }
+  // source frames go back to their pools
+  placements_.clear();
+
+  last_compose_ms_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count() /
+                     1000.0;
+  total_compose_ms_ += last_compose_ms_;
+  ++composed_frames_;
+  return canvas;
+}
+
+VideoCompositorStats VideoCompositor::getStats() {
+  VideoCompositorStats stats;
+  {
+    std::lock_guard<std::mutex> lock(source_mutex_);
+    stats.sources = static_cast<int>(sources_.size());
+    stats.skippedSourceFrames = skipped_source_frames_;
+    stats.droppedSourceFrames = dropped_source_frames_;
+  }
+  stats.workerCount = static_cast<int>(workers_.size()) + 1;
+  stats.tiles = tile_count_;
+  stats.composedFrames = composed_frames_;
+  stats.lastComposeMs = last_compose_ms_;
+  stats.averageComposeMs = composed_frames_ ? total_compose_ms_ / composed_frames_ : 0;
+  return stats;
+}
@@ -0,0 +1,151 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Application side video compositing on a pool of worker threads.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pixel_converter.h"
+#include "video_scaler.h"
+
+struct VideoCompositorConfig {
+  int width = 1920;
+  int height = 1080;
+  // 0 means one per online CPU. The thread calling compose() is one of them.
+  int workerCount = 0;
+  // Canvas rows per tile, rounded up to even. Tiles are the unit of work.
+  int tileRows = 64;
+  // Canvas buffers that can be in use at once, e.g. queued for sending
+  int poolSize = 3;
+  // Keep the aspect ratio of every source inside its cell
+  bool keepAspectRatio = true;
+  // A source without a new frame for this long is left out of the canvas,
+  // so a user who stopped sending does not stay frozen. 0 keeps it forever.
+  int sourceTimeoutMs = 2000;
+};
+
+struct VideoCompositorStats {
+  int sources = 0;
+  int workerCount = 0;
+  int tiles = 0;
+  uint64_t composedFrames = 0;
+  // Source frames replaced by a newer one before any compose() used them
+  uint64_t skippedSourceFrames = 0;
+  uint64_t droppedSourceFrames = 0;
+  double lastComposeMs = 0;
+  double averageComposeMs = 0;
+};
+
+struct CompositorRect {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+/**
+ Composites the latest frame of every source onto one I420 canvas.
+
+ Sources push frames whenever they arrive, at any rate; only the newest one
+ is kept, and compose() uses whatever each source has at that moment. The
+ canvas is split into bands of tileRows rows that the workers take one at a
+ time: a worker fills the background of its band and scales into it the rows
+ of every source that crosses it, so each band is finished while it is still
+ in that core's cache and no two workers write the same memory.
+
+ Without explicit layouts the sources are laid out as an even grid in order
+ of their ids, e.g. 5x5 cells of 768x432 for 25 sources on a 4K canvas.
+ */
+class VideoCompositor {
+ public:
+  explicit VideoCompositor(const VideoCompositorConfig& config);
+  ~VideoCompositor();
+
+  bool initialize();
+
+  // Thread safe. A source takes part in the layout from addSource() until
+  // removeSource(); frames and layouts for other ids are ignored, so a late
+  // frame can not bring back a source that was just removed.
+  void addSource(const std::string& id);
+  // The visible part of the frame is copied. Returns false if the frame could
+  // not be stored or the source is not added.
+  bool updateSource(const std::string& id, const PixelPlanes& planes, int width, int height);
+  void removeSource(const std::string& id);
+
+  // Puts a source at a fixed place on the canvas instead of in the grid.
+  // Later calls draw over earlier ones where they overlap.
+  void setLayout(const std::string& id, const CompositorRect& rect);
+  void clearLayout(const std::string& id);
+
+  // Draws the canvas. Returns nullptr if every canvas buffer is in use.
+  std::shared_ptr<I420BufferPool::Buffer> compose();
+
+  // From the thread calling compose()
+  VideoCompositorStats getStats();
+
+ private:
+  struct Source {
+    std::shared_ptr<I420BufferPool> pool;
+    std::shared_ptr<I420BufferPool::Buffer> latest;
+    std::chrono::steady_clock::time_point updateTime;
+    bool used = false;
+    bool hasLayout = false;
+    int layoutOrder = 0;
+    CompositorRect layout = {0, 0, 0, 0};
+    // scaler of the last placement, reused while sizes stay the same
+    std::shared_ptr<I420RowScaler> scaler;
+    CompositorRect placed = {0, 0, 0, 0};
+  };
+
+  // What one compose() draws, fixed before the workers start
+  struct Placement {
+    std::shared_ptr<I420BufferPool::Buffer> frame;
+    std::shared_ptr<I420RowScaler> scaler;
+    CompositorRect rect;
+  };
+
+  void placeSources(std::vector<Placement>& placements);
+  void drawTile(int tile, const PixelPlanes& canvas, std::vector<uint8_t>& rowBuffer);
+  void runTiles(std::vector<uint8_t>& rowBuffer);
+  void workerLoop();
+
+  VideoCompositorConfig config_;
+  int tile_rows_;
+  int tile_count_;
+  std::shared_ptr<I420BufferPool> canvas_pool_;
+
+  std::mutex source_mutex_;
+  std::map<std::string, Source> sources_;
+  int layout_order_;
+  uint64_t skipped_source_frames_;
+  uint64_t dropped_source_frames_;
+
+  // state of the compose() in progress, read by the workers
+  std::vector<Placement> placements_;
+  PixelPlanes canvas_planes_;
+  std::vector<uint8_t> row_buffer_;
+
+  std::mutex work_mutex_;
+  std::condition_variable work_cond_;
+  std::condition_variable done_cond_;
+  uint64_t generation_;
+  int next_tile_;
+  int tiles_done_;
+  bool stopping_;
+  std::vector<std::thread> workers_;
+
+  uint64_t composed_frames_;
+  double last_compose_ms_;
+  double total_compose_ms_;
+};
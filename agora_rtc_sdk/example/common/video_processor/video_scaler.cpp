@@ -0,0 +1,497 @@
+#include "video_scaler.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VIDEO_SCALER_X86 1
+#endif
+
+// Source rows of the luma plane consumed per band, chroma uses half
+#define SCALE_BAND_ROWS (16)
+#define SCALE_MIN_SIZE (4)
+
+struct ScaleRowKernels {
+  // 2x2 box, srcWidth source pixels into (srcWidth + 1) / 2
+  void (*boxRow)(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int srcWidth);
+  // (src0 * (256 - f) + src1 * f + 128) >> 8, f in 1..255
+  void (*interpolateRow)(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int width,
+                         int fraction);
+  // Horizontal bilinear from per pixel tables, weights hold (256 - f) | f << 16.
+  // The first gatherCount pixels may read 4 bytes at their index.
+  void (*filterCols)(const uint8_t* src, uint8_t* dst, int width, const int32_t* index,
+                     const int32_t* weights, int gatherCount);
+};
+
+//
+// Scalar rows, also used for the tails the SIMD rows leave
+//
+
+static void boxRow_C(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int srcWidth) {
+  int x = 0;
+  for (; x + 1 < srcWidth; x += 2) {
+    dst[x / 2] = (src0[x] + src0[x + 1] + src1[x] + src1[x + 1] + 2) >> 2;
+  }
+  // the last column of an odd width is paired with itself
+  if (x < srcWidth) {
+    dst[x / 2] = (src0[x] + src1[x] + 1) >> 1;
+  }
+}
+
+static void interpolateRow_C(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int width,
+                             int fraction) {
+  for (int x = 0; x < width; ++x) {
+    dst[x] = (src0[x] * (256 - fraction) + src1[x] * fraction + 128) >> 8;
+  }
+}
+
+static void filterCols_C(const uint8_t* src, uint8_t* dst, int width, const int32_t* index,
+                         const int32_t* weights, int gatherCount) {
+  for (int x = 0; x < width; ++x) {
+    const uint8_t* p = src + index[x];
+    dst[x] = (p[0] * (weights[x] & 0xffff) + p[1] * (weights[x] >> 16) + 128) >> 8;
+  }
+}
+
+#ifdef VIDEO_SCALER_X86
+
+//
+// SSSE3 rows
+//
+
+__attribute__((target("ssse3"))) static void boxRow_SSSE3(const uint8_t* src0,
+                                                           const uint8_t* src1, uint8_t* dst,
+                                                           int srcWidth) {
+  const __m128i ones = _mm_set1_epi8(1);
+  const __m128i two = _mm_set1_epi16(2);
+  int x = 0;
+  for (; x + 32 <= srcWidth; x += 32) {
+    __m128i s0 =
+        _mm_add_epi16(_mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(src0 + x)), ones),
+                      _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(src1 + x)), ones));
+    __m128i s1 =
+        _mm_add_epi16(_mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(src0 + x + 16)), ones),
+                      _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(src1 + x + 16)), ones));
+    s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+    s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+    _mm_storeu_si128((__m128i*)(dst + x / 2), _mm_packus_epi16(s0, s1));
+  }
+  boxRow_C(src0 + x, src1 + x, dst + x / 2, srcWidth - x);
+}
+
+__attribute__((target("ssse3"))) static void interpolateRow_SSSE3(const uint8_t* src0,
+                                                                   const uint8_t* src1,
+                                                                   uint8_t* dst, int width,
+                                                                   int fraction) {
+  const __m128i w0 = _mm_set1_epi16(256 - fraction);
+  const __m128i w1 = _mm_set1_epi16(fraction);
+  const __m128i round = _mm_set1_epi16(128);
+  const __m128i zero = _mm_setzero_si128();
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(src0 + x));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src1 + x));
+    // the sum stays below 65536, so wrapping 16 bit multiplies are exact
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1));
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+  }
+  interpolateRow_C(src0 + x, src1 + x, dst + x, width - x, fraction);
+}
+
+__attribute__((target("ssse3"))) static void filterCols_SSSE3(const uint8_t* src, uint8_t* dst,
+                                                               int width, const int32_t* index,
+                                                               const int32_t* weights,
+                                                               int gatherCount) {
+  // byte pair (p0, p1) of every dword into 16 bit lanes for madd
+  const __m128i spread = _mm_setr_epi8(0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1);
+  const __m128i round = _mm_set1_epi32(128);
+  int x = 0;
+  // only the pair itself is loaded, so every pixel can take this path
+  for (; x + 8 <= width; x += 8) {
+    uint16_t p[8];
+    for (int i = 0; i < 8; ++i) {
+      memcpy(&p[i], src + index[x + i], 2);
+    }
+    __m128i lo = _mm_shuffle_epi8(_mm_setr_epi32(p[0], p[1], p[2], p[3]), spread);
+    __m128i hi = _mm_shuffle_epi8(_mm_setr_epi32(p[4], p[5], p[6], p[7]), spread);
+    lo = _mm_madd_epi16(lo, _mm_loadu_si128((const __m128i*)(weights + x)));
+    hi = _mm_madd_epi16(hi, _mm_loadu_si128((const __m128i*)(weights + x + 4)));
+    lo = _mm_srli_epi32(_mm_add_epi32(lo, round), 8);
+    hi = _mm_srli_epi32(_mm_add_epi32(hi, round), 8);
+    __m128i packed = _mm_packs_epi32(lo, hi);
+    _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(packed, packed));
+  }
+  filterCols_C(src, dst + x, width - x, index + x, weights + x, 0);
+}
+
+//
+// AVX2 rows. 256 bit packs work per 128 bit lane, the permutes restore pixel order.
+//
+
+__attribute__((target("avx2"))) static void boxRow_AVX2(const uint8_t* src0, const uint8_t* src1,
+                                                         uint8_t* dst, int srcWidth) {
+  const __m256i ones = _mm256_set1_epi8(1);
+  const __m256i two = _mm256_set1_epi16(2);
+  int x = 0;
+  for (; x + 64 <= srcWidth; x += 64) {
+    __m256i s0 = _mm256_add_epi16(
+        _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(src0 + x)), ones),
+        _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(src1 + x)), ones));
+    __m256i s1 = _mm256_add_epi16(
+        _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(src0 + x + 32)), ones),
+        _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(src1 + x + 32)), ones));
+    s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, two), 2);
+    s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, two), 2);
+    _mm256_storeu_si256((__m256i*)(dst + x / 2),
+                        _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), 0xd8));
+  }
+  boxRow_SSSE3(src0 + x, src1 + x, dst + x / 2, srcWidth - x);
+}
+
+__attribute__((target("avx2"))) static void interpolateRow_AVX2(const uint8_t* src0,
+                                                                 const uint8_t* src1,
+                                                                 uint8_t* dst, int width,
+                                                                 int fraction) {
+  const __m256i w0 = _mm256_set1_epi16(256 - fraction);
+  const __m256i w1 = _mm256_set1_epi16(fraction);
+  const __m256i round = _mm256_set1_epi16(128);
+  const __m256i zero = _mm256_setzero_si256();
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(src0 + x));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src1 + x));
+    // unpack and pack both stay within a lane, so pixel order is kept
+    __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), w0),
+                                  _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), w1));
+    __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), w0),
+                                  _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), w1));
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), 8);
+    _mm256_storeu_si256((__m256i*)(dst + x), _mm256_packus_epi16(lo, hi));
+  }
+  interpolateRow_SSSE3(src0 + x, src1 + x, dst + x, width - x, fraction);
+}
+
+__attribute__((target("avx2"))) static void filterCols_AVX2(const uint8_t* src, uint8_t* dst,
+                                                             int width, const int32_t* index,
+                                                             const int32_t* weights,
+                                                             int gatherCount) {
+  const __m256i lowByte = _mm256_set1_epi32(0xff);
+  const __m256i secondByte = _mm256_set1_epi32(0xff00);
+  const __m256i round = _mm256_set1_epi32(128);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int x = 0;
+  for (; x + 16 <= gatherCount; x += 16) {
+    __m256i g0 = _mm256_i32gather_epi32((const int*)src,
+                                        _mm256_loadu_si256((const __m256i*)(index + x)), 1);
+    __m256i g1 = _mm256_i32gather_epi32((const int*)src,
+                                        _mm256_loadu_si256((const __m256i*)(index + x + 8)), 1);
+    // p0 in the low and p1 in the high 16 bits of every dword
+    g0 = _mm256_or_si256(_mm256_and_si256(g0, lowByte),
+                         _mm256_slli_epi32(_mm256_and_si256(g0, secondByte), 8));
+    g1 = _mm256_or_si256(_mm256_and_si256(g1, lowByte),
+                         _mm256_slli_epi32(_mm256_and_si256(g1, secondByte), 8));
+    g0 = _mm256_madd_epi16(g0, _mm256_loadu_si256((const __m256i*)(weights + x)));
+    g1 = _mm256_madd_epi16(g1, _mm256_loadu_si256((const __m256i*)(weights + x + 8)));
+    g0 = _mm256_srli_epi32(_mm256_add_epi32(g0, round), 8);
+    g1 = _mm256_srli_epi32(_mm256_add_epi32(g1, round), 8);
+    __m256i packed = _mm256_packs_epi32(g0, g1);
+    packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(packed, packed), order);
+    _mm_storeu_si128((__m128i*)(dst + x), _mm256_castsi256_si128(packed));
+  }
+  filterCols_SSSE3(src, dst + x, width - x, index + x, weights + x, gatherCount - x);
+}
+
+#endif  // VIDEO_SCALER_X86
+
+static const ScaleRowKernels kScaleKernelsC = {boxRow_C, interpolateRow_C, filterCols_C};
+
+#ifdef VIDEO_SCALER_X86
+static const ScaleRowKernels kScaleKernelsSSSE3 = {boxRow_SSSE3, interpolateRow_SSSE3,
+                                                   filterCols_SSSE3};
+static const ScaleRowKernels kScaleKernelsAVX2 = {boxRow_AVX2, interpolateRow_AVX2,
+                                                  filterCols_AVX2};
+#endif
+
+// Follows the level set for the pixel converter
+static const ScaleRowKernels& scaleKernels() {
+  switch (getPixelSimdLevel()) {
+#ifdef VIDEO_SCALER_X86
+    case PIXEL_SIMD_AVX2:
+      return kScaleKernelsAVX2;
+    case PIXEL_SIMD_SSSE3:
+      return kScaleKernelsSSSE3;
+#endif
+    default:
+      return kScaleKernelsC;
+  }
+}
+
+// Scales one plane a row at a time, with the sampling positions of every
+// output row and column worked out up front
+class PlaneScaler {
+ public:
+  PlaneScaler(int srcWidth, int srcHeight, int dstWidth, int dstHeight, ScaleFilter filter);
+
+  int dstHeight() const { return dst_height_; }
+
+  // Source rows that must be ready before output row dstRow can be made
+  int rowsNeeded(int dstRow) const {
+    if (box_) return dstRow * 2 + 2 < src_height_ ? dstRow * 2 + 2 : src_height_;
+    return row_index_[dstRow] + (row_fraction_[dstRow] ? 2 : 1);
+  }
+
+  void scaleRow(const ScaleRowKernels& k, const uint8_t* src, int srcStride, uint8_t* dst,
+                int dstRow) {
+    scaleRow(k, src, srcStride, dst, dstRow, row_buffer_.data());
+  }
+  // rowBuffer holds srcWidth bytes, so threads can share the tables
+  void scaleRow(const ScaleRowKernels& k, const uint8_t* src, int srcStride, uint8_t* dst,
+                int dstRow, uint8_t* rowBuffer) const;
+
+ private:
+  int src_width_;
+  int src_height_;
+  int dst_width_;
+  int dst_height_;
+  bool box_;
+  std::vector<int> row_index_;
+  std::vector<int> row_fraction_;
+  std::vector<int32_t> col_index_;
+  std::vector<int32_t> col_weights_;
+  int gather_count_;
+  std::vector<uint8_t> row_buffer_;
+};
+
+// Center aligned source position of every output pixel, as an index and an
+// 8 bit fraction towards the next pixel. The index stays at most size - 2 so
+// the pair can always be read.
+static void samplePositions(int srcSize, int dstSize, std::vector<int>& index,
+                            std::vector<int>& fraction) {
+  index.resize(dstSize);
+  fraction.resize(dstSize);
+  double scale = static_cast<double>(srcSize) / dstSize;
+  for (int i = 0; i < dstSize; ++i) {
+    double pos = (i + 0.5) * scale - 0.5;
+    if (pos < 0) pos = 0;
+    int whole = static_cast<int>(pos);
+    int f = static_cast<int>(lround((pos - whole) * 256));
+    if (whole >= srcSize - 1) {
+      whole = srcSize - 2;
+      f = 256;
+    }
+    index[i] = whole;
+    fraction[i] = f;
+  }
+}
+
+PlaneScaler::PlaneScaler(int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+                         ScaleFilter filter)
+    : src_width_(srcWidth),
+      src_height_(srcHeight),
+      dst_width_(dstWidth),
+      dst_height_(dstHeight),
+      box_(filter == SCALE_FILTER_BOX && dstWidth == (srcWidth + 1) / 2 &&
+           dstHeight == (srcHeight + 1) / 2),
+      gather_count_(0) {
+  if (box_) {
+    return;
+  }
+
+  samplePositions(srcHeight, dstHeight, row_index_, row_fraction_);
+  for (int i = 0; i < dstHeight; ++i) {
+    // a whole step needs only the next row
+    if (row_fraction_[i] == 256) {
+      ++row_index_[i];
+      row_fraction_[i] = 0;
+    }
+  }
+
+  std::vector<int> index, fraction;
+  samplePositions(srcWidth, dstWidth, index, fraction);
+  col_index_.resize(dstWidth);
+  col_weights_.resize(dstWidth);
+  for (int i = 0; i < dstWidth; ++i) {
+    col_index_[i] = index[i];
+    col_weights_[i] = (256 - fraction[i]) | (fraction[i] << 16);
+    if (index[i] + 4 <= srcWidth) {
+      gather_count_ = i + 1;
+    }
+  }
+  row_buffer_.resize(srcWidth);
+}
+
+void PlaneScaler::scaleRow(const ScaleRowKernels& k, const uint8_t* src, int srcStride,
+                           uint8_t* dst, int dstRow, uint8_t* rowBuffer) const {
+  if (box_) {
+    int row = dstRow * 2;
+    // the last row of an odd height is paired with itself
+    int next = (row + 1 < src_height_) ? row + 1 : row;
+    k.boxRow(src + row * srcStride, src + next * srcStride, dst, src_width_);
+    return;
+  }
+
+  const uint8_t* row = src + row_index_[dstRow] * srcStride;
+  if (row_fraction_[dstRow]) {
+    k.interpolateRow(row, row + srcStride, rowBuffer, src_width_, row_fraction_[dstRow]);
+    row = rowBuffer;
+  }
+  if (dst_width_ == src_width_) {
+    memcpy(dst, row, dst_width_);
+  } else {
+    k.filterCols(row, dst, dst_width_, col_index_.data(), col_weights_.data(), gather_count_);
+  }
+}
+
+static bool validScale(int width, int height, int dstWidth, int dstHeight) {
+  return dstWidth >= SCALE_MIN_SIZE && dstHeight >= SCALE_MIN_SIZE && dstWidth <= width &&
+         dstHeight <= height;
+}
+
+int scaleI420(const PixelPlanes& src, int width, int height, const PixelPlanes& dst,
+              int dstWidth, int dstHeight, ScaleFilter filter) {
+  if (!src.data[0] || !src.data[1] || !src.data[2] || !dst.data[0] || !dst.data[1] ||
+      !dst.data[2] || !validScale(width, height, dstWidth, dstHeight)) {
+    return -1;
+  }
+
+  const ScaleRowKernels& k = scaleKernels();
+  for (int p = 0; p < 3; ++p) {
+    int shift = p ? 1 : 0;
+    PlaneScaler scaler((width + shift) >> shift, (height + shift) >> shift,
+                       (dstWidth + shift) >> shift, (dstHeight + shift) >> shift, filter);
+    for (int row = 0; row < scaler.dstHeight(); ++row) {
+      scaler.scaleRow(k, src.data[p], src.stride[p], dst.data[p] + row * dst.stride[p], row);
+    }
+  }
+  return 0;
+}
+
+I420RowScaler::I420RowScaler(int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+                             ScaleFilter filter)
+    : src_width_(srcWidth), src_height_(srcHeight), dst_width_(dstWidth), dst_height_(dstHeight) {
+  if (srcWidth < SCALE_MIN_SIZE || srcHeight < SCALE_MIN_SIZE || dstWidth < SCALE_MIN_SIZE ||
+      dstHeight < SCALE_MIN_SIZE) {
+    return;
+  }
+  for (int p = 0; p < 3; ++p) {
+    int shift = p ? 1 : 0;
+    planes_[p].reset(new PlaneScaler((srcWidth + shift) >> shift, (srcHeight + shift) >> shift,
+                                     (dstWidth + shift) >> shift, (dstHeight + shift) >> shift,
+                                     filter));
+  }
+}
+
+I420RowScaler::~I420RowScaler() = default;
+
+void I420RowScaler::scaleRows(const PixelPlanes& src, const PixelPlanes& dst, int rowBegin,
+                              int rowEnd, uint8_t* rowBuffer) const {
+  if (!valid() || rowBegin < 0 || rowEnd > dst_height_ || (rowBegin & 1)) {
+    return;
+  }
+  const ScaleRowKernels& k = scaleKernels();
+  for (int row = rowBegin; row < rowEnd; ++row) {
+    planes_[0]->scaleRow(k, src.data[0], src.stride[0], dst.data[0] + row * dst.stride[0], row,
+                         rowBuffer);
+  }
+  for (int p = 1; p < 3; ++p) {
+    for (int row = rowBegin / 2; row < (rowEnd + 1) / 2; ++row) {
+      planes_[p]->scaleRow(k, src.data[p], src.stride[p], dst.data[p] + row * dst.stride[p], row,
+                           rowBuffer);
+    }
+  }
+}
+
+SimulcastPyramid::SimulcastPyramid(int width, int height,
+                                   const std::vector<SimulcastLayer>& layers, ScaleFilter filter,
+                                   int poolSize)
+    : width_(width), height_(height), layers_(layers), filter_(filter), pool_size_(poolSize) {}
+
+SimulcastPyramid::~SimulcastPyramid() = default;
+
+bool SimulcastPyramid::initialize() {
+  stages_.clear();
+  stages_.resize(layers_.size());
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    const SimulcastLayer& layer = layers_[i];
+    if (!validScale(width_, height_, layer.width, layer.height)) {
+      return false;
+    }
+
+    Stage& stage = stages_[i];
+    stage.parent = -1;
+    int parentWidth = width_, parentHeight = height_;
+    if (i > 0 && layers_[i - 1].width >= layer.width && layers_[i - 1].height >= layer.height) {
+      stage.parent = static_cast<int>(i) - 1;
+      parentWidth = layers_[i - 1].width;
+      parentHeight = layers_[i - 1].height;
+    }
+
+    stage.pool = I420BufferPool::create(layer.width, layer.height, pool_size_);
+    if (!stage.pool) {
+      return false;
+    }
+    for (int p = 0; p < 3; ++p) {
+      int shift = p ? 1 : 0;
+      stage.planes[p].reset(new PlaneScaler(
+          (parentWidth + shift) >> shift, (parentHeight + shift) >> shift,
+          (layer.width + shift) >> shift, (layer.height + shift) >> shift, filter_));
+    }
+  }
+  return true;
+}
+
+std::vector<std::shared_ptr<I420BufferPool::Buffer>> SimulcastPyramid::process(
+    const PixelPlanes& src) {
+  std::vector<std::shared_ptr<I420BufferPool::Buffer>> out;
+  for (auto& stage : stages_) {
+    auto buffer = stage.pool->acquire();
+    if (!buffer) {
+      return {};
+    }
+    out.push_back(std::move(buffer));
+  }
+
+  const ScaleRowKernels& k = scaleKernels();
+  std::vector<int> produced(stages_.size());
+  for (int p = 0; p < 3; ++p) {
+    int shift = p ? 1 : 0;
+    int srcHeight = (height_ + shift) >> shift;
+    int band = SCALE_BAND_ROWS >> shift;
+    std::fill(produced.begin(), produced.end(), 0);
+
+    for (int srcRows = band;; srcRows += band) {
+      if (srcRows > srcHeight) srcRows = srcHeight;
+      // parents come first, so a band flows through every layer before the next one
+      for (size_t i = 0; i < stages_.size(); ++i) {
+        Stage& stage = stages_[i];
+        const uint8_t* parent = src.data[p];
+        int parentStride = src.stride[p];
+        int parentRows = srcRows;
+        if (stage.parent >= 0) {
+          parent = out[stage.parent]->planes.data[p];
+          parentStride = out[stage.parent]->planes.stride[p];
+          parentRows = produced[stage.parent];
+        }
+
+        PlaneScaler& scaler = *stage.planes[p];
+        const PixelPlanes& dst = out[i]->planes;
+        int& row = produced[i];
+        while (row < scaler.dstHeight() && scaler.rowsNeeded(row) <= parentRows) {
+          scaler.scaleRow(k, parent, parentStride, dst.data[p] + row * dst.stride[p], row);
+          ++row;
+        }
+      }
+      if (srcRows == srcHeight) break;
+    }
+  }
+  return out;
+}
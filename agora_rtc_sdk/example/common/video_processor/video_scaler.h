@@ -0,0 +1,99 @@
+//  Agora RTC/MEDIA SDK
+//
+//  I420 scaling and simulcast layer generation.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "pixel_converter.h"
+
+enum ScaleFilter {
+  // Exact 2:1 steps are box filtered, any other ratio falls back to bilinear
+  SCALE_FILTER_BOX = 0,
+  SCALE_FILTER_BILINEAR,
+};
+
+struct SimulcastLayer {
+  int width;
+  int height;
+};
+
+class PlaneScaler;
+
+// Scales the whole of src into dst. Sizes must be at least 4x4 and dst no
+// larger than src. Returns 0 on success, -1 on bad arguments. Sets up tables
+// on every call; use SimulcastPyramid for a stream of frames.
+int scaleI420(const PixelPlanes& src, int width, int height, const PixelPlanes& dst,
+              int dstWidth, int dstHeight, ScaleFilter filter = SCALE_FILTER_BOX);
+
+// Scales between one fixed pair of sizes, up or down, one range of output
+// rows at a time. The tables are only read while scaling, so several threads
+// can share a scaler and fill disjoint row ranges of the same frame, e.g. the
+// tiles of a composite.
+class I420RowScaler {
+ public:
+  I420RowScaler(int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+                ScaleFilter filter = SCALE_FILTER_BILINEAR);
+  ~I420RowScaler();
+
+  // False if any size is below 4x4
+  bool valid() const { return planes_[0] != nullptr; }
+  int srcWidth() const { return src_width_; }
+  int srcHeight() const { return src_height_; }
+  int dstWidth() const { return dst_width_; }
+  int dstHeight() const { return dst_height_; }
+
+  // Makes output luma rows [rowBegin, rowEnd) and the chroma rows under them.
+  // dst points at output row 0 and rowBegin must be even. rowBuffer is
+  // scratch space of srcWidth bytes owned by the calling thread.
+  void scaleRows(const PixelPlanes& src, const PixelPlanes& dst, int rowBegin, int rowEnd,
+                 uint8_t* rowBuffer) const;
+
+ private:
+  int src_width_;
+  int src_height_;
+  int dst_width_;
+  int dst_height_;
+  std::unique_ptr<PlaneScaler> planes_[3];
+};
+
+// Builds every simulcast layer of an I420 frame in one pass over it. Layers
+// are listed from the largest to the smallest; each one is scaled from the
+// previous layer when that is at least as large, so 2:1 steps cascade. Rows
+// are produced in bands, so a layer reads its parent's rows while they are
+// still in cache instead of going back to memory once per layer. Bilinear
+// steps larger than 2:1 skip source pixels, so keep neighbouring layers
+// within 2:1 of each other.
+class SimulcastPyramid {
+ public:
+  SimulcastPyramid(int width, int height, const std::vector<SimulcastLayer>& layers,
+                   ScaleFilter filter = SCALE_FILTER_BOX, int poolSize = 3);
+  ~SimulcastPyramid();
+
+  bool initialize();
+
+  // One buffer per layer, in the order the layers were given. Empty if the
+  // pool of any layer has no free buffer.
+  std::vector<std::shared_ptr<I420BufferPool::Buffer>> process(const PixelPlanes& src);
+
+  const std::vector<SimulcastLayer>& layers() const { return layers_; }
+
+ private:
+  struct Stage {
+    int parent;  // -1 for the source frame
+    std::shared_ptr<I420BufferPool> pool;
+    std::unique_ptr<PlaneScaler> planes[3];
+  };
+
+  int width_;
+  int height_;
+  std::vector<SimulcastLayer> layers_;
+  ScaleFilter filter_;
+  int pool_size_;
+  std::vector<Stage> stages_;
+};
@@ -0,0 +1,283 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Round trip time and CPU per message of control messages, sent as media
+//  control packets and as data stream messages. Run one instance with
+//  --role pong and one with --role ping in the same channel.
+//
+
+#include <sys/resource.h>
+
+#include <csignal>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "IAgoraService.h"
+#include "NGIAgoraRtcConnection.h"
+#include "common/control_channel.h"
+#include "common/helper.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/sample_common.h"
+#include "common/sample_connection_observer.h"
+#include "common/sample_local_user_observer.h"
+
+#include "NGIAgoraLocalUser.h"
+
+#define DEFAULT_CONNECT_TIMEOUT_MS (3000)
+#define DEFAULT_MESSAGE_COUNT (1000)
+#define DEFAULT_INTERVAL_MS (20)
+#define DEFAULT_PAYLOAD_BYTES (16)
+#define DEFAULT_REQUEST_TIMEOUT_MS (1000)
+#define ROLE_PING "ping"
+#define ROLE_PONG "pong"
+#define TRANSPORT_CONTROL "ctrl"
+#define TRANSPORT_STREAM "stream"
+#define TRANSPORT_BOTH "both"
+
+struct SampleOptions {
+  std::string appId;
+  std::string channelId;
+  std::string userId;
+  std::string peerUserId;
+  std::string role = ROLE_PING;
+  std::string transport = TRANSPORT_BOTH;
+  int count = DEFAULT_MESSAGE_COUNT;
+  int intervalMs = DEFAULT_INTERVAL_MS;
+  int payloadBytes = DEFAULT_PAYLOAD_BYTES;
+};
+
+static int64_t cpuTimeUs() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec +
+         usage.ru_stime.tv_usec;
+}
+
+static void logCpu(const char* name, int64_t cpuUs, uint64_t messages) {
+  if (messages) {
+    AG_LOG(INFO, "%s: %.1f us CPU per message sent or received", name,
+           static_cast<double>(cpuUs) / messages);
+  }
+}
+
+// Returns the messages sent and received
+static uint64_t logStats(const char* name, ControlChannel& channel) {
+  ControlChannelStats stats = channel.getStats();
+  AG_LOG(INFO,
+         "%s: sent %llu, received %llu, answered %llu, timed out %llu, send failures %llu, "
+         "malformed %llu",
+         name, (unsigned long long)stats.sent, (unsigned long long)stats.received,
+         (unsigned long long)stats.responses, (unsigned long long)stats.timeouts,
+         (unsigned long long)stats.sendFailures, (unsigned long long)stats.malformed);
+  if (stats.responses) {
+    AG_LOG(INFO, "%s: RTT us min %ld, avg %ld, p50 %ld, p99 %ld, max %ld", name,
+           static_cast<long>(stats.rttMinUs), static_cast<long>(stats.rttAvgUs),
+           static_cast<long>(stats.rttP50Us), static_cast<long>(stats.rttP99Us),
+           static_cast<long>(stats.rttMaxUs));
+  }
+  return stats.sent + stats.received;
+}
+
+// Sends count pings, one per interval, then waits for the stragglers
+static void SamplePingTask(const SampleOptions& options, ControlChannel& channel,
+                           const char* name, bool& exitFlag) {
+  ControlPing ping;
+  ping.padding.assign(options.payloadBytes, 0x5a);
+  int64_t cpuStart = cpuTimeUs();
+
+  PacerInfo pacer = {0, options.intervalMs, 0, std::chrono::steady_clock::now()};
+  for (int i = 0; i < options.count && !exitFlag; ++i) {
+    channel.request(options.peerUserId, ping, nullptr);
+    waitBeforeNextSend(pacer);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(DEFAULT_REQUEST_TIMEOUT_MS));
+  channel.expireRequests();
+  int64_t cpuUs = cpuTimeUs() - cpuStart;
+  logCpu(name, cpuUs, logStats(name, channel));
+}
+
+static bool exitFlag = false;
+static void SignalHandler(int sigNo) { exitFlag = true; }
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("token", &options.appId, "The token for authentication / must");
+  optParser.add_long_opt("channelId", &options.channelId, "Channel Id / must");
+  optParser.add_long_opt("userId", &options.userId, "User Id / default is 0");
+  optParser.add_long_opt("peerUserId", &options.peerUserId,
+                         "Send control packets to this user only / default is everyone");
+  optParser.add_long_opt("role", &options.role, "ping sends requests, pong answers them");
+  optParser.add_long_opt("transport", &options.transport,
+                         "ctrl for media control packets, stream for data streams, both to "
+                         "measure one after the other / default is both");
+  optParser.add_long_opt("count", &options.count, "Requests per transport / default is 1000");
+  optParser.add_long_opt("intervalMs", &options.intervalMs,
+                         "Time between requests / default is 20");
+  optParser.add_long_opt("payloadBytes", &options.payloadBytes,
+                         "Payload after the 8 byte header / default is 16");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  if (options.appId.empty()) {
+    AG_LOG(ERROR, "Must provide appId!");
+    return -1;
+  }
+
+  if (options.channelId.empty()) {
+    AG_LOG(ERROR, "Must provide channelId!");
+    return -1;
+  }
+
+  if (options.role != ROLE_PING && options.role != ROLE_PONG) {
+    AG_LOG(ERROR, "Role must be ping or pong!");
+    return -1;
+  }
+  bool useControl =
+      options.transport == TRANSPORT_CONTROL || options.transport == TRANSPORT_BOTH;
+  bool useStream = options.transport == TRANSPORT_STREAM || options.transport == TRANSPORT_BOTH;
+  if (!useControl && !useStream) {
+    AG_LOG(ERROR, "Transport must be ctrl, stream or both!");
+    return -1;
+  }
+
+  std::signal(SIGQUIT, SignalHandler);
+  std::signal(SIGABRT, SignalHandler);
+  std::signal(SIGINT, SignalHandler);
+
+  // Create Agora service
+  auto service = createAndInitAgoraService(false, true, true);
+  if (!service) {
+    AG_LOG(ERROR, "Failed to creating Agora service!");
+    return -1;
+  }
+
+  // Create Agora connection, data streams need a broadcaster
+  agora::rtc::RtcConnectionConfiguration ccfg;
+  ccfg.autoSubscribeAudio = false;
+  ccfg.autoSubscribeVideo = false;
+  ccfg.clientRoleType = agora::rtc::CLIENT_ROLE_BROADCASTER;
+  agora::agora_refptr<agora::rtc::IRtcConnection> connection = service->createRtcConnection(ccfg);
+  if (!connection) {
+    AG_LOG(ERROR, "Failed to creating Agora connection!");
+    return -1;
+  }
+
+  // Register connection observer to monitor connection event
+  auto connObserver = std::make_shared<SampleConnectionObserver>();
+  connection->registerObserver(connObserver.get());
+
+  // Local user observer delivers the data stream messages
+  auto localUserObserver = std::make_shared<SampleLocalUserObserver>(connection->getLocalUser());
+
+  // One channel per transport, both answer pings the same way
+  std::unique_ptr<MediaControlPacketTransport> controlTransport;
+  std::unique_ptr<DataStreamTransport> streamTransport;
+  std::unique_ptr<ControlChannel> controlChannel;
+  std::unique_ptr<ControlChannel> streamChannel;
+  if (useControl) {
+    controlTransport.reset(new MediaControlPacketTransport(connection->getLocalUser()));
+    controlChannel.reset(new ControlChannel(controlTransport.get(), DEFAULT_REQUEST_TIMEOUT_MS));
+  }
+  if (useStream) {
+    streamTransport.reset(new DataStreamTransport(connection.get(), localUserObserver.get()));
+    streamChannel.reset(new ControlChannel(streamTransport.get(), DEFAULT_REQUEST_TIMEOUT_MS));
+  }
+  for (ControlChannel* channel : {controlChannel.get(), streamChannel.get()}) {
+    if (channel) {
+      // answered on the SDK thread, nothing is in between
+      channel->setHandler(ControlPing::TYPE, [channel](const ControlPacket& packet) {
+        ControlPing ping;
+        if (packet.kind == CONTROL_PACKET_REQUEST && packet.decode(ping)) {
+          channel->respond(packet, ping);
+        }
+      });
+    }
+  }
+  if ((controlTransport && !controlTransport->start()) ||
+      (streamTransport && !streamTransport->start())) {
+    return -1;
+  }
+
+  // Connect to Agora channel
+  if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
+                          options.userId.c_str())) {
+    AG_LOG(ERROR, "Failed to connect to Agora channel!");
+    return -1;
+  }
+  if (connObserver->waitUntilConnected(DEFAULT_CONNECT_TIMEOUT_MS) != 0) {
+    AG_LOG(ERROR, "Not connected after %d ms!", DEFAULT_CONNECT_TIMEOUT_MS);
+    return -1;
+  }
+
+  int64_t cpuStart = cpuTimeUs();
+  if (options.role == ROLE_PING) {
+    // one transport after the other, so each gets its own CPU figure
+    if (controlChannel) {
+      SamplePingTask(options, *controlChannel, controlTransport->name(), exitFlag);
+    }
+    if (streamChannel && !exitFlag) {
+      SamplePingTask(options, *streamChannel, streamTransport->name(), exitFlag);
+    }
+  } else {
+    AG_LOG(INFO, "Answering pings ...");
+    while (!exitFlag) {
+      usleep(10000);
+    }
+    // the transports answer at the same time, so CPU time is only known for
+    // both together
+    int64_t cpuUs = cpuTimeUs() - cpuStart;
+    uint64_t messages = 0;
+    if (controlChannel) {
+      messages += logStats(controlTransport->name(), *controlChannel);
+    }
+    if (streamChannel) {
+      messages += logStats(streamTransport->name(), *streamChannel);
+    }
+    logCpu(controlChannel && streamChannel ? "both transports"
+           : controlChannel                ? controlTransport->name()
+                                           : streamTransport->name(),
+           cpuUs, messages);
+  }
+
+  // Stop receiving before the channels go
+  if (controlTransport) {
+    controlTransport->stop();
+  }
+  if (streamTransport) {
+    streamTransport->stop();
+  }
+
+  // Unregister connection observer
+  connection->unregisterObserver(connObserver.get());
+
+  // Disconnect from Agora channel
+  if (connection->disconnect()) {
+    AG_LOG(ERROR, "Failed to disconnect from Agora channel!");
+    return -1;
+  }
+  AG_LOG(INFO, "Disconnected from Agora channel successfully");
+
+  // Destroy Agora connection and related resources
+  controlChannel.reset();
+  streamChannel.reset();
+  controlTransport.reset();
+  streamTransport.reset();
+  connObserver.reset();
+  localUserObserver.reset();
+  connection = nullptr;
+
+  // Destroy Agora Service
+  service->release();
+  service = nullptr;
+
+  return 0;
+}
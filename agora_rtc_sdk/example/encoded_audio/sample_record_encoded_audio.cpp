@@ -0,0 +1,433 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Recording node: receive encoded Opus audio from one or more channels and
+//  decode all streams on a shared worker pool (OpusDecodeService) instead of
+//  one decoder thread per stream. Lost packets are concealed.
+//  Modified from sample_receive_encoded_audio.cpp
+//
+
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IAgoraService.h"
+#include "NGIAgoraRtcConnection.h"
+#include "common/audio_decoder/opus_decode_service.h"
+#include "common/file_parser/helper_opus_parser.h"
+#include "common/helper.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/sample_common.h"
+#include "common/sample_connection_observer.h"
+#include "common/sample_local_user_observer.h"
+
+#include "NGIAgoraLocalUser.h"
+
+#define DEFAULT_CONNECT_TIMEOUT_MS (3000)
+#define DEFAULT_FILE_LIMIT (100 * 1024 * 1024)
+#define DEFAULT_STATS_INTERVAL_MS (5000)
+#define DEFAULT_SIMULATE_DURATION_SEC (30)
+#define DEFAULT_OPUS_FRAME_DURATION_MS (20)
+
+struct SampleOptions {
+  std::string appId;
+  std::string channelId;
+  std::string userId;
+  std::string remoteUserId;
+  std::string pcmFilePrefix;
+  int numberOfChannels = 1;
+  int workers = 0;
+  int batchSize = 16;
+  bool pinWorkers = false;
+  struct {
+    int streams = 0;
+    std::string audioFile;
+    int lossRate = 0;
+    int durationSec = DEFAULT_SIMULATE_DURATION_SEC;
+  } simulate;
+};
+
+// Writes the decoded PCM of every stream to its own file. The decode service
+// serializes callbacks per stream, so each file is only touched by one thread
+// at a time.
+class PcmRecorder {
+ public:
+  PcmRecorder(const std::string& filePrefix, int maxStreams)
+      : filePrefix_(filePrefix), files_(maxStreams) {}
+
+  ~PcmRecorder() {
+    for (auto& file : files_) {
+      if (file.fp) {
+        fclose(file.fp);
+      }
+    }
+  }
+
+  void onPcm(int streamId, const int16_t* pcm, int samplesPerChannel, int numberOfChannels) {
+    if (filePrefix_.empty()) {
+      return;
+    }
+    StreamFile& file = files_[streamId];
+    if (!file.fp) {
+      std::string fileName = filePrefix_ + "_" + std::to_string(streamId) + "_" +
+                             std::to_string(++file.count) + ".pcm";
+      if (!(file.fp = fopen(fileName.c_str(), "w"))) {
+        AG_LOG(ERROR, "Failed to create pcm file %s", fileName.c_str());
+        return;
+      }
+      AG_LOG(INFO, "Created file %s to save decoded audio of stream %d", fileName.c_str(),
+             streamId);
+    }
+    size_t bytes = samplesPerChannel * numberOfChannels * sizeof(int16_t);
+    if (fwrite(pcm, 1, bytes, file.fp) != bytes) {
+      AG_LOG(ERROR, "Error writing pcm data: %s", std::strerror(errno));
+      return;
+    }
+    file.size += bytes;
+    if (file.size >= DEFAULT_FILE_LIMIT) {
+      fclose(file.fp);
+      file.fp = nullptr;
+      file.size = 0;
+    }
+  }
+
+ private:
+  struct StreamFile {
+    FILE* fp = nullptr;
+    int count = 0;
+    size_t size = 0;
+  };
+  std::string filePrefix_;
+  std::vector<StreamFile> files_;
+};
+
+// Feeds the encoded frames of one connection into one decode stream
+class EncodedAudioDecodeFeeder : public agora::rtc::IAudioEncodedFrameReceiver {
+ public:
+  EncodedAudioDecodeFeeder(OpusDecodeService* service, int streamId)
+      : service_(service), streamId_(streamId) {}
+
+  bool onEncodedAudioFrameReceived(const uint8_t* packet, size_t length,
+                                   const agora::media::base::AudioEncodedFrameInfo& info) override {
+    if (info.codec != agora::rtc::AUDIO_CODEC_OPUS) {
+      if (!warned_) {
+        AG_LOG(WARNING, "Stream %d: codec %d is not Opus, frames are ignored", streamId_,
+               (int)info.codec);
+        warned_ = true;
+      }
+      return false;
+    }
+    // never block the SDK callback thread, a full queue drops the packet
+    return service_->pushPacket(streamId_, packet, length, info.sendTs);
+  }
+
+ private:
+  OpusDecodeService* service_;
+  int streamId_;
+  bool warned_ = false;
+};
+
+static void printStats(OpusDecodeService& service) {
+  OpusDecodeServiceStats stats = service.getStats();
+  AG_LOG(INFO,
+         "streams %d, workers %d, decoded %llu, concealed %llu, dropped %llu, late %llu, "
+         "errors %llu, resets %llu",
+         stats.activeStreams, stats.workerCount, (unsigned long long)stats.decodedFrames,
+         (unsigned long long)stats.concealedFrames, (unsigned long long)stats.droppedPackets,
+         (unsigned long long)stats.latePackets, (unsigned long long)stats.decodeErrors,
+         (unsigned long long)stats.decoderResets);
+  AG_LOG(INFO,
+         "%.1f s audio in %.3f s cpu: %.1f streams/core, latency p50 %.0f us, p99 %.0f us, "
+         "max %.0f us, %zu bytes per stream",
+         stats.audioSeconds, stats.cpuSeconds, stats.streamsPerCore, stats.p50LatencyUs,
+         stats.p99LatencyUs, stats.maxLatencyUs, stats.bytesPerStream);
+}
+
+static bool exitFlag = false;
+static void SignalHandler(int sigNo) { exitFlag = true; }
+
+// Replay an Opus file into many streams in real time, as if they had been
+// received from the network, to size a recording node without a channel.
+static int simulateStreams(const SampleOptions& options, OpusDecodeService& service) {
+  HelperOpusFileParser parser(options.simulate.audioFile.c_str());
+  if (!parser.initialize()) {
+    return -1;
+  }
+  struct Packet {
+    std::unique_ptr<char[]> data;
+    int length;
+    int64_t timestampMs;
+  };
+  std::vector<Packet> packets;
+  int64_t timestampMs = 0;
+  while (auto frame = parser.getAudioFrame(DEFAULT_OPUS_FRAME_DURATION_MS)) {
+    packets.push_back({std::move(frame->buffer), frame->bufferLen, timestampMs});
+    timestampMs += frame->audioFrameInfo.samplesPerChannel * 1000 /
+                   frame->audioFrameInfo.sampleRateHz;
+  }
+  if (packets.empty() || timestampMs <= 0) {
+    AG_LOG(ERROR, "No audio packets in %s", options.simulate.audioFile.c_str());
+    return -1;
+  }
+  int64_t fileDurationMs = timestampMs;
+
+  std::vector<int> streamIds;
+  for (int i = 0; i < options.simulate.streams; ++i) {
+    int streamId = service.addStream();
+    if (streamId < 0) {
+      AG_LOG(ERROR, "Failed to add stream %d", i);
+      return -1;
+    }
+    streamIds.push_back(streamId);
+  }
+  AG_LOG(INFO, "Replaying %zu packets (%ld ms) into %d streams, %d%% loss", packets.size(),
+         fileDurationMs, options.simulate.streams, options.simulate.lossRate);
+
+  // Spread the streams over one frame period so that packets do not all arrive at once
+  struct StreamClock {
+    int64_t nextDueMs;
+    size_t index;
+    int64_t loops;
+  };
+  std::vector<StreamClock> clocks(streamIds.size());
+  for (size_t i = 0; i < clocks.size(); ++i) {
+    clocks[i] = {(int64_t)(i * DEFAULT_OPUS_FRAME_DURATION_MS / clocks.size()), 0, 0};
+  }
+
+  std::mt19937 random(12345);
+  std::uniform_int_distribution<int> percent(0, 99);
+  uint64_t startMs = now_ms_t();
+  uint64_t lastStatsMs = startMs;
+  while (!exitFlag) {
+    int64_t elapsedMs = now_ms_t() - startMs;
+    if (elapsedMs >= options.simulate.durationSec * 1000LL) {
+      break;
+    }
+    for (size_t i = 0; i < clocks.size(); ++i) {
+      StreamClock& clock = clocks[i];
+      while (clock.nextDueMs <= elapsedMs) {
+        const Packet& packet = packets[clock.index];
+        int64_t packetTs = clock.loops * fileDurationMs + packet.timestampMs;
+        if (percent(random) >= options.simulate.lossRate) {
+          service.pushPacket(streamIds[i], reinterpret_cast<const uint8_t*>(packet.data.get()),
+                             packet.length, packetTs);
+        }
+        if (++clock.index == packets.size()) {
+          clock.index = 0;
+          ++clock.loops;
+        }
+        const Packet& next = packets[clock.index];
+        clock.nextDueMs += clock.loops * fileDurationMs + next.timestampMs - packetTs;
+      }
+    }
+    if (now_ms_t() - lastStatsMs >= DEFAULT_STATS_INTERVAL_MS) {
+      printStats(service);
+      lastStatsMs = now_ms_t();
+    }
+    usleep(2000);
+  }
+
+  for (int streamId : streamIds) {
+    service.removeStream(streamId);
+  }
+  return 0;
+}
+
+static std::vector<std::string> splitChannelIds(const std::string& channelIds) {
+  std::vector<std::string> result;
+  std::stringstream stream(channelIds);
+  std::string channelId;
+  while (std::getline(stream, channelId, ',')) {
+    if (!channelId.empty()) {
+      result.push_back(channelId);
+    }
+  }
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("token", &options.appId, "The token for authentication / must");
+  optParser.add_long_opt("channelId", &options.channelId,
+                         "Channel Id, or a comma separated list to record several channels");
+  optParser.add_long_opt("userId", &options.userId, "User Id / default is 0");
+  optParser.add_long_opt("remoteUserId", &options.remoteUserId,
+                         "The remote user to record in every channel / must, unless "
+                         "simulateStreams");
+  optParser.add_long_opt("pcmFilePrefix", &options.pcmFilePrefix,
+                         "Save decoded audio to <prefix>_<stream>_<n>.pcm / default is no file");
+  optParser.add_long_opt("channels", &options.numberOfChannels,
+                         "Number of decoded channels, 1 or 2 / default is 1");
+  optParser.add_long_opt("workers", &options.workers,
+                         "Decode worker threads / default is one per CPU");
+  optParser.add_long_opt("batchSize", &options.batchSize,
+                         "Streams a worker decodes per batch / default is 16");
+  optParser.add_long_opt("pinWorkers", &options.pinWorkers, "Pin decode workers to CPUs");
+  optParser.add_long_opt("simulateStreams", &options.simulate.streams,
+                         "Replay audioFile into this many streams instead of joining a channel");
+  optParser.add_long_opt("audioFile", &options.simulate.audioFile,
+                         "Ogg Opus file replayed by simulateStreams");
+  optParser.add_long_opt("lossRate", &options.simulate.lossRate,
+                         "Packet loss in percent for simulateStreams / default is 0");
+  optParser.add_long_opt("durationSec", &options.simulate.durationSec,
+                         "Length of the simulateStreams run / default is 30");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  std::vector<std::string> channelIds = splitChannelIds(options.channelId);
+  if (options.simulate.streams > 0) {
+    if (options.simulate.audioFile.empty()) {
+      AG_LOG(ERROR, "Must provide audioFile with simulateStreams!");
+      return -1;
+    }
+  } else {
+    if (options.appId.empty()) {
+      AG_LOG(ERROR, "Must provide appId!");
+      return -1;
+    }
+    if (channelIds.empty()) {
+      AG_LOG(ERROR, "Must provide channelId!");
+      return -1;
+    }
+    // One decoder and one file per channel, the packets of several users would be mixed
+    if (options.remoteUserId.empty()) {
+      AG_LOG(ERROR, "Must provide remoteUserId!");
+      return -1;
+    }
+  }
+
+  std::signal(SIGQUIT, SignalHandler);
+  std::signal(SIGABRT, SignalHandler);
+  std::signal(SIGINT, SignalHandler);
+
+  OpusDecodeServiceConfig decodeConfig;
+  decodeConfig.numberOfChannels = options.numberOfChannels;
+  decodeConfig.maxStreams =
+      options.simulate.streams > 0 ? options.simulate.streams : (int)channelIds.size();
+  decodeConfig.workerCount = options.workers;
+  decodeConfig.batchSize = options.batchSize;
+  decodeConfig.pinWorkers = options.pinWorkers;
+
+  OpusDecodeService decodeService(decodeConfig);
+  PcmRecorder recorder(options.pcmFilePrefix, decodeConfig.maxStreams);
+  if (!decodeService.start([&recorder](int streamId, const int16_t* pcm, int samplesPerChannel,
+                                       int numberOfChannels, int64_t timestampMs,
+                                       bool concealed) {
+        recorder.onPcm(streamId, pcm, samplesPerChannel, numberOfChannels);
+      })) {
+    AG_LOG(ERROR, "Failed to start opus decode service!");
+    return -1;
+  }
+
+  if (options.simulate.streams > 0) {
+    int ret = simulateStreams(options, decodeService);
+    decodeService.stop();
+    printStats(decodeService);
+    return ret;
+  }
+
+  // Create Agora service
+  auto service = createAndInitAgoraService(false, true, true);
+  if (!service) {
+    AG_LOG(ERROR, "Failed to creating Agora service!");
+    return -1;
+  }
+
+  // One audience connection and one decode stream per channel
+  struct Recording {
+    agora::agora_refptr<agora::rtc::IRtcConnection> connection;
+    std::shared_ptr<SampleConnectionObserver> connObserver;
+    std::shared_ptr<SampleLocalUserObserver> localUserObserver;
+    std::shared_ptr<EncodedAudioDecodeFeeder> feeder;
+    int streamId;
+  };
+  std::vector<Recording> recordings;
+
+  for (const auto& channelId : channelIds) {
+    agora::rtc::RtcConnectionConfiguration ccfg;
+    ccfg.clientRoleType = agora::rtc::CLIENT_ROLE_AUDIENCE;
+    ccfg.autoSubscribeAudio = false;
+    ccfg.autoSubscribeVideo = false;
+    ccfg.enableAudioRecordingOrPlayout = false;  // Subscribe audio but without playback
+    ccfg.audioRecvEncodedFrame = true;
+
+    Recording recording;
+    recording.connection = service->createRtcConnection(ccfg);
+    if (!recording.connection) {
+      AG_LOG(ERROR, "Failed to creating Agora connection for %s!", channelId.c_str());
+      break;
+    }
+    recording.connObserver = std::make_shared<SampleConnectionObserver>();
+    recording.connection->registerObserver(recording.connObserver.get());
+
+    recording.connection->getLocalUser()->subscribeAudio(options.remoteUserId.c_str());
+
+    recording.streamId = decodeService.addStream();
+    recording.feeder =
+        std::make_shared<EncodedAudioDecodeFeeder>(&decodeService, recording.streamId);
+    recording.localUserObserver =
+        std::make_shared<SampleLocalUserObserver>(recording.connection->getLocalUser());
+    recording.localUserObserver->setEncodedAudioFrameObserver(recording.feeder.get());
+
+    if (recording.connection->connect(options.appId.c_str(), channelId.c_str(),
+                                      options.userId.c_str())) {
+      AG_LOG(ERROR, "Failed to connect to Agora channel %s!", channelId.c_str());
+      recording.localUserObserver.reset();
+      decodeService.removeStream(recording.streamId);
+      recording.connection->unregisterObserver(recording.connObserver.get());
+      break;
+    }
+    recording.connObserver->waitUntilConnected(DEFAULT_CONNECT_TIMEOUT_MS);
+    AG_LOG(INFO, "Recording channel %s into stream %d", channelId.c_str(), recording.streamId);
+    recordings.push_back(std::move(recording));
+  }
+
+  // Periodically check exit flag
+  uint64_t lastStatsMs = now_ms_t();
+  while (!exitFlag && recordings.size() == channelIds.size()) {
+    if (now_ms_t() - lastStatsMs >= DEFAULT_STATS_INTERVAL_MS) {
+      printStats(decodeService);
+      lastStatsMs = now_ms_t();
+    }
+    usleep(10000);
+  }
+
+  for (auto& recording : recordings) {
+    recording.connection->unregisterObserver(recording.connObserver.get());
+    if (recording.connection->disconnect()) {
+      AG_LOG(ERROR, "Failed to disconnect from Agora channel!");
+    }
+  }
+  AG_LOG(INFO, "Disconnected from Agora channels successfully");
+
+  // Destroy Agora connections and related resources
+  for (auto& recording : recordings) {
+    recording.localUserObserver.reset();
+    decodeService.removeStream(recording.streamId);
+    recording.feeder.reset();
+    recording.connObserver.reset();
+    recording.connection = nullptr;
+  }
+  recordings.clear();
+
+  decodeService.stop();
+  printStats(decodeService);
+
+  // Destroy Agora Service
+  service->release();
+  service = nullptr;
+
+  return 0;
+}
@@ -0,0 +1,373 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Receive encoded audio (Opus/AAC) from one channel and republish the
+//  same frames into another channel without decoding or re-encoding.
+//  Modified from sample_receive_encoded_audio.cpp and sample_send_opus.cpp
+//
+
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "IAgoraService.h"
+#include "NGIAgoraRtcConnection.h"
+#include "common/file_parser/helper_opus_packet.h"
+#include "common/helper.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/sample_common.h"
+#include "common/sample_connection_observer.h"
+#include "common/sample_local_user_observer.h"
+
+#include "NGIAgoraAudioTrack.h"
+#include "NGIAgoraLocalUser.h"
+#include "NGIAgoraMediaNodeFactory.h"
+#include "NGIAgoraMediaNode.h"
+#include "NGIAgoraVideoTrack.h"
+
+#define DEFAULT_CONNECT_TIMEOUT_MS (3000)
+#define DEFAULT_FILE_LIMIT (100 * 1024 * 1024)
+#define DEFAULT_OPUS_SAMPLE_RATE (48000)
+#define DEFAULT_AAC_SAMPLES_PER_CHANNEL (1024)
+#define DEFAULT_STATS_INTERVAL_MS (5000)
+
+struct SampleOptions {
+  std::string appId;
+  std::string channelId;
+  std::string userId;
+  std::string remoteUserId;
+  std::string dstChannelId;
+  std::string dstUserId;
+  std::string audioFile;
+};
+
+static const int AacSampleRateMap[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000,
+                                       22050, 16000, 12000, 11025, 8000,  7350};
+
+// Fill codec parameters from the Opus TOC byte. Returns false on a malformed packet.
+static bool parseOpusPacket(const uint8_t* packet, size_t length,
+                            agora::rtc::EncodedAudioFrameInfo& info) {
+  int samplesPerChannel = opusPacketSamples(packet, length);
+  if (samplesPerChannel <= 0) return false;
+  info.codec = agora::rtc::AUDIO_CODEC_OPUS;
+  info.sampleRateHz = DEFAULT_OPUS_SAMPLE_RATE;
+  info.numberOfChannels = (packet[0] & 0x4) ? 2 : 1;
+  info.samplesPerChannel = samplesPerChannel;
+  return true;
+}
+
+// Fill codec parameters from the ADTS header. Returns false if the frame has no ADTS header.
+static bool parseAdtsPacket(const uint8_t* packet, size_t length,
+                            agora::rtc::EncodedAudioFrameInfo& info) {
+  if (length < 7 || packet[0] != 0xff || (packet[1] & 0xf0) != 0xf0) return false;
+  int sampleRateIndex = (packet[2] >> 2) & 0x0f;
+  if (sampleRateIndex >= (int)(sizeof(AacSampleRateMap) / sizeof(AacSampleRateMap[0]))) {
+    return false;
+  }
+  int channels = ((packet[2] & 0x1) << 2) | (packet[3] >> 6);
+  info.sampleRateHz = AacSampleRateMap[sampleRateIndex];
+  info.numberOfChannels = channels > 0 ? channels : 1;
+  info.samplesPerChannel = DEFAULT_AAC_SAMPLES_PER_CHANNEL * ((packet[6] & 0x3) + 1);
+  return true;
+}
+
+class EncodedAudioRelay : public agora::rtc::IAudioEncodedFrameReceiver {
+ public:
+  EncodedAudioRelay(agora::agora_refptr<agora::rtc::IAudioEncodedFrameSender> audioFrameSender,
+                    const std::string& outputFilePath)
+      : audioFrameSender_(audioFrameSender), outputFilePath_(outputFilePath) {}
+
+  ~EncodedAudioRelay() {
+    if (file_) {
+      fclose(file_);
+      file_ = nullptr;
+    }
+  }
+
+  bool onEncodedAudioFrameReceived(const uint8_t* packet, size_t length,
+                                   const agora::media::base::AudioEncodedFrameInfo& info) override;
+
+ private:
+  bool buildFrameInfo(const uint8_t* packet, size_t length,
+                      const agora::media::base::AudioEncodedFrameInfo& info,
+                      agora::rtc::EncodedAudioFrameInfo& frameInfo);
+  void trackSequence(const agora::media::base::AudioEncodedFrameInfo& info, int frameDurationMs);
+  bool writeToFile(const uint8_t* packet, size_t length);
+
+ private:
+  agora::agora_refptr<agora::rtc::IAudioEncodedFrameSender> audioFrameSender_;
+  std::string outputFilePath_;
+  FILE* file_ = nullptr;
+  int fileCount_ = 0;
+  int fileSize_ = 0;
+
+  // Only touched from the SDK callback thread
+  uint64_t lastSendTs_ = 0;
+  uint64_t lastStatsTs_ = 0;
+  uint64_t relayedFrames_ = 0;
+  uint64_t relayedBytes_ = 0;
+  uint64_t gapCount_ = 0;
+  uint64_t reorderCount_ = 0;
+  uint64_t failedFrames_ = 0;
+};
+
+bool EncodedAudioRelay::buildFrameInfo(const uint8_t* packet, size_t length,
+                                       const agora::media::base::AudioEncodedFrameInfo& info,
+                                       agora::rtc::EncodedAudioFrameInfo& frameInfo) {
+  switch (info.codec) {
+    case agora::rtc::AUDIO_CODEC_OPUS:
+      return parseOpusPacket(packet, length, frameInfo);
+    case agora::rtc::AUDIO_CODEC_AACLC:
+    case agora::rtc::AUDIO_CODEC_HEAAC:
+    case agora::rtc::AUDIO_CODEC_HEAAC2:
+      frameInfo.codec = static_cast<agora::rtc::AUDIO_CODEC_TYPE>(info.codec);
+      return parseAdtsPacket(packet, length, frameInfo);
+    default:
+      // unknown codec id, fall back to sniffing the payload
+      if (parseAdtsPacket(packet, length, frameInfo)) {
+        frameInfo.codec = agora::rtc::AUDIO_CODEC_AACLC;
+        return true;
+      }
+      return parseOpusPacket(packet, length, frameInfo);
+  }
+}
+
+void EncodedAudioRelay::trackSequence(const agora::media::base::AudioEncodedFrameInfo& info,
+                                      int frameDurationMs) {
+  if (lastSendTs_ != 0) {
+    if (info.sendTs < lastSendTs_) {
+      ++reorderCount_;
+    } else if (info.sendTs - lastSendTs_ > (uint64_t)(2 * frameDurationMs)) {
+      ++gapCount_;
+    }
+  }
+  lastSendTs_ = info.sendTs;
+}
+
+bool EncodedAudioRelay::writeToFile(const uint8_t* packet, size_t length) {
+  if (!file_) {
+    std::string fileName = (++fileCount_ > 1) ? (outputFilePath_ + to_string(fileCount_))
+                                              : outputFilePath_;
+    if (!(file_ = fopen(fileName.c_str(), "w"))) {
+      AG_LOG(ERROR, "Failed to create relayed audio file %s", fileName.c_str());
+      return false;
+    }
+    AG_LOG(INFO, "Created file %s to save relayed audio frames", fileName.c_str());
+  }
+
+  if (fwrite(packet, 1, length, file_) != length) {
+    AG_LOG(ERROR, "Error writing encoded audio data: %s", std::strerror(errno));
+    return false;
+  }
+  fileSize_ += length;
+  if (fileSize_ >= DEFAULT_FILE_LIMIT) {
+    fclose(file_);
+    file_ = nullptr;
+    fileSize_ = 0;
+  }
+  return true;
+}
+
+bool EncodedAudioRelay::onEncodedAudioFrameReceived(
+    const uint8_t* packet, size_t length, const agora::media::base::AudioEncodedFrameInfo& info) {
+  agora::rtc::EncodedAudioFrameInfo frameInfo;
+  if (!buildFrameInfo(packet, length, info, frameInfo)) {
+    ++failedFrames_;
+    return false;
+  }
+  // keep the original send time so the receiver side sees the publisher timeline
+  frameInfo.captureTimeMs = info.sendTs;
+  trackSequence(info, frameInfo.samplesPerChannel * 1000 / frameInfo.sampleRateHz);
+
+  // The packet is handed to the sender as-is: no decode, no re-encode, no copy
+  if (audioFrameSender_ && !audioFrameSender_->sendEncodedAudioFrame(packet, length, frameInfo)) {
+    ++failedFrames_;
+  }
+  if (!outputFilePath_.empty()) {
+    writeToFile(packet, length);
+  }
+
+  ++relayedFrames_;
+  relayedBytes_ += length;
+  // sendTs can step back, e.g. when the publisher rejoins, so restart the interval then
+  if (info.sendTs < lastStatsTs_ || info.sendTs - lastStatsTs_ >= DEFAULT_STATS_INTERVAL_MS) {
+    AG_LOG(INFO, "relayed frames %llu, bytes %llu, gaps %llu, reordered %llu, failed %llu",
+           (unsigned long long)relayedFrames_, (unsigned long long)relayedBytes_,
+           (unsigned long long)gapCount_, (unsigned long long)reorderCount_,
+           (unsigned long long)failedFrames_);
+    lastStatsTs_ = info.sendTs;
+  }
+  return true;
+}
+
+static bool exitFlag = false;
+static void SignalHandler(int sigNo) { exitFlag = true; }
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("token", &options.appId, "The token for authentication / must");
+  optParser.add_long_opt("channelId", &options.channelId, "Source channel Id / must");
+  optParser.add_long_opt("userId", &options.userId, "User Id / default is 0");
+  optParser.add_long_opt("remoteUserId", &options.remoteUserId,
+                         "The remote user to relay audio from / must");
+  optParser.add_long_opt("dstChannelId", &options.dstChannelId,
+                         "Destination channel Id to republish the encoded audio");
+  optParser.add_long_opt("dstUserId", &options.dstUserId,
+                         "User Id in the destination channel / default is 0");
+  optParser.add_long_opt("audioFile", &options.audioFile,
+                         "Also save the relayed encoded audio to this file");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  if (options.appId.empty()) {
+    AG_LOG(ERROR, "Must provide appId!");
+    return -1;
+  }
+
+  if (options.channelId.empty()) {
+    AG_LOG(ERROR, "Must provide channelId!");
+    return -1;
+  }
+
+  // One sender and one sequence tracker carry a single publisher's stream
+  if (options.remoteUserId.empty()) {
+    AG_LOG(ERROR, "Must provide remoteUserId!");
+    return -1;
+  }
+
+  if (options.dstChannelId.empty() && options.audioFile.empty()) {
+    AG_LOG(ERROR, "Must provide dstChannelId or audioFile!");
+    return -1;
+  }
+
+  std::signal(SIGQUIT, SignalHandler);
+  std::signal(SIGABRT, SignalHandler);
+  std::signal(SIGINT, SignalHandler);
+
+  // Create Agora service
+  auto service = createAndInitAgoraService(false, true, true);
+  if (!service) {
+    AG_LOG(ERROR, "Failed to creating Agora service!");
+    return -1;
+  }
+
+  // Create the destination connection and encoded audio track first, so that
+  // no frame is lost between subscription and publication
+  agora::agora_refptr<agora::rtc::IRtcConnection> dstConnection;
+  agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory;
+  agora::agora_refptr<agora::rtc::IAudioEncodedFrameSender> audioFrameSender;
+  agora::agora_refptr<agora::rtc::ILocalAudioTrack> customAudioTrack;
+  auto dstConnObserver = std::make_shared<SampleConnectionObserver>();
+
+  if (!options.dstChannelId.empty()) {
+    agora::rtc::RtcConnectionConfiguration dstCfg;
+    dstCfg.autoSubscribeAudio = false;
+    dstCfg.autoSubscribeVideo = false;
+    dstCfg.clientRoleType = agora::rtc::CLIENT_ROLE_BROADCASTER;
+    dstConnection = service->createRtcConnection(dstCfg);
+    if (!dstConnection) {
+      AG_LOG(ERROR, "Failed to creating destination connection!");
+      return -1;
+    }
+    dstConnection->registerObserver(dstConnObserver.get());
+
+    factory = service->createMediaNodeFactory();
+    if (!factory) {
+      AG_LOG(ERROR, "Failed to create media node factory!");
+      return -1;
+    }
+
+    audioFrameSender = factory->createAudioEncodedFrameSender();
+    if (!audioFrameSender) {
+      AG_LOG(ERROR, "Failed to create audio encoded frame sender!");
+      return -1;
+    }
+
+    customAudioTrack = service->createCustomAudioTrack(audioFrameSender, agora::base::MIX_DISABLED);
+    if (!customAudioTrack) {
+      AG_LOG(ERROR, "Failed to create audio track!");
+      return -1;
+    }
+
+    if (dstConnection->connect(options.appId.c_str(), options.dstChannelId.c_str(),
+                               options.dstUserId.c_str())) {
+      AG_LOG(ERROR, "Failed to connect to destination channel!");
+      return -1;
+    }
+    dstConnection->getLocalUser()->publishAudio(customAudioTrack);
+    dstConnObserver->waitUntilConnected(DEFAULT_CONNECT_TIMEOUT_MS);
+  }
+
+  // Create the source connection which only receives encoded audio
+  agora::rtc::RtcConnectionConfiguration srcCfg;
+  srcCfg.clientRoleType = agora::rtc::CLIENT_ROLE_AUDIENCE;
+  srcCfg.autoSubscribeAudio = false;
+  srcCfg.autoSubscribeVideo = false;
+  srcCfg.enableAudioRecordingOrPlayout = false;  // Subscribe audio but without playback
+  srcCfg.audioRecvEncodedFrame = true;
+
+  agora::agora_refptr<agora::rtc::IRtcConnection> srcConnection =
+      service->createRtcConnection(srcCfg);
+  if (!srcConnection) {
+    AG_LOG(ERROR, "Failed to creating source connection!");
+    return -1;
+  }
+
+  srcConnection->getLocalUser()->subscribeAudio(options.remoteUserId.c_str());
+
+  auto localUserObserver =
+      std::make_shared<SampleLocalUserObserver>(srcConnection->getLocalUser());
+  auto audioRelay = std::make_shared<EncodedAudioRelay>(audioFrameSender, options.audioFile);
+  localUserObserver->setEncodedAudioFrameObserver(audioRelay.get());
+
+  if (srcConnection->connect(options.appId.c_str(), options.channelId.c_str(),
+                             options.userId.c_str())) {
+    AG_LOG(ERROR, "Failed to connect to source channel!");
+    return -1;
+  }
+
+  AG_LOG(INFO, "Start relaying encoded audio from %s to %s ...", options.channelId.c_str(),
+         options.dstChannelId.empty() ? options.audioFile.c_str() : options.dstChannelId.c_str());
+
+  // Periodically check exit flag
+  while (!exitFlag) {
+    usleep(10000);
+  }
+
+  if (srcConnection->disconnect()) {
+    AG_LOG(ERROR, "Failed to disconnect from source channel!");
+  }
+  if (dstConnection) {
+    dstConnection->getLocalUser()->unpublishAudio(customAudioTrack);
+    dstConnection->unregisterObserver(dstConnObserver.get());
+    if (dstConnection->disconnect()) {
+      AG_LOG(ERROR, "Failed to disconnect from destination channel!");
+    }
+  }
+  AG_LOG(INFO, "Disconnected from Agora channels successfully");
+
+  // Destroy Agora connections and related resources
+  localUserObserver.reset();
+  audioRelay.reset();
+  dstConnObserver.reset();
+  audioFrameSender = nullptr;
+  customAudioTrack = nullptr;
+  factory = nullptr;
+  srcConnection = nullptr;
+  dstConnection = nullptr;
+
+  // Destroy Agora Service
+  service->release();
+  service = nullptr;
+
+  return 0;
+}
@@ -13,6 +13,7 @@
 #include "IAgoraService.h"
 #include "NGIAgoraRtcConnection.h"
 #include "common/file_parser/helper_aac_parser.h"
+#include "common/file_writer/send_capture_writer.h"
 #include "common/helper.h"
 #include "common/opt_parser.h"
 #include "common/sample_common.h"
@@ -37,6 +38,7 @@ struct SampleOptions {
   std::string channelId;
   std::string userId;
   std::string audioFile = DEFAULT_AUDIO_FILE;
+  std::string captureFile;
   struct {
     int frameDuration = DEFAULT_AUDIO_FRAME_DURATION;
   } audio;
@@ -44,7 +46,8 @@ struct SampleOptions {
 
 static void SampleSendAudioTask(
     const SampleOptions& options,
-    agora::agora_refptr<agora::rtc::IAudioEncodedFrameSender> audioFrameSender, bool& exitFlag) {
+    agora::agora_refptr<agora::rtc::IAudioEncodedFrameSender> audioFrameSender,
+    SendCaptureWriter* captureWriter, bool& exitFlag) {
   std::unique_ptr<HelperAacFileParser> audioFileParser(
       new HelperAacFileParser(options.audioFile.c_str()));
   audioFileParser->initialize();
@@ -52,6 +55,10 @@ static void SampleSendAudioTask(
 
   while (!exitFlag) {
     if (auto audioFrame = audioFileParser->getAudioFrame(options.audio.frameDuration)) {
+      if (captureWriter) {
+        captureWriter->captureEncodedAudio(0, audioFrame.get()->buffer, audioFrame.get()->bufferLen,
+                                           audioFrame.get()->audioFrameInfo);
+      }
       audioFrameSender->sendEncodedAudioFrame(audioFrame.get()->buffer, audioFrame.get()->bufferLen,
                                               audioFrame.get()->audioFrameInfo);
     // we should send one aac frame during 21.33333ms
@@ -77,6 +84,8 @@ int main(int argc, char* argv[]) {
                          "The audio file to be sent");
   optParser.add_long_opt("frameDuration", &options.audio.frameDuration,
                          "The frame duration (in ms) of the audio file / default is 20 ms");
+  optParser.add_long_opt("captureFile", &options.captureFile,
+                         "Log every sent frame to this file for sample_replay_capture");
 
   if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
     std::ostringstream strStream;
@@ -155,11 +164,19 @@ int main(int argc, char* argv[]) {
   // Wait until connected before sending media stream
   connObserver->waitUntilConnected(DEFAULT_CONNECT_TIMEOUT_MS);
 
+  // Optionally log what is sent, to replay it later
+  std::unique_ptr<SendCaptureWriter> captureWriter;
+  if (!options.captureFile.empty()) {
+    captureWriter.reset(new SendCaptureWriter(options.captureFile));
+  }
+
   // Start sending media data
   AG_LOG(INFO, "Start sending audio data ...");
-  std::thread sendAudioThread(SampleSendAudioTask, options, audioFrameSender, std::ref(exitFlag));
+  std::thread sendAudioThread(SampleSendAudioTask, options, audioFrameSender, captureWriter.get(),
+                              std::ref(exitFlag));
 
   sendAudioThread.join();
+  captureWriter.reset();
 
   // Unpublish audio track
   connection->getLocalUser()->unpublishAudio(customAudioTrack);
@@ -0,0 +1,179 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Measures what end to end frame encryption costs: throughput and added
+//  latency per frame for typical 1080p and 4K H.264 streams. Runs offline,
+//  no connection is made.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/e2ee/h264_frame_cipher.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+
+#define DEFAULT_FRAME_COUNT (600)
+#define DEFAULT_GOP_SIZE (60)
+#define DEFAULT_BENCH_KEY "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+
+struct SampleOptions {
+  int frameCount = DEFAULT_FRAME_COUNT;
+  int gopSize = DEFAULT_GOP_SIZE;
+  std::string e2eeKey = DEFAULT_BENCH_KEY;
+};
+
+// Frame sizes of a 30 fps stream at a typical real-time bitrate
+struct BenchProfile {
+  const char* name;
+  size_t keyFrameBytes;
+  size_t deltaFrameBytes;
+  int slices;
+};
+
+static const BenchProfile kProfiles[] = {
+    {"1080p 8Mbps", 200 * 1024, 30 * 1024, 4},
+    {"4K 30Mbps", 800 * 1024, 120 * 1024, 8},
+};
+
+static void appendNal(std::vector<uint8_t>& frame, uint8_t header, size_t size,
+                      std::mt19937& rng) {
+  static const uint8_t startCode[] = {0, 0, 0, 1};
+  frame.insert(frame.end(), startCode, startCode + sizeof(startCode));
+  frame.push_back(header);
+  size_t begin = frame.size();
+  for (size_t i = 0; i < size; ++i) {
+    frame.push_back(static_cast<uint8_t>(rng()));
+  }
+  // what an encoder emits never has 00 00 0x in a NAL unit
+  for (size_t i = begin; i + 2 < frame.size(); ++i) {
+    if (frame[i] == 0 && frame[i + 1] == 0 && frame[i + 2] <= 3) {
+      frame[i + 2] = 3;
+    }
+  }
+  frame.back() |= 0x80;
+}
+
+static std::vector<std::vector<uint8_t>> makeFrames(const BenchProfile& profile, int gopSize,
+                                                    std::mt19937& rng) {
+  std::vector<std::vector<uint8_t>> frames(gopSize);
+  for (int i = 0; i < gopSize; ++i) {
+    bool keyFrame = i == 0;
+    size_t bytes = keyFrame ? profile.keyFrameBytes : profile.deltaFrameBytes;
+    if (keyFrame) {
+      appendNal(frames[i], 0x67, 16, rng);
+      appendNal(frames[i], 0x68, 4, rng);
+    }
+    for (int s = 0; s < profile.slices; ++s) {
+      appendNal(frames[i], keyFrame ? 0x65 : 0x41, bytes / profile.slices, rng);
+    }
+  }
+  return frames;
+}
+
+static double percentile(std::vector<double>& values, double fraction) {
+  size_t index = std::min(values.size() - 1, static_cast<size_t>(values.size() * fraction));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+static void runProfile(const BenchProfile& profile, const SampleOptions& options) {
+  std::mt19937 rng(1);
+  std::vector<std::vector<uint8_t>> frames = makeFrames(profile, options.gopSize, rng);
+  H264FrameCipher encryptor;
+  H264FrameCipher decryptor;
+  if (!encryptor.setKey(options.e2eeKey) || !decryptor.setKey(options.e2eeKey)) {
+    return;
+  }
+
+  std::vector<double> encryptUs;
+  std::vector<double> decryptUs;
+  std::vector<uint8_t> encrypted;
+  double encryptTotalUs = 0;
+  double decryptTotalUs = 0;
+  uint64_t bytes = 0;
+  uint64_t overhead = 0;
+  for (int i = 0; i < options.frameCount; ++i) {
+    const std::vector<uint8_t>& frame = frames[i % frames.size()];
+    const uint8_t* out = nullptr;
+    size_t outLength = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = encryptor.encrypt(frame.data(), frame.size(), out, outLength);
+    auto end = std::chrono::steady_clock::now();
+    if (!ok) {
+      AG_LOG(ERROR, "Failed to encrypt frame %d", i);
+      return;
+    }
+    encryptUs.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    encrypted.assign(out, out + outLength);
+    overhead += outLength - frame.size();
+
+    start = std::chrono::steady_clock::now();
+    ok = decryptor.decrypt(encrypted.data(), encrypted.size(), out, outLength);
+    end = std::chrono::steady_clock::now();
+    if (!ok || outLength != frame.size() || memcmp(out, frame.data(), outLength) != 0) {
+      AG_LOG(ERROR, "Failed to decrypt frame %d", i);
+      return;
+    }
+    decryptUs.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+
+    encryptTotalUs += encryptUs.back();
+    decryptTotalUs += decryptUs.back();
+    bytes += frame.size();
+  }
+
+  double meanBytes = static_cast<double>(bytes) / options.frameCount;
+  AG_LOG(INFO, "%s: %d frames, %.0f bytes on average, %.1f bytes added", profile.name,
+         options.frameCount, meanBytes, static_cast<double>(overhead) / options.frameCount);
+  AG_LOG(INFO, "  encrypt %.2f GB/s, per frame p50 %.1f us p99 %.1f us max %.1f us",
+         bytes / encryptTotalUs / 1000, percentile(encryptUs, 0.5), percentile(encryptUs, 0.99),
+         *std::max_element(encryptUs.begin(), encryptUs.end()));
+  AG_LOG(INFO, "  decrypt %.2f GB/s, per frame p50 %.1f us p99 %.1f us max %.1f us",
+         bytes / decryptTotalUs / 1000, percentile(decryptUs, 0.5), percentile(decryptUs, 0.99),
+         *std::max_element(decryptUs.begin(), decryptUs.end()));
+}
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("frames", &options.frameCount,
+                         "Frames to encrypt per profile / default is 600");
+  optParser.add_long_opt("gop", &options.gopSize, "Frames per key frame / default is 60");
+  optParser.add_long_opt("e2eeKey", &options.e2eeKey,
+                         "AES key, 32 or 64 hex digits / default is a fixed AES-256 key");
+
+  if (!optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  if (options.frameCount <= 0 || options.gopSize <= 0) {
+    AG_LOG(ERROR, "frames and gop must be positive!");
+    return -1;
+  }
+
+  if (!H264FrameCipher().setKey(options.e2eeKey)) {
+    return -1;
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  // OpenSSL picks its AES-GCM code from the same CPU features
+  AG_LOG(INFO, "CPU: aes %d pclmul %d avx2 %d vaes %d", !!__builtin_cpu_supports("aes"),
+         !!__builtin_cpu_supports("pclmul"), !!__builtin_cpu_supports("avx2"),
+         !!__builtin_cpu_supports("vaes"));
+#endif
+
+  for (const BenchProfile& profile : kProfiles) {
+    runProfile(profile, options);
+  }
+
+  return 0;
+}
@@ -12,6 +12,7 @@
 
 #include "IAgoraService.h"
 #include "NGIAgoraRtcConnection.h"
+#include "common/e2ee/h264_frame_cipher.h"
 #include "common/log.h"
 #include "common/opt_parser.h"
 #include "common/sample_common.h"
@@ -34,32 +35,46 @@ struct SampleOptions {
   std::string videoFile = DEFAULT_VIDEO_FILE;
   int encryptionMode = 0;
   std::string encryptionKey;
+  std::string e2eeKey;
 };
 
 class H264FrameReceiver : public agora::media::IVideoEncodedFrameObserver {
  public:
-  H264FrameReceiver(const std::string& outputFilePath)
+  H264FrameReceiver(const std::string& outputFilePath,
+                    std::unique_ptr<H264FrameCipher> cipher = nullptr)
       : outputFilePath_(outputFilePath),
         h264File_(nullptr),
         fileCount(0),
-        fileSize_(0) {}
+        fileSize_(0),
+        cipher_(std::move(cipher)) {}
 
   bool onEncodedVideoFrameReceived(agora::rtc::uid_t uid, const uint8_t* imageBuffer, size_t length,
                                    const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo)  override;
 
 
+  // Read once no more frames arrive, e.g. after disconnecting
+  H264FrameCipherStats getCipherStats() const {
+    return cipher_ ? cipher_->getStats() : H264FrameCipherStats();
+  }
 
  private:
   std::string outputFilePath_;
   FILE* h264File_;
   int fileCount;
   int fileSize_;
+  std::unique_ptr<H264FrameCipher> cipher_;
 };
 
 bool H264FrameReceiver:: onEncodedVideoFrameReceived(agora::rtc::uid_t uid, const uint8_t* imageBuffer, size_t length,
                                    const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo) 
 
  {
+  // Decrypt end to end encrypted frames, drop the ones that fail to verify
+  if (cipher_ && !cipher_->decrypt(imageBuffer, length, imageBuffer, length)) {
+    AG_LOG(ERROR, "Failed to decrypt the frame from %u, dropped", uid);
+    return false;
+  }
+
   // Create new file to save received H264 frames
   if (!h264File_) {
     std::string fileName = (++fileCount > 1)
@@ -107,6 +122,8 @@ int main(int argc, char* argv[]) {
                          "open the encrypt or not");
   optParser.add_long_opt("encryptionKey", &options.encryptionKey,
                          "the encryptionKey ");
+  optParser.add_long_opt("e2eeKey", &options.e2eeKey,
+                         "Decrypt frames encrypted end to end with this key, 32 or 64 hex digits");
 
   if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
     std::ostringstream strStream;
@@ -132,6 +149,14 @@ int main(int argc, char* argv[]) {
     }
   }
 
+  std::unique_ptr<H264FrameCipher> cipher;
+  if (!options.e2eeKey.empty()) {
+    cipher.reset(new H264FrameCipher);
+    if (!cipher->setKey(options.e2eeKey)) {
+      return -1;
+    }
+  }
+
   std::signal(SIGQUIT, SignalHandler);
   std::signal(SIGABRT, SignalHandler);
   std::signal(SIGINT, SignalHandler);
@@ -189,7 +214,7 @@ int main(int argc, char* argv[]) {
 
   // Register h264 frame receiver to receive video stream
   auto h264FrameReceiver =
-      std::make_shared<H264FrameReceiver>(options.videoFile);
+      std::make_shared<H264FrameReceiver>(options.videoFile, std::move(cipher));
   localUserObserver->setVideoEncodedImageReceiver(h264FrameReceiver.get());
 
   // Periodically check exit flag
@@ -207,6 +232,13 @@ int main(int argc, char* argv[]) {
   }
   AG_LOG(INFO, "Disconnected from Agora channel successfully");
 
+  if (!options.e2eeKey.empty()) {
+    H264FrameCipherStats stats = h264FrameReceiver->getCipherStats();
+    AG_LOG(INFO, "Decrypted %llu frames, %llu failed to verify, %llu malformed",
+           (unsigned long long)stats.frames, (unsigned long long)stats.authFailures,
+           (unsigned long long)stats.malformed);
+  }
+
   // Destroy Agora connection and related resources
   localUserObserver.reset();
   h264FrameReceiver.reset();
@@ -12,6 +12,7 @@
 
 #include "IAgoraService.h"
 #include "NGIAgoraRtcConnection.h"
+#include "common/e2ee/h264_frame_cipher.h"
 #include "common/file_parser/helper_h264_parser.h"
 #include "common/helper.h"
 #include "common/log.h"
@@ -37,6 +38,7 @@ struct SampleOptions {
   std::string videoFile = DEFAULT_VIDEO_FILE;
   int encryptionMode = 0;
   std::string encryptionKey;
+  std::string e2eeKey;
   struct {
     int frameRate = DEFAULT_FRAME_RATE;
   } video;
@@ -45,7 +47,8 @@ struct SampleOptions {
 static void sendOneH264Frame(
     int frameRate, std::unique_ptr<HelperH264Frame> h264Frame,
     agora::agora_refptr<agora::rtc::IVideoEncodedImageSender>
-        videoH264FrameSender) {
+        videoH264FrameSender,
+    H264FrameCipher* cipher) {
   agora::rtc::EncodedVideoFrameInfo videoEncodedFrameInfo;
   videoEncodedFrameInfo.rotation = agora::rtc::VIDEO_ORIENTATION_0;
   videoEncodedFrameInfo.codecType = agora::rtc::VIDEO_CODEC_H264;
@@ -59,9 +62,15 @@ static void sendOneH264Frame(
            reinterpret_cast<uint8_t*>(h264Frame.get()->buffer.get()),
      h264Frame.get()->bufferLen, videoEncodedFrameInfo.frameType); */
 
-  videoH264FrameSender->sendEncodedVideoImage(
-      reinterpret_cast<uint8_t*>(h264Frame.get()->buffer.get()),
-      h264Frame.get()->bufferLen, videoEncodedFrameInfo);
+  const uint8_t* buffer = reinterpret_cast<uint8_t*>(h264Frame.get()->buffer.get());
+  size_t length = h264Frame.get()->bufferLen;
+  // Encrypt the payload end to end, the NAL headers stay readable
+  if (cipher && !cipher->encrypt(buffer, length, buffer, length)) {
+    AG_LOG(ERROR, "Failed to encrypt the frame, dropped");
+    return;
+  }
+
+  videoH264FrameSender->sendEncodedVideoImage(buffer, length, videoEncodedFrameInfo);
 }
 
 static void SampleSendVideoH264Task(
@@ -78,13 +87,29 @@ static void SampleSendVideoH264Task(
   PacerInfo pacer = {0, 1000 / options.video.frameRate,0,
                      std::chrono::steady_clock::now()};
 
+  std::unique_ptr<H264FrameCipher> cipher;
+  if (!options.e2eeKey.empty()) {
+    cipher.reset(new H264FrameCipher);
+    if (!cipher->setKey(options.e2eeKey)) {
+      AG_LOG(ERROR, "Failed to set the end-to-end key, not sending video");
+      exitFlag = true;
+      return;
+    }
+  }
+
   while (!exitFlag) {
     if (auto h264Frame = h264FileParser->getH264Frame()) {
       sendOneH264Frame(options.video.frameRate, std::move(h264Frame),
-                       videoH264FrameSender);
+                       videoH264FrameSender, cipher.get());
       waitBeforeNextSend(pacer);  // sleep for a while before sending next frame
     }
   };
+
+  if (cipher) {
+    H264FrameCipherStats stats = cipher->getStats();
+    AG_LOG(INFO, "Encrypted %llu frames, %llu bytes", (unsigned long long)stats.frames,
+           (unsigned long long)stats.bytes);
+  }
 }
 
 static bool exitFlag = false;
@@ -106,6 +131,8 @@ int main(int argc, char* argv[]) {
                          "open the encrypt or not");
   optParser.add_long_opt("encryptionKey", &options.encryptionKey,
                          "the encryptionKey ");
+  optParser.add_long_opt("e2eeKey", &options.e2eeKey,
+                         "Encrypt the frames end to end with AES-GCM, 32 or 64 hex digits");
 
   if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
     std::ostringstream strStream;
@@ -131,6 +158,9 @@ int main(int argc, char* argv[]) {
     }
   }
 
+  if (!options.e2eeKey.empty() && !H264FrameCipher().setKey(options.e2eeKey)) {
+    return -1;
+  }
 
   std::signal(SIGQUIT, SignalHandler);
   std::signal(SIGABRT, SignalHandler);
@@ -0,0 +1,575 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Forward encoded video received in one channel to custom encoded video
+//  tracks in one or more other channels, without decoding or re-encoding.
+//  Modified from sample_echo_h264_pcm.cpp
+//
+
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "IAgoraService.h"
+#include "NGIAgoraRtcConnection.h"
+#include "common/helper.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/sample_common.h"
+#include "common/sample_connection_observer.h"
+#include "common/sample_local_user_observer.h"
+
+#include "NGIAgoraAudioTrack.h"
+#include "NGIAgoraLocalUser.h"
+#include "NGIAgoraMediaNodeFactory.h"
+#include "NGIAgoraMediaNode.h"
+#include "NGIAgoraVideoTrack.h"
+
+#define DEFAULT_CONNECT_TIMEOUT_MS (3000)
+#define DEFAULT_MAX_QUEUED_FRAMES (30)
+#define DEFAULT_INTRA_REQUEST_INTERVAL_MS (500)
+#define STREAM_TYPE_HIGH "high"
+#define STREAM_TYPE_LOW "low"
+
+struct SampleOptions {
+  std::string appId;
+  std::string channelId;
+  std::string userId;
+  std::string remoteUserId;
+  std::string dstChannelIds;
+  std::string dstUserId;
+  std::string streamType = STREAM_TYPE_HIGH;
+  std::string videoCodec = "h264";
+  int maxQueuedFrames = DEFAULT_MAX_QUEUED_FRAMES;
+};
+
+// One received frame, copied once out of the SDK buffer and shared read-only
+// by every output queue.
+struct SharedEncodedFrame {
+  std::unique_ptr<uint8_t[]> buffer;
+  size_t length;
+  agora::rtc::EncodedVideoFrameInfo info;
+};
+
+class EncodedVideoForwarder;
+
+// A destination connection for one source user, with its own send queue and
+// thread, so that a slow destination never blocks the SDK receive thread or
+// other outputs.
+class ForwardOutput {
+ public:
+  ForwardOutput(EncodedVideoForwarder* forwarder, agora::rtc::uid_t sourceUid,
+                const std::string& channelId, int maxQueuedFrames)
+      : forwarder_(forwarder),
+        sourceUid_(sourceUid),
+        channelId_(channelId),
+        maxQueuedFrames_(maxQueuedFrames) {}
+
+  bool initialize(agora::base::IAgoraService* service,
+                  agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory,
+                  const std::string& appId, const std::string& dstUserId,
+                  agora::rtc::VIDEO_CODEC_TYPE codecType);
+  void release();
+
+  void push(const std::shared_ptr<const SharedEncodedFrame>& frame);
+  void start();
+  void stop();
+
+ private:
+  void sendTask();
+
+ private:
+  EncodedVideoForwarder* forwarder_;
+  agora::rtc::uid_t sourceUid_;
+  std::string channelId_;
+  int maxQueuedFrames_;
+
+  agora::agora_refptr<agora::rtc::IRtcConnection> connection_;
+  agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> videoSender_;
+  agora::agora_refptr<agora::rtc::ILocalVideoTrack> videoTrack_;
+  std::shared_ptr<SampleConnectionObserver> connObserver_;
+  std::shared_ptr<SampleLocalUserObserver> localUserObserver_;
+
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::deque<std::shared_ptr<const SharedEncodedFrame>> queue_;
+  bool waitKeyFrame_ = true;
+  bool exit_ = false;
+  std::thread thread_;
+  uint64_t droppedFrames_ = 0;
+};
+
+// Routes the frames of each source user to outputs of its own, one per
+// destination channel, so that streams from different users never interleave
+// and key frame requests reach the user whose stream needs one.
+class EncodedVideoForwarder : public agora::media::IVideoEncodedFrameObserver {
+ public:
+  EncodedVideoForwarder(agora::rtc::ILocalUser* sourceUser, agora::base::IAgoraService* service,
+                        agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory,
+                        const SampleOptions& options, agora::rtc::VIDEO_CODEC_TYPE codecType,
+                        const std::vector<std::string>& dstChannelIds)
+      : sourceUser_(sourceUser),
+        service_(service),
+        factory_(factory),
+        options_(options),
+        codecType_(codecType),
+        dstChannelIds_(dstChannelIds) {}
+
+  // Connects the outputs of a source user, which may block for a while, so
+  // it is never called from the SDK thread
+  bool addRoute(agora::rtc::uid_t uid, const std::string& dstUserId);
+  // Adds routes for the users whose frames arrived before they had one
+  void addPendingRoutes();
+  void release();
+
+  bool onEncodedVideoFrameReceived(
+      agora::rtc::uid_t uid, const uint8_t* imageBuffer, size_t length,
+      const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo) override;
+
+  // Ask a publisher in the source channel for a key frame. Requests from all
+  // of its outputs are coalesced so it sees at most one per interval.
+  void requestKeyFrame(agora::rtc::uid_t uid);
+
+ private:
+  struct Route {
+    bool ready = false;
+    std::vector<std::shared_ptr<ForwardOutput>> outputs;
+    uint64_t lastIntraRequestMs = 0;
+  };
+
+  agora::rtc::ILocalUser* sourceUser_;
+  agora::base::IAgoraService* service_;
+  agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory_;
+  SampleOptions options_;
+  agora::rtc::VIDEO_CODEC_TYPE codecType_;
+  std::vector<std::string> dstChannelIds_;
+
+  std::mutex lock_;
+  std::map<agora::rtc::uid_t, Route> routes_;
+};
+
+bool EncodedVideoForwarder::addRoute(agora::rtc::uid_t uid, const std::string& dstUserId) {
+  std::vector<std::shared_ptr<ForwardOutput>> outputs;
+  for (const auto& dstChannelId : dstChannelIds_) {
+    auto output =
+        std::make_shared<ForwardOutput>(this, uid, dstChannelId, options_.maxQueuedFrames);
+    if (!output->initialize(service_, factory_, options_.appId, dstUserId, codecType_)) {
+      output->release();
+      for (auto& started : outputs) {
+        started->stop();
+        started->release();
+      }
+      return false;
+    }
+    output->start();
+    outputs.push_back(output);
+  }
+  AG_LOG(INFO, "Forwarding user %u to %d channels", uid, (int)outputs.size());
+
+  std::lock_guard<std::mutex> _(lock_);
+  Route& route = routes_[uid];
+  route.outputs = outputs;
+  route.ready = true;
+  return true;
+}
+
+void EncodedVideoForwarder::addPendingRoutes() {
+  std::vector<agora::rtc::uid_t> pending;
+  {
+    std::lock_guard<std::mutex> _(lock_);
+    for (auto& route : routes_) {
+      if (!route.second.ready) {
+        // claimed here so that a failed user is not retried in a loop
+        route.second.ready = true;
+        pending.push_back(route.first);
+      }
+    }
+  }
+  for (agora::rtc::uid_t uid : pending) {
+    if (!addRoute(uid, "")) {
+      AG_LOG(ERROR, "Failed to forward user %u", uid);
+    }
+  }
+}
+
+void EncodedVideoForwarder::release() {
+  std::map<agora::rtc::uid_t, Route> routes;
+  {
+    std::lock_guard<std::mutex> _(lock_);
+    routes.swap(routes_);
+  }
+  for (auto& route : routes) {
+    for (auto& output : route.second.outputs) {
+      output->stop();
+      output->release();
+    }
+  }
+}
+
+bool EncodedVideoForwarder::onEncodedVideoFrameReceived(
+    agora::rtc::uid_t uid, const uint8_t* imageBuffer, size_t length,
+    const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo) {
+  std::vector<std::shared_ptr<ForwardOutput>> outputs;
+  {
+    std::lock_guard<std::mutex> _(lock_);
+    auto it = routes_.find(uid);
+    if (it == routes_.end()) {
+      // first frame of a new user, the main thread connects its outputs
+      routes_[uid];
+      return true;
+    }
+    outputs = it->second.outputs;
+  }
+  if (outputs.empty()) {
+    return true;
+  }
+
+  std::shared_ptr<SharedEncodedFrame> frame = std::make_shared<SharedEncodedFrame>();
+  frame->buffer.reset(new uint8_t[length]);
+  memcpy(frame->buffer.get(), imageBuffer, length);
+  frame->length = length;
+  frame->info = videoEncodedFrameInfo;
+
+  std::shared_ptr<const SharedEncodedFrame> sharedFrame = frame;
+  for (auto& output : outputs) {
+    output->push(sharedFrame);
+  }
+  return true;
+}
+
+void EncodedVideoForwarder::requestKeyFrame(agora::rtc::uid_t uid) {
+  uint64_t now = now_ms_t();
+  {
+    std::lock_guard<std::mutex> _(lock_);
+    auto it = routes_.find(uid);
+    if (it == routes_.end() ||
+        now - it->second.lastIntraRequestMs < DEFAULT_INTRA_REQUEST_INTERVAL_MS) {
+      return;
+    }
+    it->second.lastIntraRequestMs = now;
+  }
+  std::string userId = to_string(uid);
+  AG_LOG(INFO, "Request key frame from user %s", userId.c_str());
+  sourceUser_->sendIntraRequest(userId.c_str());
+}
+
+bool ForwardOutput::initialize(agora::base::IAgoraService* service,
+                               agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory,
+                               const std::string& appId, const std::string& dstUserId,
+                               agora::rtc::VIDEO_CODEC_TYPE codecType) {
+  agora::rtc::RtcConnectionConfiguration ccfg;
+  ccfg.autoSubscribeAudio = false;
+  ccfg.autoSubscribeVideo = false;
+  ccfg.clientRoleType = agora::rtc::CLIENT_ROLE_BROADCASTER;
+  connection_ = service->createRtcConnection(ccfg);
+  if (!connection_) {
+    AG_LOG(ERROR, "Failed to creating Agora connection for %s!", channelId_.c_str());
+    return false;
+  }
+
+  // Key frame requests from subscribers in this channel are propagated
+  // upstream. The callback is set before the connection observer is
+  // registered and before connect, so no request can race it.
+  localUserObserver_ = std::make_shared<SampleLocalUserObserver>(connection_->getLocalUser());
+  EncodedVideoForwarder* forwarder = forwarder_;
+  agora::rtc::uid_t sourceUid = sourceUid_;
+  localUserObserver_->setIntraRequestCallback(
+      [forwarder, sourceUid]() { forwarder->requestKeyFrame(sourceUid); });
+
+  connObserver_ = std::make_shared<SampleConnectionObserver>();
+  connection_->registerObserver(connObserver_.get());
+
+  videoSender_ = factory->createVideoEncodedImageSender();
+  if (!videoSender_) {
+    AG_LOG(ERROR, "Failed to create encoded video sender for %s!", channelId_.c_str());
+    return false;
+  }
+
+  agora::rtc::SenderOptions senderOptions;
+  senderOptions.codecType = codecType;
+  videoTrack_ = service->createCustomVideoTrack(videoSender_, senderOptions);
+  if (!videoTrack_) {
+    AG_LOG(ERROR, "Failed to create video track for %s!", channelId_.c_str());
+    return false;
+  }
+
+  if (connection_->connect(appId.c_str(), channelId_.c_str(), dstUserId.c_str())) {
+    AG_LOG(ERROR, "Failed to connect to Agora channel %s!", channelId_.c_str());
+    return false;
+  }
+  videoTrack_->setEnabled(true);
+  connection_->getLocalUser()->publishVideo(videoTrack_);
+  connObserver_->waitUntilConnected(DEFAULT_CONNECT_TIMEOUT_MS);
+  return true;
+}
+
+void ForwardOutput::release() {
+  if (connection_) {
+    if (videoTrack_) {
+      connection_->getLocalUser()->unpublishVideo(videoTrack_);
+    }
+    if (connObserver_) {
+      connection_->unregisterObserver(connObserver_.get());
+    }
+    if (connection_->disconnect()) {
+      AG_LOG(ERROR, "Failed to disconnect from Agora channel %s!", channelId_.c_str());
+    }
+  }
+  localUserObserver_.reset();
+  connObserver_.reset();
+  videoSender_ = nullptr;
+  videoTrack_ = nullptr;
+  connection_ = nullptr;
+}
+
+void ForwardOutput::push(const std::shared_ptr<const SharedEncodedFrame>& frame) {
+  bool isKeyFrame = frame->info.frameType == agora::rtc::VIDEO_FRAME_TYPE_KEY_FRAME;
+  bool needKeyFrame = false;
+  {
+    std::lock_guard<std::mutex> _(lock_);
+    if (waitKeyFrame_ && !isKeyFrame) {
+      // at startup and after an overflow, ask for the key frame being waited for
+      ++droppedFrames_;
+      needKeyFrame = true;
+    } else {
+      if ((int)queue_.size() >= maxQueuedFrames_) {
+        // The destination fell behind: flush the backlog and resume from the
+        // next key frame so that the decoder never sees a broken reference chain
+        droppedFrames_ += queue_.size();
+        queue_.clear();
+        if (!isKeyFrame) {
+          ++droppedFrames_;
+          waitKeyFrame_ = true;
+          needKeyFrame = true;
+          AG_LOG(WARNING, "Output %s overflow, dropped %llu frames so far", channelId_.c_str(),
+                 (unsigned long long)droppedFrames_);
+        }
+      }
+      if (!needKeyFrame) {
+        waitKeyFrame_ = false;
+        queue_.push_back(frame);
+        cond_.notify_one();
+      }
+    }
+  }
+  if (needKeyFrame) {
+    forwarder_->requestKeyFrame(sourceUid_);
+  }
+}
+
+void ForwardOutput::start() { thread_ = std::thread(&ForwardOutput::sendTask, this); }
+
+void ForwardOutput::stop() {
+  {
+    std::lock_guard<std::mutex> _(lock_);
+    exit_ = true;
+    cond_.notify_one();
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void ForwardOutput::sendTask() {
+  while (true) {
+    std::shared_ptr<const SharedEncodedFrame> frame;
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      cond_.wait(lock, [this]() { return !queue_.empty() || exit_; });
+      if (exit_) {
+        break;
+      }
+      frame = queue_.front();
+      queue_.pop_front();
+    }
+    videoSender_->sendEncodedVideoImage(frame->buffer.get(), frame->length, frame->info);
+  }
+}
+
+static bool parseVideoCodec(const std::string& name, agora::rtc::VIDEO_CODEC_TYPE& codecType) {
+  if (name == "h264") {
+    codecType = agora::rtc::VIDEO_CODEC_H264;
+  } else if (name == "h265") {
+    codecType = agora::rtc::VIDEO_CODEC_H265;
+  } else if (name == "vp8") {
+    codecType = agora::rtc::VIDEO_CODEC_VP8;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static std::vector<std::string> splitChannelIds(const std::string& channelIds) {
+  std::vector<std::string> result;
+  std::stringstream ss(channelIds);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      result.push_back(item);
+    }
+  }
+  return result;
+}
+
+static bool exitFlag = false;
+static void SignalHandler(int sigNo) { exitFlag = true; }
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("token", &options.appId, "The token for authentication / must");
+  optParser.add_long_opt("channelId", &options.channelId, "Source channel Id / must");
+  optParser.add_long_opt("userId", &options.userId, "User Id / default is 0");
+  optParser.add_long_opt("remoteUserId", &options.remoteUserId,
+                         "The remote user to forward video from / default is all users");
+  optParser.add_long_opt("dstChannelIds", &options.dstChannelIds,
+                         "Comma separated destination channel Ids / must");
+  optParser.add_long_opt("dstUserId", &options.dstUserId,
+                         "User Id in the destination channels, with remoteUserId / default is 0");
+  optParser.add_long_opt("streamtype", &options.streamType, "the stream type, high or low");
+  optParser.add_long_opt("videoCodec", &options.videoCodec,
+                         "Codec of the forwarded stream: h264, h265 or vp8");
+  optParser.add_long_opt("maxQueuedFrames", &options.maxQueuedFrames,
+                         "Frames queued per destination before skipping to the next key frame");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  if (options.appId.empty()) {
+    AG_LOG(ERROR, "Must provide appId!");
+    return -1;
+  }
+
+  if (options.channelId.empty()) {
+    AG_LOG(ERROR, "Must provide channelId!");
+    return -1;
+  }
+
+  std::vector<std::string> dstChannelIds = splitChannelIds(options.dstChannelIds);
+  if (dstChannelIds.empty()) {
+    AG_LOG(ERROR, "Must provide dstChannelIds!");
+    return -1;
+  }
+
+  // Every forwarded user gets its own destination uid
+  if (options.remoteUserId.empty() && !options.dstUserId.empty()) {
+    AG_LOG(ERROR, "dstUserId needs remoteUserId!");
+    return -1;
+  }
+
+  agora::rtc::VIDEO_CODEC_TYPE codecType;
+  if (!parseVideoCodec(options.videoCodec, codecType)) {
+    AG_LOG(ERROR, "Unsupported video codec %s", options.videoCodec.c_str());
+    return -1;
+  }
+
+  std::signal(SIGQUIT, SignalHandler);
+  std::signal(SIGABRT, SignalHandler);
+  std::signal(SIGINT, SignalHandler);
+
+  // Create Agora service
+  auto service = createAndInitAgoraService(false, true, true);
+  if (!service) {
+    AG_LOG(ERROR, "Failed to creating Agora service!");
+    return -1;
+  }
+
+  // Create the source connection which only receives encoded video
+  agora::rtc::RtcConnectionConfiguration ccfg;
+  ccfg.clientRoleType = agora::rtc::CLIENT_ROLE_AUDIENCE;
+  ccfg.autoSubscribeAudio = false;
+  ccfg.autoSubscribeVideo = false;
+  ccfg.enableAudioRecordingOrPlayout = false;
+
+  agora::agora_refptr<agora::rtc::IRtcConnection> connection = service->createRtcConnection(ccfg);
+  if (!connection) {
+    AG_LOG(ERROR, "Failed to creating Agora connection!");
+    return -1;
+  }
+
+  agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory = service->createMediaNodeFactory();
+  if (!factory) {
+    AG_LOG(ERROR, "Failed to create media node factory!");
+    return -1;
+  }
+
+  // A given remote user is brought up in every destination before the source
+  // starts delivering frames, other users as their first frame arrives
+  auto forwarder = std::make_shared<EncodedVideoForwarder>(connection->getLocalUser(), service,
+                                                           factory, options, codecType,
+                                                           dstChannelIds);
+  if (!options.remoteUserId.empty() &&
+      !forwarder->addRoute(strtoul(options.remoteUserId.c_str(), nullptr, 10),
+                           options.dstUserId)) {
+    forwarder->release();
+    return -1;
+  }
+
+  agora::rtc::VideoSubscriptionOptions subscriptionOptions;
+  subscriptionOptions.encodedFrameOnly = true;
+  if (options.streamType == STREAM_TYPE_HIGH) {
+    subscriptionOptions.type = agora::rtc::VIDEO_STREAM_HIGH;
+  } else if (options.streamType == STREAM_TYPE_LOW) {
+    subscriptionOptions.type = agora::rtc::VIDEO_STREAM_LOW;
+  } else {
+    AG_LOG(ERROR, "It is a error stream type");
+    return -1;
+  }
+  if (options.remoteUserId.empty()) {
+    AG_LOG(INFO, "Subscribe streams from all remote users");
+    connection->getLocalUser()->subscribeAllVideo(subscriptionOptions);
+  } else {
+    connection->getLocalUser()->subscribeVideo(options.remoteUserId.c_str(), subscriptionOptions);
+  }
+
+  auto localUserObserver = std::make_shared<SampleLocalUserObserver>(connection->getLocalUser());
+  localUserObserver->setVideoEncodedImageReceiver(forwarder.get());
+
+  if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
+                          options.userId.c_str())) {
+    AG_LOG(ERROR, "Failed to connect to Agora channel!");
+    localUserObserver.reset();
+    forwarder->release();
+    return -1;
+  }
+
+  AG_LOG(INFO, "Start forwarding encoded video to %d channels ...", (int)dstChannelIds.size());
+
+  // Periodically check exit flag, and connect the outputs of newly seen users
+  while (!exitFlag) {
+    forwarder->addPendingRoutes();
+    usleep(10000);
+  }
+
+  if (connection->disconnect()) {
+    AG_LOG(ERROR, "Failed to disconnect from Agora channel!");
+  }
+  localUserObserver.reset();
+  forwarder->release();
+  AG_LOG(INFO, "Disconnected from Agora channels successfully");
+
+  // Destroy Agora connection and related resources
+  forwarder.reset();
+  factory = nullptr;
+  connection = nullptr;
+
+  // Destroy Agora Service
+  service->release();
+  service = nullptr;
+
+  return 0;
+}
@@ -71,19 +71,25 @@
 // Wish you have a great experience with Agora_SDK!
 
 
+#include <chrono>
 #include <csignal>
 #include <cstring>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <unistd.h>
+#include <vector>
 
 #include "IAgoraService.h"
 #include "NGIAgoraRtcConnection.h"
+#include "common/event_reactor.h"
 #include "common/log.h"
 #include "common/opt_parser.h"
 #include "common/sample_common.h"
 #include "common/sample_local_user_observer.h"
+#include "common/stats_collector.h"
+#include "common/file_writer/media_muxers.h"
 
 #include "NGIAgoraAudioTrack.h"
 #include "NGIAgoraLocalUser.h"
@@ -96,8 +102,12 @@
 #define DEFAULT_AUDIO_FILE "received_audio.pcm"
 #define DEFAULT_VIDEO_FILE "received_video.h264"
 #define DEFAULT_FILE_LIMIT (100 * 1024 * 1024)
+#define WAV_FILE_SUFFIX ".wav"
 #define STREAM_TYPE_HIGH "high"
 #define STREAM_TYPE_LOW "low"
+#define DEFAULT_REACTOR_THREADS (2)
+#define REACTOR_QUEUE_AUDIO (0)
+#define REACTOR_QUEUE_VIDEO (1)
 
 struct SampleOptions {
   std::string appId;
@@ -107,6 +117,9 @@ struct SampleOptions {
   std::string streamType = STREAM_TYPE_HIGH;
   std::string audioFile = DEFAULT_AUDIO_FILE;
   std::string videoFile = DEFAULT_VIDEO_FILE;
+  int reactorThreads = DEFAULT_REACTOR_THREADS;
+  int statsPort = 0;
+  std::string statsJson;
 
   struct {
     int sampleRate = DEFAULT_SAMPLE_RATE;
@@ -116,8 +129,9 @@ struct SampleOptions {
 
 class PcmFrameObserver : public agora::media::IAudioFrameObserverBase {
  public:
-  PcmFrameObserver(const std::string& outputFilePath)
+  PcmFrameObserver(const std::string& outputFilePath, EventReactor* reactor)
       : outputFilePath_(outputFilePath),
+        reactor_(reactor),
         pcmFile_(nullptr),
         fileCount(0),
         fileSize_(0) {}
@@ -142,9 +156,15 @@ class PcmFrameObserver : public agora::media::IAudioFrameObserverBase {
 
   AudioParams getMixedAudioParams() override {return  AudioParams();};
 
+  bool writeSamples(const int16_t* samples, int samplesPerChannel, int channels,
+                    int samplesPerSec);
 
  private:
   std::string outputFilePath_;
+  // writes run here when set, the callback only copies the frame
+  EventReactor* reactor_;
+  // used instead of the raw file if the output path ends in .wav
+  std::unique_ptr<WavMuxer> wavMuxer_;
   FILE* pcmFile_;
   int fileCount;
   int fileSize_;
@@ -152,23 +172,52 @@ class PcmFrameObserver : public agora::media::IAudioFrameObserverBase {
 
 class H264FrameReceiver : public agora::media::IVideoEncodedFrameObserver {
  public:
-  H264FrameReceiver(const std::string& outputFilePath)
-      : outputFilePath_(outputFilePath),
-        h264File_(nullptr),
-        fileCount(0),
-        fileSize_(0) {}
+  H264FrameReceiver(const std::string& outputFilePath, EventReactor* reactor)
+      : outputFilePath_(outputFilePath), reactor_(reactor) {}
 
   bool onEncodedVideoFrameReceived(agora::rtc::uid_t uid, const uint8_t* imageBuffer, size_t length,
                                    const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo)  override;
 
+  bool writeFrame(const uint8_t* imageBuffer, size_t length,
+                  const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo);
+
  private:
   std::string outputFilePath_;
-  FILE* h264File_;
-  int fileCount;
-  int fileSize_;
+  EventReactor* reactor_;
+  // H264/H265 go to an Annex-B file with an index, VP8 to IVF. Files are
+  // rotated at keyframes, so every file plays back on its own.
+  std::unique_ptr<AnnexBMuxer> annexBMuxer_;
+  std::unique_ptr<IvfMuxer> ivfMuxer_;
 };
 
 bool PcmFrameObserver::onPlaybackAudioFrameBeforeMixing(const char* channelId, agora::media::base::user_id_t userId, AudioFrame& audioFrame) {
+  const int16_t* samples = static_cast<const int16_t*>(audioFrame.buffer);
+  if (!reactor_) {
+    return writeSamples(samples, audioFrame.samplesPerChannel, audioFrame.channels,
+                        audioFrame.samplesPerSec);
+  }
+  std::shared_ptr<std::vector<int16_t>> copy = std::make_shared<std::vector<int16_t>>(
+      samples, samples + audioFrame.samplesPerChannel * audioFrame.channels);
+  int channels = audioFrame.channels;
+  int samplesPerSec = audioFrame.samplesPerSec;
+  return reactor_->post(REACTOR_QUEUE_AUDIO, [this, copy, channels, samplesPerSec]() {
+    writeSamples(copy->data(), static_cast<int>(copy->size()) / channels, channels,
+                 samplesPerSec);
+  });
+}
+
+bool PcmFrameObserver::writeSamples(const int16_t* samples, int samplesPerChannel, int channels,
+                                    int samplesPerSec) {
+  if (outputFilePath_.size() > strlen(WAV_FILE_SUFFIX) &&
+      outputFilePath_.compare(outputFilePath_.size() - strlen(WAV_FILE_SUFFIX),
+                              strlen(WAV_FILE_SUFFIX), WAV_FILE_SUFFIX) == 0) {
+    if (!wavMuxer_) {
+      wavMuxer_.reset(new WavMuxer(outputFilePath_, samplesPerSec, channels,
+                                   DEFAULT_FILE_LIMIT));
+    }
+    return wavMuxer_->writeSamples(samples, samplesPerChannel);
+  }
+
   // Create new file to save received PCM samples
   if (!pcmFile_) {
     std::string fileName = (++fileCount > 1)
@@ -185,8 +234,8 @@ bool PcmFrameObserver::onPlaybackAudioFrameBeforeMixing(const char* channelId, a
 
   // Write PCM samples
   size_t writeBytes =
-      audioFrame.samplesPerChannel * audioFrame.channels * sizeof(int16_t);
-  if (fwrite(audioFrame.buffer, 1, writeBytes, pcmFile_) != writeBytes) {
+      samplesPerChannel * channels * sizeof(int16_t);
+  if (fwrite(samples, 1, writeBytes, pcmFile_) != writeBytes) {
     AG_LOG(ERROR, "Error writing decoded audio data: %s", std::strerror(errno));
     return false;
   }
@@ -203,37 +252,50 @@ bool PcmFrameObserver::onPlaybackAudioFrameBeforeMixing(const char* channelId, a
 
 bool H264FrameReceiver::onEncodedVideoFrameReceived(agora::rtc::uid_t uid, const uint8_t* imageBuffer, size_t length,
                                    const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo) {
-  // Create new file to save received H264 frames
-  if (!h264File_) {
-    std::string fileName = (++fileCount > 1)
-                               ? (outputFilePath_ + to_string(fileCount))
-                               : outputFilePath_;
-    if (!(h264File_ = fopen(fileName.c_str(), "w+"))) {
-      AG_LOG(ERROR, "Failed to create received video file %s",
-             fileName.c_str());
-      return false;
-    }
-    AG_LOG(INFO, "Created file %s to save received H264 frames",
-           fileName.c_str());
+  if (!reactor_) {
+    return writeFrame(imageBuffer, length, videoEncodedFrameInfo);
   }
+  std::shared_ptr<std::vector<uint8_t>> copy =
+      std::make_shared<std::vector<uint8_t>>(imageBuffer, imageBuffer + length);
+  agora::rtc::EncodedVideoFrameInfo info = videoEncodedFrameInfo;
+  return reactor_->post(REACTOR_QUEUE_VIDEO,
+                        [this, copy, info]() { writeFrame(copy->data(), copy->size(), info); });
+}
 
-  if (fwrite(imageBuffer, 1, length, h264File_) != length) {
-    AG_LOG(ERROR, "Error writing h264 data: %s", std::strerror(errno));
-    return false;
+bool H264FrameReceiver::writeFrame(
+    const uint8_t* imageBuffer, size_t length,
+    const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo) {
+  bool isKeyFrame = videoEncodedFrameInfo.frameType == agora::rtc::VIDEO_FRAME_TYPE_KEY_FRAME;
+  int64_t timestampMs = videoEncodedFrameInfo.captureTimeMs;
+  if (!timestampMs) {
+    timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
   }
-  fileSize_ += length;
 
-  // Close the file if size limit is reached
-  if (fileSize_ >= DEFAULT_FILE_LIMIT) {
-    fclose(h264File_);
-    h264File_ = nullptr;
-    fileSize_ = 0;
+  if (videoEncodedFrameInfo.codecType == agora::rtc::VIDEO_CODEC_VP8) {
+    if (!ivfMuxer_) {
+      ivfMuxer_.reset(new IvfMuxer(outputFilePath_, "VP80", DEFAULT_FILE_LIMIT));
+    }
+    return ivfMuxer_->writeFrame(imageBuffer, length, isKeyFrame, timestampMs,
+                                 videoEncodedFrameInfo.width, videoEncodedFrameInfo.height);
   }
-  return true;
+
+  if (!annexBMuxer_) {
+    annexBMuxer_.reset(new AnnexBMuxer(outputFilePath_, DEFAULT_FILE_LIMIT));
+  }
+  return annexBMuxer_->writeFrame(imageBuffer, length, isKeyFrame, timestampMs);
 }
 
 static bool exitFlag = false;
-static void SignalHandler(int sigNo) { exitFlag = true; }
+// wakes the main thread as soon as a signal comes in
+static EventReactor* signalReactor = nullptr;
+static void SignalHandler(int sigNo) {
+  exitFlag = true;
+  if (signalReactor) {
+    signalReactor->requestStop();
+  }
+}
 
 int main(int argc, char* argv[]) {
   SampleOptions options;
@@ -252,6 +314,13 @@ int main(int argc, char* argv[]) {
   optParser.add_long_opt("numOfChannels", &options.audio.numOfChannels,
                          "Number of channels for received audio");
   optParser.add_long_opt("streamtype", &options.streamType, "the stream  type");
+  optParser.add_long_opt("reactorThreads", &options.reactorThreads,
+                         "Threads writing the received files, 0 to write them in the SDK "
+                         "callbacks / default is 2");
+  optParser.add_long_opt("statsPort", &options.statsPort,
+                         "Serve remote track stats for Prometheus on this local port");
+  optParser.add_long_opt("statsJson", &options.statsJson,
+                         "Write remote track stats to this JSON file every 10 s");
 
   if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
     std::ostringstream strStream;
@@ -270,6 +339,18 @@ int main(int argc, char* argv[]) {
     return -1;
   }
 
+  // Audio goes first, it has the tighter callback budget
+  EventReactorConfig reactorConfig;
+  reactorConfig.workerThreads = options.reactorThreads;
+  EventReactor reactor(reactorConfig);
+  reactor.addQueue(REACTOR_QUEUE_AUDIO, EVENT_PRIORITY_HIGH);
+  reactor.addQueue(REACTOR_QUEUE_VIDEO, EVENT_PRIORITY_NORMAL);
+  if (!reactor.start()) {
+    return -1;
+  }
+  EventReactor* writeReactor = options.reactorThreads > 0 ? &reactor : nullptr;
+  signalReactor = &reactor;
+
   std::signal(SIGQUIT, SignalHandler);
   std::signal(SIGABRT, SignalHandler);
   std::signal(SIGINT, SignalHandler);
@@ -317,6 +398,23 @@ int main(int argc, char* argv[]) {
                                                subscriptionOptions);
   }
 
+  // Create local user observer
+  auto localUserObserver =
+      std::make_shared<SampleLocalUserObserver>(connection->getLocalUser());
+
+  // Bitrate, loss, delay and freezes of every remote track, attached before
+  // connecting so no callback sees it change
+  StatsCollectorConfig statsConfig;
+  statsConfig.prometheusPort = options.statsPort;
+  statsConfig.jsonFile = options.statsJson;
+  StatsCollector stats(statsConfig);
+  if (options.statsPort > 0 || !options.statsJson.empty()) {
+    if (!stats.start()) {
+      return -1;
+    }
+    stats.attach(options.channelId, nullptr, localUserObserver.get());
+  }
+
   // Connect to Agora channel
   if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
                           options.userId.c_str())) {
@@ -324,12 +422,8 @@ int main(int argc, char* argv[]) {
     return -1;
   }
 
-  // Create local user observer
-  auto localUserObserver =
-      std::make_shared<SampleLocalUserObserver>(connection->getLocalUser());
-
   // Register audio frame observer to receive audio stream
-  auto pcmFrameObserver = std::make_shared<PcmFrameObserver>(options.audioFile);
+  auto pcmFrameObserver = std::make_shared<PcmFrameObserver>(options.audioFile, writeReactor);
   if (connection->getLocalUser()->setPlaybackAudioFrameBeforeMixingParameters(
           options.audio.numOfChannels, options.audio.sampleRate)) {
     AG_LOG(ERROR, "Failed to set audio frame parameters!");
@@ -339,27 +433,39 @@ int main(int argc, char* argv[]) {
 
   // Register h264 frame receiver to receive video stream
   auto h264FrameReceiver =
-      std::make_shared<H264FrameReceiver>(options.videoFile);
+      std::make_shared<H264FrameReceiver>(options.videoFile, writeReactor);
   localUserObserver->setVideoEncodedImageReceiver(h264FrameReceiver.get());
 
   // Start receiving incoming media data
   AG_LOG(INFO, "Start receiving audio & video data ...");
 
-  // Periodically check exit flag
-  while (!exitFlag) {
-    usleep(10000);
-  }
+  // Block until a signal stops the reactor
+  reactor.wait();
 
   // Unregister audio & video frame observers
   localUserObserver->unsetAudioFrameObserver();
   localUserObserver->unsetVideoFrameObserver();
 
+  // Write out everything still queued
+  reactor.stop();
+  signalReactor = nullptr;
+  if (writeReactor) {
+    EventReactorStats reactorStats = reactor.getStats();
+    AG_LOG(INFO,
+           "Reactor wrote %llu of %llu frames in %llu batches, dropped %llu, deepest queue %zu",
+           (unsigned long long)reactorStats.ranEvents,
+           (unsigned long long)reactorStats.postedEvents,
+           (unsigned long long)reactorStats.batches,
+           (unsigned long long)reactorStats.droppedEvents, reactorStats.maxQueueDepth);
+  }
+
   // Disconnect from Agora channel
   if (connection->disconnect()) {
     AG_LOG(ERROR, "Failed to disconnect from Agora channel!");
     return -1;
   }
   AG_LOG(INFO, "Disconnected from Agora channel successfully");
+  stats.stop();
 
   // Destroy Agora connection and related resources
   localUserObserver.reset();
@@ -65,6 +65,7 @@
 // Wish you have a great experience with Agora_SDK!
 
 
+#include <algorithm>
 #include <csignal>
 #include <cstring>
 #include <sstream>
@@ -73,13 +74,18 @@
 
 #include "IAgoraService.h"
 #include "NGIAgoraRtcConnection.h"
+#include "common/abr_controller.h"
+#include "common/encoded_video_send_queue.h"
+#include "common/file_parser/helper_h264_ladder.h"
 #include "common/file_parser/helper_h264_parser.h"
+#include "common/file_writer/send_capture_writer.h"
 #include "common/helper.h"
 #include "common/log.h"
 #include "common/opt_parser.h"
 #include "common/sample_common.h"
 #include "common/sample_connection_observer.h"
 #include "common/sample_local_user_observer.h"
+#include "common/startup_profiler.h"
 
 #include "NGIAgoraAudioTrack.h"
 #include "NGIAgoraLocalUser.h"
@@ -93,6 +99,9 @@
 #define DEFAULT_FRAME_RATE (30)
 #define DEFAULT_AUDIO_FILE "test_data/send_audio_16k_1ch.pcm"
 #define DEFAULT_VIDEO_FILE "test_data/send_video.h264"
+// What the send queue may spend at once above the ABR budget
+#define SEND_QUEUE_BURST_MS (200)
+#define SEND_QUEUE_STATS_INTERVAL_MS (5000)
 
 struct SampleOptions {
   std::string appId;
@@ -101,6 +110,13 @@ struct SampleOptions {
   std::string audioFile = DEFAULT_AUDIO_FILE;
   std::string videoFile = DEFAULT_VIDEO_FILE;
   std::string localIP;
+  std::string captureFile;
+  // "file@bps,..." renditions to switch between, instead of videoFile
+  std::string abrLadder;
+  int abrHoldMs = AbrControllerConfig().upSwitchHoldMs;
+  // 0 sends every frame inline
+  int sendQueueMs = 0;
+  bool fastStart = false;
   struct {
     int sampleRate = DEFAULT_SAMPLE_RATE;
     int numOfChannels = DEFAULT_NUM_OF_CHANNELS;
@@ -112,7 +128,8 @@ struct SampleOptions {
 };
 
 static void sendOnePcmFrame(const SampleOptions& options,
-                            agora::agora_refptr<agora::rtc::IAudioPcmDataSender> audioFrameSender) {
+                            agora::agora_refptr<agora::rtc::IAudioPcmDataSender> audioFrameSender,
+                            SendCaptureWriter* captureWriter) {
   static FILE* file = nullptr;
   const char* fileName = options.audioFile.c_str();
 
@@ -142,6 +159,10 @@ static void sendOnePcmFrame(const SampleOptions& options,
     return;
   }
 
+  if (captureWriter) {
+    captureWriter->capturePcmAudio(0, frameBuf, samplesPer10ms, agora::rtc::TWO_BYTES_PER_SAMPLE,
+                                   options.audio.numOfChannels, options.audio.sampleRate);
+  }
   if (audioFrameSender->sendAudioPcmData(frameBuf, 0,0, samplesPer10ms,  agora::rtc::TWO_BYTES_PER_SAMPLE,
                                          options.audio.numOfChannels,
                                          options.audio.sampleRate) < 0) {
@@ -151,7 +172,8 @@ static void sendOnePcmFrame(const SampleOptions& options,
 
 static void sendOneH264Frame(
     int frameRate, std::unique_ptr<HelperH264Frame> h264Frame,
-    agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> videoH264FrameSender) {
+    agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> videoH264FrameSender,
+    SendCaptureWriter* captureWriter) {
   agora::rtc::EncodedVideoFrameInfo videoEncodedFrameInfo;
   videoEncodedFrameInfo.rotation = agora::rtc::VIDEO_ORIENTATION_0;
   videoEncodedFrameInfo.codecType = agora::rtc::VIDEO_CODEC_H264;
@@ -164,6 +186,10 @@ static void sendOneH264Frame(
            reinterpret_cast<uint8_t*>(h264Frame.get()->buffer.get()), h264Frame.get()->bufferLen,
            videoEncodedFrameInfo.frameType); */
 
+  if (captureWriter) {
+    captureWriter->captureEncodedVideo(0, h264Frame.get()->buffer.get(), h264Frame.get()->bufferLen,
+                                       videoEncodedFrameInfo);
+  }
   videoH264FrameSender->sendEncodedVideoImage(
       reinterpret_cast<uint8_t*>(h264Frame.get()->buffer.get()), h264Frame.get()->bufferLen,
       videoEncodedFrameInfo);
@@ -171,12 +197,13 @@ static void sendOneH264Frame(
 
 static void SampleSendAudioTask(
     const SampleOptions& options,
-    agora::agora_refptr<agora::rtc::IAudioPcmDataSender> audioFrameSender, bool& exitFlag) {
+    agora::agora_refptr<agora::rtc::IAudioPcmDataSender> audioFrameSender,
+    SendCaptureWriter* captureWriter, bool& exitFlag) {
   // Currently only 10 ms PCM frame is supported. So PCM frames are sent at 10 ms interval
   PacerInfo pacer = {0, 10,0, std::chrono::steady_clock::now()};
 
   while (!exitFlag) {
-    sendOnePcmFrame(options, audioFrameSender);
+    sendOnePcmFrame(options, audioFrameSender, captureWriter);
     waitBeforeNextSend(pacer);  // sleep for a while before sending next frame
   }
 }
@@ -184,20 +211,95 @@ static void SampleSendAudioTask(
 static void SampleSendVideoH264Task(
     const SampleOptions& options,
     agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> videoH264FrameSender,
-    bool& exitFlag) {
-  std::unique_ptr<HelperH264FileParser> h264FileParser(
-      new HelperH264FileParser(options.videoFile.c_str()));
-  h264FileParser->initialize();
+    HelperH264Ladder* ladder, AbrController* abr, EncodedVideoSendQueue* sendQueue,
+    SendCaptureWriter* captureWriter, bool& exitFlag) {
+  std::unique_ptr<HelperH264FileParser> h264FileParser;
+  if (!ladder) {
+    h264FileParser.reset(new HelperH264FileParser(options.videoFile.c_str()));
+    h264FileParser->initialize();
+    // keyframes are looked up by frame number to answer intra requests
+    if (sendQueue) {
+      h264FileParser->buildIndex();
+    }
+  }
 
   // Calculate send interval based on frame rate. H264 frames are sent at this interval
   PacerInfo pacer = {0, 1000 / options.video.frameRate, 0, std::chrono::steady_clock::now()};
 
   while (!exitFlag) {
-    if (auto h264Frame = h264FileParser->getH264Frame()) {
-      sendOneH264Frame(options.video.frameRate, std::move(h264Frame), videoH264FrameSender);
+    // the rest of the GOP is useless to a receiver that asked for a keyframe
+    if (sendQueue && sendQueue->takeKeyFrameRequest()) {
+      if (ladder) {
+        ladder->skipToKeyFrame();
+      } else {
+        h264FileParser->seekToNextKeyFrame();
+      }
+    }
+    // the ladder follows the uplink estimate, switching at the next keyframe
+    if (auto h264Frame = ladder ? ladder->getH264Frame(abr->level())
+                                : h264FileParser->getH264Frame()) {
+      if (sendQueue) {
+        sendQueue->push(std::move(h264Frame));
+      } else {
+        sendOneH264Frame(options.video.frameRate, std::move(h264Frame), videoH264FrameSender,
+                         captureWriter);
+      }
       waitBeforeNextSend(pacer);  // sleep for a while before sending next frame
     }
   };
+  if (sendQueue) {
+    sendQueue->close();
+  }
+}
+
+// Sends what SampleSendVideoH264Task queued. With ABR the frames are paced to
+// the budget like a token bucket, so a congested uplink shows up as queue
+// latency, where it is bounded by dropping GOPs, rather than as loss.
+static void SampleDrainVideoQueueTask(
+    const SampleOptions& options,
+    agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> videoH264FrameSender,
+    EncodedVideoSendQueue* sendQueue, AbrController* abr, SendCaptureWriter* captureWriter,
+    bool& exitFlag) {
+  auto lastRefill = std::chrono::steady_clock::now();
+  auto lastStats = lastRefill;
+  double tokens = 0;
+
+  while (!exitFlag) {
+    std::unique_ptr<HelperH264Frame> h264Frame = sendQueue->pop(100);
+    if (h264Frame && abr) {
+      // a keyframe may take the budget below zero, later frames wait for it
+      while (!exitFlag) {
+        auto now = std::chrono::steady_clock::now();
+        double bytesPerMs = abr->budgetBps() / 8000.0;
+        tokens += std::chrono::duration<double, std::milli>(now - lastRefill).count() * bytesPerMs;
+        tokens = std::min(tokens, SEND_QUEUE_BURST_MS * bytesPerMs);
+        lastRefill = now;
+        if (tokens >= 0) {
+          break;
+        }
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(static_cast<int64_t>(-tokens / bytesPerMs * 1000) + 1));
+      }
+      tokens -= h264Frame->bufferLen;
+    }
+    if (h264Frame) {
+      sendOneH264Frame(options.video.frameRate, std::move(h264Frame), videoH264FrameSender,
+                       captureWriter);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastStats >= std::chrono::milliseconds(SEND_QUEUE_STATS_INTERVAL_MS)) {
+      lastStats = now;
+      EncodedVideoSendQueueStats stats = sendQueue->getStats();
+      AG_LOG(INFO,
+             "Send queue: %d frames / %d ms queued, sent %llu of %llu, dropped %llu disposable "
+             "and %llu in GOPs, %llu keyframe jumps",
+             stats.queuedFrames, stats.queuedLatencyMs, (unsigned long long)stats.sentFrames,
+             (unsigned long long)stats.pushedFrames,
+             (unsigned long long)stats.droppedDisposableFrames,
+             (unsigned long long)stats.droppedGopFrames, (unsigned long long)stats.keyFrameJumps);
+    }
+  }
 }
 
 static bool exitFlag = false;
@@ -224,6 +326,21 @@ int main(int argc, char* argv[]) {
                          "show or hide bandwidth estimation info");
   optParser.add_long_opt("localIP", &options.localIP,
                          "Local IP");
+  optParser.add_long_opt("captureFile", &options.captureFile,
+                         "Log every sent frame to this file for sample_replay_capture");
+  optParser.add_long_opt("abrLadder", &options.abrLadder,
+                         "H.264 renditions of one video as file@bps,file@bps,... to switch "
+                         "between at keyframes as the uplink estimate changes");
+  optParser.add_long_opt("abrHoldMs", &options.abrHoldMs,
+                         "How long (ms) the estimate must allow a higher rendition before "
+                         "switching up / default is 5000");
+  optParser.add_long_opt("sendQueueMs", &options.sendQueueMs,
+                         "Send video from a queue that drops frames by GOP once they are this "
+                         "many ms late, and jumps to a keyframe on intra requests / default is "
+                         "0, frames are sent inline");
+  optParser.add_long_opt("fastStart", &options.fastStart,
+                         "Set up the SDK log file and verify the license while connecting, "
+                         "and log where startup time went");
 
   if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
     std::ostringstream strStream;
@@ -247,6 +364,7 @@ int main(int argc, char* argv[]) {
   std::signal(SIGINT, SignalHandler);
 
   // Create Agora service
+  setAgoraServiceFastStart(options.fastStart);
   auto service = createAndInitAgoraService(false, true, true);
   if (!service) {
     AG_LOG(ERROR, "Failed to creating Agora service!");
@@ -274,25 +392,63 @@ int main(int argc, char* argv[]) {
   auto connObserver = std::make_shared<SampleConnectionObserver>();
   connection->registerObserver(connObserver.get());
 
+  // Renditions are indexed before connecting, a bad ladder fails early
+  std::unique_ptr<HelperH264Ladder> ladder;
+  std::unique_ptr<AbrController> abr;
+  if (!options.abrLadder.empty()) {
+    std::vector<HelperH264Rendition> renditions;
+    if (!HelperH264Ladder::parseRenditions(options.abrLadder, renditions)) {
+      return -1;
+    }
+    ladder.reset(new HelperH264Ladder(renditions));
+    // start low, the estimate takes a few seconds to ramp up
+    if (!ladder->initialize(0)) {
+      return -1;
+    }
+    AbrControllerConfig abrConfig;
+    abrConfig.upSwitchHoldMs = options.abrHoldMs;
+    std::vector<int> bitrates = ladder->bitrates();
+    abr.reset(new AbrController(abrConfig, bitrates, bitrates.front()));
+    AbrController* abrPtr = abr.get();
+    connObserver->setUplinkBitrateCallback(
+        [abrPtr](int targetBitrateBps) { abrPtr->onUplinkEstimate(targetBitrateBps); });
+  }
+
   // Register network observer to monitor bandwidth estimation result
-  if (options.video.showBandwidthEstimation) {
+  if (options.video.showBandwidthEstimation || abr) {
     connection->registerNetworkObserver(connObserver.get());
   }
 
   // Create local user observer to monitor intra frame request
   auto localUserObserver = std::make_shared<SampleLocalUserObserver>(connection->getLocalUser());
 
+  // The send queue answers intra requests, so it is hooked up before connecting
+  std::unique_ptr<EncodedVideoSendQueue> sendQueue;
+  if (options.sendQueueMs > 0) {
+    EncodedVideoSendQueueConfig queueConfig;
+    queueConfig.maxLatencyMs = options.sendQueueMs;
+    sendQueue.reset(new EncodedVideoSendQueue(queueConfig));
+    EncodedVideoSendQueue* queuePtr = sendQueue.get();
+    localUserObserver->setIntraRequestCallback([queuePtr]() { queuePtr->requestKeyFrame(); });
+  }
+
   // Connect to Agora channel
+  auto connectStart = std::chrono::steady_clock::now();
   if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
                           options.userId.c_str())) {
     AG_LOG(ERROR, "Failed to connect to Agora channel!");
     return -1;
   }
 
-  // Create media node factory
-  agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory = service->createMediaNodeFactory();
+  // Create media node factory, while the SDK connects
+  agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory;
+  {
+    StartupProfiler::Scope phase("createMediaNodeFactory");
+    factory = service->createMediaNodeFactory();
+  }
   if (!factory) {
     AG_LOG(ERROR, "Failed to create media node factory!");
+    return -1;
   }
 
   // Create audio data sender
@@ -333,8 +489,18 @@ int main(int argc, char* argv[]) {
   connection->getLocalUser()->publishAudio(customAudioTrack);
   connection->getLocalUser()->publishVideo(customVideoTrack);
 
+  // With fast start the log file is set up and the license verified while connecting
+  if (finishAgoraServiceStartup() != 0) {
+    return -1;
+  }
+
   // Wait until connected before sending media stream
   connObserver->waitUntilConnected(DEFAULT_CONNECT_TIMEOUT_MS);
+  StartupProfiler::instance().record("connect", connectStart, std::chrono::steady_clock::now(),
+                                     false);
+  if (options.fastStart) {
+    StartupProfiler::instance().report();
+  }
 
   if (!options.localIP.empty()) {
     std::string ip;
@@ -342,14 +508,32 @@ int main(int argc, char* argv[]) {
     AG_LOG(INFO, "Local IP:%s", ip.c_str());
   }
 
+  // Optionally log what is sent, to replay it later
+  std::unique_ptr<SendCaptureWriter> captureWriter;
+  if (!options.captureFile.empty()) {
+    captureWriter.reset(new SendCaptureWriter(options.captureFile));
+  }
+
   // Start sending media data
   AG_LOG(INFO, "Start sending audio & video data ...");
-  std::thread sendAudioThread(SampleSendAudioTask, options, audioFrameSender, std::ref(exitFlag));
-  std::thread sendVideoThread(SampleSendVideoH264Task, options, videoFrameSender,
+  std::thread sendAudioThread(SampleSendAudioTask, options, audioFrameSender, captureWriter.get(),
+                              std::ref(exitFlag));
+  std::thread drainVideoThread;
+  if (sendQueue) {
+    drainVideoThread = std::thread(SampleDrainVideoQueueTask, options, videoFrameSender,
+                                   sendQueue.get(), abr.get(), captureWriter.get(),
+                                   std::ref(exitFlag));
+  }
+  std::thread sendVideoThread(SampleSendVideoH264Task, options, videoFrameSender, ladder.get(),
+                              abr.get(), sendQueue.get(), captureWriter.get(),
                               std::ref(exitFlag));
 
   sendAudioThread.join();
   sendVideoThread.join();
+  if (drainVideoThread.joinable()) {
+    drainVideoThread.join();
+  }
+  captureWriter.reset();
 
   // Unpublish audio & video track
   connection->getLocalUser()->unpublishAudio(customAudioTrack);
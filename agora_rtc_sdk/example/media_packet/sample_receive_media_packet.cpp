@@ -0,0 +1,208 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Receive the media packets of the remote tracks as they were sent, and
+//  forward them over UDP, e.g. back to a gateway, without decoding.
+//
+
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "IAgoraService.h"
+#include "NGIAgoraRtcConnection.h"
+#include "common/helper.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/sample_common.h"
+#include "common/sample_connection_observer.h"
+#include "common/sample_local_user_observer.h"
+#include "common/udp_packet_io.h"
+
+#include "NGIAgoraAudioTrack.h"
+#include "NGIAgoraLocalUser.h"
+#include "NGIAgoraMediaNodeFactory.h"
+#include "NGIAgoraMediaNode.h"
+#include "NGIAgoraVideoTrack.h"
+
+#define DEFAULT_CONNECT_TIMEOUT_MS (3000)
+#define DEFAULT_FORWARD_ADDRESS "127.0.0.1"
+#define DEFAULT_STATS_INTERVAL_MS (5000)
+
+struct SampleOptions {
+  std::string appId;
+  std::string channelId;
+  std::string userId;
+  std::string remoteUserId;
+  std::string forwardAddress = DEFAULT_FORWARD_ADDRESS;
+  int audioPort = 0;
+  int videoPort = 0;
+};
+
+// Forwards on the SDK thread, sendto does not block on UDP
+class MediaPacketForwarder : public agora::rtc::IMediaPacketReceiver {
+ public:
+  explicit MediaPacketForwarder(const char* name) : name_(name) {}
+
+  bool open(const std::string& address, int port) {
+    return port == 0 || sink_.open(address, port);
+  }
+
+  bool onMediaPacketReceived(const uint8_t* packet, size_t length,
+                             const agora::media::base::PacketOptions& options) override {
+    ++packets_;
+    bytes_ += length;
+    last_timestamp_ = options.timestamp;
+    if (sink_.isOpen() && sink_.send(packet, length) != 0) {
+      ++failed_;
+    }
+    return true;
+  }
+
+  void logStats() {
+    AG_LOG(INFO, "%s: received %llu packets %llu bytes, forward failed %llu, last timestamp %u",
+           name_, (unsigned long long)packets_.load(), (unsigned long long)bytes_.load(),
+           (unsigned long long)failed_.load(), last_timestamp_.load());
+  }
+
+ private:
+  const char* name_;
+  UdpPacketSink sink_;
+  std::atomic<uint64_t> packets_{0};
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint64_t> failed_{0};
+  std::atomic<uint32_t> last_timestamp_{0};
+};
+
+static bool exitFlag = false;
+static void SignalHandler(int sigNo) { exitFlag = true; }
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("token", &options.appId, "The token for authentication / must");
+  optParser.add_long_opt("channelId", &options.channelId, "Channel Id / must");
+  optParser.add_long_opt("userId", &options.userId, "User Id / default is 0");
+  optParser.add_long_opt("remoteUserId", &options.remoteUserId,
+                         "The remote user to receive stream from / must");
+  optParser.add_long_opt("forwardAddress", &options.forwardAddress,
+                         "Where the packets are forwarded to / default is 127.0.0.1");
+  optParser.add_long_opt("audioPort", &options.audioPort,
+                         "UDP port the audio packets are forwarded to / default is 0, count only");
+  optParser.add_long_opt("videoPort", &options.videoPort,
+                         "UDP port the video packets are forwarded to / default is 0, count only");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  if (options.appId.empty()) {
+    AG_LOG(ERROR, "Must provide appId!");
+    return -1;
+  }
+
+  if (options.channelId.empty()) {
+    AG_LOG(ERROR, "Must provide channelId!");
+    return -1;
+  }
+
+  // One forwarder per media type sends to one port, packets of several users
+  // would be interleaved there
+  if (options.remoteUserId.empty()) {
+    AG_LOG(ERROR, "Must provide remoteUserId!");
+    return -1;
+  }
+
+  std::signal(SIGQUIT, SignalHandler);
+  std::signal(SIGABRT, SignalHandler);
+  std::signal(SIGINT, SignalHandler);
+
+  MediaPacketForwarder audioForwarder("audio");
+  MediaPacketForwarder videoForwarder("video");
+  if (!audioForwarder.open(options.forwardAddress, options.audioPort) ||
+      !videoForwarder.open(options.forwardAddress, options.videoPort)) {
+    return -1;
+  }
+
+  // Create Agora service
+  auto service = createAndInitAgoraService(false, true, true);
+  if (!service) {
+    AG_LOG(ERROR, "Failed to creating Agora service!");
+    return -1;
+  }
+
+  // Create Agora connection, remote tracks deliver media packets instead of
+  // decoded frames
+  agora::rtc::RtcConnectionConfiguration ccfg;
+  ccfg.clientRoleType = agora::rtc::CLIENT_ROLE_AUDIENCE;
+  ccfg.autoSubscribeAudio = false;
+  ccfg.autoSubscribeVideo = false;
+  ccfg.enableAudioRecordingOrPlayout = false;
+  ccfg.audioRecvMediaPacket = true;
+  ccfg.videoRecvMediaPacket = true;
+  agora::agora_refptr<agora::rtc::IRtcConnection> connection = service->createRtcConnection(ccfg);
+  if (!connection) {
+    AG_LOG(ERROR, "Failed to creating Agora connection!");
+    return -1;
+  }
+
+  // Subcribe streams from the remote user
+  agora::rtc::VideoSubscriptionOptions subscriptionOptions;
+  subscriptionOptions.encodedFrameOnly = true;
+  connection->getLocalUser()->subscribeAudio(options.remoteUserId.c_str());
+  connection->getLocalUser()->subscribeVideo(options.remoteUserId.c_str(), subscriptionOptions);
+
+  // Register connection observer to monitor connection event
+  auto connObserver = std::make_shared<SampleConnectionObserver>();
+  connection->registerObserver(connObserver.get());
+
+  // Register the packet receivers on the remote tracks as they come
+  auto localUserObserver = std::make_shared<SampleLocalUserObserver>(connection->getLocalUser());
+  localUserObserver->setMediaPacketReceivers(&audioForwarder, &videoForwarder);
+
+  // Connect to Agora channel
+  if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
+                          options.userId.c_str())) {
+    AG_LOG(ERROR, "Failed to connect to Agora channel!");
+    return -1;
+  }
+
+  int64_t elapsedMs = 0;
+  while (!exitFlag) {
+    usleep(10000);
+    elapsedMs += 10;
+    if (elapsedMs % DEFAULT_STATS_INTERVAL_MS == 0) {
+      audioForwarder.logStats();
+      videoForwarder.logStats();
+    }
+  }
+
+  localUserObserver->unsetMediaPacketReceivers();
+
+  // Unregister connection observer
+  connection->unregisterObserver(connObserver.get());
+
+  // Disconnect from Agora channel
+  if (connection->disconnect()) {
+    AG_LOG(ERROR, "Failed to disconnect from Agora channel!");
+    return -1;
+  }
+  AG_LOG(INFO, "Disconnected from Agora channel successfully");
+
+  // Destroy Agora connection and related resources
+  localUserObserver.reset();
+  connObserver.reset();
+  connection = nullptr;
+
+  // Destroy Agora Service
+  service->release();
+  service = nullptr;
+
+  return 0;
+}
@@ -0,0 +1,343 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Publish already packetized media, e.g. RTP from an upstream gateway, as
+//  custom packet tracks. Packets received on the UDP ports are handed to the
+//  media packet senders as they are, without depacketizing them into frames.
+//
+
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IAgoraService.h"
+#include "NGIAgoraRtcConnection.h"
+#include "common/helper.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/sample_common.h"
+#include "common/sample_connection_observer.h"
+#include "common/sample_local_user_observer.h"
+#include "common/udp_packet_io.h"
+
+#include "NGIAgoraAudioTrack.h"
+#include "NGIAgoraLocalUser.h"
+#include "NGIAgoraMediaNodeFactory.h"
+#include "NGIAgoraMediaNode.h"
+#include "NGIAgoraVideoTrack.h"
+
+#define DEFAULT_CONNECT_TIMEOUT_MS (3000)
+#define DEFAULT_LISTEN_ADDRESS "127.0.0.1"
+#define DEFAULT_BATCH_SIZE (32)
+#define DEFAULT_STATS_INTERVAL_MS (5000)
+#define STUB_AUDIO_PAYLOAD_SIZE (160)
+#define STUB_VIDEO_PAYLOAD_SIZE (1200)
+#define STUB_VIDEO_PACKETS_PER_FRAME (8)
+#define STUB_VIDEO_FRAME_RATE (25)
+
+struct SampleOptions {
+  std::string appId;
+  std::string channelId;
+  std::string userId;
+  std::string listenAddress = DEFAULT_LISTEN_ADDRESS;
+  int audioPort = 0;
+  int videoPort = 0;
+  int batchSize = DEFAULT_BATCH_SIZE;
+  bool stubSource = false;
+};
+
+struct PacketSendStats {
+  std::atomic<uint64_t> sent{0};
+  std::atomic<uint64_t> failed{0};
+  // packets that are not RTP and got a local clock timestamp
+  std::atomic<uint64_t> notRtp{0};
+};
+
+static int64_t nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static void sendPacket(agora::rtc::IMediaPacketSender* sender, const uint8_t* data, size_t length,
+                       int clockRate, PacketSendStats& stats) {
+  agora::media::base::PacketOptions options;
+  options.audioLevelIndication = 0;
+  if (!parseRtpTimestamp(data, length, options.timestamp)) {
+    ++stats.notRtp;
+    options.timestamp = static_cast<uint32_t>(nowMs() * (clockRate / 1000));
+  }
+  if (sender->sendMediaPacket(data, length, options) == 0) {
+    ++stats.sent;
+  } else {
+    ++stats.failed;
+  }
+}
+
+static void writeStubRtpHeader(uint8_t* packet, uint8_t payloadType, bool marker, uint16_t seq,
+                               uint32_t timestamp, uint32_t ssrc) {
+  packet[0] = 0x80;
+  packet[1] = (marker ? 0x80 : 0) | payloadType;
+  packet[2] = seq >> 8;
+  packet[3] = seq & 0xff;
+  for (int i = 0; i < 4; ++i) {
+    packet[4 + i] = timestamp >> (24 - 8 * i);
+    packet[8 + i] = ssrc >> (24 - 8 * i);
+  }
+}
+
+// Stands in for the upstream RTP source: 20 ms audio packets and 25 fps
+// video frames of a few packets each, filled with zeros
+static void StubSourceTask(const SampleOptions& options, bool& exitFlag) {
+  UdpPacketSink audioSink;
+  UdpPacketSink videoSink;
+  if (options.audioPort) {
+    audioSink.open(options.listenAddress, options.audioPort);
+  }
+  if (options.videoPort) {
+    videoSink.open(options.listenAddress, options.videoPort);
+  }
+
+  std::vector<uint8_t> packet(12 + STUB_VIDEO_PAYLOAD_SIZE, 0);
+  uint16_t audioSeq = 0;
+  uint16_t videoSeq = 0;
+  uint32_t audioTimestamp = 0;
+  uint32_t videoTimestamp = 0;
+  int tick = 0;
+  PacerInfo pacer = {0, 10, 0, std::chrono::steady_clock::now()};
+  while (!exitFlag) {
+    if (audioSink.isOpen() && tick % 2 == 0) {
+      writeStubRtpHeader(packet.data(), 111, false, audioSeq++, audioTimestamp, 0x1111);
+      audioSink.send(packet.data(), 12 + STUB_AUDIO_PAYLOAD_SIZE);
+      audioTimestamp += 960;
+    }
+    if (videoSink.isOpen() && tick % (100 / STUB_VIDEO_FRAME_RATE) == 0) {
+      for (int i = 0; i < STUB_VIDEO_PACKETS_PER_FRAME; ++i) {
+        writeStubRtpHeader(packet.data(), 96, i == STUB_VIDEO_PACKETS_PER_FRAME - 1,
+                           videoSeq++, videoTimestamp, 0x2222);
+        videoSink.send(packet.data(), packet.size());
+      }
+      videoTimestamp += 90000 / STUB_VIDEO_FRAME_RATE;
+    }
+    ++tick;
+    waitBeforeNextSend(pacer);
+  }
+}
+
+static void logStats(const char* name, const UdpPacketSource& source,
+                     const PacketSendStats& stats) {
+  UdpPacketSourceStats received = source.getStats();
+  AG_LOG(INFO,
+         "%s: received %llu packets %llu bytes in %llu batches (%.1f per batch), truncated "
+         "%llu, sent %llu, failed %llu, not RTP %llu",
+         name, (unsigned long long)received.packets, (unsigned long long)received.bytes,
+         (unsigned long long)received.batches,
+         received.batches ? static_cast<double>(received.packets) / received.batches : 0.0,
+         (unsigned long long)received.truncated, (unsigned long long)stats.sent.load(),
+         (unsigned long long)stats.failed.load(), (unsigned long long)stats.notRtp.load());
+}
+
+static bool exitFlag = false;
+static void SignalHandler(int sigNo) { exitFlag = true; }
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("token", &options.appId, "The token for authentication / must");
+  optParser.add_long_opt("channelId", &options.channelId, "Channel Id / must");
+  optParser.add_long_opt("userId", &options.userId, "User Id / default is 0");
+  optParser.add_long_opt("listenAddress", &options.listenAddress,
+                         "Address the UDP ports are bound to / default is 127.0.0.1");
+  optParser.add_long_opt("audioPort", &options.audioPort,
+                         "UDP port of the audio packets / default is 0, no audio");
+  optParser.add_long_opt("videoPort", &options.videoPort,
+                         "UDP port of the video packets / default is 0, no video");
+  optParser.add_long_opt("batchSize", &options.batchSize,
+                         "Packets received per system call at most / default is 32");
+  optParser.add_long_opt("stubSource", &options.stubSource,
+                         "Send synthetic RTP to the ports from a local thread");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  if (options.appId.empty()) {
+    AG_LOG(ERROR, "Must provide appId!");
+    return -1;
+  }
+
+  if (options.channelId.empty()) {
+    AG_LOG(ERROR, "Must provide channelId!");
+    return -1;
+  }
+
+  if (!options.audioPort && !options.videoPort) {
+    AG_LOG(ERROR, "Must provide audioPort or videoPort!");
+    return -1;
+  }
+
+  std::signal(SIGQUIT, SignalHandler);
+  std::signal(SIGABRT, SignalHandler);
+  std::signal(SIGINT, SignalHandler);
+
+  // Create Agora service
+  auto service = createAndInitAgoraService(false, true, true);
+  if (!service) {
+    AG_LOG(ERROR, "Failed to creating Agora service!");
+    return -1;
+  }
+
+  // Create Agora connection
+  agora::rtc::RtcConnectionConfiguration ccfg;
+  ccfg.autoSubscribeAudio = false;
+  ccfg.autoSubscribeVideo = false;
+  ccfg.clientRoleType = agora::rtc::CLIENT_ROLE_BROADCASTER;
+  agora::agora_refptr<agora::rtc::IRtcConnection> connection = service->createRtcConnection(ccfg);
+  if (!connection) {
+    AG_LOG(ERROR, "Failed to creating Agora connection!");
+    return -1;
+  }
+
+  // Register connection observer to monitor connection event
+  auto connObserver = std::make_shared<SampleConnectionObserver>();
+  connection->registerObserver(connObserver.get());
+
+  // Create local user observer
+  auto localUserObserver = std::make_shared<SampleLocalUserObserver>(connection->getLocalUser());
+
+  // Create media node factory
+  agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory = service->createMediaNodeFactory();
+  if (!factory) {
+    AG_LOG(ERROR, "Failed to create media node factory!");
+  }
+
+  // One packet sender per track, each fed by its own UDP port
+  agora::agora_refptr<agora::rtc::IMediaPacketSender> audioPacketSender;
+  agora::agora_refptr<agora::rtc::IMediaPacketSender> videoPacketSender;
+  agora::agora_refptr<agora::rtc::ILocalAudioTrack> customAudioTrack;
+  agora::agora_refptr<agora::rtc::ILocalVideoTrack> customVideoTrack;
+  if (options.audioPort) {
+    audioPacketSender = factory->createMediaPacketSender();
+    customAudioTrack = service->createCustomAudioTrack(audioPacketSender);
+    if (!customAudioTrack) {
+      AG_LOG(ERROR, "Failed to create audio track!");
+      return -1;
+    }
+  }
+  if (options.videoPort) {
+    videoPacketSender = factory->createMediaPacketSender();
+    customVideoTrack = service->createCustomVideoTrack(videoPacketSender);
+    if (!customVideoTrack) {
+      AG_LOG(ERROR, "Failed to create video track!");
+      return -1;
+    }
+  }
+
+  // Connect to Agora channel
+  if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
+                          options.userId.c_str())) {
+    AG_LOG(ERROR, "Failed to connect to Agora channel!");
+    return -1;
+  }
+
+  // Publish the tracks
+  if (customAudioTrack) {
+    customAudioTrack->setEnabled(true);
+    localUserObserver->GetLocalUser()->publishAudio(customAudioTrack);
+  }
+  if (customVideoTrack) {
+    customVideoTrack->setEnabled(true);
+    localUserObserver->GetLocalUser()->publishVideo(customVideoTrack);
+  }
+
+  // Wait until connected before forwarding
+  connObserver->waitUntilConnected(DEFAULT_CONNECT_TIMEOUT_MS);
+
+  // The receive threads call the senders directly, nothing is queued or copied
+  PacketSendStats audioStats;
+  PacketSendStats videoStats;
+  UdpPacketSource audioSource(options.listenAddress, options.audioPort, options.batchSize);
+  UdpPacketSource videoSource(options.listenAddress, options.videoPort, options.batchSize);
+  if (options.audioPort) {
+    agora::rtc::IMediaPacketSender* sender = audioPacketSender.get();
+    if (!audioSource.start([sender, &audioStats](const uint8_t* data, size_t length) {
+          sendPacket(sender, data, length, 48000, audioStats);
+        })) {
+      return -1;
+    }
+  }
+  if (options.videoPort) {
+    agora::rtc::IMediaPacketSender* sender = videoPacketSender.get();
+    if (!videoSource.start([sender, &videoStats](const uint8_t* data, size_t length) {
+          sendPacket(sender, data, length, 90000, videoStats);
+        })) {
+      return -1;
+    }
+  }
+
+  std::thread stubThread;
+  if (options.stubSource) {
+    stubThread = std::thread(StubSourceTask, std::cref(options), std::ref(exitFlag));
+  }
+
+  int64_t nextStatsMs = nowMs() + DEFAULT_STATS_INTERVAL_MS;
+  while (!exitFlag) {
+    usleep(10000);
+    if (nowMs() >= nextStatsMs) {
+      nextStatsMs += DEFAULT_STATS_INTERVAL_MS;
+      if (options.audioPort) {
+        logStats("audio", audioSource, audioStats);
+      }
+      if (options.videoPort) {
+        logStats("video", videoSource, videoStats);
+      }
+    }
+  }
+
+  if (stubThread.joinable()) {
+    stubThread.join();
+  }
+  audioSource.stop();
+  videoSource.stop();
+
+  // Unpublish the tracks
+  if (customAudioTrack) {
+    localUserObserver->GetLocalUser()->unpublishAudio(customAudioTrack);
+  }
+  if (customVideoTrack) {
+    localUserObserver->GetLocalUser()->unpublishVideo(customVideoTrack);
+  }
+
+  // Unregister connection observer
+  connection->unregisterObserver(connObserver.get());
+
+  // Disconnect from Agora channel
+  if (connection->disconnect()) {
+    AG_LOG(ERROR, "Failed to disconnect from Agora channel!");
+    return -1;
+  }
+  AG_LOG(INFO, "Disconnected from Agora channel successfully");
+
+  // Destroy Agora connection and related resources
+  connObserver.reset();
+  localUserObserver.reset();
+  audioPacketSender = nullptr;
+  videoPacketSender = nullptr;
+  customAudioTrack = nullptr;
+  customVideoTrack = nullptr;
+  factory = nullptr;
+  connection = nullptr;
+
+  // Destroy Agora Service
+  service->release();
+  service = nullptr;
+
+  return 0;
+}
@@ -0,0 +1,262 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Publish the same PCM and H.264 file into many channels from one process.
+//  Connections come from a warm pool and join in parallel, and the time each
+//  one took to connect and to send its first frame is reported.
+//
+
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IAgoraService.h"
+#include "NGIAgoraRtcConnection.h"
+#include "common/connection_manager.h"
+#include "common/file_parser/helper_h264_parser.h"
+#include "common/helper.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/sample_common.h"
+#include "common/stats_collector.h"
+
+#include "NGIAgoraAudioTrack.h"
+#include "NGIAgoraMediaNodeFactory.h"
+#include "NGIAgoraVideoTrack.h"
+
+#define DEFAULT_SAMPLE_RATE (16000)
+#define DEFAULT_NUM_OF_CHANNELS (1)
+#define DEFAULT_FRAME_RATE (30)
+#define DEFAULT_CHANNEL_COUNT (4)
+#define DEFAULT_PARALLEL_CONNECTS (8)
+#define DEFAULT_REPORT_INTERVAL_MS (10000)
+#define DEFAULT_AUDIO_FILE "test_data/send_audio_16k_1ch.pcm"
+#define DEFAULT_VIDEO_FILE "test_data/send_video.h264"
+
+struct SampleOptions {
+  std::string appId;
+  std::string channelId;
+  std::string userId;
+  std::string audioFile = DEFAULT_AUDIO_FILE;
+  std::string videoFile = DEFAULT_VIDEO_FILE;
+  int channels = DEFAULT_CHANNEL_COUNT;
+  // -1 for one per channel
+  int warmConnections = -1;
+  int parallelConnects = DEFAULT_PARALLEL_CONNECTS;
+  int connectTimeoutMs = ConnectionManagerConfig().connectTimeoutMs;
+  int statsPort = 0;
+  std::string statsJson;
+  struct {
+    int sampleRate = DEFAULT_SAMPLE_RATE;
+    int numOfChannels = DEFAULT_NUM_OF_CHANNELS;
+  } audio;
+  struct {
+    int frameRate = DEFAULT_FRAME_RATE;
+  } video;
+};
+
+static void logReport(ConnectionManager& manager) {
+  ConnectionManagerReport report = manager.getReport();
+  AG_LOG(INFO, "Channels: %d connected (%d warm), %d failed", report.connected, report.warm,
+         report.failed);
+  const LatencyPercentiles& created = report.timeToCreateMs;
+  if (created.count > 0) {
+    AG_LOG(INFO, "Time to create (ms, %d cold channels): p50 %ld, p90 %ld, p99 %ld, max %ld",
+           created.count, static_cast<long>(created.p50), static_cast<long>(created.p90),
+           static_cast<long>(created.p99), static_cast<long>(created.max));
+  }
+  const LatencyPercentiles& connected = report.timeToConnectedMs;
+  AG_LOG(INFO, "Time to connected (ms): p50 %ld, p90 %ld, p99 %ld, max %ld",
+         static_cast<long>(connected.p50), static_cast<long>(connected.p90),
+         static_cast<long>(connected.p99), static_cast<long>(connected.max));
+  const LatencyPercentiles& firstFrame = report.timeToFirstFrameMs;
+  AG_LOG(INFO, "Time to first frame (ms, %d channels): p50 %ld, p90 %ld, p99 %ld, max %ld",
+         firstFrame.count, static_cast<long>(firstFrame.p50), static_cast<long>(firstFrame.p90),
+         static_cast<long>(firstFrame.p99), static_cast<long>(firstFrame.max));
+}
+
+static void SampleSendAudioTask(const SampleOptions& options,
+                                const std::vector<std::shared_ptr<PooledConnection>>& connections,
+                                bool& exitFlag) {
+  int samplesPer10ms = options.audio.sampleRate / 100;
+  int sendBytes = sizeof(int16_t) * options.audio.numOfChannels * samplesPer10ms;
+  std::vector<uint8_t> frameBuf(sendBytes);
+  FILE* file = nullptr;
+
+  // Currently only 10 ms PCM frame is supported. So PCM frames are sent at 10 ms interval
+  PacerInfo pacer = {0, 10, 0, std::chrono::steady_clock::now()};
+  while (!exitFlag) {
+    if (!file && !(file = fopen(options.audioFile.c_str(), "rb"))) {
+      AG_LOG(ERROR, "Failed to open audio file %s", options.audioFile.c_str());
+      return;
+    }
+    if (fread(frameBuf.data(), 1, frameBuf.size(), file) != frameBuf.size()) {
+      fclose(file);
+      file = nullptr;
+      continue;
+    }
+    // every channel gets the same frame
+    for (auto& pooled : connections) {
+      pooled->audioSender->sendAudioPcmData(frameBuf.data(), 0, 0, samplesPer10ms,
+                                            agora::rtc::TWO_BYTES_PER_SAMPLE,
+                                            options.audio.numOfChannels, options.audio.sampleRate);
+    }
+    waitBeforeNextSend(pacer);
+  }
+  if (file) {
+    fclose(file);
+  }
+}
+
+static void SampleSendVideoH264Task(
+    const SampleOptions& options,
+    const std::vector<std::shared_ptr<PooledConnection>>& connections, bool& exitFlag) {
+  HelperH264FileParser h264FileParser(options.videoFile.c_str());
+  if (!h264FileParser.initialize()) {
+    return;
+  }
+
+  // Calculate send interval based on frame rate. H264 frames are sent at this interval
+  PacerInfo pacer = {0, 1000 / options.video.frameRate, 0, std::chrono::steady_clock::now()};
+  while (!exitFlag) {
+    std::unique_ptr<HelperH264Frame> h264Frame = h264FileParser.getH264Frame();
+    if (!h264Frame) {
+      continue;
+    }
+    agora::rtc::EncodedVideoFrameInfo videoEncodedFrameInfo;
+    videoEncodedFrameInfo.rotation = agora::rtc::VIDEO_ORIENTATION_0;
+    videoEncodedFrameInfo.codecType = agora::rtc::VIDEO_CODEC_H264;
+    videoEncodedFrameInfo.framesPerSecond = options.video.frameRate;
+    videoEncodedFrameInfo.frameType = h264Frame->isKeyFrame
+                                          ? agora::rtc::VIDEO_FRAME_TYPE_KEY_FRAME
+                                          : agora::rtc::VIDEO_FRAME_TYPE_DELTA_FRAME;
+    for (auto& pooled : connections) {
+      if (pooled->videoSender->sendEncodedVideoImage(h264Frame->buffer.get(),
+                                                     h264Frame->bufferLen,
+                                                     videoEncodedFrameInfo)) {
+        pooled->markFirstFrameSent();
+      }
+    }
+    waitBeforeNextSend(pacer);
+  }
+}
+
+static bool exitFlag = false;
+static void SignalHandler(int sigNo) { exitFlag = true; }
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("token", &options.appId, "The token for authentication / must");
+  optParser.add_long_opt("channelId", &options.channelId,
+                         "Channel Id prefix, channels are <channelId>_<n> / must");
+  optParser.add_long_opt("userId", &options.userId, "User Id / default is 0");
+  optParser.add_long_opt("audioFile", &options.audioFile,
+                         "The audio file in raw PCM format to be sent");
+  optParser.add_long_opt("videoFile", &options.videoFile,
+                         "The video file in H.264 format to be sent");
+  optParser.add_long_opt("sampleRate", &options.audio.sampleRate,
+                         "Sample rate for the PCM file to be sent");
+  optParser.add_long_opt("numOfChannels", &options.audio.numOfChannels,
+                         "Number of channels for the PCM file to be sent");
+  optParser.add_long_opt("fps", &options.video.frameRate,
+                         "Target frame rate for sending the video stream");
+  optParser.add_long_opt("channels", &options.channels,
+                         "Number of channels to publish into / default is 4");
+  optParser.add_long_opt("warmConnections", &options.warmConnections,
+                         "Connections created before joining / default is one per channel");
+  optParser.add_long_opt("parallelConnects", &options.parallelConnects,
+                         "Joins in flight at once / default is 8");
+  optParser.add_long_opt("connectTimeoutMs", &options.connectTimeoutMs,
+                         "Give up on a channel after this long / default is 3000");
+  optParser.add_long_opt("statsPort", &options.statsPort,
+                         "Serve per channel stats for Prometheus on this local port");
+  optParser.add_long_opt("statsJson", &options.statsJson,
+                         "Write per channel stats to this JSON file every 10 s");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  if (options.appId.empty()) {
+    AG_LOG(ERROR, "Must provide appId!");
+    return -1;
+  }
+
+  if (options.channelId.empty()) {
+    AG_LOG(ERROR, "Must provide channelId!");
+    return -1;
+  }
+
+  std::signal(SIGQUIT, SignalHandler);
+  std::signal(SIGABRT, SignalHandler);
+  std::signal(SIGINT, SignalHandler);
+
+  ConnectionManagerConfig managerConfig;
+  managerConfig.warmConnections =
+      options.warmConnections < 0 ? options.channels : options.warmConnections;
+  managerConfig.maxParallelConnects = options.parallelConnects;
+  managerConfig.connectTimeoutMs = options.connectTimeoutMs;
+
+  // Outlives the manager, which removes channels from it as they go
+  StatsCollectorConfig statsConfig;
+  statsConfig.prometheusPort = options.statsPort;
+  statsConfig.jsonFile = options.statsJson;
+  StatsCollector stats(statsConfig);
+  bool collectStats = options.statsPort > 0 || !options.statsJson.empty();
+  if (collectStats && !stats.start()) {
+    return -1;
+  }
+
+  ConnectionManager manager(managerConfig);
+  if (collectStats) {
+    manager.setStatsCollector(&stats);
+  }
+
+  // Service, factory and warm connections are ready before any join starts
+  if (!manager.initialize()) {
+    return -1;
+  }
+
+  std::vector<ConnectionTarget> targets;
+  for (int i = 0; i < options.channels; ++i) {
+    targets.push_back({options.channelId + "_" + to_string(i), options.userId});
+  }
+  std::vector<std::shared_ptr<PooledConnection>> connections =
+      manager.connectAll(options.appId, targets);
+  if (connections.empty()) {
+    AG_LOG(ERROR, "No channel connected!");
+    return -1;
+  }
+
+  // Start sending media data
+  AG_LOG(INFO, "Start sending audio & video data to %zu channels ...", connections.size());
+  std::thread sendAudioThread(SampleSendAudioTask, options, std::cref(connections),
+                              std::ref(exitFlag));
+  std::thread sendVideoThread(SampleSendVideoH264Task, options, std::cref(connections),
+                              std::ref(exitFlag));
+
+  PacerInfo reportPacer = {0, DEFAULT_REPORT_INTERVAL_MS, 0, std::chrono::steady_clock::now()};
+  while (!exitFlag) {
+    waitBeforeNextSend(reportPacer);
+    logReport(manager);
+  }
+
+  sendAudioThread.join();
+  sendVideoThread.join();
+  logReport(manager);
+
+  // Unpublish, disconnect and release the service
+  connections.clear();
+  manager.disconnectAll();
+  AG_LOG(INFO, "Disconnected from all channels");
+  stats.stop();
+
+  return 0;
+}
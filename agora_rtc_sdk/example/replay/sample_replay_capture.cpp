@@ -0,0 +1,334 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Replay a send capture into a channel at the original timing, faster, or
+//  as fast as the send path takes it.
+//
+
+// Run sample_send_h264_pcm or sample_send_aac with --captureFile to log every
+// frame handed to the SDK, then feed the log back into a channel:
+//
+//   --speed 1      original timing (default)
+//   --speed 2/10   faster, the recorded gaps divided by the speed
+//   --fast         no pacing at all; reports how many frames and bytes per
+//                  second the send path took, as a benchmark
+//
+// One custom track is created per captured track before the replay starts,
+// so every frame goes out on the same kind of track it was captured from.
+
+#include <csignal>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "IAgoraService.h"
+#include "NGIAgoraRtcConnection.h"
+#include "common/file_parser/helper_capture_parser.h"
+#include "common/helper.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/sample_common.h"
+#include "common/sample_connection_observer.h"
+
+#include "NGIAgoraAudioTrack.h"
+#include "NGIAgoraLocalUser.h"
+#include "NGIAgoraMediaNodeFactory.h"
+#include "NGIAgoraMediaNode.h"
+#include "NGIAgoraVideoTrack.h"
+
+#define DEFAULT_CONNECT_TIMEOUT_MS (3000)
+#define DEFAULT_SPEED (1.0)
+#define STATS_INTERVAL_MS (1000)
+
+struct SampleOptions {
+  std::string appId;
+  std::string channelId;
+  std::string userId;
+  std::string captureFile;
+  double speed = DEFAULT_SPEED;
+  bool fast = false;
+  int loops = 1;
+};
+
+struct ReplayTrack {
+  agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> videoSender;
+  agora::agora_refptr<agora::rtc::IAudioPcmDataSender> pcmSender;
+  agora::agora_refptr<agora::rtc::IAudioEncodedFrameSender> audioSender;
+  agora::agora_refptr<agora::rtc::ILocalVideoTrack> videoTrack;
+  agora::agora_refptr<agora::rtc::ILocalAudioTrack> audioTrack;
+};
+
+struct ReplayStats {
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+  uint64_t failures = 0;
+};
+
+static int trackKey(const HelperCaptureRecordHeader& header) {
+  return (header.trackType << 8) | header.trackId;
+}
+
+static bool createReplayTrack(agora::base::IAgoraService* service,
+                              agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory,
+                              const HelperCaptureRecordHeader& header, ReplayTrack& track) {
+  switch (header.trackType) {
+    case CAPTURE_ENCODED_VIDEO: {
+      track.videoSender = factory->createVideoEncodedImageSender();
+      if (!track.videoSender) {
+        return false;
+      }
+      agora::rtc::SenderOptions option;
+      option.ccMode = agora::rtc::TCcMode::CC_ENABLED;
+      track.videoTrack = service->createCustomVideoTrack(track.videoSender, option);
+      return track.videoTrack;
+    }
+    case CAPTURE_PCM_AUDIO:
+      track.pcmSender = factory->createAudioPcmDataSender();
+      if (!track.pcmSender) {
+        return false;
+      }
+      track.audioTrack = service->createCustomAudioTrack(track.pcmSender);
+      return track.audioTrack;
+    case CAPTURE_ENCODED_AUDIO:
+      track.audioSender = factory->createAudioEncodedFrameSender();
+      if (!track.audioSender) {
+        return false;
+      }
+      track.audioTrack =
+          service->createCustomAudioTrack(track.audioSender, agora::base::MIX_DISABLED);
+      return track.audioTrack;
+    default:
+      return false;
+  }
+}
+
+static bool sendRecord(const HelperCaptureRecord& record, ReplayTrack& track) {
+  const HelperCaptureRecordHeader& header = record.header;
+  switch (header.trackType) {
+    case CAPTURE_ENCODED_VIDEO: {
+      agora::rtc::EncodedVideoFrameInfo videoEncodedFrameInfo;
+      videoEncodedFrameInfo.rotation = agora::rtc::VIDEO_ORIENTATION_0;
+      videoEncodedFrameInfo.codecType = static_cast<agora::rtc::VIDEO_CODEC_TYPE>(header.codec);
+      videoEncodedFrameInfo.width = header.width;
+      videoEncodedFrameInfo.height = header.height;
+      videoEncodedFrameInfo.framesPerSecond = header.framesPerSecond;
+      videoEncodedFrameInfo.frameType = (header.flags & CAPTURE_FLAG_KEY_FRAME)
+                                            ? agora::rtc::VIDEO_FRAME_TYPE_KEY_FRAME
+                                            : agora::rtc::VIDEO_FRAME_TYPE_DELTA_FRAME;
+      return track.videoSender->sendEncodedVideoImage(record.buffer, record.bufferLen,
+                                                      videoEncodedFrameInfo);
+    }
+    case CAPTURE_PCM_AUDIO: {
+      size_t samples = header.samplesPerChannel * header.channels;
+      if (!samples) {
+        return false;
+      }
+      return track.pcmSender->sendAudioPcmData(
+                 record.buffer, 0, 0, header.samplesPerChannel,
+                 static_cast<agora::rtc::BYTES_PER_SAMPLE>(record.bufferLen / samples),
+                 header.channels, header.sampleRate) >= 0;
+    }
+    case CAPTURE_ENCODED_AUDIO: {
+      agora::rtc::EncodedAudioFrameInfo audioFrameInfo;
+      audioFrameInfo.codec = static_cast<agora::rtc::AUDIO_CODEC_TYPE>(header.codec);
+      audioFrameInfo.sampleRateHz = header.sampleRate;
+      audioFrameInfo.samplesPerChannel = header.samplesPerChannel;
+      audioFrameInfo.numberOfChannels = header.channels;
+      return track.audioSender->sendEncodedAudioFrame(record.buffer, record.bufferLen,
+                                                      audioFrameInfo);
+    }
+    default:
+      return false;
+  }
+}
+
+static void printStats(const char* prefix, const ReplayStats& stats,
+                       std::chrono::steady_clock::time_point startTime) {
+  double seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - startTime)
+                       .count() /
+                   1e6;
+  if (seconds <= 0) {
+    return;
+  }
+  AG_LOG(INFO, "%s: %llu frames, %.2f MB in %.3f s, %.0f frames/s, %.2f MB/s, %llu send failures",
+         prefix, (unsigned long long)stats.frames, stats.bytes / 1e6, seconds,
+         stats.frames / seconds, stats.bytes / 1e6 / seconds,
+         (unsigned long long)stats.failures);
+}
+
+static bool exitFlag = false;
+static void SignalHandler(int sigNo) { exitFlag = true; }
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("token", &options.appId, "The token for authentication / must");
+  optParser.add_long_opt("channelId", &options.channelId, "Channel Id / must");
+  optParser.add_long_opt("userId", &options.userId, "User Id / default is 0");
+  optParser.add_long_opt("captureFile", &options.captureFile,
+                         "The file written by a sender's --captureFile / must");
+  optParser.add_long_opt("speed", &options.speed, "Replay speed / default is 1.0");
+  optParser.add_long_opt("fast", &options.fast,
+                         "Send as fast as possible and report the throughput");
+  optParser.add_long_opt("loops", &options.loops, "Times to replay the capture / default is 1");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  if (options.appId.empty()) {
+    AG_LOG(ERROR, "Must provide appId!");
+    return -1;
+  }
+
+  if (options.channelId.empty()) {
+    AG_LOG(ERROR, "Must provide channelId!");
+    return -1;
+  }
+
+  if (options.speed <= 0) {
+    AG_LOG(ERROR, "Speed must be positive!");
+    return -1;
+  }
+
+  std::unique_ptr<HelperCaptureFileParser> captureParser(
+      new HelperCaptureFileParser(options.captureFile.c_str()));
+  if (!captureParser->initialize()) {
+    return -1;
+  }
+
+  std::signal(SIGQUIT, SignalHandler);
+  std::signal(SIGABRT, SignalHandler);
+  std::signal(SIGINT, SignalHandler);
+
+  // Create Agora service
+  auto service = createAndInitAgoraService(false, true, true);
+  if (!service) {
+    AG_LOG(ERROR, "Failed to creating Agora service!");
+    return -1;
+  }
+
+  // Create Agora connection
+  agora::rtc::RtcConnectionConfiguration ccfg;
+  ccfg.autoSubscribeAudio = false;
+  ccfg.autoSubscribeVideo = false;
+  ccfg.clientRoleType = agora::rtc::CLIENT_ROLE_BROADCASTER;
+  agora::agora_refptr<agora::rtc::IRtcConnection> connection = service->createRtcConnection(ccfg);
+  if (!connection) {
+    AG_LOG(ERROR, "Failed to creating Agora connection!");
+    return -1;
+  }
+
+  // Register connection observer to monitor connection event
+  auto connObserver = std::make_shared<SampleConnectionObserver>();
+  connection->registerObserver(connObserver.get());
+
+  // Connect to Agora channel
+  if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
+                          options.userId.c_str())) {
+    AG_LOG(ERROR, "Failed to connect to Agora channel!");
+    return -1;
+  }
+
+  // Create media node factory
+  agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory = service->createMediaNodeFactory();
+  if (!factory) {
+    AG_LOG(ERROR, "Failed to create media node factory!");
+    return -1;
+  }
+
+  // One pass over the capture to create and publish every track up front
+  std::map<int, ReplayTrack> tracks;
+  while (auto record = captureParser->getRecord()) {
+    int key = trackKey(record->header);
+    if (tracks.count(key)) {
+      continue;
+    }
+    if (!createReplayTrack(service, factory, record->header, tracks[key])) {
+      AG_LOG(ERROR, "Failed to create track for type %d id %d", record->header.trackType,
+             record->header.trackId);
+      return -1;
+    }
+    AG_LOG(INFO, "Replaying track type %d id %d", record->header.trackType,
+           record->header.trackId);
+  }
+  captureParser->setFileParseRestart();
+
+  for (auto& it : tracks) {
+    if (it.second.videoTrack) {
+      connection->getLocalUser()->publishVideo(it.second.videoTrack);
+    } else {
+      connection->getLocalUser()->publishAudio(it.second.audioTrack);
+    }
+  }
+
+  // Wait until connected before sending media stream
+  connObserver->waitUntilConnected(DEFAULT_CONNECT_TIMEOUT_MS);
+
+  AG_LOG(INFO, "Start replaying %s ...", options.captureFile.c_str());
+  ReplayStats stats;
+  auto startTime = std::chrono::steady_clock::now();
+  auto statsTime = startTime;
+  for (int loop = 0; loop < options.loops && !exitFlag; ++loop) {
+    // every loop starts the timeline over
+    PacerInfo pacer = {0, 0, 0, std::chrono::steady_clock::now()};
+    while (!exitFlag) {
+      auto record = captureParser->getRecord();
+      if (!record) {
+        break;
+      }
+      if (!options.fast) {
+        waitUntilTimestamp(pacer, static_cast<int64_t>(record->header.timestampUs / 1000.0 /
+                                                       options.speed));
+      }
+      if (!sendRecord(*record, tracks[trackKey(record->header)])) {
+        ++stats.failures;
+      }
+      ++stats.frames;
+      stats.bytes += record->bufferLen;
+
+      if (options.fast && std::chrono::steady_clock::now() - statsTime >=
+                              std::chrono::milliseconds(STATS_INTERVAL_MS)) {
+        printStats("Replaying", stats, startTime);
+        statsTime = std::chrono::steady_clock::now();
+      }
+    }
+  }
+  printStats("Replay done", stats, startTime);
+
+  // Unpublish tracks
+  for (auto& it : tracks) {
+    if (it.second.videoTrack) {
+      connection->getLocalUser()->unpublishVideo(it.second.videoTrack);
+    } else {
+      connection->getLocalUser()->unpublishAudio(it.second.audioTrack);
+    }
+  }
+
+  // Unregister connection observer
+  connection->unregisterObserver(connObserver.get());
+
+  // Disconnect from Agora channel
+  if (connection->disconnect()) {
+    AG_LOG(ERROR, "Failed to disconnect from Agora channel!");
+    return -1;
+  }
+  AG_LOG(INFO, "Disconnected from Agora channel successfully");
+
+  // Destroy Agora connection and related resources
+  connObserver.reset();
+  tracks.clear();
+  factory = nullptr;
+  connection = nullptr;
+
+  // Destroy Agora Service
+  service->release();
+  service = nullptr;
+
+  return 0;
+}
@@ -0,0 +1,412 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Push pre-encoded H.264 and AAC to one or more RTMP servers without
+//  transcoding. The frames come from files, or from a remote user in an Agora
+//  channel, and go out as they were encoded; every destination shares them, so
+//  the stream is encoded once however many there are. --localServers pushes
+//  to RTMP servers in this process, so no ingest server is needed to try it.
+//
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IAgoraService.h"
+#include "NGIAgoraRtcConnection.h"
+#include "common/file_parser/helper_aac_parser.h"
+#include "common/file_parser/helper_h264_parser.h"
+#include "common/helper.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/rtmp_push/local_rtmp_server.h"
+#include "common/rtmp_push/rtmp_fanout.h"
+#include "common/sample_common.h"
+#include "common/sample_connection_observer.h"
+#include "common/sample_local_user_observer.h"
+
+#include "NGIAgoraLocalUser.h"
+#include "NGIAgoraMediaNode.h"
+
+#define DEFAULT_CONNECT_TIMEOUT_MS (3000)
+#define DEFAULT_FRAME_RATE (30)
+#define DEFAULT_MAX_QUEUED_FRAMES (150)
+#define DEFAULT_STATS_INTERVAL_MS (5000)
+#define DEFAULT_STALL_MS (15000)
+#define DEFAULT_SEND_BUFFER_BYTES (64 * 1024)
+#define DEFAULT_AAC_SAMPLES_PER_FRAME (1024)
+#define DEFAULT_VIDEO_FILE "test_data/send_video.h264"
+#define DEFAULT_AUDIO_FILE "test_data/send_audio.aac"
+#define LOCAL_SERVER_STREAM "live/test"
+
+struct SampleOptions {
+  std::string rtmpUrl;
+  std::string videoFile = DEFAULT_VIDEO_FILE;
+  std::string audioFile = DEFAULT_AUDIO_FILE;
+  int frameRate = DEFAULT_FRAME_RATE;
+  int width = 0;
+  int height = 0;
+  int maxQueuedFrames = DEFAULT_MAX_QUEUED_FRAMES;
+  int sendBufferBytes = DEFAULT_SEND_BUFFER_BYTES;
+  int localServers = 0;
+  std::string recordFlv;
+  int stallDestination = -1;
+  int stallMs = DEFAULT_STALL_MS;
+  std::string appId;
+  std::string channelId;
+  std::string userId;
+  std::string remoteUserId;
+};
+
+static std::vector<std::string> splitUrls(const std::string& urls) {
+  std::vector<std::string> result;
+  std::stringstream ss(urls);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      result.push_back(item);
+    }
+  }
+  return result;
+}
+
+static bool exitFlag = false;
+static void SignalHandler(int sigNo) { exitFlag = true; }
+
+static void SamplePushVideoTask(const SampleOptions& options, RtmpFanout& fanout,
+                                std::chrono::steady_clock::time_point startTime) {
+  HelperH264FileParser parser(options.videoFile.c_str());
+  if (!parser.initialize()) {
+    return;
+  }
+  PacerInfo pacer = {0, 0, 0, startTime};
+  int64_t frameIndex = 0;
+
+  while (!exitFlag) {
+    std::unique_ptr<HelperH264Frame> h264Frame = parser.getH264Frame();
+    if (!h264Frame) {
+      parser.setFileParseRestart();
+      continue;
+    }
+    int64_t timestampMs = frameIndex++ * 1000 / options.frameRate;
+    auto frame = std::make_shared<EncodedMediaFrame>();
+    frame->kind = EncodedMediaFrame::VIDEO_H264;
+    frame->isKeyFrame = h264Frame->isKeyFrame;
+    frame->timestampMs = static_cast<uint32_t>(timestampMs);
+    frame->data.assign(h264Frame->buffer.get(), h264Frame->buffer.get() + h264Frame->bufferLen);
+    fanout.push(frame);
+    waitUntilTimestamp(pacer, frameIndex * 1000 / options.frameRate);
+  }
+}
+
+static void SamplePushAudioTask(const SampleOptions& options, RtmpFanout& fanout,
+                                std::chrono::steady_clock::time_point startTime) {
+  HelperAacFileParser parser(options.audioFile.c_str());
+  if (!parser.initialize()) {
+    return;
+  }
+  PacerInfo pacer = {0, 0, 0, startTime};
+  int64_t samples = 0;
+
+  while (!exitFlag) {
+    // the duration only sets samplesPerChannel in the frame info, unused here
+    std::unique_ptr<HelperAudioFrame> aacFrame = parser.getAudioFrame(0);
+    if (!aacFrame) {
+      break;
+    }
+    // one AAC frame is 1024 samples, whatever the rate
+    int sampleRate = aacFrame->audioFrameInfo.sampleRateHz;
+    int64_t timestampMs = samples * 1000 / sampleRate;
+    samples += DEFAULT_AAC_SAMPLES_PER_FRAME;
+    auto frame = std::make_shared<EncodedMediaFrame>();
+    frame->kind = EncodedMediaFrame::AUDIO_AAC;
+    frame->timestampMs = static_cast<uint32_t>(timestampMs);
+    frame->data.assign(aacFrame->buffer, aacFrame->buffer + aacFrame->bufferLen);
+    fanout.push(frame);
+    waitUntilTimestamp(pacer, samples * 1000 / sampleRate);
+  }
+}
+
+// Pushes what a remote user publishes, stamped with the local receive time
+class EncodedFramePusher : public agora::media::IVideoEncodedFrameObserver,
+                           public agora::rtc::IAudioEncodedFrameReceiver {
+ public:
+  explicit EncodedFramePusher(RtmpFanout& fanout) : fanout_(fanout) {}
+
+  bool onEncodedVideoFrameReceived(
+      agora::rtc::uid_t uid, const uint8_t* imageBuffer, size_t length,
+      const agora::rtc::EncodedVideoFrameInfo& videoEncodedFrameInfo) override {
+    if (videoEncodedFrameInfo.codecType != agora::rtc::VIDEO_CODEC_H264) {
+      if (!warnedVideo_.exchange(true)) {
+        AG_LOG(ERROR, "Remote video codec %d is not H.264, it is not pushed",
+               videoEncodedFrameInfo.codecType);
+      }
+      return true;
+    }
+    auto frame = std::make_shared<EncodedMediaFrame>();
+    frame->kind = EncodedMediaFrame::VIDEO_H264;
+    frame->isKeyFrame = videoEncodedFrameInfo.frameType == agora::rtc::VIDEO_FRAME_TYPE_KEY_FRAME;
+    frame->timestampMs = static_cast<uint32_t>(now_ms_t());
+    frame->data.assign(imageBuffer, imageBuffer + length);
+    fanout_.push(frame);
+    return true;
+  }
+
+  bool onEncodedAudioFrameReceived(const uint8_t* packet, size_t length,
+                                   const agora::media::base::AudioEncodedFrameInfo& info) override {
+    // FLV carries AAC, which arrives with ADTS headers
+    if (length < 7 || packet[0] != 0xff || (packet[1] & 0xf0) != 0xf0) {
+      if (!warnedAudio_.exchange(true)) {
+        AG_LOG(ERROR, "Remote audio codec %d is not AAC, it is not pushed", info.codec);
+      }
+      return true;
+    }
+    auto frame = std::make_shared<EncodedMediaFrame>();
+    frame->kind = EncodedMediaFrame::AUDIO_AAC;
+    frame->timestampMs = static_cast<uint32_t>(now_ms_t());
+    frame->data.assign(packet, packet + length);
+    fanout_.push(frame);
+    return true;
+  }
+
+ private:
+  RtmpFanout& fanout_;
+  std::atomic<bool> warnedVideo_{false};
+  std::atomic<bool> warnedAudio_{false};
+};
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("rtmpUrl", &options.rtmpUrl,
+                         "Comma separated rtmp://host[:port]/app/stream to push to / must without "
+                         "localServers");
+  optParser.add_long_opt("videoFile", &options.videoFile,
+                         "H.264 Annex B file to push / default is test_data/send_video.h264");
+  optParser.add_long_opt("audioFile", &options.audioFile,
+                         "ADTS AAC file to push / default is test_data/send_audio.aac");
+  optParser.add_long_opt("fps", &options.frameRate, "Video frame rate / default is 30");
+  optParser.add_long_opt("width", &options.width, "Video width for onMetaData / default is 0");
+  optParser.add_long_opt("height", &options.height, "Video height for onMetaData / default is 0");
+  optParser.add_long_opt("maxQueuedFrames", &options.maxQueuedFrames,
+                         "Frames queued before skipping to the next key frame / default is 150");
+  optParser.add_long_opt("sendBufferBytes", &options.sendBufferBytes,
+                         "Socket send buffer per destination, 0 for the system's / "
+                         "default is 65536");
+  optParser.add_long_opt("localServers", &options.localServers,
+                         "Also push to this many RTMP servers in this process / default is 0");
+  optParser.add_long_opt("recordFlv", &options.recordFlv,
+                         "Write what the first local server receives to this FLV file");
+  optParser.add_long_opt("stallDestination", &options.stallDestination,
+                         "Local server that stops reading 5 s in, to see a slow destination");
+  optParser.add_long_opt("stallMs", &options.stallMs,
+                         "How long the local server stalls / default is 15000");
+  optParser.add_long_opt("token", &options.appId,
+                         "The token for authentication, with channelId to push from a channel");
+  optParser.add_long_opt("channelId", &options.channelId,
+                         "Push a remote user's streams from this channel instead of files");
+  optParser.add_long_opt("userId", &options.userId, "User Id / default is 0");
+  optParser.add_long_opt("remoteUserId", &options.remoteUserId,
+                         "The remote user to push / must with channelId");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  std::vector<std::string> urls = splitUrls(options.rtmpUrl);
+  if (urls.empty() && options.localServers <= 0) {
+    AG_LOG(ERROR, "Must provide rtmpUrl or localServers!");
+    return -1;
+  }
+
+  if (!options.channelId.empty() && options.appId.empty()) {
+    AG_LOG(ERROR, "Must provide token to push from a channel!");
+    return -1;
+  }
+
+  // One FLV stream carries one user, the frames of several would be mixed
+  if (!options.channelId.empty() && options.remoteUserId.empty()) {
+    AG_LOG(ERROR, "Must provide remoteUserId to push from a channel!");
+    return -1;
+  }
+
+  if (options.frameRate <= 0 || options.maxQueuedFrames <= 0) {
+    AG_LOG(ERROR, "fps and maxQueuedFrames must be positive!");
+    return -1;
+  }
+
+  std::signal(SIGQUIT, SignalHandler);
+  std::signal(SIGABRT, SignalHandler);
+  std::signal(SIGINT, SignalHandler);
+
+  std::vector<std::unique_ptr<LocalRtmpServer>> localServers;
+  for (int i = 0; i < options.localServers; ++i) {
+    std::unique_ptr<LocalRtmpServer> localServer(new LocalRtmpServer());
+    if (!localServer->start(0, i == 0 ? options.recordFlv : "")) {
+      return -1;
+    }
+    urls.push_back("rtmp://127.0.0.1:" + std::to_string(localServer->port()) +
+                   "/" LOCAL_SERVER_STREAM);
+    localServers.push_back(std::move(localServer));
+  }
+
+  // One pipeline and observer per destination, all fed the same frames. The
+  // observers outlive the fanout, whose threads call them until it is gone
+  std::vector<std::shared_ptr<RtmpConnectionObserver>> rtmpObservers;
+  RtmpFanout fanout;
+  for (size_t i = 0; i < urls.size(); ++i) {
+    RtmpPushConfig pushConfig;
+    pushConfig.url = urls[i];
+    pushConfig.maxQueuedFrames = options.maxQueuedFrames;
+    pushConfig.sendBufferBytes = options.sendBufferBytes;
+    pushConfig.statsIntervalMs = DEFAULT_STATS_INTERVAL_MS;
+    pushConfig.videoWidth = options.width;
+    pushConfig.videoHeight = options.height;
+    pushConfig.videoFrameRate = options.frameRate;
+    auto rtmpObserver = std::make_shared<RtmpConnectionObserver>("rtmp" + std::to_string(i));
+    fanout.addDestination(pushConfig, rtmpObserver.get());
+    rtmpObservers.push_back(rtmpObserver);
+    AG_LOG(INFO, "rtmp%d: %s", static_cast<int>(i), urls[i].c_str());
+  }
+  fanout.start();
+  for (size_t i = 0; i < urls.size(); ++i) {
+    if (rtmpObservers[i]->waitUntilConnected(DEFAULT_CONNECT_TIMEOUT_MS) < 0) {
+      AG_LOG(INFO, "Not connected to %s yet, frames are queued until it is", urls[i].c_str());
+    }
+  }
+
+  agora::base::IAgoraService* service = nullptr;
+  agora::agora_refptr<agora::rtc::IRtcConnection> connection;
+  std::shared_ptr<SampleLocalUserObserver> localUserObserver;
+  std::shared_ptr<EncodedFramePusher> pusher;
+  std::thread videoThread;
+  std::thread audioThread;
+
+  if (!options.channelId.empty()) {
+    service = createAndInitAgoraService(false, true, true);
+    if (!service) {
+      AG_LOG(ERROR, "Failed to creating Agora service!");
+      return -1;
+    }
+
+    // Encoded frames only, nothing is decoded on the way to the server
+    agora::rtc::RtcConnectionConfiguration ccfg;
+    ccfg.clientRoleType = agora::rtc::CLIENT_ROLE_AUDIENCE;
+    ccfg.autoSubscribeAudio = false;
+    ccfg.autoSubscribeVideo = false;
+    ccfg.enableAudioRecordingOrPlayout = false;
+    ccfg.audioRecvEncodedFrame = true;
+    connection = service->createRtcConnection(ccfg);
+    if (!connection) {
+      AG_LOG(ERROR, "Failed to creating Agora connection!");
+      return -1;
+    }
+
+    agora::rtc::VideoSubscriptionOptions subscriptionOptions;
+    subscriptionOptions.encodedFrameOnly = true;
+    subscriptionOptions.type = agora::rtc::VIDEO_STREAM_HIGH;
+    connection->getLocalUser()->subscribeAudio(options.remoteUserId.c_str());
+    connection->getLocalUser()->subscribeVideo(options.remoteUserId.c_str(), subscriptionOptions);
+
+    pusher = std::make_shared<EncodedFramePusher>(fanout);
+    localUserObserver = std::make_shared<SampleLocalUserObserver>(connection->getLocalUser());
+    localUserObserver->setVideoEncodedImageReceiver(pusher.get());
+    localUserObserver->setEncodedAudioFrameObserver(pusher.get());
+
+    if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
+                            options.userId.c_str())) {
+      AG_LOG(ERROR, "Failed to connect to Agora channel!");
+      return -1;
+    }
+    AG_LOG(INFO, "Start pushing channel %s to %d destinations ...", options.channelId.c_str(),
+           static_cast<int>(urls.size()));
+  } else {
+    auto startTime = std::chrono::steady_clock::now();
+    videoThread = std::thread(SamplePushVideoTask, std::cref(options), std::ref(fanout),
+                              startTime);
+    audioThread = std::thread(SamplePushAudioTask, std::cref(options), std::ref(fanout),
+                              startTime);
+    AG_LOG(INFO, "Start pushing %s and %s to %d destinations ...", options.videoFile.c_str(),
+           options.audioFile.c_str(), static_cast<int>(urls.size()));
+  }
+
+  // Periodically check exit flag, and report each destination's backlog
+  uint64_t startMs = now_ms_t();
+  uint64_t lastStatsMs = startMs;
+  bool stalled = false;
+  while (!exitFlag) {
+    usleep(10000);
+    if (!stalled && options.stallDestination >= 0 &&
+        options.stallDestination < static_cast<int>(localServers.size()) &&
+        now_ms_t() - startMs >= 5000) {
+      stalled = true;
+      AG_LOG(INFO, "Stalling local server %d for %d ms", options.stallDestination,
+             options.stallMs);
+      localServers[options.stallDestination]->stall(options.stallMs);
+    }
+    if (now_ms_t() - lastStatsMs < DEFAULT_STATS_INTERVAL_MS) {
+      continue;
+    }
+    lastStatsMs = now_ms_t();
+    for (size_t i = 0; i < fanout.size(); ++i) {
+      RtmpPushStats stats = fanout.destination(i).getStats();
+      AG_LOG(INFO,
+             "rtmp%d %s: sent video %llu audio %llu, dropped video %llu audio %llu, "
+             "backlog %llu, reconnects %d, %llu bytes",
+             static_cast<int>(i), stats.connected ? "connected" : "disconnected",
+             (unsigned long long)stats.sentVideoFrames, (unsigned long long)stats.sentAudioFrames,
+             (unsigned long long)stats.droppedVideoFrames,
+             (unsigned long long)stats.droppedAudioFrames,
+             (unsigned long long)rtmpObservers[i]->getVideoBacklog(),
+             rtmpObservers[i]->getReconnectingCount(), (unsigned long long)stats.bytesSent);
+    }
+    for (size_t i = 0; i < localServers.size(); ++i) {
+      LocalRtmpServerStats serverStats = localServers[i]->getStats();
+      AG_LOG(INFO, "local server %d received video %llu (%llu key) audio %llu, %llu bytes",
+             static_cast<int>(i), (unsigned long long)serverStats.videoFrames,
+             (unsigned long long)serverStats.keyFrames,
+             (unsigned long long)serverStats.audioFrames,
+             (unsigned long long)serverStats.mediaBytes);
+    }
+  }
+
+  if (connection) {
+    if (connection->disconnect()) {
+      AG_LOG(ERROR, "Failed to disconnect from Agora channel!");
+    }
+  }
+  if (videoThread.joinable()) {
+    videoThread.join();
+  }
+  if (audioThread.joinable()) {
+    audioThread.join();
+  }
+  fanout.stop();
+  for (auto& localServer : localServers) {
+    localServer->stop();
+  }
+  AG_LOG(INFO, "Stopped pushing");
+
+  // Destroy Agora connection and related resources
+  localUserObserver.reset();
+  pusher.reset();
+  connection = nullptr;
+  rtmpObservers.clear();
+
+  // Destroy Agora Service
+  if (service) {
+    service->release();
+    service = nullptr;
+  }
+
+  return 0;
+}
@@ -9,6 +9,7 @@
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "IAgoraService.h"
 #include "NGIAgoraAudioTrack.h"
@@ -17,6 +18,7 @@
 #include "NGIAgoraMediaNodeFactory.h"
 #include "NGIAgoraRtcConnection.h"
 #include "NGIAgoraVideoTrack.h"
+#include "common/file_parser/helper_yuv_parser.h"
 #include "common/helper.h"
 #include "common/log.h"
 #include "common/opt_parser.h"
@@ -55,7 +57,8 @@ struct SampleOptions {
 };
 
 static void sendOnePcmFrame(const SampleOptions &options,
-							agora::agora_refptr<agora::rtc::IAudioPcmDataSender> audioPcmDataSender)
+							agora::agora_refptr<agora::rtc::IAudioPcmDataSender> audioPcmDataSender,
+							std::vector<uint8_t> &frameBuf)
 {
 	static FILE *file = nullptr;
 	const char *fileName = options.audioFile.c_str();
@@ -73,9 +76,10 @@ static void sendOnePcmFrame(const SampleOptions &options,
 		AG_LOG(INFO, "Open audio file %s successfully", fileName);
 	}
 
-	uint8_t frameBuf[sendBytes];
+	// Reused from frame to frame, no variable length array on the stack
+	frameBuf.resize(sendBytes);
 
-	if (fread(frameBuf, 1, sizeof(frameBuf), file) != sizeof(frameBuf)) {
+	if (fread(frameBuf.data(), 1, frameBuf.size(), file) != frameBuf.size()) {
 		if (feof(file)) {
 			fclose(file);
 			file = nullptr;
@@ -87,46 +91,25 @@ static void sendOnePcmFrame(const SampleOptions &options,
 	}
 
 	if (audioPcmDataSender->sendAudioPcmData(
-				frameBuf, 0, 0,samplesPer10ms, agora::rtc::TWO_BYTES_PER_SAMPLE,
+				frameBuf.data(), 0, 0,samplesPer10ms, agora::rtc::TWO_BYTES_PER_SAMPLE,
 				options.audio.numOfChannels, options.audio.sampleRate) < 0) {
 		AG_LOG(ERROR, "Failed to send audio frame!");
 	}
 }
 
-static void sendOneYuvFrame(const SampleOptions &options,
+static void sendOneYuvFrame(const SampleOptions &options, HelperYuvFileParser &yuvFileParser,
 							agora::agora_refptr<agora::rtc::IVideoFrameSender> videoFrameSender)
 {
-	static FILE *file = nullptr;
-	const char *fileName = options.videoFile.c_str();
-
-	// Calculate byte size for YUV420 image
-	int sendBytes = options.video.width * options.video.height * 3 / 2;
-
-	if (!file) {
-		if (!(file = fopen(fileName, "rb"))) {
-			AG_LOG(ERROR, "Failed to open video file %s", fileName);
-			return;
-		}
-		AG_LOG(INFO, "Open video file %s successfully", fileName);
-	}
-
-	uint8_t frameBuf[sendBytes];
-
-	if (fread(frameBuf, 1, sizeof(frameBuf), file) != sizeof(frameBuf)) {
-		if (feof(file)) {
-			fclose(file);
-			file = nullptr;
-			AG_LOG(INFO, "End of video file");
-		} else {
-			AG_LOG(ERROR, "Error reading video data: %s", std::strerror(errno));
-		}
+	// Points into the mapped file, no per-frame read
+	const uint8_t *frameBuf = yuvFileParser.getYuvFrame();
+	if (!frameBuf) {
 		return;
 	}
 
 	agora::media::base::ExternalVideoFrame videoFrame;
 	videoFrame.type = agora::media::base::ExternalVideoFrame::VIDEO_BUFFER_RAW_DATA;
 	videoFrame.format = agora::media::base::VIDEO_PIXEL_I420;
-	videoFrame.buffer = frameBuf;
+	videoFrame.buffer = const_cast<uint8_t *>(frameBuf);
 	videoFrame.stride = options.video.width;
 	videoFrame.height = options.video.height;
 	videoFrame.cropLeft = 0;
@@ -149,9 +132,10 @@ SampleSendAudioTask(const SampleOptions &options,
 	// Currently only 10 ms PCM frame is supported. So PCM frames are sent at 10
 	// ms interval
 	PacerInfo pacer = { 0, 10, 0, std::chrono::steady_clock::now() };
+	std::vector<uint8_t> frameBuf;
 
 	while (!exitFlag) {
-		sendOnePcmFrame(options, audioPcmDataSender);
+		sendOnePcmFrame(options, audioPcmDataSender, frameBuf);
 		waitBeforeNextSend(pacer); // sleep for a while before sending next frame
 	}
 }
@@ -164,8 +148,14 @@ static void SampleSendVideoTask(const SampleOptions &options,
 	// interval
 	PacerInfo pacer = { 0, 1000 / options.video.frameRate, 0, std::chrono::steady_clock::now() };
 
+	HelperYuvFileParser yuvFileParser(options.videoFile.c_str(), options.video.width,
+									  options.video.height);
+	if (!yuvFileParser.initialize()) {
+		return;
+	}
+
 	while (!exitFlag) {
-		sendOneYuvFrame(options, videoFrameSender);
+		sendOneYuvFrame(options, yuvFileParser, videoFrameSender);
 		waitBeforeNextSend(pacer); // sleep for a while before sending next frame
 	}
 }
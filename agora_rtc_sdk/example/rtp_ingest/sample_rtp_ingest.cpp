@@ -0,0 +1,266 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Ingest H.264 and Opus over RTP/UDP, e.g. from an on-prem encoder, and
+//  publish them as custom encoded tracks. --replayPcap or --replayH264File
+//  feed the ports from this process, so no encoder is needed to try it.
+//
+
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "IAgoraService.h"
+#include "NGIAgoraRtcConnection.h"
+#include "common/helper.h"
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/rtp_ingest/rtp_ingest.h"
+#include "common/rtp_ingest/rtp_replayer.h"
+#include "common/sample_common.h"
+#include "common/sample_connection_observer.h"
+#include "common/sample_local_user_observer.h"
+
+#include "NGIAgoraAudioTrack.h"
+#include "NGIAgoraLocalUser.h"
+#include "NGIAgoraMediaNodeFactory.h"
+#include "NGIAgoraMediaNode.h"
+#include "NGIAgoraVideoTrack.h"
+
+#define DEFAULT_CONNECT_TIMEOUT_MS (3000)
+#define DEFAULT_FRAME_RATE (30)
+#define DEFAULT_LATENCY_MS (50)
+#define DEFAULT_STATS_INTERVAL_MS (5000)
+
+struct SampleOptions {
+  std::string appId;
+  std::string channelId;
+  std::string userId;
+  std::string listenAddress = "127.0.0.1";
+  int videoPort = 0;
+  int audioPort = 0;
+  int videoPayloadType = -1;
+  int audioPayloadType = -1;
+  int latencyMs = DEFAULT_LATENCY_MS;
+  int frameRate = DEFAULT_FRAME_RATE;
+  std::string replayPcap;
+  int pcapVideoPort = 0;
+  int pcapAudioPort = 0;
+  std::string replayH264File;
+  bool loop = false;
+};
+
+static bool exitFlag = false;
+static void SignalHandler(int sigNo) { exitFlag = true; }
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("token", &options.appId, "The token for authentication / must");
+  optParser.add_long_opt("channelId", &options.channelId, "Channel Id / must");
+  optParser.add_long_opt("userId", &options.userId, "User Id / default is 0");
+  optParser.add_long_opt("listenAddress", &options.listenAddress,
+                         "Address the RTP ports are bound to / default is 127.0.0.1");
+  optParser.add_long_opt("videoPort", &options.videoPort,
+                         "UDP port of the H.264 RTP stream / default is 0, no video");
+  optParser.add_long_opt("audioPort", &options.audioPort,
+                         "UDP port of the Opus RTP stream / default is 0, no audio");
+  optParser.add_long_opt("videoPayloadType", &options.videoPayloadType,
+                         "Only take this video payload type / default is any");
+  optParser.add_long_opt("audioPayloadType", &options.audioPayloadType,
+                         "Only take this audio payload type / default is any");
+  optParser.add_long_opt("latencyMs", &options.latencyMs,
+                         "How long a missing packet is waited for / default is 50");
+  optParser.add_long_opt("fps", &options.frameRate, "Video frame rate / default is 30");
+  optParser.add_long_opt("replayPcap", &options.replayPcap,
+                         "Replay the RTP in this pcap capture to the ports");
+  optParser.add_long_opt("pcapVideoPort", &options.pcapVideoPort,
+                         "Destination port of the video in the capture");
+  optParser.add_long_opt("pcapAudioPort", &options.pcapAudioPort,
+                         "Destination port of the audio in the capture");
+  optParser.add_long_opt("replayH264File", &options.replayH264File,
+                         "Packetize this H.264 file and replay it to the video port");
+  optParser.add_long_opt("loop", &options.loop, "Replay again when done");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  if (options.appId.empty()) {
+    AG_LOG(ERROR, "Must provide appId!");
+    return -1;
+  }
+
+  if (options.channelId.empty()) {
+    AG_LOG(ERROR, "Must provide channelId!");
+    return -1;
+  }
+
+  if (!options.videoPort && !options.audioPort) {
+    AG_LOG(ERROR, "Must provide videoPort or audioPort!");
+    return -1;
+  }
+
+  // Load the replay before connecting, a bad file fails fast
+  RtpReplayer replayer;
+  if (!options.replayPcap.empty() &&
+      !replayer.loadPcap(options.replayPcap, options.pcapVideoPort, options.pcapAudioPort)) {
+    AG_LOG(ERROR, "Failed to load %s!", options.replayPcap.c_str());
+    return -1;
+  }
+  if (!options.replayH264File.empty() &&
+      !replayer.loadH264File(options.replayH264File, options.frameRate)) {
+    AG_LOG(ERROR, "Failed to load %s!", options.replayH264File.c_str());
+    return -1;
+  }
+
+  std::signal(SIGQUIT, SignalHandler);
+  std::signal(SIGABRT, SignalHandler);
+  std::signal(SIGINT, SignalHandler);
+
+  // Create Agora service
+  auto service = createAndInitAgoraService(false, true, true);
+  if (!service) {
+    AG_LOG(ERROR, "Failed to creating Agora service!");
+    return -1;
+  }
+
+  // Create Agora connection
+  agora::rtc::RtcConnectionConfiguration ccfg;
+  ccfg.autoSubscribeAudio = false;
+  ccfg.autoSubscribeVideo = false;
+  ccfg.clientRoleType = agora::rtc::CLIENT_ROLE_BROADCASTER;
+  agora::agora_refptr<agora::rtc::IRtcConnection> connection = service->createRtcConnection(ccfg);
+  if (!connection) {
+    AG_LOG(ERROR, "Failed to creating Agora connection!");
+    return -1;
+  }
+
+  // Register connection observer to monitor connection event
+  auto connObserver = std::make_shared<SampleConnectionObserver>();
+  connection->registerObserver(connObserver.get());
+
+  // Create local user observer
+  auto localUserObserver = std::make_shared<SampleLocalUserObserver>(connection->getLocalUser());
+
+  // Create media node factory
+  agora::agora_refptr<agora::rtc::IMediaNodeFactory> factory = service->createMediaNodeFactory();
+  if (!factory) {
+    AG_LOG(ERROR, "Failed to create media node factory!");
+    return -1;
+  }
+
+  // Create the encoded frame senders and their tracks
+  agora::agora_refptr<agora::rtc::IVideoEncodedImageSender> videoFrameSender;
+  agora::agora_refptr<agora::rtc::IAudioEncodedFrameSender> audioFrameSender;
+  agora::agora_refptr<agora::rtc::ILocalVideoTrack> customVideoTrack;
+  agora::agora_refptr<agora::rtc::ILocalAudioTrack> customAudioTrack;
+  if (options.videoPort) {
+    videoFrameSender = factory->createVideoEncodedImageSender();
+    agora::rtc::SenderOptions option;
+    option.ccMode = agora::rtc::TCcMode::CC_ENABLED;
+    customVideoTrack = service->createCustomVideoTrack(videoFrameSender, option);
+    if (!customVideoTrack) {
+      AG_LOG(ERROR, "Failed to create video track!");
+      return -1;
+    }
+  }
+  if (options.audioPort) {
+    audioFrameSender = factory->createAudioEncodedFrameSender();
+    customAudioTrack = service->createCustomAudioTrack(audioFrameSender, agora::base::MIX_DISABLED);
+    if (!customAudioTrack) {
+      AG_LOG(ERROR, "Failed to create audio track!");
+      return -1;
+    }
+  }
+
+  // Connect to Agora channel
+  if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
+                          options.userId.c_str())) {
+    AG_LOG(ERROR, "Failed to connect to Agora channel!");
+    return -1;
+  }
+
+  // Publish the tracks
+  if (customVideoTrack) {
+    customVideoTrack->setEnabled(true);
+    localUserObserver->GetLocalUser()->publishVideo(customVideoTrack);
+  }
+  if (customAudioTrack) {
+    customAudioTrack->setEnabled(true);
+    localUserObserver->GetLocalUser()->publishAudio(customAudioTrack);
+  }
+
+  // Wait until connected before ingesting
+  connObserver->waitUntilConnected(DEFAULT_CONNECT_TIMEOUT_MS);
+
+  RtpIngestConfig ingestConfig;
+  ingestConfig.listenAddress = options.listenAddress;
+  ingestConfig.videoPort = options.videoPort;
+  ingestConfig.audioPort = options.audioPort;
+  ingestConfig.videoPayloadType = options.videoPayloadType;
+  ingestConfig.audioPayloadType = options.audioPayloadType;
+  ingestConfig.latencyMs = options.latencyMs;
+  ingestConfig.frameRate = options.frameRate;
+  RtpIngest ingest(ingestConfig, videoFrameSender, audioFrameSender);
+  if (!ingest.start()) {
+    return -1;
+  }
+  if (replayer.packetCount() &&
+      !replayer.start(options.listenAddress, options.videoPort, options.audioPort, options.loop)) {
+    AG_LOG(ERROR, "Failed to start the replay!");
+    return -1;
+  }
+
+  int64_t elapsedMs = 0;
+  while (!exitFlag) {
+    usleep(10000);
+    elapsedMs += 10;
+    if (elapsedMs % DEFAULT_STATS_INTERVAL_MS == 0) {
+      ingest.logStats();
+    }
+  }
+
+  replayer.stop();
+  ingest.stop();
+  ingest.logStats();
+
+  // Unpublish the tracks
+  if (customVideoTrack) {
+    localUserObserver->GetLocalUser()->unpublishVideo(customVideoTrack);
+  }
+  if (customAudioTrack) {
+    localUserObserver->GetLocalUser()->unpublishAudio(customAudioTrack);
+  }
+
+  // Unregister connection observer
+  connection->unregisterObserver(connObserver.get());
+
+  // Disconnect from Agora channel
+  if (connection->disconnect()) {
+    AG_LOG(ERROR, "Failed to disconnect from Agora channel!");
+    return -1;
+  }
+  AG_LOG(INFO, "Disconnected from Agora channel successfully");
+
+  // Destroy Agora connection and related resources
+  connObserver.reset();
+  localUserObserver.reset();
+  videoFrameSender = nullptr;
+  audioFrameSender = nullptr;
+  customVideoTrack = nullptr;
+  customAudioTrack = nullptr;
+  factory = nullptr;
+  connection = nullptr;
+
+  // Destroy Agora Service
+  service->release();
+  service = nullptr;
+
+  return 0;
+}
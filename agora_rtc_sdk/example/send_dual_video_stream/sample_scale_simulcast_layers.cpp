@@ -0,0 +1,205 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Scale a raw I420 file into simulcast layer files with the simulcast
+//  pyramid, or benchmark the pyramid against scaling every layer separately.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/video_processor/video_scaler.h"
+
+#define DEFAULT_LAYER_COUNT (3)
+#define DEFAULT_BENCHMARK_ITERATIONS (100)
+
+struct SampleOptions {
+  std::string inputFile;
+  std::string outputPrefix = "layer";
+  int width = 0;
+  int height = 0;
+  int layers = DEFAULT_LAYER_COUNT;
+  bool bilinear = false;
+  std::string simd;
+  bool benchmark = false;
+};
+
+static const char* kSimdNames[] = {"c", "ssse3", "avx2"};
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Every layer halves the one above it, the full size frame being layer 0
+static std::vector<SimulcastLayer> halvingLayers(int width, int height, int count) {
+  std::vector<SimulcastLayer> layers;
+  for (int i = 1; i < count; ++i) {
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+    layers.push_back({width, height});
+  }
+  return layers;
+}
+
+// What the pyramid replaces: one full read of the source per layer
+static void naiveScaleLayers(const PixelPlanes& src, int width, int height,
+                             const std::vector<SimulcastLayer>& layers,
+                             std::vector<std::shared_ptr<I420BufferPool>>& pools,
+                             ScaleFilter filter) {
+  for (size_t i = 0; i < layers.size(); ++i) {
+    auto buffer = pools[i]->acquire();
+    scaleI420(src, width, height, buffer->planes, layers[i].width, layers[i].height, filter);
+  }
+}
+
+static void runBenchmark(const SampleOptions& options) {
+  static const struct {
+    const char* name;
+    int width;
+    int height;
+  } kSizes[] = {{"720p", 1280, 720}, {"1080p", 1920, 1080}, {"4K", 3840, 2160}};
+
+  PixelSimdLevel best = getPixelSimdLevel();
+  ScaleFilter filter = options.bilinear ? SCALE_FILTER_BILINEAR : SCALE_FILTER_BOX;
+  AG_LOG(INFO, "Best SIMD level on this CPU: %s, %d layers", kSimdNames[best], options.layers);
+
+  for (const auto& size : kSizes) {
+    std::vector<uint8_t> frame(pixelBufferSize(RAW_PIXEL_I420, size.width, size.height));
+    for (size_t i = 0; i < frame.size(); ++i) {
+      frame[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+    PixelPlanes src = pixelBufferPlanes(RAW_PIXEL_I420, frame.data(), size.width, size.height);
+    std::vector<SimulcastLayer> layers = halvingLayers(size.width, size.height, options.layers);
+    std::vector<std::shared_ptr<I420BufferPool>> pools;
+    for (const auto& layer : layers) {
+      pools.push_back(I420BufferPool::create(layer.width, layer.height, 1));
+    }
+
+    std::ostringstream line;
+    line.precision(3);
+    line << std::fixed;
+    for (int level = PIXEL_SIMD_NONE; level <= best; ++level) {
+      setPixelSimdLevel(static_cast<PixelSimdLevel>(level));
+      SimulcastPyramid pyramid(size.width, size.height, layers, filter, 1);
+      if (!pyramid.initialize()) {
+        AG_LOG(ERROR, "Failed to initialize simulcast pyramid");
+        return;
+      }
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < DEFAULT_BENCHMARK_ITERATIONS; ++i) {
+        naiveScaleLayers(src, size.width, size.height, layers, pools, filter);
+      }
+      double separateMs = elapsedMs(start) / DEFAULT_BENCHMARK_ITERATIONS;
+      start = std::chrono::steady_clock::now();
+      for (int i = 0; i < DEFAULT_BENCHMARK_ITERATIONS; ++i) {
+        pyramid.process(src);
+      }
+      double pyramidMs = elapsedMs(start) / DEFAULT_BENCHMARK_ITERATIONS;
+      line << "  " << kSimdNames[level] << " " << separateMs << "/" << pyramidMs;
+    }
+    AG_LOG(INFO, "%-5s separate/pyramid ms:%s", size.name, line.str().c_str());
+    setPixelSimdLevel(best);
+  }
+}
+
+static int scaleFile(const SampleOptions& options) {
+  std::vector<SimulcastLayer> layers = halvingLayers(options.width, options.height,
+                                                     options.layers);
+  SimulcastPyramid pyramid(options.width, options.height, layers,
+                           options.bilinear ? SCALE_FILTER_BILINEAR : SCALE_FILTER_BOX, 1);
+  if (layers.empty() || !pyramid.initialize()) {
+    AG_LOG(ERROR, "Invalid layer setup for %dx%d with %d layers", options.width, options.height,
+           options.layers);
+    return -1;
+  }
+
+  FILE* in = fopen(options.inputFile.c_str(), "rb");
+  if (!in) {
+    AG_LOG(ERROR, "Failed to open input file %s", options.inputFile.c_str());
+    return -1;
+  }
+  std::vector<FILE*> outputs;
+  for (const auto& layer : layers) {
+    std::string name = options.outputPrefix + "_" + std::to_string(layer.width) + "x" +
+                       std::to_string(layer.height) + ".yuv";
+    FILE* out = fopen(name.c_str(), "wb");
+    if (!out) {
+      AG_LOG(ERROR, "Failed to create output file %s", name.c_str());
+      break;
+    }
+    outputs.push_back(out);
+  }
+
+  std::vector<uint8_t> frame(pixelBufferSize(RAW_PIXEL_I420, options.width, options.height));
+  PixelPlanes src =
+      pixelBufferPlanes(RAW_PIXEL_I420, frame.data(), options.width, options.height);
+  int frames = 0;
+  double scaleMs = 0;
+  while (outputs.size() == layers.size() &&
+         fread(frame.data(), 1, frame.size(), in) == frame.size()) {
+    auto start = std::chrono::steady_clock::now();
+    auto buffers = pyramid.process(src);
+    scaleMs += elapsedMs(start);
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      fwrite(buffers[i]->data, 1, pixelBufferSize(RAW_PIXEL_I420, layers[i].width,
+                                                  layers[i].height),
+             outputs[i]);
+    }
+    ++frames;
+  }
+  fclose(in);
+  for (FILE* out : outputs) {
+    fclose(out);
+  }
+  AG_LOG(INFO, "Scaled %d frames into %zu layers, %.3f ms per frame (%s)", frames, layers.size(),
+         frames ? scaleMs / frames : 0.0, kSimdNames[getPixelSimdLevel()]);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("inputFile", &options.inputFile, "The video file in YUV420 format");
+  optParser.add_long_opt("outputPrefix", &options.outputPrefix,
+                         "Layer files are written as <prefix>_<width>x<height>.yuv");
+  optParser.add_long_opt("width", &options.width, "Width of the input video / must");
+  optParser.add_long_opt("height", &options.height, "Height of the input video / must");
+  optParser.add_long_opt("layers", &options.layers,
+                         "Simulcast layers including the full size one / default is 3");
+  optParser.add_long_opt("bilinear", &options.bilinear,
+                         "Use bilinear instead of box filtering for 2:1 steps");
+  optParser.add_long_opt("simd", &options.simd, "Limit SIMD to c, ssse3 or avx2");
+  optParser.add_long_opt("benchmark", &options.benchmark,
+                         "Time the pyramid at 720p, 1080p and 4K against separate scaling");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  for (int level = PIXEL_SIMD_NONE; level <= PIXEL_SIMD_AVX2; ++level) {
+    if (options.simd == kSimdNames[level]) {
+      setPixelSimdLevel(static_cast<PixelSimdLevel>(level));
+    }
+  }
+
+  if (options.benchmark) {
+    runBenchmark(options);
+    return 0;
+  }
+
+  if (options.inputFile.empty() || options.width <= 0 || options.height <= 0) {
+    AG_LOG(ERROR, "Must provide inputFile, width and height!");
+    return -1;
+  }
+  return scaleFile(options);
+}
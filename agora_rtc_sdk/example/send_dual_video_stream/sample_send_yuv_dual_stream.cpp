@@ -12,6 +12,7 @@
 
 #include "IAgoraService.h"
 #include "NGIAgoraRtcConnection.h"
+#include "common/file_parser/helper_yuv_parser.h"
 #include "common/helper.h"
 #include "common/log.h"
 #include "common/opt_parser.h"
@@ -45,39 +46,18 @@ struct SampleOptions {
   } video;
 };
 
-static void sendOneYuvFrame(const SampleOptions& options,
+static void sendOneYuvFrame(const SampleOptions& options, HelperYuvFileParser& yuvFileParser,
                             agora::agora_refptr<agora::rtc::IVideoFrameSender> videoFrameSender) {
-  static FILE* file = nullptr;
-  const char* fileName = options.videoFile.c_str();
-
-  // Calculate byte size for YUV420 image
-  int sendBytes = options.video.width * options.video.height * 3 / 2;
-
-  if (!file) {
-    if (!(file = fopen(fileName, "rb"))) {
-      AG_LOG(ERROR, "Failed to open video file %s", fileName);
-      return;
-    }
-    AG_LOG(INFO, "Open video file %s successfully", fileName);
-  }
-
-  uint8_t frameBuf[sendBytes];
-
-  if (fread(frameBuf, 1, sizeof(frameBuf), file) != sizeof(frameBuf)) {
-    if (feof(file)) {
-      fclose(file);
-      file = nullptr;
-      AG_LOG(INFO, "End of video file");
-    } else {
-      AG_LOG(ERROR, "Error reading video data: %s", std::strerror(errno));
-    }
+  // Points into the mapped file, no per-frame read
+  const uint8_t* frameBuf = yuvFileParser.getYuvFrame();
+  if (!frameBuf) {
     return;
   }
 
   agora::media::base::ExternalVideoFrame videoFrame;
   videoFrame.type = agora::media::base::ExternalVideoFrame::VIDEO_BUFFER_RAW_DATA;
   videoFrame.format = agora::media::base::VIDEO_PIXEL_I420;
-  videoFrame.buffer = frameBuf;
+  videoFrame.buffer = const_cast<uint8_t*>(frameBuf);
   videoFrame.stride = options.video.width;
   videoFrame.height = options.video.height;
   videoFrame.cropLeft = 0;
@@ -98,8 +78,14 @@ static void SampleSendVideoTask(const SampleOptions& options,
   // Calculate send interval based on frame rate. H264 frames are sent at this interval
   PacerInfo pacer = {0, 1000 / options.video.frameRate,0, std::chrono::steady_clock::now()};
 
+  HelperYuvFileParser yuvFileParser(options.videoFile.c_str(), options.video.width,
+                                    options.video.height);
+  if (!yuvFileParser.initialize()) {
+    return;
+  }
+
   while (!exitFlag) {
-    sendOneYuvFrame(options, videoFrameSender);
+    sendOneYuvFrame(options, yuvFileParser, videoFrameSender);
     waitBeforeNextSend(pacer);  // sleep for a while before sending next frame
   }
 }
@@ -0,0 +1,97 @@
+/* Pitch kernel check.
+
+   Compares the inner products and cross-correlation of every architecture
+   level the CPU supports against the C reference, for every length up to
+   MAX_LEN, so the partial-vector tails of the SIMD kernels are covered. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "cpu_support.h"
+#include "pitch.h"
+
+#ifndef FIXED_POINT
+
+#define MAX_LEN 96
+#define MAX_LAGS 24
+
+int ret = 0;
+
+static float noise(void)
+{
+   return (float)rand()/RAND_MAX - .5f;
+}
+
+/* The SIMD kernels sum in a different order, so allow rounding relative to
+   the magnitude of the terms rather than of the result. */
+static void check(const char *name, int arch, int N, float got, float ref,
+      const float *x, const float *y)
+{
+   int i;
+   float mag = 0;
+   for (i=0;i<N;i++) mag += fabsf(x[i]*y[i]);
+   if (fabsf(got - ref) > 1e-5f*mag + 1e-30f)
+   {
+      fprintf(stderr, "FAIL: %s arch %d N=%d: %g, expected %g\n",
+            name, arch, N, got, ref);
+      ret = 1;
+   }
+}
+
+static void test_arch(int arch)
+{
+   float x[MAX_LEN+MAX_LAGS], y[MAX_LEN+MAX_LAGS], y2[MAX_LEN];
+   float xcorr[MAX_LAGS];
+   int N, i;
+   for (N=1;N<=MAX_LEN;N++)
+   {
+      opus_val32 xy1, xy2;
+      for (i=0;i<MAX_LEN+MAX_LAGS;i++)
+      {
+         x[i] = noise();
+         y[i] = noise();
+      }
+      for (i=0;i<MAX_LEN;i++) y2[i] = noise();
+      /* Leaves the vector registers full of unrelated values, which a kernel
+         that reads lanes it never set would pick up. */
+      celt_pitch_xcorr(y, x, xcorr, MAX_LEN, MAX_LAGS, arch);
+
+      check("celt_inner_prod", arch, N, celt_inner_prod(x, y, N, arch),
+            celt_inner_prod_c(x, y, N), x, y);
+      dual_inner_prod(x, y, y2, N, &xy1, &xy2, arch);
+      check("dual_inner_prod", arch, N, xy1, celt_inner_prod_c(x, y, N), x, y);
+      check("dual_inner_prod", arch, N, xy2, celt_inner_prod_c(x, y2, N), x, y2);
+
+      celt_pitch_xcorr(x, y, xcorr, N, MAX_LAGS, arch);
+      for (i=0;i<MAX_LAGS;i++)
+      {
+         check("celt_pitch_xcorr", arch, N, xcorr[i],
+               celt_inner_prod_c(x, y+i, N), x, y+i);
+      }
+   }
+}
+
+int main(void)
+{
+   int arch, max_arch;
+   max_arch = opus_select_arch();
+   for (arch=0;arch<=max_arch;arch++)
+   {
+      test_arch(arch);
+      printf("arch %d: %s\n", arch, ret ? "FAIL" : "ok");
+   }
+   return ret;
+}
+
+#else
+
+int main(void)
+{
+   return 0;
+}
+
+#endif
@@ -338,8 +338,8 @@ unsigned alg_quant(celt_norm *X, int N, int K, int spread, int B, ec_enc *enc,
    celt_assert2(K>0, "alg_quant() needs at least one pulse");
    celt_assert2(N>1, "alg_quant() needs at least two dimensions");
 
-   /* Covers vectorization by up to 4. */
-   ALLOC(iy, N+3, int);
+   /* Covers vectorization by up to 8. */
+   ALLOC(iy, N+7, int);
 
    exp_rotation(X, N, 1, B, K, spread);
 
@@ -0,0 +1,188 @@
+/* Copyright (c) 2014, Cisco Systems, INC
+   Written by XiangMingZhu WeiZhou MinPeng YanWang
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "macros.h"
+#include "celt_lpc.h"
+#include "stack_alloc.h"
+#include "mathops.h"
+#include "pitch.h"
+
+#if defined(OPUS_X86_MAY_HAVE_AVX2) && !defined(FIXED_POINT)
+
+#include <immintrin.h>
+#include "arch.h"
+
+static OPUS_INLINE float horizontal_sum_avx2(__m256 x)
+{
+   __m128 sum;
+   sum = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+   sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+   sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+   return _mm_cvtss_f32(sum);
+}
+
+/* Computes 8 correlation lags per pass. Each lag block keeps four independent
+   accumulators so that the FMA latency is hidden behind the loads. */
+void celt_pitch_xcorr_avx2(const opus_val16 *_x, const opus_val16 *_y,
+      opus_val32 *xcorr, int len, int max_pitch, int arch)
+{
+   int i, j;
+   (void)arch;
+   celt_assert(max_pitch>0);
+   for (i=0;i<max_pitch-7;i+=8)
+   {
+      __m256 sum0, sum1, sum2, sum3;
+      const opus_val16 *y = _y+i;
+      sum0 = _mm256_setzero_ps();
+      sum1 = _mm256_setzero_ps();
+      sum2 = _mm256_setzero_ps();
+      sum3 = _mm256_setzero_ps();
+      for (j=0;j<len-3;j+=4)
+      {
+         sum0 = _mm256_fmadd_ps(_mm256_broadcast_ss(&_x[j]),   _mm256_loadu_ps(&y[j]),   sum0);
+         sum1 = _mm256_fmadd_ps(_mm256_broadcast_ss(&_x[j+1]), _mm256_loadu_ps(&y[j+1]), sum1);
+         sum2 = _mm256_fmadd_ps(_mm256_broadcast_ss(&_x[j+2]), _mm256_loadu_ps(&y[j+2]), sum2);
+         sum3 = _mm256_fmadd_ps(_mm256_broadcast_ss(&_x[j+3]), _mm256_loadu_ps(&y[j+3]), sum3);
+      }
+      for (;j<len;j++)
+      {
+         sum0 = _mm256_fmadd_ps(_mm256_broadcast_ss(&_x[j]), _mm256_loadu_ps(&y[j]), sum0);
+      }
+      sum0 = _mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3));
+      _mm256_storeu_ps(xcorr+i, sum0);
+   }
+   /* In case max_pitch isn't a multiple of 8, do the remaining lags one by one. */
+   for (;i<max_pitch;i++)
+   {
+      xcorr[i] = celt_inner_prod_avx2(_x, _y+i, len);
+   }
+}
+
+opus_val32 celt_inner_prod_avx2(const opus_val16 *x, const opus_val16 *y,
+      int N)
+{
+   int i;
+   float xy;
+   __m256 sum0, sum1;
+   __m128 sum4;
+   sum0 = _mm256_setzero_ps();
+   sum1 = _mm256_setzero_ps();
+   sum4 = _mm_setzero_ps();
+   for (i=0;i<N-15;i+=16)
+   {
+      sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(x+i),   _mm256_loadu_ps(y+i),   sum0);
+      sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(x+i+8), _mm256_loadu_ps(y+i+8), sum1);
+   }
+   if (i<N-7)
+   {
+      sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(x+i), _mm256_loadu_ps(y+i), sum0);
+      i += 8;
+   }
+   if (i<N-3)
+   {
+      /* Most CELT bands are short, so keep a 4-wide step before the scalar tail.
+         It gets its own 128-bit accumulator: a cast to 256 bits would leave the
+         upper lanes undefined and they would end up in the sum. */
+      sum4 = _mm_fmadd_ps(_mm_loadu_ps(x+i), _mm_loadu_ps(y+i), sum4);
+      i += 4;
+   }
+   xy = horizontal_sum_avx2(_mm256_add_ps(sum0, sum1));
+   sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+   sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 0x55));
+   xy += _mm_cvtss_f32(sum4);
+   for (;i<N;i++)
+   {
+      xy = MAC16_16(xy, x[i], y[i]);
+   }
+   return xy;
+}
+
+void dual_inner_prod_avx2(const opus_val16 *x, const opus_val16 *y01, const opus_val16 *y02,
+      int N, opus_val32 *xy1, opus_val32 *xy2)
+{
+   int i;
+   float sum1, sum2;
+   __m256 xsum1, xsum2;
+   xsum1 = _mm256_setzero_ps();
+   xsum2 = _mm256_setzero_ps();
+   for (i=0;i<N-7;i+=8)
+   {
+      __m256 xi = _mm256_loadu_ps(x+i);
+      xsum1 = _mm256_fmadd_ps(xi, _mm256_loadu_ps(y01+i), xsum1);
+      xsum2 = _mm256_fmadd_ps(xi, _mm256_loadu_ps(y02+i), xsum2);
+   }
+   sum1 = horizontal_sum_avx2(xsum1);
+   sum2 = horizontal_sum_avx2(xsum2);
+   for (;i<N;i++)
+   {
+      sum1 = MAC16_16(sum1, x[i], y01[i]);
+      sum2 = MAC16_16(sum2, x[i], y02[i]);
+   }
+   *xy1 = sum1;
+   *xy2 = sum2;
+}
+
+/* y and x may alias (the decoder post-filter runs in place). This is safe because
+   T >= COMBFILTER_MINPERIOD, so every tap read for an 8-sample block lies
+   before the block being written. */
+void comb_filter_const_avx2(opus_val32 *y, opus_val32 *x, int T, int N,
+      opus_val16 g10, opus_val16 g11, opus_val16 g12)
+{
+   int i;
+   __m256 g10v, g11v, g12v;
+   g10v = _mm256_set1_ps(g10);
+   g11v = _mm256_set1_ps(g11);
+   g12v = _mm256_set1_ps(g12);
+   for (i=0;i<N-7;i+=8)
+   {
+      __m256 yi, x0v, x1v, x2v, x3v, x4v;
+      const opus_val32 *xp = &x[i-T-2];
+      yi = _mm256_loadu_ps(x+i);
+      x0v = _mm256_loadu_ps(xp);
+      x1v = _mm256_loadu_ps(xp+1);
+      x2v = _mm256_loadu_ps(xp+2);
+      x3v = _mm256_loadu_ps(xp+3);
+      x4v = _mm256_loadu_ps(xp+4);
+      yi = _mm256_fmadd_ps(g10v, x2v, yi);
+      yi = _mm256_fmadd_ps(g11v, _mm256_add_ps(x3v, x1v), yi);
+      yi = _mm256_fmadd_ps(g12v, _mm256_add_ps(x4v, x0v), yi);
+      _mm256_storeu_ps(y+i, yi);
+   }
+   for (;i<N;i++)
+   {
+      y[i] = x[i]
+               + MULT16_32_Q15(g10,x[i-T])
+               + MULT16_32_Q15(g11,ADD32(x[i-T+1],x[i-T-1]))
+               + MULT16_32_Q15(g12,ADD32(x[i-T+2],x[i-T-2]));
+   }
+}
+
+#endif
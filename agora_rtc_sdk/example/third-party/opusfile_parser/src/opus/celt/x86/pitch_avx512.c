@@ -0,0 +1,79 @@
+/* Copyright (c) 2014, Cisco Systems, INC
+   Written by XiangMingZhu WeiZhou MinPeng YanWang
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "macros.h"
+#include "celt_lpc.h"
+#include "stack_alloc.h"
+#include "mathops.h"
+#include "pitch.h"
+
+#if defined(OPUS_X86_MAY_HAVE_AVX512) && !defined(FIXED_POINT)
+
+#include <immintrin.h>
+#include "arch.h"
+
+/* Same structure as celt_pitch_xcorr_avx2(), but with 16 lags per pass.
+   Worthwhile for the long correlations of the pitch search and the LPC
+   autocorrelation; everything else stays on the AVX2 kernels. */
+void celt_pitch_xcorr_avx512(const opus_val16 *_x, const opus_val16 *_y,
+      opus_val32 *xcorr, int len, int max_pitch, int arch)
+{
+   int i, j;
+   celt_assert(max_pitch>0);
+   for (i=0;i<max_pitch-15;i+=16)
+   {
+      __m512 sum0, sum1, sum2, sum3;
+      const opus_val16 *y = _y+i;
+      sum0 = _mm512_setzero_ps();
+      sum1 = _mm512_setzero_ps();
+      sum2 = _mm512_setzero_ps();
+      sum3 = _mm512_setzero_ps();
+      for (j=0;j<len-3;j+=4)
+      {
+         sum0 = _mm512_fmadd_ps(_mm512_set1_ps(_x[j]),   _mm512_loadu_ps(&y[j]),   sum0);
+         sum1 = _mm512_fmadd_ps(_mm512_set1_ps(_x[j+1]), _mm512_loadu_ps(&y[j+1]), sum1);
+         sum2 = _mm512_fmadd_ps(_mm512_set1_ps(_x[j+2]), _mm512_loadu_ps(&y[j+2]), sum2);
+         sum3 = _mm512_fmadd_ps(_mm512_set1_ps(_x[j+3]), _mm512_loadu_ps(&y[j+3]), sum3);
+      }
+      for (;j<len;j++)
+      {
+         sum0 = _mm512_fmadd_ps(_mm512_set1_ps(_x[j]), _mm512_loadu_ps(&y[j]), sum0);
+      }
+      sum0 = _mm512_add_ps(_mm512_add_ps(sum0, sum1), _mm512_add_ps(sum2, sum3));
+      _mm512_storeu_ps(xcorr+i, sum0);
+   }
+   if (i<max_pitch)
+   {
+      celt_pitch_xcorr_avx2(_x, _y+i, xcorr+i, len, max_pitch-i, arch);
+   }
+}
+
+#endif
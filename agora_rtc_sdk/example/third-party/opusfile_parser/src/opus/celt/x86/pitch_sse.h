@@ -109,7 +109,7 @@ opus_val32 celt_inner_prod_sse(
 #define celt_inner_prod(x, y, N, arch) \
     ((void)arch, celt_inner_prod_sse2(x, y, N))
 
-#elif defined(OPUS_X86_PRESUME_SSE) && !defined(FIXED_POINT)
+#elif defined(OPUS_X86_PRESUME_SSE) && !defined(FIXED_POINT) && !defined(OPUS_X86_MAY_HAVE_AVX2)
 #define OVERRIDE_CELT_INNER_PROD
 #define celt_inner_prod(x, y, N, arch) \
     ((void)arch, celt_inner_prod_sse(x, y, N))
@@ -153,7 +153,7 @@ void comb_filter_const_sse(opus_val32 *y,
     opus_val16  g12);
 
 
-#if defined(OPUS_X86_PRESUME_SSE)
+#if defined(OPUS_X86_PRESUME_SSE) && !defined(OPUS_X86_MAY_HAVE_AVX2)
 # define dual_inner_prod(x, y01, y02, N, xy1, xy2, arch) \
     ((void)(arch),dual_inner_prod_sse(x, y01, y02, N, xy1, xy2))
 
@@ -189,4 +189,58 @@ extern void (*const COMB_FILTER_CONST_IMPL[OPUS_ARCHMASK + 1])(
 #endif
 #endif
 
+#if defined(OPUS_X86_MAY_HAVE_AVX2) && !defined(FIXED_POINT)
+
+/* The AVX2 kernels are always reached through the RTCD tables, even when SSE
+   is presumed, so that a single binary still runs on CPUs without AVX2. */
+void celt_pitch_xcorr_avx2(const opus_val16 *_x,
+    const opus_val16 *_y,
+    opus_val32       *xcorr,
+    int               len,
+    int               max_pitch,
+    int               arch);
+
+opus_val32 celt_inner_prod_avx2(
+    const opus_val16 *x,
+    const opus_val16 *y,
+    int               N);
+
+void dual_inner_prod_avx2(const opus_val16 *x,
+    const opus_val16 *y01,
+    const opus_val16 *y02,
+    int               N,
+    opus_val32       *xy1,
+    opus_val32       *xy2);
+
+void comb_filter_const_avx2(opus_val32 *y,
+    opus_val32 *x,
+    int         T,
+    int         N,
+    opus_val16  g10,
+    opus_val16  g11,
+    opus_val16  g12);
+
+#if defined(OPUS_X86_MAY_HAVE_AVX512)
+void celt_pitch_xcorr_avx512(const opus_val16 *_x,
+    const opus_val16 *_y,
+    opus_val32       *xcorr,
+    int               len,
+    int               max_pitch,
+    int               arch);
+#endif
+
+extern void (*const PITCH_XCORR_IMPL[OPUS_ARCHMASK + 1])(
+              const opus_val16 *_x,
+              const opus_val16 *_y,
+              opus_val32       *xcorr,
+              int               len,
+              int               max_pitch,
+              int               arch);
+
+#define OVERRIDE_PITCH_XCORR
+#define celt_pitch_xcorr(_x, _y, xcorr, len, max_pitch, arch) \
+    ((*PITCH_XCORR_IMPL[(arch) & OPUS_ARCHMASK])(_x, _y, xcorr, len, max_pitch, arch))
+
+#endif
+
 #endif
@@ -0,0 +1,243 @@
+/* Copyright (c) 2007-2008 CSIRO
+   Copyright (c) 2007-2009 Xiph.Org Foundation
+   Copyright (c) 2007-2016 Jean-Marc Valin */
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <immintrin.h>
+#include "celt_lpc.h"
+#include "stack_alloc.h"
+#include "mathops.h"
+#include "vq.h"
+#include "x86cpu.h"
+
+
+#if defined(OPUS_X86_MAY_HAVE_AVX2) && !defined(FIXED_POINT)
+
+/* 8-wide version of op_pvq_search_sse2(). The caller must allocate iy with
+   room for N+7 entries. */
+opus_val16 op_pvq_search_avx2(celt_norm *_X, int *iy, int K, int N, int arch)
+{
+   int i, j;
+   int pulsesLeft;
+   float xy, yy;
+   VARDECL(celt_norm, y);
+   VARDECL(celt_norm, X);
+   VARDECL(float, signy);
+   __m256 signmask;
+   __m256 sums;
+   __m256i eights;
+   __m128 sum4;
+   SAVE_STACK;
+
+#if defined(OPUS_X86_MAY_HAVE_SSE2)
+   /* On short bands the wider horizontal max in the pulse loop costs more
+      than the halved number of iterations saves. */
+   if (N < 32)
+   {
+      RESTORE_STACK;
+      return op_pvq_search_sse2(_X, iy, K, N, arch);
+   }
+#endif
+   (void)arch;
+   /* All bits set to zero, except for the sign bit. */
+   signmask = _mm256_set1_ps(-0.f);
+   eights = _mm256_set1_epi32(8);
+   ALLOC(y, N+7, celt_norm);
+   ALLOC(X, N+7, celt_norm);
+   ALLOC(signy, N+7, float);
+
+   OPUS_COPY(X, _X, N);
+   for (j=N;j<N+7;j++)
+      X[j] = 0;
+   sums = _mm256_setzero_ps();
+   for (j=0;j<N;j+=8)
+   {
+      __m256 x8, s8;
+      x8 = _mm256_loadu_ps(&X[j]);
+      s8 = _mm256_cmp_ps(x8, _mm256_setzero_ps(), _CMP_LT_OQ);
+      /* Get rid of the sign */
+      x8 = _mm256_andnot_ps(signmask, x8);
+      sums = _mm256_add_ps(sums, x8);
+      /* Clear y and iy in case we don't do the projection. */
+      _mm256_storeu_ps(&y[j], _mm256_setzero_ps());
+      _mm256_storeu_si256((__m256i*)&iy[j], _mm256_setzero_si256());
+      _mm256_storeu_ps(&X[j], x8);
+      _mm256_storeu_ps(&signy[j], s8);
+   }
+   sum4 = _mm_add_ps(_mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1));
+   sum4 = _mm_add_ps(sum4, _mm_shuffle_ps(sum4, sum4, _MM_SHUFFLE(1, 0, 3, 2)));
+   sum4 = _mm_add_ps(sum4, _mm_shuffle_ps(sum4, sum4, _MM_SHUFFLE(2, 3, 0, 1)));
+
+   xy = yy = 0;
+
+   pulsesLeft = K;
+
+   /* Do a pre-search by projecting on the pyramid */
+   if (K > (N>>1))
+   {
+      __m256i pulses_sum;
+      __m256 yy8, xy8;
+      __m256 rcp8;
+      __m128i pulses4;
+      __m128 xy4, yy4;
+      opus_val32 sum = _mm_cvtss_f32(sum4);
+      /* If X is too small, just replace it with a pulse at 0 */
+      /* Prevents infinities and NaNs from causing too many pulses
+         to be allocated. 64 is an approximation of infinity here. */
+      if (!(sum > EPSILON && sum < 64))
+      {
+         X[0] = QCONST16(1.f,14);
+         j=1; do
+            X[j]=0;
+         while (++j<N);
+         sum = 1.f;
+      }
+      /* Using K+e with e < 1 guarantees we cannot get more than K pulses.
+         Matches the _mm_rcp_ps() approximation of the SSE2 version. */
+      rcp8 = _mm256_mul_ps(_mm256_set1_ps((float)(K+.8)),
+                           _mm256_rcp_ps(_mm256_set1_ps(sum)));
+      xy8 = yy8 = _mm256_setzero_ps();
+      pulses_sum = _mm256_setzero_si256();
+      for (j=0;j<N;j+=8)
+      {
+         __m256 rx8, x8, y8;
+         __m256i iy8;
+         x8 = _mm256_loadu_ps(&X[j]);
+         rx8 = _mm256_mul_ps(x8, rcp8);
+         iy8 = _mm256_cvttps_epi32(rx8);
+         pulses_sum = _mm256_add_epi32(pulses_sum, iy8);
+         _mm256_storeu_si256((__m256i*)&iy[j], iy8);
+         y8 = _mm256_cvtepi32_ps(iy8);
+         xy8 = _mm256_fmadd_ps(x8, y8, xy8);
+         yy8 = _mm256_fmadd_ps(y8, y8, yy8);
+         /* double the y[] vector so we don't have to do it in the search loop. */
+         _mm256_storeu_ps(&y[j], _mm256_add_ps(y8, y8));
+      }
+      pulses4 = _mm_add_epi32(_mm256_castsi256_si128(pulses_sum), _mm256_extracti128_si256(pulses_sum, 1));
+      pulses4 = _mm_add_epi32(pulses4, _mm_shuffle_epi32(pulses4, _MM_SHUFFLE(1, 0, 3, 2)));
+      pulses4 = _mm_add_epi32(pulses4, _mm_shuffle_epi32(pulses4, _MM_SHUFFLE(2, 3, 0, 1)));
+      pulsesLeft -= _mm_cvtsi128_si32(pulses4);
+      xy4 = _mm_add_ps(_mm256_castps256_ps128(xy8), _mm256_extractf128_ps(xy8, 1));
+      xy4 = _mm_add_ps(xy4, _mm_shuffle_ps(xy4, xy4, _MM_SHUFFLE(1, 0, 3, 2)));
+      xy4 = _mm_add_ps(xy4, _mm_shuffle_ps(xy4, xy4, _MM_SHUFFLE(2, 3, 0, 1)));
+      xy = _mm_cvtss_f32(xy4);
+      yy4 = _mm_add_ps(_mm256_castps256_ps128(yy8), _mm256_extractf128_ps(yy8, 1));
+      yy4 = _mm_add_ps(yy4, _mm_shuffle_ps(yy4, yy4, _MM_SHUFFLE(1, 0, 3, 2)));
+      yy4 = _mm_add_ps(yy4, _mm_shuffle_ps(yy4, yy4, _MM_SHUFFLE(2, 3, 0, 1)));
+      yy = _mm_cvtss_f32(yy4);
+   }
+   for (j=N;j<N+7;j++)
+   {
+      X[j] = -100;
+      y[j] = 100;
+   }
+   celt_sig_assert(pulsesLeft>=0);
+
+   /* This should never happen, but just in case it does (e.g. on silence)
+      we fill the first bin with pulses. */
+   if (pulsesLeft > N+3)
+   {
+      opus_val16 tmp = (opus_val16)pulsesLeft;
+      yy = MAC16_16(yy, tmp, tmp);
+      yy = MAC16_16(yy, tmp, y[0]);
+      iy[0] += pulsesLeft;
+      pulsesLeft=0;
+   }
+
+   for (i=0;i<pulsesLeft;i++)
+   {
+      int best_id;
+      __m256 xy8, yy8;
+      __m256 max, max2;
+      __m256i count;
+      __m256i pos;
+      __m128i pos4;
+      /* The squared magnitude term gets added anyway, so we might as well
+         add it outside the loop */
+      yy = ADD16(yy, 1);
+      xy8 = _mm256_set1_ps(xy);
+      yy8 = _mm256_set1_ps(yy);
+      max = _mm256_setzero_ps();
+      pos = _mm256_setzero_si256();
+      count = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+      for (j=0;j<N;j+=8)
+      {
+         __m256 x8, y8, r8;
+         x8 = _mm256_loadu_ps(&X[j]);
+         y8 = _mm256_loadu_ps(&y[j]);
+         x8 = _mm256_add_ps(x8, xy8);
+         y8 = _mm256_add_ps(y8, yy8);
+         y8 = _mm256_rsqrt_ps(y8);
+         r8 = _mm256_mul_ps(x8, y8);
+         /* Update the index of the max. */
+         pos = _mm256_max_epi32(pos, _mm256_and_si256(count, _mm256_castps_si256(_mm256_cmp_ps(r8, max, _CMP_GT_OQ))));
+         /* Update the max. */
+         max = _mm256_max_ps(max, r8);
+         /* Update the indices (+8) */
+         count = _mm256_add_epi32(count, eights);
+      }
+      /* Horizontal max */
+      max2 = _mm256_max_ps(max, _mm256_permute2f128_ps(max, max, 1));
+      max2 = _mm256_max_ps(max2, _mm256_shuffle_ps(max2, max2, _MM_SHUFFLE(1, 0, 3, 2)));
+      max2 = _mm256_max_ps(max2, _mm256_shuffle_ps(max2, max2, _MM_SHUFFLE(2, 3, 0, 1)));
+      /* Now that max2 contains the max at all positions, look at which value(s) of the
+         partial max is equal to the global max. */
+      pos = _mm256_and_si256(pos, _mm256_castps_si256(_mm256_cmp_ps(max, max2, _CMP_EQ_OQ)));
+      pos4 = _mm_max_epi32(_mm256_castsi256_si128(pos), _mm256_extracti128_si256(pos, 1));
+      pos4 = _mm_max_epi32(pos4, _mm_unpackhi_epi64(pos4, pos4));
+      pos4 = _mm_max_epi32(pos4, _mm_shuffle_epi32(pos4, _MM_SHUFFLE(2, 3, 0, 1)));
+      best_id = _mm_cvtsi128_si32(pos4);
+
+      /* Updating the sums of the new pulse(s) */
+      xy = ADD32(xy, EXTEND32(X[best_id]));
+      /* We're multiplying y[j] by two so we don't have to do it here */
+      yy = ADD16(yy, y[best_id]);
+
+      /* Only now that we've made the final choice, update y/iy */
+      /* Multiplying y[j] by 2 so we don't have to do it everywhere else */
+      y[best_id] += 2;
+      iy[best_id]++;
+   }
+
+   /* Put the original sign back */
+   for (j=0;j<N;j+=8)
+   {
+      __m256i y8;
+      __m256i s8;
+      y8 = _mm256_loadu_si256((__m256i*)&iy[j]);
+      s8 = _mm256_castps_si256(_mm256_loadu_ps(&signy[j]));
+      y8 = _mm256_xor_si256(_mm256_add_epi32(y8, s8), s8);
+      _mm256_storeu_si256((__m256i*)&iy[j], y8);
+   }
+   RESTORE_STACK;
+   return yy;
+}
+
+#endif
@@ -53,7 +53,9 @@ void (*const CELT_FIR_IMPL[OPUS_ARCHMASK + 1])(
   celt_fir_c,
   celt_fir_c,
   MAY_HAVE_SSE4_1(celt_fir), /* sse4.1  */
-  MAY_HAVE_SSE4_1(celt_fir)  /* avx  */
+  MAY_HAVE_SSE4_1(celt_fir), /* avx  */
+  MAY_HAVE_SSE4_1(celt_fir), /* avx2  */
+  MAY_HAVE_SSE4_1(celt_fir)  /* avx512  */
 };
 
 void (*const XCORR_KERNEL_IMPL[OPUS_ARCHMASK + 1])(
@@ -66,7 +68,9 @@ void (*const XCORR_KERNEL_IMPL[OPUS_ARCHMASK + 1])(
   xcorr_kernel_c,
   xcorr_kernel_c,
   MAY_HAVE_SSE4_1(xcorr_kernel), /* sse4.1  */
-  MAY_HAVE_SSE4_1(xcorr_kernel)  /* avx  */
+  MAY_HAVE_SSE4_1(xcorr_kernel), /* avx  */
+  MAY_HAVE_SSE4_1(xcorr_kernel), /* avx2  */
+  MAY_HAVE_SSE4_1(xcorr_kernel)  /* avx512  */
 };
 
 #endif
@@ -83,7 +87,9 @@ opus_val32 (*const CELT_INNER_PROD_IMPL[OPUS_ARCHMASK + 1])(
   celt_inner_prod_c,
   MAY_HAVE_SSE2(celt_inner_prod),
   MAY_HAVE_SSE4_1(celt_inner_prod), /* sse4.1  */
-  MAY_HAVE_SSE4_1(celt_inner_prod)  /* avx  */
+  MAY_HAVE_SSE4_1(celt_inner_prod), /* avx  */
+  MAY_HAVE_SSE4_1(celt_inner_prod), /* avx2  */
+  MAY_HAVE_SSE4_1(celt_inner_prod)  /* avx512  */
 };
 
 #endif
@@ -102,9 +108,37 @@ void (*const XCORR_KERNEL_IMPL[OPUS_ARCHMASK + 1])(
   MAY_HAVE_SSE(xcorr_kernel),
   MAY_HAVE_SSE(xcorr_kernel),
   MAY_HAVE_SSE(xcorr_kernel),
+  MAY_HAVE_SSE(xcorr_kernel),
+  MAY_HAVE_SSE(xcorr_kernel),
   MAY_HAVE_SSE(xcorr_kernel)
 };
 
+#endif
+
+#if defined(OPUS_X86_MAY_HAVE_AVX2)
+
+void (*const PITCH_XCORR_IMPL[OPUS_ARCHMASK + 1])(
+         const opus_val16 *_x,
+         const opus_val16 *_y,
+         opus_val32       *xcorr,
+         int              len,
+         int              max_pitch,
+         int              arch
+) = {
+  celt_pitch_xcorr_c,                /* non-sse */
+  celt_pitch_xcorr_c,
+  celt_pitch_xcorr_c,
+  celt_pitch_xcorr_c,
+  celt_pitch_xcorr_c,                /* avx */
+  MAY_HAVE_AVX2(celt_pitch_xcorr),   /* avx2 */
+  MAY_HAVE_AVX512(celt_pitch_xcorr)  /* avx512 */
+};
+
+#endif
+
+#if (defined(OPUS_X86_MAY_HAVE_SSE) && !defined(OPUS_X86_PRESUME_SSE)) || \
+  defined(OPUS_X86_MAY_HAVE_AVX2)
+
 opus_val32 (*const CELT_INNER_PROD_IMPL[OPUS_ARCHMASK + 1])(
          const opus_val16 *x,
          const opus_val16 *y,
@@ -114,7 +148,9 @@ opus_val32 (*const CELT_INNER_PROD_IMPL[OPUS_ARCHMASK + 1])(
   MAY_HAVE_SSE(celt_inner_prod),
   MAY_HAVE_SSE(celt_inner_prod),
   MAY_HAVE_SSE(celt_inner_prod),
-  MAY_HAVE_SSE(celt_inner_prod)
+  MAY_HAVE_SSE(celt_inner_prod),
+  MAY_HAVE_AVX2(celt_inner_prod),   /* avx2 */
+  MAY_HAVE_AVX2(celt_inner_prod)    /* avx512 */
 };
 
 void (*const DUAL_INNER_PROD_IMPL[OPUS_ARCHMASK + 1])(
@@ -129,7 +165,9 @@ void (*const DUAL_INNER_PROD_IMPL[OPUS_ARCHMASK + 1])(
   MAY_HAVE_SSE(dual_inner_prod),
   MAY_HAVE_SSE(dual_inner_prod),
   MAY_HAVE_SSE(dual_inner_prod),
-  MAY_HAVE_SSE(dual_inner_prod)
+  MAY_HAVE_SSE(dual_inner_prod),
+  MAY_HAVE_AVX2(dual_inner_prod),   /* avx2 */
+  MAY_HAVE_AVX2(dual_inner_prod)    /* avx512 */
 };
 
 void (*const COMB_FILTER_CONST_IMPL[OPUS_ARCHMASK + 1])(
@@ -145,13 +183,16 @@ void (*const COMB_FILTER_CONST_IMPL[OPUS_ARCHMASK + 1])(
   MAY_HAVE_SSE(comb_filter_const),
   MAY_HAVE_SSE(comb_filter_const),
   MAY_HAVE_SSE(comb_filter_const),
-  MAY_HAVE_SSE(comb_filter_const)
+  MAY_HAVE_SSE(comb_filter_const),
+  MAY_HAVE_AVX2(comb_filter_const),   /* avx2 */
+  MAY_HAVE_AVX2(comb_filter_const)    /* avx512 */
 };
 
 
 #endif
 
-#if defined(OPUS_X86_MAY_HAVE_SSE2) && !defined(OPUS_X86_PRESUME_SSE2)
+#if (defined(OPUS_X86_MAY_HAVE_SSE2) && !defined(OPUS_X86_PRESUME_SSE2)) || \
+  defined(OPUS_X86_MAY_HAVE_AVX2)
 opus_val16 (*const OP_PVQ_SEARCH_IMPL[OPUS_ARCHMASK + 1])(
       celt_norm *_X, int *iy, int K, int N, int arch
 ) = {
@@ -159,7 +200,9 @@ opus_val16 (*const OP_PVQ_SEARCH_IMPL[OPUS_ARCHMASK + 1])(
   op_pvq_search_c,
   MAY_HAVE_SSE2(op_pvq_search),
   MAY_HAVE_SSE2(op_pvq_search),
-  MAY_HAVE_SSE2(op_pvq_search)
+  MAY_HAVE_SSE2(op_pvq_search),
+  MAY_HAVE_AVX2(op_pvq_search),   /* avx2 */
+  MAY_HAVE_AVX2(op_pvq_search)    /* avx512 */
 };
 #endif
 
@@ -38,15 +38,21 @@
 #if (defined(OPUS_X86_MAY_HAVE_SSE) && !defined(OPUS_X86_PRESUME_SSE)) || \
   (defined(OPUS_X86_MAY_HAVE_SSE2) && !defined(OPUS_X86_PRESUME_SSE2)) || \
   (defined(OPUS_X86_MAY_HAVE_SSE4_1) && !defined(OPUS_X86_PRESUME_SSE4_1)) || \
-  (defined(OPUS_X86_MAY_HAVE_AVX) && !defined(OPUS_X86_PRESUME_AVX))
+  (defined(OPUS_X86_MAY_HAVE_AVX) && !defined(OPUS_X86_PRESUME_AVX)) || \
+  defined(OPUS_X86_MAY_HAVE_AVX2)
 
 
 #if defined(_MSC_VER)
 
 #include <intrin.h>
-static _inline void cpuid(unsigned int CPUInfo[4], unsigned int InfoType)
+static _inline void cpuid(unsigned int CPUInfo[4], unsigned int InfoType, unsigned int SubType)
 {
-    __cpuid((int*)CPUInfo, InfoType);
+    __cpuidex((int*)CPUInfo, InfoType, SubType);
+}
+
+static _inline unsigned int xgetbv0(void)
+{
+    return (unsigned int)_xgetbv(0);
 }
 
 #else
@@ -55,7 +61,7 @@ static _inline void cpuid(unsigned int CPUInfo[4], unsigned int InfoType)
 #include <cpuid.h>
 #endif
 
-static void cpuid(unsigned int CPUInfo[4], unsigned int InfoType)
+static void cpuid(unsigned int CPUInfo[4], unsigned int InfoType, unsigned int SubType)
 {
 #if defined(CPU_INFO_BY_ASM)
 #if defined(__i386__) && defined(__PIC__)
@@ -68,7 +74,7 @@ static void cpuid(unsigned int CPUInfo[4], unsigned int InfoType)
         "=r" (CPUInfo[1]),
         "=c" (CPUInfo[2]),
         "=d" (CPUInfo[3]) :
-        "0" (InfoType)
+        "0" (InfoType), "2" (SubType)
     );
 #else
     __asm__ __volatile__ (
@@ -77,14 +83,27 @@ static void cpuid(unsigned int CPUInfo[4], unsigned int InfoType)
         "=b" (CPUInfo[1]),
         "=c" (CPUInfo[2]),
         "=d" (CPUInfo[3]) :
-        "0" (InfoType)
+        "0" (InfoType), "2" (SubType)
     );
 #endif
 #elif defined(CPU_INFO_BY_C)
-    __get_cpuid(InfoType, &(CPUInfo[0]), &(CPUInfo[1]), &(CPUInfo[2]), &(CPUInfo[3]));
+    __get_cpuid_count(InfoType, SubType, &(CPUInfo[0]), &(CPUInfo[1]), &(CPUInfo[2]), &(CPUInfo[3]));
 #endif
 }
 
+/* Reads XCR0. Only valid when CPUID reports OSXSAVE. */
+static unsigned int xgetbv0(void)
+{
+    unsigned int eax, edx;
+    __asm__ __volatile__ (
+        "xgetbv":
+        "=a" (eax),
+        "=d" (edx) :
+        "c" (0)
+    );
+    return eax;
+}
+
 #endif
 
 typedef struct CPU_Feature{
@@ -94,22 +113,36 @@ typedef struct CPU_Feature{
     int HW_SSE41;
     /*  SIMD: 256-bit */
     int HW_AVX;
+    int HW_AVX2;
+    /*  SIMD: 512-bit */
+    int HW_AVX512;
 } CPU_Feature;
 
 static void opus_cpu_feature_check(CPU_Feature *cpu_feature)
 {
     unsigned int info[4] = {0};
     unsigned int nIds = 0;
+    unsigned int xcr0 = 0;
+    int fma = 0;
 
-    cpuid(info, 0);
+    cpuid(info, 0, 0);
     nIds = info[0];
 
+    cpu_feature->HW_AVX2 = 0;
+    cpu_feature->HW_AVX512 = 0;
+
     if (nIds >= 1){
-        cpuid(info, 1);
+        cpuid(info, 1, 0);
         cpu_feature->HW_SSE = (info[3] & (1 << 25)) != 0;
         cpu_feature->HW_SSE2 = (info[3] & (1 << 26)) != 0;
         cpu_feature->HW_SSE41 = (info[2] & (1 << 19)) != 0;
         cpu_feature->HW_AVX = (info[2] & (1 << 28)) != 0;
+        fma = (info[2] & (1 << 12)) != 0;
+        /* The OS must save the YMM (and for AVX-512 the ZMM/opmask) state. */
+        if (info[2] & (1 << 27))
+        {
+            xcr0 = xgetbv0();
+        }
     }
     else {
         cpu_feature->HW_SSE = 0;
@@ -117,6 +150,14 @@ static void opus_cpu_feature_check(CPU_Feature *cpu_feature)
         cpu_feature->HW_SSE41 = 0;
         cpu_feature->HW_AVX = 0;
     }
+
+    if (nIds >= 7){
+        cpuid(info, 7, 0);
+        cpu_feature->HW_AVX2 = cpu_feature->HW_AVX && fma
+            && (xcr0 & 0x06) == 0x06 && (info[1] & (1 << 5)) != 0;
+        cpu_feature->HW_AVX512 = cpu_feature->HW_AVX2
+            && (xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)) != 0;
+    }
 }
 
 int opus_select_arch(void)
@@ -151,6 +192,22 @@ int opus_select_arch(void)
     }
     arch++;
 
+#if defined(OPUS_X86_MAY_HAVE_AVX2)
+    if (!cpu_feature.HW_AVX2)
+    {
+        return arch;
+    }
+    arch++;
+
+#if defined(OPUS_X86_MAY_HAVE_AVX512)
+    if (!cpu_feature.HW_AVX512)
+    {
+        return arch;
+    }
+    arch++;
+#endif
+#endif
+
     return arch;
 }
 
@@ -52,6 +52,18 @@
 #  define MAY_HAVE_AVX(name) name ## _c
 # endif
 
+# if defined(OPUS_X86_MAY_HAVE_AVX2)
+#  define MAY_HAVE_AVX2(name) name ## _avx2
+# else
+#  define MAY_HAVE_AVX2(name) name ## _c
+# endif
+
+# if defined(OPUS_X86_MAY_HAVE_AVX512)
+#  define MAY_HAVE_AVX512(name) name ## _avx512
+# else
+#  define MAY_HAVE_AVX512(name) name ## _c
+# endif
+
 # if defined(OPUS_HAVE_RTCD)
 int opus_select_arch(void);
 # endif
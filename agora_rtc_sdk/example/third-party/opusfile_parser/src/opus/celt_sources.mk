@@ -31,6 +31,13 @@ CELT_SOURCES_SSE4_1 = \
 celt/x86/celt_lpc_sse4_1.c \
 celt/x86/pitch_sse4_1.c
 
+CELT_SOURCES_AVX2 = \
+celt/x86/pitch_avx2.c \
+celt/x86/vq_avx2.c
+
+CELT_SOURCES_AVX512 = \
+celt/x86/pitch_avx512.c
+
 CELT_SOURCES_ARM = \
 celt/arm/armcpu.c \
 celt/arm/arm_celt_map.c
@@ -16,6 +16,27 @@ if(HAVE_LIBM)
   list(APPEND OPUS_REQUIRED_LIBRARIES m)
 endif()
 
+# A toolchain file that sets CMAKE_SYSTEM_NAME, like scripts/toolchain.cmake,
+# makes the build a cross compile and leaves CMAKE_SYSTEM_PROCESSOR empty.
+# Take the target processor from the compiler then.
+if(NOT CMAKE_SYSTEM_PROCESSOR)
+  include(CheckSymbolExists)
+  check_symbol_exists(__x86_64__ "" OPUS_TARGET_X86_64)
+  check_symbol_exists(__i386__ "" OPUS_TARGET_I386)
+  check_symbol_exists(__aarch64__ "" OPUS_TARGET_AARCH64)
+  check_symbol_exists(__arm__ "" OPUS_TARGET_ARM)
+  if(OPUS_TARGET_X86_64)
+    set(CMAKE_SYSTEM_PROCESSOR x86_64)
+  elseif(OPUS_TARGET_I386)
+    set(CMAKE_SYSTEM_PROCESSOR i686)
+  elseif(OPUS_TARGET_AARCH64)
+    set(CMAKE_SYSTEM_PROCESSOR aarch64)
+  elseif(OPUS_TARGET_ARM)
+    set(CMAKE_SYSTEM_PROCESSOR arm)
+  endif()
+  message(STATUS "Opus target processor from the compiler: ${CMAKE_SYSTEM_PROCESSOR}")
+endif()
+
 if(CMAKE_SYSTEM_PROCESSOR MATCHES "(i[0-9]86|x86|X86|amd64|AMD64|x86_64)")
   if(CMAKE_SIZEOF_VOID_P EQUAL 8)
     set(OPUS_CPU_X64 1)
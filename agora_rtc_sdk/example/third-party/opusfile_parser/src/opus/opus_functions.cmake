@@ -165,6 +165,27 @@ function(opus_detect_sse COMPILER_SUPPORT_SIMD)
     set(AVX_SUPPORTED 0 PARENT_SCOPE)
   endif()
 
+  # AVX2 and AVX-512 are only enabled per source file, the rest of the library
+  # must keep running on CPUs without them
+  if(HAVE_IMMINTRIN_H)
+    if(MSVC)
+      check_flag(AVX2 /arch:AVX2)
+      set(FMA_SUPPORTED ${AVX2_SUPPORTED} PARENT_SCOPE)
+      set(AVX2_FLAGS "/arch:AVX2" PARENT_SCOPE)
+      check_flag(AVX512 /arch:AVX512)
+      set(AVX512_FLAGS "/arch:AVX512" PARENT_SCOPE)
+    else()
+      check_flag(AVX2 -mavx2)
+      check_flag(FMA -mfma)
+      set(AVX2_FLAGS "-mavx2 -mfma" PARENT_SCOPE)
+      check_flag(AVX512 -mavx512f)
+      set(AVX512_FLAGS "-mavx2 -mfma -mavx512f" PARENT_SCOPE)
+    endif()
+  else()
+    set(AVX2_SUPPORTED 0 PARENT_SCOPE)
+    set(AVX512_SUPPORTED 0 PARENT_SCOPE)
+  endif()
+
   if(MSVC) # To avoid warning D9025 of overriding compiler options
     if(AVX_SUPPORTED) # on 64 bit and 32 bits
       add_definitions(/arch:AVX)
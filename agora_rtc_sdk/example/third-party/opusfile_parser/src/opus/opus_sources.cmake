@@ -18,6 +18,8 @@ get_opus_sources(CELT_SOURCES celt_sources.mk celt_sources)
 get_opus_sources(CELT_SOURCES_SSE celt_sources.mk celt_sources_sse)
 get_opus_sources(CELT_SOURCES_SSE2 celt_sources.mk celt_sources_sse2)
 get_opus_sources(CELT_SOURCES_SSE4_1 celt_sources.mk celt_sources_sse4_1)
+get_opus_sources(CELT_SOURCES_AVX2 celt_sources.mk celt_sources_avx2)
+get_opus_sources(CELT_SOURCES_AVX512 celt_sources.mk celt_sources_avx512)
 get_opus_sources(CELT_SOURCES_ARM celt_sources.mk celt_sources_arm)
 get_opus_sources(CELT_SOURCES_ARM_ASM celt_sources.mk celt_sources_arm_asm)
 get_opus_sources(CELT_AM_SOURCES_ARM_ASM celt_sources.mk
@@ -50,7 +50,9 @@ opus_int64 (*const SILK_INNER_PROD16_ALIGNED_64_IMPL[ OPUS_ARCHMASK + 1 ] )(
   silk_inner_prod16_aligned_64_c,
   silk_inner_prod16_aligned_64_c,
   MAY_HAVE_SSE4_1( silk_inner_prod16_aligned_64 ), /* sse4.1 */
-  MAY_HAVE_SSE4_1( silk_inner_prod16_aligned_64 )  /* avx */
+  MAY_HAVE_SSE4_1( silk_inner_prod16_aligned_64 ), /* avx */
+  MAY_HAVE_SSE4_1( silk_inner_prod16_aligned_64 ), /* avx2 */
+  MAY_HAVE_SSE4_1( silk_inner_prod16_aligned_64 )  /* avx512 */
 };
 
 #endif
@@ -63,7 +65,9 @@ opus_int (*const SILK_VAD_GETSA_Q8_IMPL[ OPUS_ARCHMASK + 1 ] )(
   silk_VAD_GetSA_Q8_c,
   silk_VAD_GetSA_Q8_c,
   MAY_HAVE_SSE4_1( silk_VAD_GetSA_Q8 ), /* sse4.1 */
-  MAY_HAVE_SSE4_1( silk_VAD_GetSA_Q8 )  /* avx */
+  MAY_HAVE_SSE4_1( silk_VAD_GetSA_Q8 ), /* avx */
+  MAY_HAVE_SSE4_1( silk_VAD_GetSA_Q8 ), /* avx2 */
+  MAY_HAVE_SSE4_1( silk_VAD_GetSA_Q8 )  /* avx512 */
 };
 
 #if 0 /* FIXME: SSE disabled until the NSQ code gets updated. */
@@ -88,7 +92,9 @@ void (*const SILK_NSQ_IMPL[ OPUS_ARCHMASK + 1 ] )(
   silk_NSQ_c,
   silk_NSQ_c,
   MAY_HAVE_SSE4_1( silk_NSQ ), /* sse4.1 */
-  MAY_HAVE_SSE4_1( silk_NSQ )  /* avx */
+  MAY_HAVE_SSE4_1( silk_NSQ ), /* avx */
+  MAY_HAVE_SSE4_1( silk_NSQ ), /* avx2 */
+  MAY_HAVE_SSE4_1( silk_NSQ )  /* avx512 */
 };
 #endif
 
@@ -110,7 +116,9 @@ void (*const SILK_VQ_WMAT_EC_IMPL[ OPUS_ARCHMASK + 1 ] )(
   silk_VQ_WMat_EC_c,
   silk_VQ_WMat_EC_c,
   MAY_HAVE_SSE4_1( silk_VQ_WMat_EC ), /* sse4.1 */
-  MAY_HAVE_SSE4_1( silk_VQ_WMat_EC )  /* avx */
+  MAY_HAVE_SSE4_1( silk_VQ_WMat_EC ), /* avx */
+  MAY_HAVE_SSE4_1( silk_VQ_WMat_EC ), /* avx2 */
+  MAY_HAVE_SSE4_1( silk_VQ_WMat_EC )  /* avx512 */
 };
 #endif
 
@@ -136,7 +144,9 @@ void (*const SILK_NSQ_DEL_DEC_IMPL[ OPUS_ARCHMASK + 1 ] )(
   silk_NSQ_del_dec_c,
   silk_NSQ_del_dec_c,
   MAY_HAVE_SSE4_1( silk_NSQ_del_dec ), /* sse4.1 */
-  MAY_HAVE_SSE4_1( silk_NSQ_del_dec )  /* avx */
+  MAY_HAVE_SSE4_1( silk_NSQ_del_dec ), /* avx */
+  MAY_HAVE_SSE4_1( silk_NSQ_del_dec ), /* avx2 */
+  MAY_HAVE_SSE4_1( silk_NSQ_del_dec )  /* avx512 */
 };
 #endif
 
@@ -157,7 +167,9 @@ void (*const SILK_BURG_MODIFIED_IMPL[ OPUS_ARCHMASK + 1 ] )(
   silk_burg_modified_c,
   silk_burg_modified_c,
   MAY_HAVE_SSE4_1( silk_burg_modified ), /* sse4.1 */
-  MAY_HAVE_SSE4_1( silk_burg_modified )  /* avx */
+  MAY_HAVE_SSE4_1( silk_burg_modified ), /* avx */
+  MAY_HAVE_SSE4_1( silk_burg_modified ), /* avx2 */
+  MAY_HAVE_SSE4_1( silk_burg_modified )  /* avx512 */
 };
 
 #endif
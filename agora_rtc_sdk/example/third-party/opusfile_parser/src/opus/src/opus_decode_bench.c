@@ -0,0 +1,306 @@
+/* Decode throughput benchmark.
+
+   Encodes a few seconds of synthetic stereo music once, then decodes the
+   packets with many independent decoders (as a transcoding server would) and
+   reports how many real-time streams a single core can sustain. Optional
+   packet loss exercises the PLC, which runs the pitch search.
+
+   It also times the CELT kernels behind the x86 RTCD tables at every
+   architecture level the CPU supports, so the effect of a given SIMD level is
+   visible independently of the rest of the codec. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "opus.h"
+#include "cpu_support.h"
+#include "pitch.h"
+#include "vq.h"
+
+#define MAX_PACKET (1500)
+#define MAX_FRAME_SIZE (48000*60/1000)
+#define SAMPLE_RATE (48000)
+#define BENCH_PI (3.14159265358979)
+
+static const char *arch_names[] = {
+   "c", "sse", "sse2", "sse4.1", "avx", "avx2", "avx512"
+};
+
+static void print_usage(char *argv[])
+{
+   fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+   fprintf(stderr, "  -streams <n>      : number of concurrent decoders (default 64)\n");
+   fprintf(stderr, "  -seconds <s>      : length of the encoded clip (default 10)\n");
+   fprintf(stderr, "  -repeat <n>       : number of passes over the clip (default 3)\n");
+   fprintf(stderr, "  -bitrate <bps>    : encoder bitrate (default 64000)\n");
+   fprintf(stderr, "  -channels <1|2>   : number of channels (default 2)\n");
+   fprintf(stderr, "  -framesize <ms>   : 2.5, 5, 10, 20, 40 or 60 (default 20)\n");
+   fprintf(stderr, "  -loss <percent>   : simulated packet loss (default 0)\n");
+   fprintf(stderr, "  -nokernels        : skip the per-architecture kernel timings\n");
+}
+
+static unsigned int rand_state = 0x2545F491;
+
+static unsigned int fast_rand(void)
+{
+   rand_state = rand_state*1664525 + 1013904223;
+   return rand_state;
+}
+
+static float noise(void)
+{
+   return ((int)(fast_rand()>>16) - 32768)*(1.f/32768);
+}
+
+static double cpu_seconds(void)
+{
+   return (double)clock()/CLOCKS_PER_SEC;
+}
+
+/* A few detuned harmonic voices with vibrato over a noise floor, which keeps
+   CELT busy in every band and gives the pitch pre-filter something to lock on. */
+static void synth_music(opus_int16 *pcm, int samples, int channels)
+{
+   int i, c, v;
+   static const float base[3] = {110.f, 164.8f, 220.f};
+   for (i=0;i<samples;i++)
+   {
+      float t = (float)i/SAMPLE_RATE;
+      for (c=0;c<channels;c++)
+      {
+         float s = 0;
+         for (v=0;v<3;v++)
+         {
+            float f = base[v]*(1.f + .003f*(float)sin(2*BENCH_PI*5*t)) + .5f*c;
+            s += .2f*(float)sin(2*BENCH_PI*f*t) + .08f*(float)sin(2*BENCH_PI*3*f*t)
+                  + .04f*(float)sin(2*BENCH_PI*7*f*t);
+         }
+         s += .02f*noise();
+         pcm[i*channels+c] = (opus_int16)(s*12000);
+      }
+   }
+}
+
+static void run_kernels(int max_arch)
+{
+   int arch, i;
+   const int xcorr_len = 240, xcorr_lags = 244;
+   const int prod_len = 96;
+   const int pvq_n = 48, pvq_k = 16;
+   float x[1024], y[1024+256], xcorr[256], yy[1024];
+   celt_norm X[64];
+   int iy[64+7];
+   float sink = 0;
+
+   for (i=0;i<1024;i++) x[i] = noise();
+   for (i=0;i<1024+256;i++) y[i] = noise();
+
+   printf("kernel timings (ns per call):\n");
+   printf("  %-8s %12s %12s %12s %12s %12s\n", "arch", "xcorr(240)", "inner(96)",
+         "dual(240)", "comb(800)", "pvq(48,16)");
+   for (arch=0;arch<=max_arch;arch++)
+   {
+      double t0, t_xcorr, t_prod, t_dual, t_comb, t_pvq;
+      const int iters = 20000;
+      int n;
+
+      t0 = cpu_seconds();
+      for (n=0;n<iters;n++)
+      {
+         celt_pitch_xcorr(x, y, xcorr, xcorr_len, xcorr_lags, arch);
+         sink += xcorr[n&127];
+      }
+      t_xcorr = cpu_seconds() - t0;
+
+      t0 = cpu_seconds();
+      for (n=0;n<iters*20;n++)
+      {
+         sink += celt_inner_prod(x+(n&63), y, prod_len, arch);
+      }
+      t_prod = (cpu_seconds() - t0)/20;
+
+      t0 = cpu_seconds();
+      for (n=0;n<iters*10;n++)
+      {
+         opus_val32 xy1, xy2;
+         dual_inner_prod(x, y+(n&63), y+64, xcorr_len, &xy1, &xy2, arch);
+         sink += xy1 + xy2;
+      }
+      t_dual = (cpu_seconds() - t0)/10;
+
+#if defined(OVERRIDE_COMB_FILTER_CONST)
+      t0 = cpu_seconds();
+      for (n=0;n<iters;n++)
+      {
+         memcpy(yy, y, sizeof(yy));
+         comb_filter_const(yy+200, yy+200, 100, 800, .2f, .1f, .05f, arch);
+         sink += yy[n&511];
+      }
+      t_comb = cpu_seconds() - t0;
+#else
+      t_comb = 0;
+#endif
+
+      t0 = cpu_seconds();
+      for (n=0;n<iters*5;n++)
+      {
+         for (i=0;i<pvq_n;i++) X[i] = x[(n+i)&1023];
+         sink += op_pvq_search(X, iy, pvq_k, pvq_n, arch);
+      }
+      t_pvq = (cpu_seconds() - t0)/5;
+
+      printf("  %-8s %12.1f %12.1f %12.1f %12.1f %12.1f\n", arch_names[arch],
+            1e9*t_xcorr/iters, 1e9*t_prod/iters, 1e9*t_dual/iters,
+            1e9*t_comb/iters, 1e9*t_pvq/iters);
+   }
+   if (sink == 12345.f) printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+   int streams = 64;
+   int seconds = 10;
+   int repeat = 3;
+   int bitrate = 64000;
+   int channels = 2;
+   float frame_ms = 20;
+   int loss = 0;
+   int kernels = 1;
+   int frame_size, nb_frames;
+   int i, s, r, err;
+   opus_int16 *pcm;
+   opus_int16 out[MAX_FRAME_SIZE*2];
+   unsigned char *packets;
+   int *lens;
+   OpusEncoder *enc;
+   OpusDecoder **dec;
+   double t0, enc_time, dec_time, audio_seconds;
+   long lost = 0;
+
+   for (i=1;i<argc;i++)
+   {
+      if (strcmp(argv[i], "-streams")==0 && i+1<argc) streams = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-seconds")==0 && i+1<argc) seconds = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-repeat")==0 && i+1<argc) repeat = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-bitrate")==0 && i+1<argc) bitrate = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-channels")==0 && i+1<argc) channels = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-framesize")==0 && i+1<argc) frame_ms = (float)atof(argv[++i]);
+      else if (strcmp(argv[i], "-loss")==0 && i+1<argc) loss = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-nokernels")==0) kernels = 0;
+      else
+      {
+         print_usage(argv);
+         return EXIT_FAILURE;
+      }
+   }
+   frame_size = (int)(SAMPLE_RATE*frame_ms/1000);
+   if (streams<1 || seconds<1 || repeat<1 || (channels!=1 && channels!=2)
+         || frame_size<120 || frame_size>MAX_FRAME_SIZE || loss<0 || loss>100)
+   {
+      print_usage(argv);
+      return EXIT_FAILURE;
+   }
+   nb_frames = seconds*SAMPLE_RATE/frame_size;
+
+   printf("%s, arch %s (%d)\n", opus_get_version_string(),
+         arch_names[opus_select_arch()], opus_select_arch());
+   printf("%d stream(s), %d ch, %d bps, %.1f ms frames, %d%% loss, %d s x %d\n",
+         streams, channels, bitrate, frame_ms, loss, seconds, repeat);
+
+   pcm = (opus_int16*)malloc(sizeof(*pcm)*nb_frames*frame_size*channels);
+   packets = (unsigned char*)malloc(MAX_PACKET*nb_frames);
+   lens = (int*)malloc(sizeof(*lens)*nb_frames);
+   dec = (OpusDecoder**)malloc(sizeof(*dec)*streams);
+   if (!pcm || !packets || !lens || !dec)
+   {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+   }
+   synth_music(pcm, nb_frames*frame_size, channels);
+
+   enc = opus_encoder_create(SAMPLE_RATE, channels, OPUS_APPLICATION_AUDIO, &err);
+   if (err != OPUS_OK)
+   {
+      fprintf(stderr, "Cannot create encoder: %s\n", opus_strerror(err));
+      return EXIT_FAILURE;
+   }
+   opus_encoder_ctl(enc, OPUS_SET_BITRATE(bitrate));
+   opus_encoder_ctl(enc, OPUS_SET_COMPLEXITY(10));
+   t0 = cpu_seconds();
+   for (i=0;i<nb_frames;i++)
+   {
+      lens[i] = opus_encode(enc, pcm+i*frame_size*channels, frame_size,
+            packets+i*MAX_PACKET, MAX_PACKET);
+      if (lens[i] < 0)
+      {
+         fprintf(stderr, "opus_encode() failed: %s\n", opus_strerror(lens[i]));
+         return EXIT_FAILURE;
+      }
+      /* Mark lost packets up front so every decoder sees the same pattern. */
+      if (loss && (int)(fast_rand()%100) < loss)
+      {
+         lens[i] = 0;
+         lost++;
+      }
+   }
+   enc_time = cpu_seconds() - t0;
+   opus_encoder_destroy(enc);
+
+   for (s=0;s<streams;s++)
+   {
+      dec[s] = opus_decoder_create(SAMPLE_RATE, channels, &err);
+      if (err != OPUS_OK)
+      {
+         fprintf(stderr, "Cannot create decoder: %s\n", opus_strerror(err));
+         return EXIT_FAILURE;
+      }
+   }
+
+   /* Streams are interleaved frame by frame, like a server serving them all at once. */
+   t0 = cpu_seconds();
+   for (r=0;r<repeat;r++)
+   {
+      for (i=0;i<nb_frames;i++)
+      {
+         for (s=0;s<streams;s++)
+         {
+            int ret;
+            if (lens[i])
+               ret = opus_decode(dec[s], packets+i*MAX_PACKET, lens[i], out, frame_size, 0);
+            else
+               ret = opus_decode(dec[s], NULL, 0, out, frame_size, 0);
+            if (ret != frame_size)
+            {
+               fprintf(stderr, "opus_decode() failed: %s\n", opus_strerror(ret));
+               return EXIT_FAILURE;
+            }
+         }
+      }
+   }
+   dec_time = cpu_seconds() - t0;
+   audio_seconds = (double)nb_frames*frame_size/SAMPLE_RATE;
+
+   printf("encode: %8.1f streams/core (%.3f s cpu for %.1f s audio)\n",
+         audio_seconds/enc_time, enc_time, audio_seconds);
+   printf("decode: %8.1f streams/core (%.3f s cpu for %.1f s audio x %d streams x %d), "
+         "%ld packets lost per pass\n",
+         audio_seconds*streams*repeat/dec_time, dec_time, audio_seconds, streams, repeat, lost);
+
+   for (s=0;s<streams;s++)
+      opus_decoder_destroy(dec[s]);
+   free(dec);
+   free(lens);
+   free(packets);
+   free(pcm);
+
+   if (kernels)
+      run_kernels(opus_select_arch());
+   return EXIT_SUCCESS;
+}
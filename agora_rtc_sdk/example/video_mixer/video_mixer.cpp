@@ -13,11 +13,14 @@
 #include "AgoraRefCountedObject.h"
 #include "IAgoraService.h"
 #include "NGIAgoraRtcConnection.h"
+#include "common/helper.h"
 #include "common/log.h"
 #include "common/opt_parser.h"
 #include "common/sample_common.h"
 #include "common/sample_connection_observer.h"
 #include "common/sample_local_user_observer.h"
+#include "common/video_processor/i420_file_writer.h"
+#include "common/video_processor/video_compositor.h"
 
 #include "NGIAgoraAudioTrack.h"
 #include "NGIAgoraLocalUser.h"
@@ -27,6 +30,10 @@
 
 #define DEFAULT_VIDEO_FILE "received_video.yuv"
 #define DEFAULT_FILE_LIMIT (100 * 1024 * 1024)
+#define DEFAULT_CANVAS_WIDTH (1920)
+#define DEFAULT_CANVAS_HEIGHT (1080)
+#define DEFAULT_CANVAS_FRAME_RATE (15)
+#define STATS_INTERVAL_FRAMES (300)
 #define STREAM_TYPE_HIGH "high"
 #define STREAM_TYPE_LOW "low"
 
@@ -37,12 +44,20 @@ struct SampleOptions {
 	std::string remoteUserId;
 	std::string streamType = STREAM_TYPE_HIGH;
 	std::string videoFile = DEFAULT_VIDEO_FILE;
+	// Composite in the app instead of with IVideoMixerSource
+	bool appCompositor = false;
+	struct {
+		int width = DEFAULT_CANVAS_WIDTH;
+		int height = DEFAULT_CANVAS_HEIGHT;
+		int frameRate = DEFAULT_CANVAS_FRAME_RATE;
+		int threads = 0;
+	} canvas;
 };
 
 class YuvFrameObserver : public agora::rtc::IVideoSinkBase {
 public:
 	YuvFrameObserver(const std::string &outputFilePath)
-			: outputFilePath_(outputFilePath), yuvFile_(nullptr), fileCount(0), fileSize_(0)
+			: yuvWriter_(outputFilePath, DEFAULT_FILE_LIMIT)
 	{
 	}
 
@@ -51,58 +66,87 @@ public:
 	virtual ~YuvFrameObserver() = default;
 
 private:
-	std::string outputFilePath_;
-	FILE *yuvFile_;
-	int fileCount;
-	int fileSize_;
+	// Writes from its own thread, onFrame only copies the visible rows
+	I420FileWriter yuvWriter_;
 };
 
 int YuvFrameObserver::onFrame(const agora::media::base::VideoFrame &videoFrame)
 {
-	// Create new file to save received YUV frames
-	// printf("it is %d %d\n",videoFrame.height,videoFrame.width);
-	if (!yuvFile_) {
-		std::string fileName =
-				(++fileCount > 1) ? (outputFilePath_ + to_string(fileCount)) : outputFilePath_;
-		if (!(yuvFile_ = fopen(fileName.c_str(), "w+"))) {
-			AG_LOG(ERROR, "Failed to create received video file %s", fileName.c_str());
-			return 0;
-		}
-		AG_LOG(INFO, "Created file %s to save received YUV frames", fileName.c_str());
-	}
+	PixelPlanes planes;
+	planes.data[0] = videoFrame.yBuffer;
+	planes.data[1] = videoFrame.uBuffer;
+	planes.data[2] = videoFrame.vBuffer;
+	planes.stride[0] = videoFrame.yStride;
+	planes.stride[1] = videoFrame.uStride;
+	planes.stride[2] = videoFrame.vStride;
+	yuvWriter_.pushFrame(planes, videoFrame.width, videoFrame.height);
+	return 0;
+};
 
-	// Write Y planar
-	size_t writeBytes = videoFrame.yStride * videoFrame.height;
-	if (fwrite(videoFrame.yBuffer, 1, writeBytes, yuvFile_) != writeBytes) {
-		AG_LOG(ERROR, "Error writing decoded video data: %s", std::strerror(errno));
-		return 0;
-	}
-	fileSize_ += writeBytes;
+// Hands every decoded remote frame to the compositor, which keeps the latest
+// one per user
+class CompositorSourceObserver : public agora::rtc::IVideoFrameObserver2 {
+public:
+	CompositorSourceObserver(VideoCompositor &compositor) : compositor_(compositor) {}
 
-	// Write U planar
-	writeBytes = videoFrame.uStride * videoFrame.height / 2;
-	if (fwrite(videoFrame.uBuffer, 1, writeBytes, yuvFile_) != writeBytes) {
-		AG_LOG(ERROR, "Error writing decoded video data: %s", std::strerror(errno));
-		return 0;
+	void onFrame(const char *channelId, agora::user_id_t remoteUid,
+				 const agora::media::base::VideoFrame *frame) override
+	{
+		PixelPlanes planes;
+		planes.data[0] = frame->yBuffer;
+		planes.data[1] = frame->uBuffer;
+		planes.data[2] = frame->vBuffer;
+		planes.stride[0] = frame->yStride;
+		planes.stride[1] = frame->uStride;
+		planes.stride[2] = frame->vStride;
+		compositor_.updateSource(remoteUid, planes, frame->width, frame->height);
 	}
-	fileSize_ += writeBytes;
 
-	// Write V planar
-	writeBytes = videoFrame.vStride * videoFrame.height / 2;
-	if (fwrite(videoFrame.vBuffer, 1, writeBytes, yuvFile_) != writeBytes) {
-		AG_LOG(ERROR, "Error writing decoded video data: %s", std::strerror(errno));
-		return 0;
+private:
+	VideoCompositor &compositor_;
+};
+
+static void sendCanvasFrame(const I420BufferPool::Buffer &canvas,
+							agora::agora_refptr<agora::rtc::IVideoFrameSender> videoFrameSender)
+{
+	agora::media::base::ExternalVideoFrame videoFrame;
+	videoFrame.type = agora::media::base::ExternalVideoFrame::VIDEO_BUFFER_RAW_DATA;
+	videoFrame.format = agora::media::base::VIDEO_PIXEL_I420;
+	videoFrame.buffer = canvas.data;
+	videoFrame.stride = canvas.width;
+	videoFrame.height = canvas.height;
+	videoFrame.cropLeft = 0;
+	videoFrame.cropTop = 0;
+	videoFrame.cropRight = 0;
+	videoFrame.cropBottom = 0;
+	videoFrame.rotation = 0;
+	videoFrame.timestamp = 0;
+
+	if (videoFrameSender->sendVideoFrame(videoFrame) < 0) {
+		AG_LOG(ERROR, "Failed to send video frame!");
 	}
-	fileSize_ += writeBytes;
+}
+
+static void SampleComposeTask(const SampleOptions &options, VideoCompositor &compositor,
+							  agora::agora_refptr<agora::rtc::IVideoFrameSender> videoFrameSender,
+							  bool &exitFlag)
+{
+	// The canvas goes out at a fixed rate whatever rate each user sends at
+	PacerInfo pacer = { 0, 1000 / options.canvas.frameRate, 0, std::chrono::steady_clock::now() };
 
-	// Close the file if size limit is reached
-	if (fileSize_ >= DEFAULT_FILE_LIMIT) {
-		fclose(yuvFile_);
-		yuvFile_ = nullptr;
-		fileSize_ = 0;
+	while (!exitFlag) {
+		if (auto canvas = compositor.compose()) {
+			sendCanvasFrame(*canvas, videoFrameSender);
+			VideoCompositorStats stats = compositor.getStats();
+			if (stats.composedFrames % STATS_INTERVAL_FRAMES == 0) {
+				AG_LOG(INFO, "Composed %llu frames of %d users, %.2f ms per frame on %d threads",
+					   (unsigned long long)stats.composedFrames, stats.sources,
+					   stats.averageComposeMs, stats.workerCount);
+			}
+		}
+		waitBeforeNextSend(pacer); // sleep for a while before sending next frame
 	}
-	return 0;
-};
+}
 
 static bool exitFlag = false;
 static void SignalHandler(int sigNo)
@@ -122,6 +166,13 @@ int main(int argc, char *argv[])
 						   "The remote user to receive stream from");
 	optParser.add_long_opt("videoFile", &options.videoFile, "Output video file");
 	optParser.add_long_opt("streamtype", &options.streamType, "the stream type");
+	optParser.add_long_opt("appCompositor", &options.appCompositor,
+						   "Composite decoded frames in the app instead of IVideoMixerSource");
+	optParser.add_long_opt("canvasWidth", &options.canvas.width, "Width of the composite");
+	optParser.add_long_opt("canvasHeight", &options.canvas.height, "Height of the composite");
+	optParser.add_long_opt("canvasFps", &options.canvas.frameRate, "Frame rate of the composite");
+	optParser.add_long_opt("compositorThreads", &options.canvas.threads,
+						   "Threads drawing the composite / default is one per CPU");
 
 	if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
 		std::ostringstream strStream;
@@ -183,10 +234,6 @@ int main(int argc, char *argv[])
 		connection->getLocalUser()->subscribeVideo(options.remoteUserId.c_str(),
 												   subscriptionOptions);
 	}
-	// Register connection observer to monitor connection event
-	auto connObserver = std::make_shared<SampleConnectionObserver>();
-	connection->registerObserver(connObserver.get());
-
 	// Create local user observer
 	auto localUserObserver = std::make_shared<SampleLocalUserObserver>(connection->getLocalUser());
 
@@ -195,49 +242,104 @@ int main(int argc, char *argv[])
 		AG_LOG(ERROR, "Failed to create media node factory!");
 	}
 
-	agora::agora_refptr<agora::rtc::IVideoMixerSource> videoMixer = factory->createVideoMixer();
-	if (!videoMixer) {
-		AG_LOG(ERROR, "Failed to create video frame sender!");
-		return -1;
-	}
-	videoMixer->setBackground(1920, 1080, 15);
+	// Register video frame observer to dump the composite
+	agora::agora_refptr<agora::rtc::IVideoSinkBase> yuvFrameObserver =
+			new agora::RefCountedObject<YuvFrameObserver>(options.videoFile);
 
-	agora::agora_refptr<agora::rtc::ILocalVideoTrack> mixVideoTrack =
-			service->createMixedVideoTrack(videoMixer);
-	if (!mixVideoTrack) {
-		AG_LOG(ERROR, "Failed to create video track!");
-		return -1;
-	}
-	agora::rtc::VideoEncoderConfiguration encoderConfig;
-	encoderConfig.codecType = agora::rtc::VIDEO_CODEC_H264;
-	encoderConfig.dimensions.width = 1920;
-	encoderConfig.dimensions.height = 1080;
-	encoderConfig.frameRate = 15;
-	//encoderConfig.bitrate = options.video.targetBitrate + 1000;
+	agora::agora_refptr<agora::rtc::IVideoMixerSource> videoMixer;
+	agora::agora_refptr<agora::rtc::IVideoFrameSender> canvasFrameSender;
+	agora::agora_refptr<agora::rtc::ILocalVideoTrack> mixVideoTrack;
+	std::unique_ptr<VideoCompositor> compositor;
+	std::unique_ptr<CompositorSourceObserver> compositorSourceObserver;
+	if (options.appCompositor) {
+		VideoCompositorConfig compositorConfig;
+		compositorConfig.width = options.canvas.width;
+		compositorConfig.height = options.canvas.height;
+		compositorConfig.workerCount = options.canvas.threads;
+		compositor.reset(new VideoCompositor(compositorConfig));
+		if (options.canvas.frameRate <= 0 || !compositor->initialize()) {
+			AG_LOG(ERROR, "Failed to create video compositor!");
+			return -1;
+		}
+
+		canvasFrameSender = factory->createVideoFrameSender();
+		if (!canvasFrameSender) {
+			AG_LOG(ERROR, "Failed to create video frame sender!");
+			return -1;
+		}
+		mixVideoTrack = service->createCustomVideoTrack(canvasFrameSender);
+		if (!mixVideoTrack) {
+			AG_LOG(ERROR, "Failed to create video track!");
+			return -1;
+		}
+		agora::rtc::VideoEncoderConfiguration encoderConfig;
+		encoderConfig.codecType = agora::rtc::VIDEO_CODEC_H264;
+		encoderConfig.dimensions.width = options.canvas.width;
+		encoderConfig.dimensions.height = options.canvas.height;
+		encoderConfig.frameRate = options.canvas.frameRate;
+		mixVideoTrack->setVideoEncoderConfiguration(encoderConfig);
+		mixVideoTrack->addRenderer(yuvFrameObserver.get(),
+								   agora::media::base::VIDEO_MODULE_POSITION::POSITION_PRE_ENCODER);
+		mixVideoTrack->setEnabled(true);
+
+		// decoded frames of every user feed the compositor
+		compositorSourceObserver.reset(new CompositorSourceObserver(*compositor));
+		localUserObserver->setVideoFrameObserver(compositorSourceObserver.get());
+		connection->getLocalUser()->publishVideo(mixVideoTrack);
+	} else {
+		videoMixer = factory->createVideoMixer();
+		if (!videoMixer) {
+			AG_LOG(ERROR, "Failed to create video frame sender!");
+			return -1;
+		}
+		videoMixer->setBackground(1920, 1080, 15);
 
-	mixVideoTrack->setVideoEncoderConfiguration(encoderConfig);
+		mixVideoTrack = service->createMixedVideoTrack(videoMixer);
+		if (!mixVideoTrack) {
+			AG_LOG(ERROR, "Failed to create video track!");
+			return -1;
+		}
+		agora::rtc::VideoEncoderConfiguration encoderConfig;
+		encoderConfig.codecType = agora::rtc::VIDEO_CODEC_H264;
+		encoderConfig.dimensions.width = 1920;
+		encoderConfig.dimensions.height = 1080;
+		encoderConfig.frameRate = 15;
+		//encoderConfig.bitrate = options.video.targetBitrate + 1000;
+
+		mixVideoTrack->setVideoEncoderConfiguration(encoderConfig);
+
+		mixVideoTrack->addRenderer(yuvFrameObserver.get(),agora::media::base::VIDEO_MODULE_POSITION::POSITION_PRE_ENCODER);
+		//printf("it is %d \n",b);
+		mixVideoTrack->setEnabled(true);
+		localUserObserver->setEnableVideoMix(true);
+		localUserObserver->setVideoMixer(videoMixer);
+	  // add a Image to video mixer
+		// {
+		// 	agora::rtc::MixerLayoutConfig mixConfig;
+		// 	mixConfig.height = 379;
+		// 	mixConfig.width = 379;
+		// 	mixConfig.image_path = "1.jpg";
+		// 	int r = videoMixer->addImageSource("1", mixConfig, agora::rtc::kJpeg);
+		// 	videoMixer->setStreamLayout("1", mixConfig);
+
+		// 	videoMixer->refresh();
+		// }
+		connection->getLocalUser()->publishVideo(mixVideoTrack);
+	}
 
-	// // Register video frame observer to receive video stream
-	agora::agora_refptr<agora::rtc::IVideoSinkBase> yuvFrameObserver =
-			new agora::RefCountedObject<YuvFrameObserver>(options.videoFile);
+	// Register connection observer to monitor connection event. Every user
+	// who joins gets a compositor source, and one who leaves takes it, and the
+	// frame pool behind it, along
+	auto connObserver = std::make_shared<SampleConnectionObserver>();
+	if (compositor) {
+		VideoCompositor *userCompositor = compositor.get();
+		connObserver->setUserJoinedCallback(
+				[userCompositor](agora::user_id_t userId) { userCompositor->addSource(userId); });
+		connObserver->setUserLeftCallback(
+				[userCompositor](agora::user_id_t userId) { userCompositor->removeSource(userId); });
+	}
+	connection->registerObserver(connObserver.get());
 
-	mixVideoTrack->addRenderer(yuvFrameObserver.get(),agora::media::base::VIDEO_MODULE_POSITION::POSITION_PRE_ENCODER);
-	//printf("it is %d \n",b);
-	mixVideoTrack->setEnabled(true);
-	localUserObserver->setEnableVideoMix(true);
-	localUserObserver->setVideoMixer(videoMixer);
-  // add a Image to video mixer
-	// {
-	// 	agora::rtc::MixerLayoutConfig mixConfig;
-	// 	mixConfig.height = 379;
-	// 	mixConfig.width = 379;
-	// 	mixConfig.image_path = "1.jpg";
-	// 	int r = videoMixer->addImageSource("1", mixConfig, agora::rtc::kJpeg);
-	// 	videoMixer->setStreamLayout("1", mixConfig);
-
-	// 	videoMixer->refresh();
-	// }
-	connection->getLocalUser()->publishVideo(mixVideoTrack);
 	// Connect to Agora channel
 	if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
 							options.userId.c_str())) {
@@ -248,9 +350,14 @@ int main(int argc, char *argv[])
 	// Start receiving incoming media data
 	AG_LOG(INFO, "Start receiving audio & video data ...");
 
-	// Periodically check exit flag
-	while (!exitFlag) {
-		usleep(10000);
+	if (compositor) {
+		SampleComposeTask(options, *compositor, canvasFrameSender, exitFlag);
+		localUserObserver->unsetVideoFrameObserver();
+	} else {
+		// Periodically check exit flag
+		while (!exitFlag) {
+			usleep(10000);
+		}
 	}
 
 	// Unregister connection observer
@@ -265,6 +372,8 @@ int main(int argc, char *argv[])
 
 	// Destroy Agora connection and related resources
 	localUserObserver.reset();
+	compositorSourceObserver.reset();
+	compositor.reset();
 	yuvFrameObserver.reset();
 	connection = nullptr;
 
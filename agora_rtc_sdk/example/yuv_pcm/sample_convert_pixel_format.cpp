@@ -0,0 +1,244 @@
+//  Agora RTC/MEDIA SDK
+//
+//  Convert raw video files between I420 and NV12/NV21/YUY2/RGBA/BGRA/I422
+//  with the SIMD pixel converter, or benchmark it against a naive loop.
+//
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/log.h"
+#include "common/opt_parser.h"
+#include "common/video_processor/pixel_converter.h"
+
+#define DEFAULT_BENCHMARK_ITERATIONS (30)
+
+struct SampleOptions {
+  std::string inputFile;
+  std::string inputFormat = "bgra";
+  std::string outputFile;
+  std::string outputFormat = "i420";
+  int width = 0;
+  int height = 0;
+  PixelCrop crop;
+  std::string simd;
+  bool benchmark = false;
+};
+
+static const struct {
+  const char* name;
+  RawPixelFormat format;
+} kFormatNames[] = {
+    {"i420", RAW_PIXEL_I420}, {"i422", RAW_PIXEL_I422}, {"nv12", RAW_PIXEL_NV12},
+    {"nv21", RAW_PIXEL_NV21}, {"yuy2", RAW_PIXEL_YUY2}, {"rgba", RAW_PIXEL_RGBA},
+    {"bgra", RAW_PIXEL_BGRA},
+};
+
+static const char* kSimdNames[] = {"c", "ssse3", "avx2"};
+
+static bool parseFormat(const std::string& name, RawPixelFormat& format) {
+  for (const auto& entry : kFormatNames) {
+    if (name == entry.name) {
+      format = entry.format;
+      return true;
+    }
+  }
+  return false;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// What a producer typically writes first: float math, one pixel at a time,
+// chroma taken from the top left pixel of every 2x2 block
+static void naiveBgraToI420(const uint8_t* bgra, int width, int height, const PixelPlanes& dst) {
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const uint8_t* p = bgra + (y * width + x) * 4;
+      float b = p[0], g = p[1], r = p[2];
+      dst.data[0][y * dst.stride[0] + x] = (uint8_t)(0.257f * r + 0.504f * g + 0.098f * b + 16);
+      if ((x & 1) == 0 && (y & 1) == 0) {
+        dst.data[1][y / 2 * dst.stride[1] + x / 2] =
+            (uint8_t)(-0.148f * r - 0.291f * g + 0.439f * b + 128);
+        dst.data[2][y / 2 * dst.stride[2] + x / 2] =
+            (uint8_t)(0.439f * r - 0.368f * g - 0.071f * b + 128);
+      }
+    }
+  }
+}
+
+static void runBenchmark() {
+  static const struct {
+    const char* name;
+    int width;
+    int height;
+  } kSizes[] = {{"720p", 1280, 720}, {"1080p", 1920, 1080}, {"4K", 3840, 2160}};
+
+  PixelSimdLevel best = getPixelSimdLevel();
+  AG_LOG(INFO, "Best SIMD level on this CPU: %s", kSimdNames[best]);
+
+  for (const auto& size : kSizes) {
+    int width = size.width;
+    int height = size.height;
+    std::vector<uint8_t> i420(pixelBufferSize(RAW_PIXEL_I420, width, height));
+    std::vector<uint8_t> other(pixelBufferSize(RAW_PIXEL_BGRA, width, height));
+    for (size_t i = 0; i < other.size(); ++i) {
+      other[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+    PixelPlanes i420Planes = pixelBufferPlanes(RAW_PIXEL_I420, i420.data(), width, height);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < DEFAULT_BENCHMARK_ITERATIONS; ++i) {
+      naiveBgraToI420(other.data(), width, height, i420Planes);
+    }
+    AG_LOG(INFO, "%-5s naive bgra->i420: %8.3f ms", size.name,
+           elapsedMs(start) / DEFAULT_BENCHMARK_ITERATIONS);
+
+    for (const auto& entry : kFormatNames) {
+      if (entry.format == RAW_PIXEL_I420) {
+        continue;
+      }
+      PixelPlanes otherPlanes = pixelBufferPlanes(entry.format, other.data(), width, height);
+      std::ostringstream line;
+      line.precision(3);
+      line << std::fixed;
+      for (int level = PIXEL_SIMD_NONE; level <= best; ++level) {
+        setPixelSimdLevel(static_cast<PixelSimdLevel>(level));
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < DEFAULT_BENCHMARK_ITERATIONS; ++i) {
+          convertToI420(entry.format, otherPlanes, width, height, i420Planes);
+        }
+        double toMs = elapsedMs(start) / DEFAULT_BENCHMARK_ITERATIONS;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < DEFAULT_BENCHMARK_ITERATIONS; ++i) {
+          convertFromI420(i420Planes, width, height, entry.format, otherPlanes);
+        }
+        double fromMs = elapsedMs(start) / DEFAULT_BENCHMARK_ITERATIONS;
+        line << "  " << kSimdNames[level] << " " << toMs << "/" << fromMs;
+      }
+      AG_LOG(INFO, "%-5s %s->i420/i420->%s ms:%s", size.name, entry.name, entry.name,
+             line.str().c_str());
+    }
+    setPixelSimdLevel(best);
+  }
+}
+
+static int convertFile(const SampleOptions& options) {
+  RawPixelFormat inputFormat, outputFormat;
+  if (!parseFormat(options.inputFormat, inputFormat) ||
+      !parseFormat(options.outputFormat, outputFormat)) {
+    AG_LOG(ERROR, "Unknown pixel format, use i420, i422, nv12, nv21, yuy2, rgba or bgra");
+    return -1;
+  }
+  if (options.width <= 0 || options.height <= 0) {
+    AG_LOG(ERROR, "Must provide width and height!");
+    return -1;
+  }
+  int outWidth = options.crop.width > 0 ? options.crop.width
+                                        : options.width - (options.crop.left & ~1);
+  int outHeight = options.crop.height > 0 ? options.crop.height
+                                          : options.height - (options.crop.top & ~1);
+  if (outWidth <= 0 || outHeight <= 0) {
+    AG_LOG(ERROR, "Invalid crop rectangle");
+    return -1;
+  }
+
+  FILE* in = fopen(options.inputFile.c_str(), "rb");
+  if (!in) {
+    AG_LOG(ERROR, "Failed to open input file %s", options.inputFile.c_str());
+    return -1;
+  }
+  FILE* out = fopen(options.outputFile.c_str(), "wb");
+  if (!out) {
+    AG_LOG(ERROR, "Failed to create output file %s", options.outputFile.c_str());
+    fclose(in);
+    return -1;
+  }
+
+  std::vector<uint8_t> input(pixelBufferSize(inputFormat, options.width, options.height));
+  std::vector<uint8_t> output(pixelBufferSize(outputFormat, outWidth, outHeight));
+  PixelPlanes inputPlanes =
+      pixelBufferPlanes(inputFormat, input.data(), options.width, options.height);
+  PixelPlanes outputPlanes = pixelBufferPlanes(outputFormat, output.data(), outWidth, outHeight);
+  auto pool = I420BufferPool::create(outWidth, outHeight, 1);
+
+  int frames = 0;
+  double convertMs = 0;
+  while (fread(input.data(), 1, input.size(), in) == input.size()) {
+    auto frame = pool->acquire();
+    auto start = std::chrono::steady_clock::now();
+    if (convertToI420(inputFormat, inputPlanes, options.width, options.height, frame->planes,
+                      &options.crop) != 0 ||
+        convertFromI420(frame->planes, outWidth, outHeight, outputFormat, outputPlanes) != 0) {
+      AG_LOG(ERROR, "Failed to convert frame %d", frames);
+      break;
+    }
+    convertMs += elapsedMs(start);
+    if (fwrite(output.data(), 1, output.size(), out) != output.size()) {
+      AG_LOG(ERROR, "Error writing output file: %s", std::strerror(errno));
+      break;
+    }
+    ++frames;
+  }
+  fclose(in);
+  fclose(out);
+  AG_LOG(INFO, "Converted %d frames %dx%d %s -> %dx%d %s, %.3f ms per frame (%s)", frames,
+         options.width, options.height, options.inputFormat.c_str(), outWidth, outHeight,
+         options.outputFormat.c_str(), frames ? convertMs / frames : 0.0,
+         kSimdNames[getPixelSimdLevel()]);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  SampleOptions options;
+  opt_parser optParser;
+
+  optParser.add_long_opt("inputFile", &options.inputFile, "Raw video file to convert");
+  optParser.add_long_opt("inputFormat", &options.inputFormat,
+                         "i420, i422, nv12, nv21, yuy2, rgba or bgra / default is bgra");
+  optParser.add_long_opt("outputFile", &options.outputFile, "Converted raw video file");
+  optParser.add_long_opt("outputFormat", &options.outputFormat,
+                         "Output pixel format / default is i420");
+  optParser.add_long_opt("width", &options.width, "Width of the input video / must");
+  optParser.add_long_opt("height", &options.height, "Height of the input video / must");
+  optParser.add_long_opt("cropLeft", &options.crop.left, "Left edge of the crop rectangle");
+  optParser.add_long_opt("cropTop", &options.crop.top, "Top edge of the crop rectangle");
+  optParser.add_long_opt("cropWidth", &options.crop.width,
+                         "Width of the crop rectangle / default is up to the right edge");
+  optParser.add_long_opt("cropHeight", &options.crop.height,
+                         "Height of the crop rectangle / default is up to the bottom edge");
+  optParser.add_long_opt("simd", &options.simd, "Limit SIMD to c, ssse3 or avx2");
+  optParser.add_long_opt("benchmark", &options.benchmark,
+                         "Time every conversion at 720p, 1080p and 4K against a naive loop");
+
+  if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
+    std::ostringstream strStream;
+    optParser.print_usage(argv[0], strStream);
+    std::cout << strStream.str() << std::endl;
+    return -1;
+  }
+
+  for (int level = PIXEL_SIMD_NONE; level <= PIXEL_SIMD_AVX2; ++level) {
+    if (options.simd == kSimdNames[level]) {
+      setPixelSimdLevel(static_cast<PixelSimdLevel>(level));
+    }
+  }
+
+  if (options.benchmark) {
+    runBenchmark();
+    return 0;
+  }
+
+  if (options.inputFile.empty() || options.outputFile.empty()) {
+    AG_LOG(ERROR, "Must provide inputFile and outputFile!");
+    return -1;
+  }
+  return convertFile(options);
+}
@@ -18,6 +18,8 @@
 #include "common/sample_common.h"
 #include "common/sample_connection_observer.h"
 #include "common/sample_local_user_observer.h"
+#include "common/video_processor/i420_file_writer.h"
+#include "common/file_writer/media_muxers.h"
 
 #include "NGIAgoraAudioTrack.h"
 #include "NGIAgoraLocalUser.h"
@@ -30,6 +32,8 @@
 #define DEFAULT_AUDIO_FILE "received_audio.pcm"
 #define DEFAULT_VIDEO_FILE "received_video.yuv"
 #define DEFAULT_FILE_LIMIT (100 * 1024 * 1024)
+#define Y4M_FILE_SUFFIX ".y4m"
+#define Y4M_FRAME_RATE (15)
 #define STREAM_TYPE_HIGH "high"
 #define STREAM_TYPE_LOW "low"
 
@@ -86,21 +90,25 @@ class PcmFrameObserver : public agora::media::IAudioFrameObserverBase {
 
 class YuvFrameObserver : public agora::rtc::IVideoFrameObserver2 {
  public:
-  YuvFrameObserver(const std::string& outputFilePath)
-      : outputFilePath_(outputFilePath),
-        yuvFile_(nullptr),
-        fileCount(0),
-        fileSize_(0) {}
+  YuvFrameObserver(const std::string& outputFilePath) {
+    size_t suffixLen = strlen(Y4M_FILE_SUFFIX);
+    if (outputFilePath.size() > suffixLen &&
+        outputFilePath.compare(outputFilePath.size() - suffixLen, suffixLen, Y4M_FILE_SUFFIX) == 0) {
+      y4mMuxer_.reset(new Y4mMuxer(outputFilePath, Y4M_FRAME_RATE, DEFAULT_FILE_LIMIT));
+    } else {
+      yuvWriter_.reset(new I420FileWriter(outputFilePath, DEFAULT_FILE_LIMIT));
+    }
+  }
 
   void onFrame(const char* channelId, agora::user_id_t remoteUid, const agora::media::base::VideoFrame* frame) override;
 
   virtual ~YuvFrameObserver() = default;
 
  private:
-  std::string outputFilePath_;
-  FILE* yuvFile_;
-  int fileCount;
-  int fileSize_;
+  // Both write from their own thread, onFrame only copies the visible rows.
+  // A .y4m output carries its resolution and can be played back directly.
+  std::unique_ptr<I420FileWriter> yuvWriter_;
+  std::unique_ptr<Y4mMuxer> y4mMuxer_;
 };
 
 bool PcmFrameObserver::onPlaybackAudioFrameBeforeMixing(const char* channelId, agora::media::base::user_id_t userId, AudioFrame& audioFrame) {
@@ -137,52 +145,21 @@ bool PcmFrameObserver::onPlaybackAudioFrameBeforeMixing(const char* channelId, a
 }
 
 void YuvFrameObserver::onFrame(const char* channelId, agora::user_id_t remoteUid, const agora::media::base::VideoFrame* videoFrame) {
-  // Create new file to save received YUV frames
-  if (!yuvFile_) {
-    std::string fileName = (++fileCount > 1)
-                               ? (outputFilePath_ + to_string(fileCount))
-                               : outputFilePath_;
-    if (!(yuvFile_ = fopen(fileName.c_str(), "w+"))) {
-      AG_LOG(ERROR, "Failed to create received video file %s",
-             fileName.c_str());
-      return ;
-    }
-    AG_LOG(INFO, "Created file %s to save received YUV frames",
-           fileName.c_str());
-  }
-
-  // Write Y planar
-  size_t writeBytes = videoFrame->yStride * videoFrame->height;
-  if (fwrite(videoFrame->yBuffer, 1, writeBytes, yuvFile_) != writeBytes) {
-    AG_LOG(ERROR, "Error writing decoded video data: %s", std::strerror(errno));
-    return ;
-  }
-  fileSize_ += writeBytes;
-
-  // Write U planar
-  writeBytes = videoFrame->uStride * videoFrame->height / 2;
-  if (fwrite(videoFrame->uBuffer, 1, writeBytes, yuvFile_) != writeBytes) {
-    AG_LOG(ERROR, "Error writing decoded video data: %s", std::strerror(errno));
-    return ;
+  if (y4mMuxer_) {
+    y4mMuxer_->writeFrame(videoFrame->yBuffer, videoFrame->yStride, videoFrame->uBuffer,
+                          videoFrame->uStride, videoFrame->vBuffer, videoFrame->vStride,
+                          videoFrame->width, videoFrame->height);
+    return;
   }
-  fileSize_ += writeBytes;
-
-  // Write V planar
-  writeBytes = videoFrame->vStride * videoFrame->height / 2;
-  if (fwrite(videoFrame->vBuffer, 1, writeBytes, yuvFile_) != writeBytes) {
-    AG_LOG(ERROR, "Error writing decoded video data: %s", std::strerror(errno));
-    return ;
-  }
-  fileSize_ += writeBytes;
-
-  // Close the file if size limit is reached
-  if (fileSize_ >= DEFAULT_FILE_LIMIT) {
-    fclose(yuvFile_);
-    yuvFile_ = nullptr;
-    fileSize_ = 0;
-  }
-  return ;
-};
+  PixelPlanes planes;
+  planes.data[0] = videoFrame->yBuffer;
+  planes.data[1] = videoFrame->uBuffer;
+  planes.data[2] = videoFrame->vBuffer;
+  planes.stride[0] = videoFrame->yStride;
+  planes.stride[1] = videoFrame->uStride;
+  planes.stride[2] = videoFrame->vStride;
+  yuvWriter_->pushFrame(planes, videoFrame->width, videoFrame->height);
+}
 
 static bool exitFlag = false;
 static void SignalHandler(int sigNo) { exitFlag = true; }
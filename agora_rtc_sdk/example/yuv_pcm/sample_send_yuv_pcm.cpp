@@ -4,7 +4,10 @@
 //  Copyright (c) 2020 Agora.io. All rights reserved.
 //
 
+#include <algorithm>
+#include <atomic>
 #include <csignal>
+#include <cstdlib>
 #include <cstring>
 #include <sstream>
 #include <string>
@@ -17,11 +20,14 @@
 #include "NGIAgoraMediaNodeFactory.h"
 #include "NGIAgoraRtcConnection.h"
 #include "NGIAgoraVideoTrack.h"
+#include "common/file_parser/helper_yuv_parser.h"
+#include "common/abr_controller.h"
 #include "common/helper.h"
 #include "common/log.h"
 #include "common/opt_parser.h"
 #include "common/sample_common.h"
 #include "common/sample_connection_observer.h"
+#include "common/video_processor/hw_encoder_scheduler.h"
 
 #define DEFAULT_CONNECT_TIMEOUT_MS (3000)
 #define DEFAULT_SAMPLE_RATE (16000)
@@ -32,6 +38,16 @@
 #define DEFAULT_FRAME_RATE (15)
 #define DEFAULT_AUDIO_FILE "test_data/send_audio_16k_1ch.pcm"
 #define DEFAULT_VIDEO_FILE "test_data/send_video_cif.yuv"
+#define DEFAULT_HW_ENCODER_PROVIDER "nv"
+#define DEFAULT_ENCODER_STATS_INTERVAL_MS (1000)
+#define VIDEO_TRACK_ID "video"
+#define ABR_MIN_BITRATE_BPS (100 * 1000)
+// Smaller budget changes are left to the rate control of the encoder
+#define ABR_RETUNE_THRESHOLD (0.1)
+// An estimate this close to the encoder bitrate is taken as held at it
+#define ABR_CAPPED_ESTIMATE_RATIO (0.95)
+// Step above the encoder bitrate tried while the estimate is held at it
+#define ABR_PROBE_STEP (1.25)
 
 struct SampleOptions {
   std::string appId;
@@ -49,6 +65,11 @@ struct SampleOptions {
     int height = DEFAULT_VIDEO_HEIGHT;
     int frameRate = DEFAULT_FRAME_RATE;
     bool enable_hw_encoder = false;
+    std::string hwEncoderProvider = DEFAULT_HW_ENCODER_PROVIDER;
+    int encoderStatsIntervalMs = DEFAULT_ENCODER_STATS_INTERVAL_MS;
+    int maxEncodeLatencyMs = HwEncoderSchedulerConfig().maxEncodeLatencyMs;
+    bool abr = false;
+    int prefetchFrames = 0;
   } video;
 };
 
@@ -92,32 +113,12 @@ static void sendOnePcmFrame(
 }
 
 static void sendOneYuvFrame(
-    const SampleOptions& options,
-    agora::agora_refptr<agora::rtc::IVideoFrameSender> videoFrameSender) {
-  static FILE* file = nullptr;
-  const char* fileName = options.videoFile.c_str();
-
-  // Calculate byte size for YUV420 image
-  int sendBytes = options.video.width * options.video.height * 3 / 2;
-
-  if (!file) {
-    if (!(file = fopen(fileName, "rb"))) {
-      AG_LOG(ERROR, "Failed to open video file %s", fileName);
-      return;
-    }
-    AG_LOG(INFO, "Open video file %s successfully", fileName);
-  }
-
-  uint8_t frameBuf[sendBytes];
-
-  if (fread(frameBuf, 1, sizeof(frameBuf), file) != sizeof(frameBuf)) {
-    if (feof(file)) {
-      fclose(file);
-      file = nullptr;
-      AG_LOG(INFO, "End of video file");
-    } else {
-      AG_LOG(ERROR, "Error reading video data: %s", std::strerror(errno));
-    }
+    const SampleOptions& options, HelperYuvFileParser& yuvFileParser,
+    agora::agora_refptr<agora::rtc::IVideoFrameSender> videoFrameSender,
+    std::atomic<uint32_t>& framesSent) {
+  // Points into the mapped file or a prefetched buffer, no per-frame read
+  const uint8_t* frameBuf = yuvFileParser.getYuvFrame();
+  if (!frameBuf) {
     return;
   }
 
@@ -125,7 +126,7 @@ static void sendOneYuvFrame(
   videoFrame.type =
       agora::media::base::ExternalVideoFrame::VIDEO_BUFFER_RAW_DATA;
   videoFrame.format = agora::media::base::VIDEO_PIXEL_I420;
-  videoFrame.buffer = frameBuf;
+  videoFrame.buffer = const_cast<uint8_t*>(frameBuf);
   videoFrame.stride = options.video.width;
   videoFrame.height = options.video.height;
   videoFrame.cropLeft = 0;
@@ -137,7 +138,9 @@ static void sendOneYuvFrame(
 
   if (videoFrameSender->sendVideoFrame(videoFrame) < 0) {
     AG_LOG(ERROR, "Failed to send video frame!");
+    return;
   }
+  ++framesSent;
 }
 
 static void SampleSendAudioTask(
@@ -157,18 +160,122 @@ static void SampleSendAudioTask(
 static void SampleSendVideoTask(
     const SampleOptions& options,
     agora::agora_refptr<agora::rtc::IVideoFrameSender> videoFrameSender,
-    bool& exitFlag) {
+    std::atomic<uint32_t>& framesSent, bool& exitFlag) {
   // Calculate send interval based on frame rate. H264 frames are sent at this
   // interval
   PacerInfo pacer = {0, 1000 / options.video.frameRate, 0,
                      std::chrono::steady_clock::now()};
 
+  HelperYuvFileParser yuvFileParser(options.videoFile.c_str(), options.video.width,
+                                    options.video.height, options.video.prefetchFrames);
+  if (!yuvFileParser.initialize()) {
+    return;
+  }
+
   while (!exitFlag) {
-    sendOneYuvFrame(options, videoFrameSender);
+    sendOneYuvFrame(options, yuvFileParser, videoFrameSender, framesSent);
     waitBeforeNextSend(pacer);  // sleep for a while before sending next frame
   }
 }
 
+// The SDK caps video_encoder_target_bitrate_bps at the bitrate the encoder is
+// configured with, so an estimate at that cap only says the uplink carries at
+// least as much. It is reported as one probe step above the encoder bitrate,
+// up to maxBitrateBps, otherwise the budget could only ever go down.
+static int uncapUplinkEstimate(int targetBitrateBps, int encoderBitrateBps, int maxBitrateBps) {
+  if (targetBitrateBps < encoderBitrateBps * ABR_CAPPED_ESTIMATE_RATIO) {
+    return targetBitrateBps;
+  }
+  return std::max(targetBitrateBps,
+                  std::min(maxBitrateBps, static_cast<int>(encoderBitrateBps * ABR_PROBE_STEP)));
+}
+
+// Retunes the encoder bitrate to the ABR budget once it has moved enough, or
+// has climbed back to the configured maximum
+static void applyAbrBudget(AbrController& abr,
+                           agora::agora_refptr<agora::rtc::ILocalVideoTrack> videoTrack,
+                           agora::rtc::VideoEncoderConfiguration& encoderConfig,
+                           int maxBitrateBps, std::atomic<int>& encoderBitrateBps) {
+  int budget = abr.budgetBps();
+  if (budget == encoderConfig.bitrate ||
+      (budget != maxBitrateBps &&
+       abs(budget - encoderConfig.bitrate) <= encoderConfig.bitrate * ABR_RETUNE_THRESHOLD)) {
+    return;
+  }
+  int previous = encoderConfig.bitrate;
+  encoderConfig.bitrate = budget;
+  if (videoTrack->setVideoEncoderConfiguration(encoderConfig)) {
+    AG_LOG(ERROR, "Failed to retune encoder bitrate to %d bps", budget);
+    encoderConfig.bitrate = previous;
+    return;
+  }
+  encoderBitrateBps = budget;
+  AG_LOG(INFO, "Encoder bitrate %d -> %d bps", previous, budget);
+}
+
+// Reads the encoder statistics of the track and lets the scheduler move it
+// between the hardware and software encoder. Encoder changes of the scheduler
+// and of the ABR budget are all made from here, on the same configuration.
+static void SampleEncoderMonitorTask(
+    const SampleOptions& options, agora::agora_refptr<agora::rtc::ILocalVideoTrack> videoTrack,
+    HwEncoderScheduler& scheduler, AbrController* abr,
+    agora::rtc::VideoEncoderConfiguration& encoderConfig, std::atomic<int>& encoderBitrateBps,
+    std::atomic<uint32_t>& framesSent, bool& exitFlag) {
+  PacerInfo pacer = {0,
+                     options.video.encoderStatsIntervalMs > 0
+                         ? options.video.encoderStatsIntervalMs
+                         : DEFAULT_ENCODER_STATS_INTERVAL_MS,
+                     0, std::chrono::steady_clock::now()};
+
+  while (!exitFlag) {
+    waitBeforeNextSend(pacer);
+    if (abr) {
+      applyAbrBudget(*abr, videoTrack, encoderConfig, options.video.targetBitrate,
+                     encoderBitrateBps);
+    }
+    if (options.video.encoderStatsIntervalMs <= 0) {
+      continue;
+    }
+    agora::rtc::LocalVideoTrackStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (!videoTrack->getStatistics(stats)) {
+      continue;
+    }
+    EncoderTrackSample sample;
+    sample.time = std::chrono::steady_clock::now();
+    sample.framesSent = framesSent;
+    sample.framesEncoded = stats.frames_encoded;
+    sample.encodeFrameRate = stats.encode_frame_rate;
+    sample.encodeLatencyMs = static_cast<int>(stats.uplink_cost_time_ms);
+    EncoderTrackReport report = scheduler.onSample(VIDEO_TRACK_ID, sample);
+    AG_LOG(INFO,
+           "Encoder %s: latency %d ms (avg %.1f, max %d), %d fps, backlog %d frames, "
+           "fallbacks %d",
+           videoEncoderPathName(report.path), report.encodeLatencyMs,
+           report.averageEncodeLatencyMs, report.maxEncodeLatencyMs, report.encodeFrameRate,
+           report.backlogFrames, report.fallbacks);
+  }
+}
+
+// The encoder is picked from engine parameters when the track (re)creates it,
+// so the switch sets them and reapplies the encoder configuration of the live
+// track instead of unpublishing it.
+static bool applyEncoderPath(agora::agora_refptr<agora::rtc::IRtcConnection> connection,
+                             const std::string& provider, VIDEO_ENCODER_PATH path) {
+  auto parameter = connection->getAgoraParameter();
+  if (!parameter) {
+    return false;
+  }
+  if (parameter->setBool("engine.video.enable_hw_encoder", path == VIDEO_ENCODER_HARDWARE)) {
+    return false;
+  }
+  if (path == VIDEO_ENCODER_HARDWARE &&
+      parameter->setString("engine.video.hw_encoder_provider", provider.c_str())) {
+    return false;
+  }
+  return true;
+}
+
 static bool exitFlag = false;
 static void SignalHandler(int sigNo) { exitFlag = true; }
 
@@ -197,7 +304,21 @@ int main(int argc, char* argv[]) {
   optParser.add_long_opt("bitrate", &options.video.targetBitrate,
                          "Target bitrate (bps) for encoding the YUV stream");
   optParser.add_long_opt("hwencoder", &options.video.enable_hw_encoder,
-                         "Target bitrate (bps) for encoding the YUV stream");
+                         "Encode on the hardware encoder when the probe finds one, and fall back "
+                         "to software when it can not keep up");
+  optParser.add_long_opt("hwEncoderProvider", &options.video.hwEncoderProvider,
+                         "Hardware encoder provider to probe and use / default is nv");
+  optParser.add_long_opt("encoderStatsMs", &options.video.encoderStatsIntervalMs,
+                         "Interval (ms) of encoder statistics and scheduling / default is 1000");
+  optParser.add_long_opt("maxEncodeLatencyMs", &options.video.maxEncodeLatencyMs,
+                         "Encode latency (ms) above which hardware counts as behind / default is "
+                         "150");
+  optParser.add_long_opt("abr", &options.video.abr,
+                         "Retune the encoder bitrate to the uplink bandwidth estimate, up to "
+                         "bitrate");
+  optParser.add_long_opt("prefetchFrames", &options.video.prefetchFrames,
+                         "Copy this many YUV frames ahead on a reader thread / default is 0, "
+                         "frames are sent straight from the mapped file");
 
   if ((argc <= 1) || !optParser.parse_opts(argc, argv)) {
     std::ostringstream strStream;
@@ -238,17 +359,46 @@ int main(int argc, char* argv[]) {
     AG_LOG(ERROR, "Failed to creating Agora connection!");
     return -1;
   }
-   
-  if(options.video.enable_hw_encoder){
-    auto s = connection->getAgoraParameter();
-    int ret = s->setBool("engine.video.enable_hw_encoder",true);
-    ret = s->setString("engine.video.hw_encoder_provider","nv");
+
+  // Only ask for the hardware encoder where there is one, so the same binary
+  // runs unchanged on machines without a GPU
+  VIDEO_ENCODER_PATH encoderPath = VIDEO_ENCODER_SOFTWARE;
+  HwEncoderCapability hwEncoder;
+  if (options.video.enable_hw_encoder) {
+    hwEncoder = probeHwEncoder(options.video.hwEncoderProvider);
+    AG_LOG(INFO, "Hardware encoder %s: %s, %s", hwEncoder.provider.c_str(),
+           hwEncoder.available ? "available" : "unavailable", hwEncoder.detail.c_str());
+    if (hwEncoder.available &&
+        applyEncoderPath(connection, hwEncoder.provider, VIDEO_ENCODER_HARDWARE)) {
+      encoderPath = VIDEO_ENCODER_HARDWARE;
+    }
   }
 
   // Register connection observer to monitor connection event
   auto connObserver = std::make_shared<SampleConnectionObserver>();
   connection->registerObserver(connObserver.get());
 
+  // The budget starts at the configured bitrate and never exceeds it. The
+  // estimate is already the encoder's own target, so no headroom is taken off.
+  std::atomic<int> encoderBitrateBps(options.video.targetBitrate);
+  std::unique_ptr<AbrController> abr;
+  if (options.video.abr) {
+    AbrControllerConfig abrConfig;
+    abrConfig.headroom = 1.0;
+    abrConfig.minBitrateBps = std::min(ABR_MIN_BITRATE_BPS, options.video.targetBitrate);
+    abrConfig.maxBitrateBps = options.video.targetBitrate;
+    abr.reset(new AbrController(abrConfig, std::vector<int>(), options.video.targetBitrate));
+    AbrController* abrPtr = abr.get();
+    std::atomic<int>* encoderBitratePtr = &encoderBitrateBps;
+    int maxBitrateBps = options.video.targetBitrate;
+    connObserver->setUplinkBitrateCallback(
+        [abrPtr, encoderBitratePtr, maxBitrateBps](int targetBitrateBps) {
+          abrPtr->onUplinkEstimate(
+              uncapUplinkEstimate(targetBitrateBps, *encoderBitratePtr, maxBitrateBps));
+        });
+    connection->registerNetworkObserver(connObserver.get());
+  }
+
   // Connect to Agora channel
   if (connection->connect(options.appId.c_str(), options.channelId.c_str(),
                           options.userId.c_str())) {
@@ -305,6 +455,17 @@ int main(int argc, char* argv[]) {
 
   customVideoTrack->setVideoEncoderConfiguration(encoderConfig);
 
+  HwEncoderSchedulerConfig schedulerConfig;
+  schedulerConfig.maxEncodeLatencyMs = options.video.maxEncodeLatencyMs;
+  schedulerConfig.maxBacklogFrames = options.video.frameRate;
+  HwEncoderScheduler encoderScheduler(
+      schedulerConfig, hwEncoder,
+      [&](const std::string& trackId, VIDEO_ENCODER_PATH path) {
+        return applyEncoderPath(connection, hwEncoder.provider, path) &&
+               customVideoTrack->setVideoEncoderConfiguration(encoderConfig) == 0;
+      });
+  encoderScheduler.addTrack(VIDEO_TRACK_ID, encoderPath, options.video.enable_hw_encoder);
+
   // Publish audio & video track
   customAudioTrack->setEnabled(true);
   connection->getLocalUser()->publishAudio(customAudioTrack);
@@ -318,11 +479,31 @@ int main(int argc, char* argv[]) {
   AG_LOG(INFO, "Start sending audio & video data ...");
   std::thread sendAudioThread(SampleSendAudioTask, options, audioPcmDataSender,
                               std::ref(exitFlag));
+  std::atomic<uint32_t> framesSent(0);
   std::thread sendVideoThread(SampleSendVideoTask, options, videoFrameSender,
-                              std::ref(exitFlag));
+                              std::ref(framesSent), std::ref(exitFlag));
+  std::thread encoderMonitorThread;
+  if (options.video.encoderStatsIntervalMs > 0 || abr) {
+    encoderMonitorThread = std::thread(SampleEncoderMonitorTask, options, customVideoTrack,
+                                       std::ref(encoderScheduler), abr.get(),
+                                       std::ref(encoderConfig), std::ref(encoderBitrateBps),
+                                       std::ref(framesSent),
+                                       std::ref(exitFlag));
+  }
 
   sendAudioThread.join();
   sendVideoThread.join();
+  if (encoderMonitorThread.joinable()) {
+    encoderMonitorThread.join();
+  }
+
+  EncoderTrackReport encoderReport;
+  if (encoderScheduler.getReport(VIDEO_TRACK_ID, encoderReport)) {
+    AG_LOG(INFO, "Encoder ended on %s: avg latency %.1f ms, max %d ms, %d fallbacks, %d retries",
+           videoEncoderPathName(encoderReport.path), encoderReport.averageEncodeLatencyMs,
+           encoderReport.maxEncodeLatencyMs, encoderReport.fallbacks,
+           encoderReport.hardwareRetries);
+  }
 
   // Unpublish audio & video track
   connection->getLocalUser()->unpublishAudio(customAudioTrack);
@@ -330,6 +511,9 @@ int main(int argc, char* argv[]) {
 
   // Unregister connection observer
   connection->unregisterObserver(connObserver.get());
+  if (abr) {
+    connection->unregisterNetworkObserver(connObserver.get());
+  }
 
   // Disconnect from Agora channel
   if (connection->disconnect()) {